@@ -16,12 +16,20 @@
 #ifndef __BASIC_SIMULATOR_H__
 #define __BASIC_SIMULATOR_H__
 
+#include <climits>
+#include <map>
+#include <mutex>
 #include <vector>
-#include "ac_int.h"
+#include "integerTypes.h"
+#include "cacheHierarchy.h"
+#include "checkpoint.h"
+#include "dbt.h"
+#include "guestMemory.h"
+#include "iss.h"
+#include "simpoint.h"
 #include "simulator.h"
 
-#define DRAM_SIZE ((size_t)1 << 26)
-#define STACK_INIT (DRAM_SIZE - 0x1000)
+#define STACK_OFFSET 0x1000 // the stack starts this many bytes below the end of the memory
 
 class BasicSimulator : public Simulator {
   unsigned heapAddress;
@@ -29,24 +37,124 @@ class BasicSimulator : public Simulator {
   // Signature address when doing compliance tests
   unsigned int begin_signature, end_signature;
 
-  std::vector<ac_int<32, false> > mem;
+  // Simulated memory, a contiguous little-endian byte array shared by core.im and core.dm
+  GuestMemory memory;
+  unsigned char* mem;
+  unsigned int stackInit;
+
+  // Interfaces used by the core (caches and main memory)
+  CacheHierarchy caches;
+
+  FunctionalCore iss;
+  BinaryTranslator dbt; // uses iss for the instructions it does not translate
+
+  // Outcomes of the conditional branches, by pc
+  BranchProfile branchProfile;
+
+  // Harts of the multi-core simulation (see runMultiCore). The first one runs on core, caches and branchProfile,
+  // the others own theirs: private caches over the same memory. A hart is started by SYS_threadstart, which
+  // gives it a pc, a stack and an argument, and stops with SYS_exit.
+  enum hartState { HART_IDLE = 0, HART_STARTING, HART_RUNNING };
+  struct Hart {
+    Core* core;
+    CacheHierarchy* caches;
+    BranchProfile* branchProfile;
+    hartState state; // changed by SYS_threadstart (under syscallLock) and between the quanta
+    bool exited;     // SYS_exit was called during the quantum
+    unsigned int pc, stack, argument, globalPointer;
+    unsigned long statsInstret; // instructions retired at the last SYS_stats_reset
+  };
+  std::vector<Hart> harts;
+
+  // Keeps the private L1 data caches of the harts coherent
+  CoherenceBus<4> coherenceBus;
+
+  // Syscalls of the harts are solved one at a time, caller being the hart making it
+  std::mutex syscallLock;
+  Hart* caller;
+
+  // Statistics syscalls (SYS_stats_reset, SYS_roi_begin...) made by the harts of a multi-core simulation, solved at
+  // the end of the quantum, and cycle of the last reset
+  std::vector<int> statsRequests;
+  unsigned long statsCycle = 0;
+  // With --roi, the pipeline only runs the region of interest: a marker asks to switch engine
+  bool inRegion     = false;
+  bool switchEngine = false;
+
+  // Files opened by the program, indexed by descriptor
+  struct OpenedFile {
+    std::string path;
+    int flags;
+    int mode;
+  };
+  std::map<int, OpenedFile> openedFiles;
 
   FILE* inputFile;
   FILE* outputFile;
   FILE* traceFile;
   FILE* signatureFile;
 
+  // CPI stack of the first core written every cpiInterval cycles (see openCpiStats), and its counters at the end of
+  // the last interval written (the last one being the instructions retired by the pipeline). printCycle only looks at
+  // the cycle count once it reaches cpiNextCycle, which stays at ULONG_MAX without a CPI file.
+  FILE* cpiFile = NULL;
+  unsigned long cpiInterval;
+  unsigned long cpiNextCycle = ULONG_MAX;
+  unsigned long cpiLast[CPI_COMPONENTS + 1];
+
 public:
   BasicSimulator(const std::string binaryFile, const std::vector<std::string>,
                  const std::string inFile, const std::string outFile,
-                 const std::string tFile, const std::string sFile);
+                 const std::string tFile, const std::string sFile, const size_t memorySize, const bool mapElf,
+                 const CacheConfig& cacheConfig, const BranchPredictorConfig& predictorConfig,
+                 const MulDivConfig& mulDivConfig, const int cores = 1);
   ~BasicSimulator();
 
+  // When not empty, the per-branch statistics are written to this file at the end of the simulation
+  std::string branchStatsFile;
+
+  // Writes the CPI stack of each interval of the given number of cycles to fileName (CSV), from the current state on
+  void openCpiStats(const std::string& fileName, const unsigned long interval);
+
+  // The functional engine translates the program to host code instead of interpreting it (-m dbt)
+  bool translate = false;
+
+  void runFunctional();
+  // Runs the given number of instructions with the binary translator before a run of the pipeline, returns false
+  // when the program ended on the way
+  bool fastForward(const unsigned long instructions);
+  // The binary translator warms the caches and the predictors during fastForward() and runSampled()
+  bool warming = false;
+
+  // Sampled simulation (see simpoint.h): profile() writes the simulation points of the program to simPointFile (and
+  // the basic block vectors to bbvFile when it is not empty), runSampled() runs the pipeline on them
+  void profile(const unsigned long intervalSize, const unsigned int maxClusters, const unsigned int samplesPerCluster,
+               const std::string& simPointFile, const std::string& bbvFile);
+  void runSampled(const SimPointSet& set, const unsigned long warmup);
+
+  // Runs the pipelines of the harts by quanta of quantum cycles on the given number of host threads, until the
+  // first hart exits
+  void runMultiCore(const int threads, const unsigned long quantum);
+
+  // Runs the region of interest, between SYS_roi_begin and SYS_roi_end, with the pipeline and the rest of the
+  // program with the binary translator (--roi)
+  bool regionOnly = false;
+  void runRegionOfInterest();
+
+  void saveCheckpoint(const char* fileName);
+  void loadCheckpoint(const char* fileName);
+
 protected:
   void printCycle();
   void printEnd();
+  void printBranchStats(FILE* out);
+  void printStats();
+  void resetStats();
+  void solveStatsRequest(const int syscallId);
+  void writeCpiInterval();
   void extend(){};
   void printCoreReg(const char* strTemp);
+  void serialize(Checkpoint& cp);
 
   // Functions for memory accesses
   void stb(const ac_int<32, false> addr, const ac_int<8, true> value);
@@ -59,8 +167,18 @@ protected:
   ac_int<32, true> ldw(const ac_int<32, false> addr);
   ac_int<32, true> ldd(const ac_int<32, false> addr);
 
+  void runEngine(const unsigned long limit);
+  void runDetailed(const unsigned long until);
+  void leavePipeline(const bool warm);
+  void runHart(Hart& hart, const unsigned long end);
+  void startHart(Hart& hart, const unsigned long cycle);
+
   // Functions for solving syscalls
   void solveSyscall();
+  void solveSyscall(Hart& hart);
+  void handleSyscall(Hart& hart);
+  ac_int<32, true> doSyscall(const ac_int<32, true> syscallId, const ac_int<32, true> arg1, const ac_int<32, true> arg2,
+                             const ac_int<32, true> arg3, const ac_int<32, true> arg4);
 
   ac_int<32, true> doRead(const unsigned file, const unsigned bufferAddr, const unsigned size);
   ac_int<32, true> doWrite(const unsigned file, const unsigned bufferAddr, const unsigned size);
@@ -73,11 +191,12 @@ protected:
   ac_int<32, true> doGettimeofday(const ac_int<32, false> timeValPtr);
   ac_int<32, true> doUnlink(const unsigned path);
   ac_int<32, true> doFstat(const unsigned file, const ac_int<32, false> stataddr);
+  ac_int<32, true> doThreadstart(const unsigned pc, const unsigned stack, const unsigned argument);
 
 private:
   std::string string_from_mem(const unsigned); // TODO make const
-  void setByte(const unsigned, const ac_int<8, true>);
-  void readElf(const char*);
+  void writeStat(const ac_int<32, false> stataddr, const struct stat& filestat);
+  void readElf(const char*, const bool mapSegments);
   void pushArgsOnStack(const std::vector<std::string>);
   void openFiles(const std::string inFile, const std::string outFile, const std::string tFile, const std::string sFile);
 };
@@ -2,59 +2,74 @@
 #define INCLUDE_BRANCHPREDICTOR_H_
 
 #include "logarithm.h"
-#include <ac_int.h>
+#include <integerTypes.h>
 
-#ifdef DEBUG
-#include <assert.h>
-#include <iostream>
-#include <queue>
+#ifndef __HLS__
+#include <cstdio>
+#include <cstdlib>
+#include <unordered_map>
+
+#include "checkpoint.h"
 #endif
 
-template <class T> class BranchPredictorWrapper {
-#ifdef DEBUG
-  int missPredictions = 0;
-  int processCount    = 0;
-  int updateCount     = 0;
-  bool predictions[2];
-  int front = 0, back = 0;
+/************************************************************************
+ * 	Largest geometries of the predictors, the one used is chosen at run time:
+ * 		- BP_MAX_ENTRIES: entries of the bimodal and gshare tables and of the TAGE base table
+ * 		- BP_MAX_HISTORY: bits of global history
+ * 		- BP_PERCEPTRON_ENTRIES, BP_PERCEPTRON_HISTORY: perceptrons and weights of each perceptron
+ * 		- BP_TAGE_ENTRIES, BP_TAGE_TABLES, BP_TAGE_TAG_BITS: tagged tables of TAGE
+ ************************************************************************/
+#ifndef BP_MAX_ENTRIES
+#define BP_MAX_ENTRIES 4096
+#endif
+#ifndef BP_MAX_HISTORY
+#define BP_MAX_HISTORY 64
+#endif
+#ifndef BP_PERCEPTRON_ENTRIES
+#define BP_PERCEPTRON_ENTRIES 256
+#endif
+#ifndef BP_PERCEPTRON_HISTORY
+#define BP_PERCEPTRON_HISTORY 32
+#endif
+#ifndef BP_TAGE_ENTRIES
+#define BP_TAGE_ENTRIES 1024
+#endif
+#ifndef BP_TAGE_TABLES
+#define BP_TAGE_TABLES 4
+#endif
+#ifndef BP_TAGE_TAG_BITS
+#define BP_TAGE_TAG_BITS 9
 #endif
 
-public:
-  void update(ac_int<32, false> pc, bool isBranch)
-  {
-    static_cast<T*>(this)->_update(pc, isBranch);
-#ifdef DEBUG
-    updateCount++;
-    assert(updateCount + 1 >= processCount);
-    bool pred = predictions[front];
-    front ^= 1;
-    missPredictions += isBranch == pred ? 0 : 1;
-    std::cout << "pc: " << pc << "\n"
-              << "branch: " << isBranch << "\n"
-              << "predict: " << pred << "\n"
-              << "miss rate: " << (float)missPredictions / updateCount << "\n";
+// Outcomes of the previous conditional branches, the most recent one in bit 0
+typedef ac_int<BP_MAX_HISTORY, false> branchHistory;
 
-#endif
+// XOR of the chunks of bits bits of the length most recent outcomes
+template <int BITS> ac_int<BITS, false> foldHistory(const branchHistory history, const int length, const int bits)
+{
+  ac_int<BITS, false> folded = 0;
+  int position               = 0;
+  for (int oneBit = 0; oneBit < BP_MAX_HISTORY; oneBit++) {
+    if (oneBit < length) {
+      folded[position] = folded[position] ^ history[oneBit];
+      position         = (position == bits - 1) ? 0 : position + 1;
+    }
   }
+  return folded;
+}
 
-  void process(ac_int<32, false> pc, bool& isBranch)
+// Predictors are given the global history seen by the branch when it was predicted, both for the prediction
+// and for the update
+template <class T> class BranchPredictorWrapper {
+public:
+  void update(ac_int<32, false> pc, branchHistory history, bool isBranch)
   {
-    static_cast<T*>(this)->_process(pc, isBranch);
-#ifdef DEBUG
-    processCount++;
-    predictions[back] = isBranch;
-    back ^= 1;
-#endif
+    static_cast<T*>(this)->_update(pc, history, isBranch);
   }
 
-  void undo()
+  void process(ac_int<32, false> pc, branchHistory history, bool& isBranch)
   {
-#ifdef DEBUG
-    if (processCount > updateCount) {
-      processCount--;
-      front ^= 1;
-    }
-#endif
+    static_cast<T*>(this)->_process(pc, history, isBranch);
   }
 };
 
@@ -67,18 +82,22 @@ class BitBranchPredictor : public BranchPredictorWrapper<BitBranchPredictor<BITS
   static const int T_FINAL     = NT_FINAL - 1;
 
   ac_int<BITS, false> table[ENTRIES];
+  ac_int<LOG_ENTRIES, false> indexMask; // entries used, ENTRIES being the largest number
 
 public:
-  BitBranchPredictor()
+  BitBranchPredictor() { configure(ENTRIES); }
+
+  void configure(const int entries)
   {
+    indexMask = entries - 1;
     for (int i = 0; i < ENTRIES; i++) {
       table[i] = T_START;
     }
   }
 
-  void _update(ac_int<32, false> pc, bool isBranch)
+  void _update(ac_int<32, false> pc, branchHistory history, bool isBranch)
   {
-    ac_int<LOG_ENTRIES, false> index = pc.slc<LOG_ENTRIES>(2);
+    ac_int<LOG_ENTRIES, false> index = pc.slc<LOG_ENTRIES>(2) & indexMask;
 
     if (isBranch) {
       table[index] -= table[index] != T_START ? 1 : 0;
@@ -87,13 +106,53 @@ public:
     }
   }
 
-  void _process(ac_int<32, false> pc, bool& isBranch)
+  void _process(ac_int<32, false> pc, branchHistory history, bool& isBranch)
   {
-    ac_int<LOG_ENTRIES, false> index = pc.slc<LOG_ENTRIES>(2);
+    ac_int<LOG_ENTRIES, false> index = pc.slc<LOG_ENTRIES>(2) & indexMask;
     isBranch                         = table[index] <= T_FINAL;
   }
 };
 
+// Gshare (McFarling): a table of 2-bit counters indexed by the pc XORed with the global history
+template <int ENTRIES> class GshareBranchPredictor : public BranchPredictorWrapper<GshareBranchPredictor<ENTRIES> > {
+  static const int LOG_ENTRIES = log2const<ENTRIES>::value;
+
+  ac_int<2, false> table[ENTRIES];
+  ac_int<LOG_ENTRIES, false> indexMask;
+  int logEntries, historyLength;
+
+  ac_int<LOG_ENTRIES, false> index(const ac_int<32, false> pc, const branchHistory history)
+  {
+    return (pc.slc<LOG_ENTRIES>(2) ^ foldHistory<LOG_ENTRIES>(history, historyLength, logEntries)) & indexMask;
+  }
+
+public:
+  GshareBranchPredictor() { configure(ENTRIES, LOG_ENTRIES); }
+
+  // The history is folded on the index when it is longer
+  void configure(const int entries, const int history)
+  {
+    indexMask     = entries - 1;
+    logEntries    = 0;
+    historyLength = history;
+    while ((1 << logEntries) < entries)
+      logEntries++;
+    for (int i = 0; i < ENTRIES; i++)
+      table[i] = 2;
+  }
+
+  void _update(ac_int<32, false> pc, branchHistory history, bool isBranch)
+  {
+    const ac_int<LOG_ENTRIES, false> entry = index(pc, history);
+    if (isBranch)
+      table[entry] += table[entry] != 3 ? 1 : 0;
+    else
+      table[entry] -= table[entry] != 0 ? 1 : 0;
+  }
+
+  void _process(ac_int<32, false> pc, branchHistory history, bool& isBranch) { isBranch = table[index(pc, history)] >= 2; }
+};
+
 template<int SIZE, int BITS, int ENTRIES, int THRESHOLD, int LR>
 class PerceptronBranchPredictor : public BranchPredictorWrapper<PerceptronBranchPredictor<SIZE, BITS, ENTRIES, THRESHOLD, LR> > {
     static const int LOG_ENTRIES = log2const<ENTRIES>::value;
@@ -103,25 +162,35 @@ class PerceptronBranchPredictor : public BranchPredictorWrapper<PerceptronBranch
     static const int PERC_DEC_TH = PERC_MIN + LR - 1;
     
     ac_int<BITS, true> perceptron[ENTRIES][SIZE+1];
+    ac_int<LOG_ENTRIES, false> indexMask;
     bool bht[SIZE];    // branch history table
     int  dp;           // dot product
     bool pd;           // prediction
 
 public:
-    PerceptronBranchPredictor() {
+    PerceptronBranchPredictor() { configure(ENTRIES); }
+
+    void configure(const int entries) {
+        indexMask = entries - 1;
         for (int i = 0; i < ENTRIES; i++) {
             for (int j = 0; j < SIZE+1; j++) {
                 perceptron[i][j] = 0;
             }
         }
+    }
+
+    // bht[SIZE-1] is the most recent outcome
+    void loadHistory(branchHistory history) {
         for (int i = 0; i < SIZE; i++) {
-            bht[i] = 0;
+            bht[i] = history[SIZE-1-i];
         }
     }
     
-    void _update(ac_int<32, false> pc, bool isBranch) {
+    void _update(ac_int<32, false> pc, branchHistory history, bool isBranch) {
+        ac_int<LOG_ENTRIES, false> index = pc.slc<LOG_ENTRIES>(2) & indexMask;
+        loadHistory(history);
+        _predict(index);
         if (pd == isBranch && dp > THRESHOLD) return;
-        ac_int<LOG_ENTRIES, false> index = pc.slc<LOG_ENTRIES>(0);
         if (isBranch) {
             if (perceptron[index][SIZE] < PERC_INC_TH) perceptron[index][SIZE] += LR;
         } else {
@@ -135,11 +204,6 @@ public:
                 if (perceptron[index][i] > PERC_DEC_TH) perceptron[index][i] -= LR;
             }
         }
-
-        shift_reg:for (int i = 0; i < SIZE-1; i++) {
-            bht[i] = bht[i+1];
-        }
-        bht[SIZE-1] = isBranch;
     }
 
     void _predict(ac_int<LOG_ENTRIES, false> index) {
@@ -155,8 +219,9 @@ public:
         if (!pd) dp = -dp;
     }
     
-    void _process(ac_int<32, false> pc, bool& isBranch) {
-        ac_int<LOG_ENTRIES, false> index = pc.slc<LOG_ENTRIES>(0);
+    void _process(ac_int<32, false> pc, branchHistory history, bool& isBranch) {
+        ac_int<LOG_ENTRIES, false> index = pc.slc<LOG_ENTRIES>(2) & indexMask;
+        loadHistory(history);
         _predict(index);
         isBranch = pd;
     }
@@ -172,25 +237,35 @@ class PerceptronBranchPredictorV2 : public BranchPredictorWrapper<PerceptronBran
     static const int PERC_DEC_TH = PERC_MIN + DOUBLE_LR - 1;
     
     ac_int<BITS, true> perceptron[ENTRIES][SIZE+1];     // w0' = -w0 + w1, w1' = -w0 - w1
+    ac_int<LOG_ENTRIES, false> indexMask;
     bool bht[SIZE];    // branch history table
     int  dp;           // dot product
     bool pd;           // prediction
 
 public:
-    PerceptronBranchPredictorV2() {
+    PerceptronBranchPredictorV2() { configure(ENTRIES); }
+
+    void configure(const int entries) {
+        indexMask = entries - 1;
         for (int i = 0; i < ENTRIES; i++) {
             for (int j = 0; j < SIZE+1; j++) {
                 perceptron[i][j] = 0;
             }
         }
+    }
+
+    // bht[SIZE-1] is the most recent outcome
+    void loadHistory(branchHistory history) {
         for (int i = 0; i < SIZE; i++) {
-            bht[i] = 0;
+            bht[i] = history[SIZE-1-i];
         }
     }
     
-    void _update(ac_int<32, false> pc, bool isBranch) {
+    void _update(ac_int<32, false> pc, branchHistory history, bool isBranch) {
+        ac_int<LOG_ENTRIES, false> index = pc.slc<LOG_ENTRIES>(2) & indexMask;
+        loadHistory(history);
+        _predict(index);
         if (pd == isBranch && dp > THRESHOLD) return;
-        ac_int<LOG_ENTRIES, false> index = pc.slc<LOG_ENTRIES>(0);
         if (isBranch) {
             if (perceptron[index][SIZE] < PERC_INC_TH) perceptron[index][SIZE] += LR;
         } else {
@@ -220,11 +295,6 @@ public:
                 }
             }
         }
-
-        shift_reg:for (int i = 0; i < SIZE-1; i++) {
-            bht[i] = bht[i+1];
-        }
-        bht[SIZE-1] = isBranch;
     }
 
     void _predict(ac_int<LOG_ENTRIES, false> index) {
@@ -258,13 +328,344 @@ public:
         if (!pd) dp = -dp;
     }
     
-    void _process(ac_int<32, false> pc, bool& isBranch) {
-        ac_int<LOG_ENTRIES, false> index = pc.slc<LOG_ENTRIES>(0);
+    void _process(ac_int<32, false> pc, branchHistory history, bool& isBranch) {
+        ac_int<LOG_ENTRIES, false> index = pc.slc<LOG_ENTRIES>(2) & indexMask;
+        loadHistory(history);
         _predict(index);
         isBranch = pd;
     }
 };
 
-using BranchPredictor = BitBranchPredictor<2, 4>;
+// TAGE (Seznec and Michaud, JILP 2006): a bimodal base table and TABLES tagged tables indexed with global
+// histories of geometric lengths. The longest matching table gives the prediction, a misprediction allocates an
+// entry in a longer table whose useful counter is null. Useful counters are halved every 2^18 updates.
+template <int BASE_ENTRIES, int TABLES, int ENTRIES, int TAG_BITS>
+class TageBranchPredictor : public BranchPredictorWrapper<TageBranchPredictor<BASE_ENTRIES, TABLES, ENTRIES, TAG_BITS> > {
+  static const int LOG_BASE_ENTRIES = log2const<BASE_ENTRIES>::value;
+  static const int LOG_ENTRIES      = log2const<ENTRIES>::value;
+
+  ac_int<2, false> base[BASE_ENTRIES];
+  ac_int<TAG_BITS, false> tag[TABLES][ENTRIES];
+  ac_int<3, false> counter[TABLES][ENTRIES]; // taken from 4
+  ac_int<2, false> useful[TABLES][ENTRIES];
+  ac_int<18, false> tick;
+
+  ac_int<LOG_BASE_ENTRIES, false> baseMask;
+  ac_int<LOG_ENTRIES, false> indexMask;
+  int logEntries;
+  int historyLength[TABLES];
+
+  // Entries of the tagged tables for a branch and the tables giving the prediction (provider) and the one it
+  // would have been without the provider (alternate), -1 for the base table
+  void lookup(const ac_int<32, false> pc, const branchHistory history, ac_int<LOG_ENTRIES, false> index[TABLES],
+              ac_int<TAG_BITS, false> tags[TABLES], int& provider, int& alternate)
+  {
+    provider  = -1;
+    alternate = -1;
+    for (int oneTable = 0; oneTable < TABLES; oneTable++) {
+      const int length = historyLength[oneTable];
+      index[oneTable]  = (pc.slc<LOG_ENTRIES>(2) ^ (pc >> (2 + logEntries)).slc<LOG_ENTRIES>(0) ^
+                         foldHistory<LOG_ENTRIES>(history, length, logEntries)) &
+                        indexMask;
+      tags[oneTable] = pc.slc<TAG_BITS>(2) ^ foldHistory<TAG_BITS>(history, length, TAG_BITS) ^
+                       (foldHistory<TAG_BITS>(history, length, TAG_BITS - 1) << 1);
+      if (tag[oneTable][index[oneTable]] == tags[oneTable]) {
+        alternate = provider;
+        provider  = oneTable;
+      }
+    }
+  }
+
+  bool prediction(const ac_int<32, false> pc, const ac_int<LOG_ENTRIES, false> index[TABLES], const int table)
+  {
+    return table < 0 ? base[pc.slc<LOG_BASE_ENTRIES>(2) & baseMask] >= 2 : counter[table][index[table]] >= 4;
+  }
+
+public:
+  TageBranchPredictor() { configure(BASE_ENTRIES, ENTRIES, 2 << TABLES); }
+
+  // Entries of the base table and of each tagged table, history of the longest table (halved for each shorter one)
+  void configure(const int baseEntries, const int entries, const int history)
+  {
+    baseMask   = baseEntries - 1;
+    indexMask  = entries - 1;
+    logEntries = 0;
+    while ((1 << logEntries) < entries)
+      logEntries++;
+    for (int oneTable = 0; oneTable < TABLES; oneTable++)
+      historyLength[oneTable] = history >> (TABLES - 1 - oneTable);
+
+    for (int i = 0; i < BASE_ENTRIES; i++)
+      base[i] = 2;
+    for (int oneTable = 0; oneTable < TABLES; oneTable++) {
+      for (int i = 0; i < ENTRIES; i++) {
+        tag[oneTable][i]     = 0;
+        counter[oneTable][i] = 3;
+        useful[oneTable][i]  = 0;
+      }
+    }
+    tick = 0;
+  }
+
+  void _update(ac_int<32, false> pc, branchHistory history, bool isBranch)
+  {
+    ac_int<LOG_ENTRIES, false> index[TABLES];
+    ac_int<TAG_BITS, false> tags[TABLES];
+    int provider, alternate;
+    lookup(pc, history, index, tags, provider, alternate);
+    const bool predicted = prediction(pc, index, provider);
+
+    if (provider < 0) {
+      const ac_int<LOG_BASE_ENTRIES, false> entry = pc.slc<LOG_BASE_ENTRIES>(2) & baseMask;
+      if (isBranch)
+        base[entry] += base[entry] != 3 ? 1 : 0;
+      else
+        base[entry] -= base[entry] != 0 ? 1 : 0;
+    } else {
+      ac_int<3, false>& providerCounter = counter[provider][index[provider]];
+      ac_int<2, false>& providerUseful  = useful[provider][index[provider]];
+      if (predicted != prediction(pc, index, alternate)) {
+        if (predicted == isBranch)
+          providerUseful += providerUseful != 3 ? 1 : 0;
+        else
+          providerUseful -= providerUseful != 0 ? 1 : 0;
+      }
+      if (isBranch)
+        providerCounter += providerCounter != 7 ? 1 : 0;
+      else
+        providerCounter -= providerCounter != 0 ? 1 : 0;
+    }
+
+    // A misprediction takes an entry in the first longer table which has a free one, or ages them all
+    if (predicted != isBranch) {
+      bool allocated = false;
+      for (int oneTable = 0; oneTable < TABLES; oneTable++) {
+        if (oneTable > provider && !allocated && useful[oneTable][index[oneTable]] == 0) {
+          tag[oneTable][index[oneTable]]     = tags[oneTable];
+          counter[oneTable][index[oneTable]] = isBranch ? 4 : 3;
+          allocated                          = true;
+        }
+      }
+      for (int oneTable = 0; oneTable < TABLES; oneTable++)
+        if (oneTable > provider && !allocated && useful[oneTable][index[oneTable]] != 0)
+          useful[oneTable][index[oneTable]]--;
+    }
+
+    tick++;
+    if (tick == 0)
+      for (int oneTable = 0; oneTable < TABLES; oneTable++)
+        for (int i = 0; i < ENTRIES; i++)
+          useful[oneTable][i] = useful[oneTable][i] >> 1;
+  }
+
+  void _process(ac_int<32, false> pc, branchHistory history, bool& isBranch)
+  {
+    ac_int<LOG_ENTRIES, false> index[TABLES];
+    ac_int<TAG_BITS, false> tags[TABLES];
+    int provider, alternate;
+    lookup(pc, history, index, tags, provider, alternate);
+    isBranch = prediction(pc, index, provider);
+  }
+};
+
+typedef enum { BIMODAL_PREDICTOR = 0, GSHARE_PREDICTOR, PERCEPTRON_PREDICTOR, TAGE_PREDICTOR } branchPredictorType;
+
+#ifndef __HLS__
+// Geometry chosen on the command line, 0 for the default of the predictor, and entries of the branch target
+// buffer and of the return address stack (0 for none)
+struct BranchPredictorConfig {
+  branchPredictorType type;
+  int entries;
+  int history;
+  int btbEntries;
+  int rasEntries;
+};
+
+// Outcomes of each conditional branch, indexed by its pc
+struct BranchCounters {
+  unsigned long executed, taken, mispredicted;
+};
+typedef std::unordered_map<unsigned int, BranchCounters> BranchProfile;
+#endif
+
+/******************************************************************************************
+ * Branch predictor of the core
+ *
+ * Every predictor is instantiated with its largest geometry and type selects the one which
+ * is used. Branches are predicted in decode and resolved in execute: the global history of
+ * the resolved branches is kept, and each branch in flight remembers the history it was
+ * predicted with so that the same entries are trained when it is resolved. undo() drops the
+ * youngest branch in flight when it is squashed by a misprediction.
+ * ****************************************************************************************
+ */
+class BranchPredictor {
+  BitBranchPredictor<2, BP_MAX_ENTRIES> bimodal;
+  GshareBranchPredictor<BP_MAX_ENTRIES> gshare;
+  PerceptronBranchPredictor<BP_PERCEPTRON_HISTORY, 8, BP_PERCEPTRON_ENTRIES, 75, 1> perceptron;
+  TageBranchPredictor<BP_MAX_ENTRIES, BP_TAGE_TABLES, BP_TAGE_ENTRIES, BP_TAGE_TAG_BITS> tage;
+
+  branchHistory history, historyMask;
+
+  // Branches in flight, at most one in execute and one in decode
+  branchHistory inFlightHistory[2];
+  bool inFlightPrediction[2];
+  ac_int<1, false> inFlightHead;
+  ac_int<2, false> inFlightCount;
+
+public:
+  branchPredictorType type;
+  int entries, historyLength;
+
+  // Stats: conditional branches resolved and mispredicted
+  unsigned long numberBranch, numberMispredict;
+#ifndef __HLS__
+  BranchProfile* profile; // per-pc stats, when not NULL
+#endif
+
+  // The default predictor is the 2-bit bimodal one with 4 entries
+  BranchPredictor()
+  {
+#ifndef __HLS__
+    profile = NULL;
+#endif
+    configure(BIMODAL_PREDICTOR, 4, 0);
+  }
+
+  // Resets the predictor with the given geometry, which has to fit in the largest one
+  void configure(const branchPredictorType predictorType, const int predictorEntries, const int predictorHistory)
+  {
+    type          = predictorType;
+    entries       = predictorEntries;
+    historyLength = predictorHistory;
+
+    if (type == BIMODAL_PREDICTOR)
+      bimodal.configure(entries);
+    else if (type == GSHARE_PREDICTOR)
+      gshare.configure(entries, historyLength);
+    else if (type == PERCEPTRON_PREDICTOR)
+      perceptron.configure(entries);
+    else
+      tage.configure(entries, entries, historyLength);
+
+    history     = 0;
+    historyMask = 0;
+    for (int oneBit = 0; oneBit < BP_MAX_HISTORY; oneBit++)
+      historyMask[oneBit] = oneBit < historyLength;
+    inFlightHead     = 0;
+    inFlightCount    = 0;
+    numberBranch     = 0;
+    numberMispredict = 0;
+  }
+
+  void process(ac_int<32, false> pc, bool& isBranch)
+  {
+    const branchHistory seen = history & historyMask;
+    if (type == BIMODAL_PREDICTOR)
+      bimodal.process(pc, seen, isBranch);
+    else if (type == GSHARE_PREDICTOR)
+      gshare.process(pc, seen, isBranch);
+    else if (type == PERCEPTRON_PREDICTOR)
+      perceptron.process(pc, seen, isBranch);
+    else
+      tage.process(pc, seen, isBranch);
+
+    const ac_int<1, false> tail = inFlightHead + inFlightCount;
+    inFlightHistory[tail]       = seen;
+    inFlightPrediction[tail]    = isBranch;
+    inFlightCount += inFlightCount != 2 ? 1 : 0;
+  }
+
+  void update(ac_int<32, false> pc, bool isBranch)
+  {
+    const branchHistory seen = inFlightHistory[inFlightHead];
+    const bool predicted     = inFlightPrediction[inFlightHead];
+    if (inFlightCount != 0) {
+      inFlightHead++;
+      inFlightCount--;
+    }
+
+    if (type == BIMODAL_PREDICTOR)
+      bimodal.update(pc, seen, isBranch);
+    else if (type == GSHARE_PREDICTOR)
+      gshare.update(pc, seen, isBranch);
+    else if (type == PERCEPTRON_PREDICTOR)
+      perceptron.update(pc, seen, isBranch);
+    else
+      tage.update(pc, seen, isBranch);
+    history = (history << 1) | (branchHistory)isBranch;
+
+    numberBranch++;
+    if (predicted != isBranch)
+      numberMispredict++;
+#ifndef __HLS__
+    if (profile != NULL) {
+      BranchCounters& counters = (*profile)[pc.to_uint()];
+      counters.executed++;
+      counters.taken += isBranch;
+      counters.mispredicted += predicted != isBranch;
+    }
+#endif
+  }
+
+  void undo()
+  {
+    if (inFlightCount != 0)
+      inFlightCount--;
+  }
+
+  // Drops the branches in flight when the pipeline is emptied
+  void flush() { inFlightCount = 0; }
+
+  // Functional warming: the branch is predicted and trained with its outcome at once, without branches in flight
+  // nor stats. Returns the prediction.
+  bool warm(const ac_int<32, false> pc, const bool isBranch)
+  {
+    const branchHistory seen = history & historyMask;
+    bool predicted;
+    if (type == BIMODAL_PREDICTOR) {
+      bimodal.process(pc, seen, predicted);
+      bimodal.update(pc, seen, isBranch);
+    } else if (type == GSHARE_PREDICTOR) {
+      gshare.process(pc, seen, predicted);
+      gshare.update(pc, seen, isBranch);
+    } else if (type == PERCEPTRON_PREDICTOR) {
+      perceptron.process(pc, seen, predicted);
+      perceptron.update(pc, seen, isBranch);
+    } else {
+      tage.process(pc, seen, predicted);
+      tage.update(pc, seen, isBranch);
+    }
+    history = (history << 1) | (branchHistory)isBranch;
+    return predicted;
+  }
+
+#ifndef __HLS__
+  void serialize(Checkpoint& cp)
+  {
+    branchPredictorType savedType = type;
+    int savedEntries              = entries;
+    int savedHistory              = historyLength;
+    cp.transfer(savedType);
+    cp.transfer(savedEntries);
+    cp.transfer(savedHistory);
+    if (savedType != type || savedEntries != entries || savedHistory != historyLength) {
+      fprintf(stderr, "Error: the checkpoint was made with another branch predictor\n");
+      exit(-1);
+    }
+
+    cp.transfer(bimodal);
+    cp.transfer(gshare);
+    cp.transfer(perceptron);
+    cp.transfer(tage);
+    cp.transfer(history);
+    cp.transfer(inFlightHistory);
+    cp.transfer(inFlightPrediction);
+    cp.transfer(inFlightHead);
+    cp.transfer(inFlightCount);
+    cp.transfer(numberBranch);
+    cp.transfer(numberMispredict);
+  }
+#endif
+};
 
 #endif /* INCLUDE_BRANCHPREDICTOR_H_ */
@@ -0,0 +1,168 @@
+/** Copyright 2021 INRIA, Université de Rennes 1 and ENS Rennes
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#ifndef __BRANCH_TARGET_BUFFER_H__
+#define __BRANCH_TARGET_BUFFER_H__
+
+#include "integerTypes.h"
+#include "logarithm.h"
+
+#ifndef __HLS__
+#include <cstdio>
+#include <cstdlib>
+
+#include "checkpoint.h"
+#endif
+
+/************************************************************************
+ * 	Largest geometry of the branch target buffer:
+ * 		- BTB_ENTRIES: entries (power of two), the number used is chosen at run time
+ * 		- BTB_TAG_BITS: bits of the pc kept in the tags, above the index
+ ************************************************************************/
+#ifndef BTB_ENTRIES
+#define BTB_ENTRIES 256
+#endif
+#ifndef BTB_TAG_BITS
+#define BTB_TAG_BITS 8
+#endif
+
+/******************************************************************************************
+ * Branch target buffer
+ *
+ * Direct-mapped table read in fetch with the pc being fetched. It holds the instructions
+ * after which decode went somewhere else than the next pc the last time it saw them (JAL and
+ * conditional branches predicted taken), with the pc decode went to. On a hit, fetch goes
+ * to this target in the next cycle, so that decode does not have to redirect it and the
+ * instruction fetched behind the branch is not lost. Decode trains the table with the pc
+ * it chose and corrects fetch when the entry was wrong (another branch with the same index
+ * and partial tag, or a branch now predicted not taken).
+ * ****************************************************************************************
+ */
+template <int ENTRIES, int TAG_BITS> class BranchTargetBuffer {
+  static const int LOG_ENTRIES = log2const<ENTRIES>::value;
+
+  bool valid[ENTRIES];
+  ac_int<TAG_BITS + 1, false> tag[ENTRIES];
+  ac_int<32, false> target[ENTRIES];
+
+  ac_int<LOG_ENTRIES, false> indexMask;
+  int logEntries;
+
+  ac_int<LOG_ENTRIES, false> index(const ac_int<32, false> pc) { return pc.slc<LOG_ENTRIES>(2) & indexMask; }
+  // The tag also keeps bit 1 of the pc, the two halves of a word may hold different compressed instructions
+  ac_int<TAG_BITS + 1, false> tagOf(const ac_int<32, false> pc)
+  {
+    ac_int<TAG_BITS + 1, false> result = pc[1];
+    result.set_slc(1, (pc >> (2 + logEntries)).slc<TAG_BITS>(0));
+    return result;
+  }
+
+public:
+  int entries; // 0 when there is no BTB
+
+  // Stats: redirections of fetch which were right (hits) or wrong (aliases), and redirections made by decode
+  // alone (misses)
+  unsigned long numberHit, numberAlias, numberMiss;
+
+  BranchTargetBuffer() { configure(0); }
+
+  void configure(const int btbEntries)
+  {
+    entries    = btbEntries;
+    indexMask  = entries - 1;
+    logEntries = 0;
+    while ((1 << logEntries) < entries)
+      logEntries++;
+    for (int oneEntry = 0; oneEntry < ENTRIES; oneEntry++) {
+      valid[oneEntry]  = false;
+      tag[oneEntry]    = 0;
+      target[oneEntry] = 0;
+    }
+    numberHit   = 0;
+    numberAlias = 0;
+    numberMiss  = 0;
+  }
+
+  // Pc fetched after the instruction at pc, which is followed by nextPC
+  ac_int<32, false> predict(const ac_int<32, false> pc, const ac_int<32, false> nextPC)
+  {
+    const ac_int<LOG_ENTRIES, false> entry = index(pc);
+    if (entries != 0 && valid[entry] && tag[entry] == tagOf(pc))
+      return target[entry];
+    return nextPC;
+  }
+
+  // Called when decode handles the instruction at pc, followed by nextPC, with the pc fetch went to after it and
+  // the one decode goes to
+  void update(const ac_int<32, false> pc, const ac_int<32, false> nextPC, const ac_int<32, false> fetchNextPC,
+              const ac_int<32, false> decodeNextPC)
+  {
+    if (entries == 0)
+      return;
+
+    const ac_int<LOG_ENTRIES, false> entry = index(pc);
+    if (fetchNextPC != nextPC) {
+      if (fetchNextPC == decodeNextPC)
+        numberHit++;
+      else
+        numberAlias++;
+    } else if (decodeNextPC != nextPC) {
+      numberMiss++;
+    }
+
+    if (decodeNextPC != nextPC) {
+      valid[entry]  = true;
+      tag[entry]    = tagOf(pc);
+      target[entry] = decodeNextPC;
+    } else if (fetchNextPC != nextPC) {
+      valid[entry] = false;
+    }
+  }
+
+  // Functional warming: the update made by decode, fetch having used the table, without stats
+  void warm(const ac_int<32, false> pc, const ac_int<32, false> nextPC, const ac_int<32, false> decodeNextPC)
+  {
+    if (entries == 0)
+      return;
+
+    const ac_int<LOG_ENTRIES, false> entry = index(pc);
+    if (decodeNextPC != nextPC) {
+      valid[entry]  = true;
+      tag[entry]    = tagOf(pc);
+      target[entry] = decodeNextPC;
+    } else if (valid[entry] && tag[entry] == tagOf(pc)) {
+      valid[entry] = false;
+    }
+  }
+
+#ifndef __HLS__
+  void serialize(Checkpoint& cp)
+  {
+    int savedEntries = entries;
+    cp.transfer(savedEntries);
+    if (savedEntries != entries) {
+      fprintf(stderr, "Error: the checkpoint was made with another branch target buffer\n");
+      exit(-1);
+    }
+
+    cp.transfer(valid);
+    cp.transfer(tag);
+    cp.transfer(target);
+    cp.transfer(numberHit);
+    cp.transfer(numberAlias);
+    cp.transfer(numberMiss);
+  }
+#endif
+};
+
+#endif // __BRANCH_TARGET_BUFFER_H__
@@ -0,0 +1,152 @@
+/** Copyright 2021 INRIA, Université de Rennes 1 and ENS Rennes
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#ifndef __CACHE_HIERARCHY_H__
+#define __CACHE_HIERARCHY_H__
+
+#include <cstdio>
+
+#include "cacheMemory.h"
+#include "checkpoint.h"
+#include "mainMemory.h"
+#include "memoryArbiter.h"
+#include "nonBlockingCacheMemory.h"
+#include "widthAdapter.h"
+
+/************************************************************************
+ * 	Geometry of the caches (line size in bytes, number of sets, number of
+ * 	ways and replacement policy), fixed at build time as for the hardware.
+ * 	They can be overridden from the compiler command line, e.g.
+ * 	-DL2_SET_SIZE=1024.
+ ************************************************************************/
+#ifndef L1_LINE_SIZE
+#define L1_LINE_SIZE 16
+#endif
+#ifndef L1_SET_SIZE
+#define L1_SET_SIZE 64
+#endif
+#ifndef L1_ASSOCIATIVITY
+#define L1_ASSOCIATIVITY 4
+#endif
+#ifndef L1_POLICY
+#define L1_POLICY LruPolicy
+#endif
+
+#ifndef L2_LINE_SIZE
+#define L2_LINE_SIZE 16
+#endif
+#ifndef L2_SET_SIZE
+#define L2_SET_SIZE 512
+#endif
+#ifndef L2_ASSOCIATIVITY
+#define L2_ASSOCIATIVITY 8
+#endif
+#ifndef L2_POLICY
+#define L2_POLICY LruPolicy
+#endif
+
+#ifndef L3_LINE_SIZE
+#define L3_LINE_SIZE 16
+#endif
+#ifndef L3_SET_SIZE
+#define L3_SET_SIZE 4096
+#endif
+#ifndef L3_ASSOCIATIVITY
+#define L3_ASSOCIATIVITY 8
+#endif
+#ifndef L3_POLICY
+#define L3_POLICY LruPolicy
+#endif
+
+// Maximum number of MSHRs of the lockup-free L1 data cache and accesses merged in each of them
+#ifndef L1D_MSHRS
+#define L1D_MSHRS 8
+#endif
+#ifndef L1D_MSHR_TARGETS
+#define L1D_MSHR_TARGETS 4
+#endif
+
+// Parameters chosen when running the simulator
+struct CacheConfig {
+  int levels;                 // 0 (no cache), 1 (split L1), 2 (and a unified L2) or 3 (and an L3)
+  unsigned int l2Latency;     // cycles
+  unsigned int l3Latency;     // cycles
+  unsigned int memoryLatency; // cycles, only used with caches
+  inclusionPolicy inclusion;  // of the L2 and L3
+  int mshrs;                  // MSHRs of the L1 data cache, 0 for a blocking cache
+  prefetcherType l1iPrefetcher;
+  prefetcherType l1dPrefetcher;
+  int writeBuffer; // lines of the write-back buffer of the L1 data cache, 0 without buffer
+};
+
+/******************************************************************************************
+ * Memory system of the simulator
+ *
+ * Without caches, the instruction and data interfaces of the core directly access the
+ * main memory. Otherwise the split L1 caches share the levels below them through an
+ * arbiter: L1I/L1D -> arbiter -> [L2 -> [L3 ->]] main memory. The L1 data cache is
+ * lockup-free when it is given MSHRs. The instruction side gives fetch a block of
+ * FETCH_INTERFACE_SIZE bytes (two words for the dual-issue core), the L1I being connected
+ * to the arbiter through a width adapter.
+ * ****************************************************************************************
+ */
+class CacheHierarchy {
+public:
+  typedef CacheMemory<4, L1_LINE_SIZE, L1_SET_SIZE, L1_ASSOCIATIVITY, L1_POLICY> L1Cache;
+  typedef CacheMemory<FETCH_INTERFACE_SIZE, L1_LINE_SIZE, L1_SET_SIZE, L1_ASSOCIATIVITY, L1_POLICY> L1ICache;
+  typedef CacheMemory<4, L2_LINE_SIZE, L2_SET_SIZE, L2_ASSOCIATIVITY, L2_POLICY> L2Cache;
+  typedef CacheMemory<4, L3_LINE_SIZE, L3_SET_SIZE, L3_ASSOCIATIVITY, L3_POLICY> L3Cache;
+  typedef NonBlockingCacheMemory<4, L1_LINE_SIZE, L1_SET_SIZE, L1_ASSOCIATIVITY, L1_POLICY, L1D_MSHRS,
+                                 L1D_MSHR_TARGETS>
+      L1NonBlockingCache;
+
+  CacheConfig config;
+
+  MainMemory<FETCH_INTERFACE_SIZE>* instructionMemory; // without caches
+  MainMemory<4>* mainMemory;
+  L1ICache* l1i;
+  WidthAdapter<FETCH_INTERFACE_SIZE, 4>* l1iAdapter;
+  L1Cache* l1d;
+  L1NonBlockingCache* l1dNonBlocking; // same cache as l1d when it is lockup-free
+  MemoryArbiter<4, 2>* arbiter;
+  L2Cache* l2;
+  L3Cache* l3;
+
+  CacheHierarchy(unsigned char* data, const CacheConfig& config);
+  ~CacheHierarchy();
+
+  MemoryInterface<FETCH_INTERFACE_SIZE>* instructionInterface();
+  MemoryInterface<4>* dataInterface();
+  // Line size of the instruction interface, 0 when it is the memory
+  unsigned int instructionLineSize() { return l1i ? L1_LINE_SIZE : 0; }
+
+  void printStats(FILE* out, const unsigned long instructions);
+  // Restarts the counters printed by printStats (SYS_stats_reset)
+  void resetStats();
+
+  // Switching between the pipeline and a functional engine: settle completes the accesses the caches are in the
+  // middle of. Caches kept warm by the engine (see CacheMemory::warm) do not follow the data, which storeLines
+  // copies to the memory and loadLines takes back when the pipeline resumes.
+  void settle();
+  void storeLines();
+  void loadLines();
+
+  // Makes the L1 data cache snoop the requests of the other cores on the bus, and put its own ones on it
+  void connect(CoherenceBus<4>& bus);
+
+  // Checks that a checkpoint is restored in the same hierarchy, the content of the caches is saved
+  // through the core interfaces
+  void serialize(Checkpoint& cp);
+};
+
+#endif // __CACHE_HIERARCHY_H__
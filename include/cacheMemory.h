@@ -18,39 +18,73 @@
 
 #include "logarithm.h"
 #include "memoryInterface.h"
-#include <ac_int.h>
+#include "prefetcher.h"
+#include "replacementPolicy.h"
+#include <integerTypes.h>
+
+#ifndef __HLS__
+#include "coherenceBus.h"
+#include <vector>
+#endif
+
+// Inclusion policy of a cache with respect to the levels above it (non-inclusive non-exclusive, inclusive or
+// exclusive)
+typedef enum { NINE = 0, INCLUSIVE, EXCLUSIVE } inclusionPolicy;
+
+// Maximum number of lines of the write-back buffer, writeBufferEntries can use fewer of them at run time
+#ifndef WRITE_BUFFER_SIZE
+#define WRITE_BUFFER_SIZE 4
+#endif
 
 /************************************************************************
  * 	Following values are templates:
- * 		- OFFSET_SIZE
- * 		- TAG_SIZE
+ * 		- INTERFACE_SIZE
+ * 		- LINE_SIZE
  * 		- SET_SIZE
- * 		- ASSOCIATIVITY
+ * 		- ASSOCIATIVITY (power of two, at least 2)
+ * 		- POLICY: replacement policy (see replacementPolicy.h)
  ************************************************************************/
-template <unsigned int INTERFACE_SIZE, int LINE_SIZE, int SET_SIZE>
+template <unsigned int INTERFACE_SIZE, int LINE_SIZE, int SET_SIZE, int ASSOCIATIVITY = 4,
+          template <int, int> class POLICY = LruPolicy>
 class CacheMemory : public MemoryInterface<INTERFACE_SIZE> {
 
   static const int LOG_SET_SIZE           = log2const<SET_SIZE>::value;
   static const int LOG_LINE_SIZE          = log2const<LINE_SIZE>::value;
   static const int TAG_SIZE               = (32 - LOG_LINE_SIZE - LOG_SET_SIZE);
-  static const int ASSOCIATIVITY          = 4;
-  static const int LOG_ASSOCIATIVITY      = 2;
+  static const int LOG_ASSOCIATIVITY      = log2const<ASSOCIATIVITY>::value;
   static const int STATE_CACHE_MISS       = ((LINE_SIZE / INTERFACE_SIZE) * 2 + 2);
   static const int STATE_CACHE_LAST_STORE = ((LINE_SIZE / INTERFACE_SIZE) + 3);
   static const int STATE_CACHE_FIRST_LOAD = ((LINE_SIZE / INTERFACE_SIZE) + 2);
   static const int STATE_CACHE_LAST_LOAD  = 2;
   static const int LOG_INTERFACE_SIZE     = log2const<INTERFACE_SIZE>::value;
+  static const int WORDS                  = LINE_SIZE / INTERFACE_SIZE;
+
+  static_assert(ASSOCIATIVITY >= 2 && (1 << LOG_ASSOCIATIVITY) == ASSOCIATIVITY,
+                "Cache associativity must be a power of two, at least 2");
 
 public:
-  IncompleteMemory<INTERFACE_SIZE>* nextLevel;
+  MemoryInterface<INTERFACE_SIZE>* nextLevel;
+
+  // Hierarchy configuration, the defaults model a stand-alone cache:
+  // 	- latency: cycles added to every access, charged once per line transfer (see AccessLatency)
+  // 	- inclusion: behavior with respect to the upper levels. An exclusive cache does not allocate on loads, and
+  // 	  gives up a line once the upper level has read it; an inclusive one back-invalidates the upper levels.
+  // 	- writeBackClean: clean victims are also written back (upper level of an exclusive cache)
+  AccessLatency<INTERFACE_SIZE> accessLatency;
+  inclusionPolicy inclusion;
+  bool writeBackClean;
+#ifndef __HLS__
+  std::vector<MemoryInterface<INTERFACE_SIZE>*> upperLevels; // back-invalidated when inclusive
+  CoherenceBus<INTERFACE_SIZE>* bus;                         // snooped with the caches of the other cores
+#endif
 
   ac_int<TAG_SIZE + LINE_SIZE * 8, false> cacheMemory[SET_SIZE][ASSOCIATIVITY];
-  ac_int<40, false> age[SET_SIZE][ASSOCIATIVITY];
+  POLICY<SET_SIZE, ASSOCIATIVITY> policy;
   ac_int<1, false> dataValid[SET_SIZE][ASSOCIATIVITY];
   ac_int<1, false> dirtyBit[SET_SIZE][ASSOCIATIVITY];
+  ac_int<1, false> sharedBit[SET_SIZE][ASSOCIATIVITY]; // clean line which other caches may hold (see coherenceBus.h)
 
-  ac_int<6, false> cacheState;                // Used for the internal state machine
-  ac_int<LOG_ASSOCIATIVITY, false> older = 0; // Set where the miss occurs
+  ac_int<6, false> cacheState; // Used for the internal state machine
 
   // Variables for next level access
   ac_int<LINE_SIZE * 8 + TAG_SIZE, false> newVal, oldVal;
@@ -58,43 +92,769 @@ public:
   memOpType nextLevelOpType;
   ac_int<INTERFACE_SIZE * 8, false> nextLevelDataIn;
   ac_int<INTERFACE_SIZE * 8, false> nextLevelDataOut;
-  ac_int<40, false> cycle;
   ac_int<LOG_ASSOCIATIVITY, false> setMiss;
   bool isValid;
   bool isDirty;
+  bool fetchLine; // false when a whole line is going to be written by the upper level (exclusive)
+  bool bypass;    // load forwarded to the next level without allocation (exclusive)
 
   bool wasStore = false;
   ac_int<LOG_ASSOCIATIVITY, false> setStore;
   ac_int<LOG_SET_SIZE, false> placeStore;
   ac_int<LINE_SIZE * 8 + TAG_SIZE, false> valStore;
   ac_int<INTERFACE_SIZE * 8, false> dataOutStore;
-  ac_int<1, false> valDirty = 0;
+  ac_int<1, false> valDirty  = 0;
+  ac_int<1, false> valShared = 0;
+  ac_int<1, false> valValid  = 1; // cleared when another cache invalidates the line before it is written
+
+  // Atomic instruction in progress (see processAtomic). When an idle cycle completes it, its result (in
+  // dataOutStore) is given to the next call instead of making the access again.
+  bool atomic;
+  ac_int<5, false> atomicOp;
+  bool atomicContended;
+  bool atomicDone;
+  // Reservation of LR, lost when another core writes the line or when the line leaves the cache
+  bool reserved;
+  ac_int<32 - LOG_LINE_SIZE, false> reservedLine;
 
   bool nextLevelWaitOut;
 
+  // Prefetcher (disabled by default). Prefetches use the next level while the cache does not, one line at a time.
+  Prefetcher<LINE_SIZE> prefetcher;
+  bool prefetching;
+  bool prefetchDiscard; // the line changed while it was being prefetched
+  ac_int<32 - LOG_LINE_SIZE, false> prefetchTarget;
+  ac_int<8, false> prefetchWord;
+  ac_int<LINE_SIZE * 8, false> prefetchValue;
+  bool fromPrefetch; // the missing line was taken from the prefetch buffer
+
+  // Write-back buffer (disabled while writeBufferEntries is 0). Victims wait in it, oldest first, and are written to
+  // the next level in the cycles the cache does not use it, so that the refill does not wait for the write-back.
+  // A miss on a line of the buffer takes it back with its data. When the buffer is full, the victim is written
+  // back before the refill as without buffer.
+  int writeBufferEntries;
+  ac_int<32 - LOG_LINE_SIZE, false> writeBufferLine[WRITE_BUFFER_SIZE];
+  ac_int<LINE_SIZE * 8, false> writeBufferData[WRITE_BUFFER_SIZE];
+  ac_int<8, false> writeBufferCount;
+  ac_int<8, false> writeBufferWord; // next word of the oldest line to write
+  bool draining;                    // a word of the oldest line is being written
+  bool fromWriteBuffer;             // the missing line was taken from the write buffer, it is dirty
+
+#ifndef __HLS__
+  // Last request of the upper level, replayed by settleCycle()
+  ac_int<32, false> requestAddr;
+  memMask requestMask;
+  memOpType requestOpType;
+  ac_int<INTERFACE_SIZE * 8, false> requestData;
+#endif
+
   bool VERBOSE = false;
 
-  // Stats
-  unsigned long numberAccess, numberMiss;
+  // Stats, line transfers from an upper level count as a single access
+  unsigned long numberAccess, numberMiss, numberWriteBack;
+  unsigned long numberBuffered, numberTakenBack, writeBufferOccupancy, writeBufferCycles, writeBufferFullCycles;
+  // Coherence: upgrades made by the cache, copies it lost to the writes of another cache, modified lines it gave
+  unsigned long numberUpgrade, numberInvalidation, numberIntervention;
+  ac_int<32 - LOG_LINE_SIZE, false> lastLine;
+  memOpType lastOpType;
 
-  CacheMemory(IncompleteMemory<INTERFACE_SIZE>* nextLevel, bool v)
+  CacheMemory(MemoryInterface<INTERFACE_SIZE>* nextLevel, bool v)
   {
     this->nextLevel = nextLevel;
     for (int oneSetElement = 0; oneSetElement < SET_SIZE; oneSetElement++) {
       for (int oneSet = 0; oneSet < ASSOCIATIVITY; oneSet++) {
         cacheMemory[oneSetElement][oneSet] = 0;
-        age[oneSetElement][oneSet]         = 0;
         dataValid[oneSetElement][oneSet]   = 0;
         dirtyBit[oneSetElement][oneSet]    = 0;
+        sharedBit[oneSetElement][oneSet]   = 0;
       }
     }
     VERBOSE          = v;
     numberAccess     = 0;
     numberMiss       = 0;
+    numberWriteBack  = 0;
+    lastLine         = 0;
+    lastOpType       = NONE;
+    inclusion        = NINE;
+    writeBackClean   = false;
+    fetchLine        = true;
+    bypass           = false;
     nextLevelWaitOut = false;
     wasStore         = false;
     cacheState       = 0;
     nextLevelOpType  = NONE;
+    this->requestPc  = 0;
+    prefetching      = false;
+    prefetchDiscard  = false;
+    prefetchWord     = 0;
+    fromPrefetch     = false;
+
+    writeBufferEntries    = 0;
+    writeBufferCount      = 0;
+    writeBufferWord       = WORDS - 1;
+    draining              = false;
+    fromWriteBuffer       = false;
+    numberBuffered        = 0;
+    numberTakenBack       = 0;
+    writeBufferOccupancy  = 0;
+    writeBufferCycles     = 0;
+    writeBufferFullCycles = 0;
+    numberUpgrade         = 0;
+    numberInvalidation    = 0;
+    numberIntervention    = 0;
+    atomic                = false;
+    atomicOp              = 0;
+    atomicContended       = false;
+    atomicDone            = false;
+    reserved              = false;
+    reservedLine          = 0;
+#ifndef __HLS__
+    bus           = NULL;
+    requestAddr   = 0;
+    requestMask   = WORD;
+    requestOpType = NONE;
+    requestData   = 0;
+#endif
+  }
+
+  bool isPresent(const ac_int<32 - LOG_LINE_SIZE, false> line)
+  {
+    const ac_int<LOG_SET_SIZE, false> place = line.template slc<LOG_SET_SIZE>(0);
+    const ac_int<TAG_SIZE, false> tag       = line.template slc<TAG_SIZE>(LOG_SET_SIZE);
+    bool result                             = false;
+    for (int oneSet = 0; oneSet < ASSOCIATIVITY; oneSet++)
+      if (dataValid[place][oneSet] && cacheMemory[place][oneSet].template slc<TAG_SIZE>(0) == tag)
+        result = true;
+    return result;
+  }
+
+  // Sets up the next level access of a prefetch when the cache does not use it, returns true if there is one
+  bool prefetchIssue()
+  {
+    if (prefetcher.type == NO_PREFETCH)
+      return false;
+    ac_int<32 - LOG_LINE_SIZE, false> candidate;
+    if (!prefetching && prefetcher.peek(candidate)) {
+      prefetcher.pop();
+      if (!isPresent(candidate) && !prefetcher.inBuffer(candidate)) {
+        prefetching     = true;
+        prefetchDiscard = false;
+        prefetchTarget  = candidate;
+        prefetchWord    = WORDS - 1;
+      }
+    }
+    if (prefetching) {
+      nextLevelAddr   = (((int)prefetchTarget) << LOG_LINE_SIZE) + (((int)prefetchWord) << LOG_INTERFACE_SIZE);
+      nextLevelOpType = LOAD;
+    }
+    return prefetching;
+  }
+
+  // Collects the word read by a prefetch, the line goes to the prefetch buffer once complete
+  void prefetchResponse()
+  {
+    if (!prefetching || nextLevelWaitOut)
+      return;
+    prefetchValue.set_slc(((int)prefetchWord) * INTERFACE_SIZE * 8, nextLevelDataOut);
+    if (prefetchWord == 0) {
+      if (!prefetchDiscard)
+        prefetcher.fill(prefetchTarget, prefetchValue);
+      prefetching     = false;
+      nextLevelOpType = NONE;
+    } else {
+      prefetchWord--;
+    }
+  }
+
+  int findBuffered(const ac_int<32 - LOG_LINE_SIZE, false> line)
+  {
+    int result = -1;
+    for (int oneEntry = 0; oneEntry < WRITE_BUFFER_SIZE; oneEntry++)
+      if (oneEntry < writeBufferCount && writeBufferLine[oneEntry] == line)
+        result = oneEntry;
+    return result;
+  }
+
+  void writeBufferPush(const ac_int<32 - LOG_LINE_SIZE, false> line, const ac_int<LINE_SIZE * 8, false> data)
+  {
+    writeBufferLine[writeBufferCount] = line;
+    writeBufferData[writeBufferCount] = data;
+    writeBufferCount++;
+    numberBuffered++;
+  }
+
+  void writeBufferRemove(const int entry)
+  {
+    for (int oneEntry = 0; oneEntry < WRITE_BUFFER_SIZE - 1; oneEntry++) {
+      if (oneEntry >= entry && oneEntry + 1 < writeBufferCount) {
+        writeBufferLine[oneEntry] = writeBufferLine[oneEntry + 1];
+        writeBufferData[oneEntry] = writeBufferData[oneEntry + 1];
+      }
+    }
+    writeBufferCount--;
+    if (entry == 0)
+      writeBufferWord = WORDS - 1;
+  }
+
+  // A missing line held in the write buffer leaves it for the cache
+  bool writeBufferTake(const ac_int<32 - LOG_LINE_SIZE, false> line, ac_int<LINE_SIZE * 8, false>& data)
+  {
+    const int entry = findBuffered(line);
+    if (entry < 0)
+      return false;
+    data = writeBufferData[entry];
+    writeBufferRemove(entry);
+    numberTakenBack++;
+    return true;
+  }
+
+  // Sets up the write of the next word of the oldest line of the write buffer, returns true if there is one
+  bool drainIssue()
+  {
+    if (writeBufferCount == 0)
+      return false;
+    draining        = true;
+    nextLevelAddr   = (((int)writeBufferLine[0]) << LOG_LINE_SIZE) + (((int)writeBufferWord) << LOG_INTERFACE_SIZE);
+    nextLevelDataIn = writeBufferData[0].template slc<INTERFACE_SIZE * 8>(((int)writeBufferWord) * INTERFACE_SIZE * 8);
+    nextLevelOpType = STORE;
+    return true;
+  }
+
+  void drainResponse()
+  {
+    if (!draining || nextLevelWaitOut)
+      return;
+    draining        = false;
+    nextLevelOpType = NONE;
+    if (writeBufferWord == 0)
+      writeBufferRemove(0);
+    else
+      writeBufferWord--;
+  }
+
+  // The write buffer goes first, a prefetch being finished before it starts
+  bool backgroundIssue() { return (!prefetching && drainIssue()) || prefetchIssue(); }
+
+  void backgroundResponse()
+  {
+    drainResponse();
+    prefetchResponse();
+  }
+
+  // Cycle in which the cache itself does not access the next level
+  void backgroundCycle()
+  {
+    if (backgroundIssue()) {
+      nextLevel->process(nextLevelAddr, LONG, nextLevelOpType, nextLevelDataIn, nextLevelDataOut, nextLevelWaitOut);
+      backgroundResponse();
+    }
+  }
+
+#ifndef __HLS__
+  void serialize(Checkpoint& cp)
+  {
+    cp.transfer(cacheMemory);
+    policy.serialize(cp);
+    cp.transfer(dataValid);
+    cp.transfer(dirtyBit);
+    cp.transfer(sharedBit);
+
+    cp.transfer(cacheState);
+    cp.transfer(newVal);
+    cp.transfer(oldVal);
+    cp.transfer(nextLevelAddr);
+    cp.transfer(nextLevelOpType);
+    cp.transfer(nextLevelDataIn);
+    cp.transfer(nextLevelDataOut);
+    cp.transfer(setMiss);
+    cp.transfer(isValid);
+    cp.transfer(isDirty);
+    cp.transfer(fetchLine);
+    cp.transfer(bypass);
+    cp.transfer(accessLatency);
+    cp.transfer(wasStore);
+    cp.transfer(setStore);
+    cp.transfer(placeStore);
+    cp.transfer(valStore);
+    cp.transfer(dataOutStore);
+    cp.transfer(valDirty);
+    cp.transfer(valShared);
+    cp.transfer(valValid);
+    cp.transfer(atomic);
+    cp.transfer(atomicOp);
+    cp.transfer(atomicContended);
+    cp.transfer(atomicDone);
+    cp.transfer(reserved);
+    cp.transfer(reservedLine);
+    cp.transfer(nextLevelWaitOut);
+    cp.transfer(numberAccess);
+    cp.transfer(numberMiss);
+    cp.transfer(numberWriteBack);
+    cp.transfer(lastLine);
+    cp.transfer(lastOpType);
+    prefetcher.serialize(cp);
+    cp.transfer(this->requestPc);
+    cp.transfer(prefetching);
+    cp.transfer(prefetchDiscard);
+    cp.transfer(prefetchTarget);
+    cp.transfer(prefetchWord);
+    cp.transfer(prefetchValue);
+    cp.transfer(fromPrefetch);
+    cp.transfer(writeBufferEntries);
+    cp.transfer(writeBufferLine);
+    cp.transfer(writeBufferData);
+    cp.transfer(writeBufferCount);
+    cp.transfer(writeBufferWord);
+    cp.transfer(draining);
+    cp.transfer(fromWriteBuffer);
+    cp.transfer(numberBuffered);
+    cp.transfer(numberTakenBack);
+    cp.transfer(writeBufferOccupancy);
+    cp.transfer(writeBufferCycles);
+    cp.transfer(writeBufferFullCycles);
+    cp.transfer(numberUpgrade);
+    cp.transfer(numberInvalidation);
+    cp.transfer(numberIntervention);
+    cp.transfer(requestAddr);
+    cp.transfer(requestMask);
+    cp.transfer(requestOpType);
+    cp.transfer(requestData);
+
+    nextLevel->serialize(cp);
+  }
+
+  // Block transfers are made line by line: lines present in the cache are read or updated in place (and marked
+  // dirty), the other ones are transferred to the next level without being allocated.
+  int findLine(const unsigned int addr)
+  {
+    const ac_int<32, false> address   = addr;
+    ac_int<LOG_SET_SIZE, false> place = address.slc<LOG_SET_SIZE>(LOG_LINE_SIZE);
+    ac_int<TAG_SIZE, false> tag       = address.slc<TAG_SIZE>(LOG_LINE_SIZE + LOG_SET_SIZE);
+    for (int oneSet = 0; oneSet < ASSOCIATIVITY; oneSet++)
+      if (dataValid[place][oneSet] && cacheMemory[place][oneSet].template slc<TAG_SIZE>(0) == tag)
+        return oneSet;
+    return -1;
+  }
+
+  // Lock of the coherence bus, held while a cache of the multi-core simulation is accessed
+  std::unique_lock<std::mutex> lockBus()
+  {
+    return bus ? std::unique_lock<std::mutex>(bus->lock) : std::unique_lock<std::mutex>();
+  }
+
+  // Lines of the write buffer are handled as the ones of the cache. The access to the next level made by a
+  // prefetch or the write buffer is completed first, so that the next level is idle. On a coherence bus, the
+  // modified copies of the other caches are written back before the memory is read, and invalidated before it is
+  // written; a shared line of the cache is upgraded before it is written.
+  void readBlock(const unsigned int addr, unsigned char* dst, const unsigned int size)
+  {
+    std::unique_lock<std::mutex> guard = lockBus();
+    finishBackground();
+    for (unsigned int done = 0; done < size;) {
+      const unsigned int current    = addr + done;
+      const unsigned int lineOffset = current & (LINE_SIZE - 1);
+      const unsigned int chunk      = (LINE_SIZE - lineOffset < size - done) ? LINE_SIZE - lineOffset : size - done;
+      const int set                 = findLine(current);
+      const int entry               = findBuffered(current >> LOG_LINE_SIZE);
+      if (set >= 0) {
+        const unsigned int place = (current >> LOG_LINE_SIZE) & (SET_SIZE - 1);
+        for (unsigned int i = 0; i < chunk; i++)
+          dst[done + i] = cacheMemory[place][set].template slc<8>(TAG_SIZE + 8 * (lineOffset + i)).to_uint();
+      } else if (entry >= 0) {
+        for (unsigned int i = 0; i < chunk; i++)
+          dst[done + i] = writeBufferData[entry].template slc<8>(8 * (lineOffset + i)).to_uint();
+      } else {
+        if (bus) {
+          unsigned char line[LINE_SIZE];
+          bool dirty;
+          bus->request(this, current & ~(LINE_SIZE - 1), BUS_READ, line, dirty);
+        }
+        nextLevel->readBlock(current, dst + done, chunk);
+      }
+      done += chunk;
+    }
+  }
+
+  void writeBlock(const unsigned int addr, const unsigned char* src, const unsigned int size)
+  {
+    std::unique_lock<std::mutex> guard = lockBus();
+    finishBackground();
+    for (unsigned int done = 0; done < size;) {
+      const unsigned int current    = addr + done;
+      const unsigned int lineOffset = current & (LINE_SIZE - 1);
+      const unsigned int chunk      = (LINE_SIZE - lineOffset < size - done) ? LINE_SIZE - lineOffset : size - done;
+      const int set                 = findLine(current);
+      const int entry               = findBuffered(current >> LOG_LINE_SIZE);
+      if (set >= 0) {
+        const unsigned int place = (current >> LOG_LINE_SIZE) & (SET_SIZE - 1);
+        if (bus && sharedBit[place][set])
+          upgrade(current & ~(LINE_SIZE - 1));
+        for (unsigned int i = 0; i < chunk; i++)
+          cacheMemory[place][set].set_slc(TAG_SIZE + 8 * (lineOffset + i), (ac_int<8, false>)src[done + i]);
+        dirtyBit[place][set]  = 1;
+        sharedBit[place][set] = 0;
+      } else if (entry >= 0) {
+        // Words of the line may already have been written: it is written again from its last word
+        for (unsigned int i = 0; i < chunk; i++)
+          writeBufferData[entry].set_slc(8 * (lineOffset + i), (ac_int<8, false>)src[done + i]);
+        if (entry == 0)
+          writeBufferWord = WORDS - 1;
+      } else {
+        if (bus) {
+          unsigned char line[LINE_SIZE];
+          bool dirty;
+          bus->request(this, current & ~(LINE_SIZE - 1), BUS_READ_EXCLUSIVE, line, dirty);
+          if (dirty)
+            nextLevel->writeBlock(current & ~(LINE_SIZE - 1), line, LINE_SIZE);
+        }
+        nextLevel->writeBlock(current, src + done, chunk);
+      }
+      dropPrefetched(current);
+      done += chunk;
+    }
+  }
+
+  // Prefetched copies of a line are dropped when the line changes or leaves the hierarchy
+  void dropPrefetched(const unsigned int addr)
+  {
+    const ac_int<32 - LOG_LINE_SIZE, false> line = addr >> LOG_LINE_SIZE;
+    prefetcher.invalidate(line);
+    if (prefetching && prefetchTarget == line)
+      prefetchDiscard = true;
+  }
+
+  // Completes the access to the next level made by a prefetch or the write buffer
+  void finishBackground()
+  {
+    while (prefetching || draining) {
+      backgroundIssue();
+      nextLevel->process(nextLevelAddr, LONG, nextLevelOpType, nextLevelDataIn, nextLevelDataOut, nextLevelWaitOut);
+      backgroundResponse();
+    }
+  }
+
+  bool invalidateBlock(const unsigned int addr, unsigned char* data, const unsigned int size)
+  {
+    bool hasDirty = false;
+    for (unsigned int lineAddr = addr & ~(LINE_SIZE - 1); lineAddr < addr + size; lineAddr += LINE_SIZE) {
+      dropPrefetched(lineAddr);
+      if (reserved && reservedLine == (lineAddr >> LOG_LINE_SIZE))
+        reserved = false;
+      const int entry = findBuffered(lineAddr >> LOG_LINE_SIZE);
+      if (entry >= 0) {
+        for (unsigned int i = 0; i < LINE_SIZE; i++)
+          if (lineAddr + i >= addr && lineAddr + i < addr + size)
+            data[lineAddr + i - addr] = writeBufferData[entry].template slc<8>(8 * i).to_uint();
+        hasDirty = true;
+        writeBufferRemove(entry);
+      }
+      const int set = findLine(lineAddr);
+      if (set < 0)
+        continue;
+      const unsigned int place = (lineAddr >> LOG_LINE_SIZE) & (SET_SIZE - 1);
+      if (dirtyBit[place][set]) {
+        for (unsigned int i = 0; i < LINE_SIZE; i++)
+          if (lineAddr + i >= addr && lineAddr + i < addr + size)
+            data[lineAddr + i - addr] = cacheMemory[place][set].template slc<8>(TAG_SIZE + 8 * i).to_uint();
+        hasDirty = true;
+      }
+      dataValid[place][set] = 0;
+      dirtyBit[place][set]  = 0;
+    }
+
+    // Copies held above an inclusive cache are removed as well, their data being the most recent one
+    if (inclusion == INCLUSIVE)
+      for (auto upper : upperLevels)
+        hasDirty |= upper->invalidateBlock(addr, data, size);
+    return hasDirty;
+  }
+
+  // Invalidates the copies of the other caches before a shared line is written, returns true if there were any
+  bool upgrade(const unsigned int lineAddr)
+  {
+    unsigned char line[LINE_SIZE];
+    bool dirty;
+    numberUpgrade++;
+    return bus->request(this, lineAddr, BUS_UPGRADE, line, dirty);
+  }
+
+  // The copy of the line may be in the cache, in the result of the last access (written in the next cycle) and in
+  // the prefetcher, which drops it on an invalidation. The victim of the miss in progress stays in the cache until
+  // the refill is written: once it has been given, the rest of its write-back is cancelled (a later write-back of
+  // the requester would otherwise be overwritten by it).
+  bool snoop(const unsigned int lineAddr, const busRequest request, unsigned char* line, bool& dirty)
+  {
+    const unsigned int place          = (lineAddr >> LOG_LINE_SIZE) & (SET_SIZE - 1);
+    const ac_int<TAG_SIZE, false> tag = lineAddr >> (LOG_LINE_SIZE + LOG_SET_SIZE);
+    const bool invalidate             = request != BUS_READ;
+    bool held                         = false;
+    dirty                             = false;
+    if (invalidate) {
+      dropPrefetched(lineAddr);
+      if (reserved && reservedLine == (lineAddr >> LOG_LINE_SIZE))
+        reserved = false;
+    }
+
+    const int set = findLine(lineAddr);
+    if (set >= 0) {
+      held = true;
+      if (dirtyBit[place][set]) {
+        for (unsigned int i = 0; i < LINE_SIZE; i++)
+          line[i] = cacheMemory[place][set].template slc<8>(TAG_SIZE + 8 * i).to_uint();
+        dirty = true;
+      }
+      if (invalidate)
+        dataValid[place][set] = 0;
+      dirtyBit[place][set]  = 0;
+      sharedBit[place][set] = 1;
+
+      const bool missInProgress = cacheState != 0 && cacheState < STATE_CACHE_MISS;
+      if (missInProgress && (unsigned int)requestAddr.slc<LOG_SET_SIZE>(LOG_LINE_SIZE) == place && setMiss == set) {
+        isValid = false;
+        if (nextLevelWaitOut && nextLevelOpType == STORE)
+          nextLevelOpType = NONE;
+      }
+    }
+
+    if (hasPending() && valValid && placeStore == place && valStore.template slc<TAG_SIZE>(0) == tag) {
+      held = true;
+      if (valDirty) {
+        for (unsigned int i = 0; i < LINE_SIZE; i++)
+          line[i] = valStore.template slc<8>(TAG_SIZE + 8 * i).to_uint();
+        dirty = true;
+      }
+      if (invalidate)
+        valValid = 0;
+      valDirty  = 0;
+      valShared = 1;
+    }
+
+    if (held && invalidate)
+      numberInvalidation++;
+    if (dirty) {
+      numberIntervention++;
+      if (!invalidate)
+        nextLevel->writeBlock(lineAddr, line, LINE_SIZE);
+    }
+    return held;
+  }
+
+  unsigned long missCount() { return numberMiss; }
+
+  void resetStats()
+  {
+    numberAccess              = 0;
+    numberMiss                = 0;
+    numberWriteBack           = 0;
+    numberBuffered            = 0;
+    numberTakenBack           = 0;
+    writeBufferOccupancy      = 0;
+    writeBufferCycles         = 0;
+    writeBufferFullCycles     = 0;
+    numberUpgrade             = 0;
+    numberInvalidation        = 0;
+    numberIntervention        = 0;
+    prefetcher.numberPrefetch = 0;
+    prefetcher.numberUseful   = 0;
+  }
+
+  void flushAll()
+  {
+    unsigned char line[LINE_SIZE];
+    finishBackground();
+    for (int oneEntry = 0; oneEntry < writeBufferCount; oneEntry++) {
+      for (unsigned int i = 0; i < LINE_SIZE; i++)
+        line[i] = writeBufferData[oneEntry].template slc<8>(8 * i).to_uint();
+      nextLevel->writeBlock(((unsigned int)writeBufferLine[oneEntry]) << LOG_LINE_SIZE, line, LINE_SIZE);
+    }
+    writeBufferCount = 0;
+    writeBufferWord  = WORDS - 1;
+    for (int oneSetElement = 0; oneSetElement < SET_SIZE; oneSetElement++) {
+      for (int oneSet = 0; oneSet < ASSOCIATIVITY; oneSet++) {
+        if (dataValid[oneSetElement][oneSet] && dirtyBit[oneSetElement][oneSet]) {
+          const unsigned int lineAddr =
+              ((unsigned int)cacheMemory[oneSetElement][oneSet].template slc<TAG_SIZE>(0) << (LOG_LINE_SIZE + LOG_SET_SIZE)) |
+              (oneSetElement << LOG_LINE_SIZE);
+          for (unsigned int i = 0; i < LINE_SIZE; i++)
+            line[i] = cacheMemory[oneSetElement][oneSet].template slc<8>(TAG_SIZE + 8 * i).to_uint();
+          nextLevel->writeBlock(lineAddr, line, LINE_SIZE);
+        }
+        dataValid[oneSetElement][oneSet] = 0;
+        dirtyBit[oneSetElement][oneSet]  = 0;
+      }
+    }
+    prefetcher.clear();
+    reserved        = false;
+    nextLevelOpType = NONE;
+    nextLevel->flushAll();
+  }
+
+  // The cache is busy while an access is in progress or waits to be committed, and while the prefetcher or the
+  // write buffer uses the next level
+  bool busy() { return cacheState != 0 || wasStore || bypass || prefetching || draining; }
+
+  // A cycle of the access in progress, made with the last request of the upper level (an access replayed by the
+  // upper level has the same effect), or an idle cycle. Used to complete the accesses of the L1 caches when the
+  // simulator leaves the pipeline, the levels below them completing theirs meanwhile.
+  void settleCycle()
+  {
+    ac_int<INTERFACE_SIZE * 8, false> dataOut;
+    bool waitOut;
+    const bool inProgress = cacheState != 0 || wasStore || bypass;
+    process(requestAddr, requestMask, inProgress ? requestOpType : NONE, requestData, dataOut, waitOut);
+  }
+
+  // Functional warming, line by line. A hit updates the replacement state (and the dirty bit of a store), a miss
+  // installs the line in place of the victim chosen by the replacement policy, the victim being written back and
+  // the line read through the warm() of the next level. As in process(), an exclusive cache gives up a line read by
+  // the upper level and only allocates the lines it writes back.
+  void warm(const unsigned int addr, const unsigned int size, const bool isStore)
+  {
+    for (unsigned int lineAddr = addr & ~(LINE_SIZE - 1); lineAddr < addr + size; lineAddr += LINE_SIZE)
+      warmLine(lineAddr, isStore);
+  }
+
+  void warmLine(const unsigned int lineAddr, const bool isStore)
+  {
+    const unsigned int place = (lineAddr >> LOG_LINE_SIZE) & (SET_SIZE - 1);
+    const int set            = findLine(lineAddr);
+    if (set >= 0) {
+      if (inclusion == EXCLUSIVE && !isStore) {
+        dataValid[place][set] = 0;
+        dirtyBit[place][set]  = 0;
+        return;
+      }
+      if (isStore)
+        dirtyBit[place][set] = 1;
+      policy.touch(place, set);
+      return;
+    }
+    if (inclusion == EXCLUSIVE && !isStore) {
+      nextLevel->warm(lineAddr, LINE_SIZE, false);
+      return;
+    }
+
+    int victim = -1;
+    for (int oneSet = ASSOCIATIVITY - 1; oneSet >= 0; oneSet--)
+      if (!dataValid[place][oneSet])
+        victim = oneSet;
+    if (victim < 0)
+      victim = policy.victim(place);
+    if (dataValid[place][victim]) {
+      const unsigned int victimAddr =
+          ((unsigned int)cacheMemory[place][victim].template slc<TAG_SIZE>(0) << (LOG_LINE_SIZE + LOG_SET_SIZE)) |
+          (place << LOG_LINE_SIZE);
+      bool dirty = dirtyBit[place][victim];
+      if (inclusion == INCLUSIVE) {
+        unsigned char line[LINE_SIZE];
+        for (auto upper : upperLevels)
+          dirty |= upper->invalidateBlock(victimAddr, line, LINE_SIZE);
+      }
+      if (dirty || writeBackClean)
+        nextLevel->warm(victimAddr, LINE_SIZE, true);
+    }
+    if (inclusion != EXCLUSIVE)
+      nextLevel->warm(lineAddr, LINE_SIZE, false);
+
+    cacheMemory[place][victim].set_slc(0, (ac_int<TAG_SIZE, false>)(lineAddr >> (LOG_LINE_SIZE + LOG_SET_SIZE)));
+    dataValid[place][victim] = 1;
+    dirtyBit[place][victim]  = isStore;
+    sharedBit[place][victim] = 0;
+    policy.insert(place, victim);
+  }
+
+  // While the caches are warmed, the data stays in memory: storeLines copies the dirty lines and the ones of the
+  // write buffer into it (lower levels first, the upper ones holding the most recent data), the write buffer then
+  // being emptied into the next level and the prefetched lines dropped. loadLines gives the valid lines the content
+  // of the memory when the pipeline resumes.
+  void storeLines(unsigned char* memory)
+  {
+    for (int oneEntry = 0; oneEntry < writeBufferCount; oneEntry++)
+      for (unsigned int i = 0; i < LINE_SIZE; i++)
+        memory[(((unsigned int)writeBufferLine[oneEntry]) << LOG_LINE_SIZE) + i] =
+            writeBufferData[oneEntry].template slc<8>(8 * i).to_uint();
+    for (int oneSetElement = 0; oneSetElement < SET_SIZE; oneSetElement++) {
+      for (int oneSet = 0; oneSet < ASSOCIATIVITY; oneSet++) {
+        if (dataValid[oneSetElement][oneSet] && dirtyBit[oneSetElement][oneSet]) {
+          const unsigned int lineAddr =
+              ((unsigned int)cacheMemory[oneSetElement][oneSet].template slc<TAG_SIZE>(0) << (LOG_LINE_SIZE + LOG_SET_SIZE)) |
+              (oneSetElement << LOG_LINE_SIZE);
+          for (unsigned int i = 0; i < LINE_SIZE; i++)
+            memory[lineAddr + i] = cacheMemory[oneSetElement][oneSet].template slc<8>(TAG_SIZE + 8 * i).to_uint();
+        }
+      }
+    }
+
+    for (int oneEntry = 0; oneEntry < writeBufferCount; oneEntry++)
+      nextLevel->warm(((unsigned int)writeBufferLine[oneEntry]) << LOG_LINE_SIZE, LINE_SIZE, true);
+    writeBufferCount = 0;
+    writeBufferWord  = WORDS - 1;
+    prefetcher.clear();
+  }
+
+  void loadLines(const unsigned char* memory)
+  {
+    for (int oneSetElement = 0; oneSetElement < SET_SIZE; oneSetElement++) {
+      for (int oneSet = 0; oneSet < ASSOCIATIVITY; oneSet++) {
+        if (dataValid[oneSetElement][oneSet]) {
+          const unsigned int lineAddr =
+              ((unsigned int)cacheMemory[oneSetElement][oneSet].template slc<TAG_SIZE>(0) << (LOG_LINE_SIZE + LOG_SET_SIZE)) |
+              (oneSetElement << LOG_LINE_SIZE);
+          for (unsigned int i = 0; i < LINE_SIZE; i++)
+            cacheMemory[oneSetElement][oneSet].set_slc(TAG_SIZE + 8 * i, (ac_int<8, false>)memory[lineAddr + i]);
+        }
+      }
+    }
+  }
+#endif
+
+  // The result of a store hit or of a miss is written into the cache in the cycle after it was given
+  bool hasPending() { return wasStore || cacheState == 1; }
+
+  void commitPending()
+  {
+    if (cacheState == 1)
+      policy.insert(placeStore, setStore);
+    cacheMemory[placeStore][setStore] = valStore;
+    dataValid[placeStore][setStore]   = valValid;
+    dirtyBit[placeStore][setStore]    = valDirty;
+    sharedBit[placeStore][setStore]   = valShared;
+    valShared                         = 0;
+    valValid                          = 1;
+    wasStore                          = false;
+    cacheState                        = 0;
+    fromPrefetch                      = false;
+    fromWriteBuffer                   = false;
+  }
+
+  // The atomic instruction is a load (LR) or a store (SC and the AMOs) of a word, the store being given the word read
+  // from the line in the same access: the value it writes is computed when a hit is found and when the line of a
+  // miss has been read, the line being held exclusively. SC fails at once when the line is not present or was not
+  // reserved.
+  void processAtomic(const ac_int<32, false> addr, const ac_int<5, false> op,
+                     const ac_int<INTERFACE_SIZE * 8, false> dataIn, const bool active,
+                     ac_int<INTERFACE_SIZE * 8, false>& dataOut, bool& waitOut, bool& contended)
+  {
+    if (active && atomicDone) {
+      dataOut         = dataOutStore;
+      waitOut         = false;
+      contended       = atomicContended;
+      atomic          = false;
+      atomicDone      = false;
+      atomicContended = false;
+      return;
+    }
+    if (active) {
+      atomic   = true;
+      atomicOp = op;
+    }
+    const memOpType opType = !active ? NONE : op == RISCV_ATOMIC_LR ? LOAD : STORE;
+    CacheMemory::process(addr, WORD, opType, dataIn, dataOut, waitOut);
+    contended = atomicContended;
+    if (active && !waitOut) {
+      atomic          = false;
+      atomicContended = false;
+    }
   }
 
   void process(ac_int<32, false> addr, memMask mask, memOpType opType, ac_int<INTERFACE_SIZE * 8, false> dataIn,
@@ -108,83 +868,95 @@ public:
     // bitSize is log(lineSize), start address is 2(because of #bytes in a word)
     ac_int<LOG_LINE_SIZE, false> offset = addr.slc<LOG_LINE_SIZE - 2>(2);
 
-    if (!nextLevelWaitOut) {
-      cycle++;
-
-      if (wasStore || cacheState == 1) {
-        cacheMemory[placeStore][setStore] = valStore;
-        age[placeStore][setStore]         = cycle;
-        dataValid[placeStore][setStore]   = 1;
-        dirtyBit[placeStore][setStore]    = valDirty;
-        dataOut                           = dataOutStore;
-        wasStore                          = false;
-        cacheState                        = 0;
-        waitOut                           = 0;
-        return;
-      } else if (opType != NONE) {
-
-        ac_int<LINE_SIZE * 8 + TAG_SIZE, false> val1 = cacheMemory[place][0];
-        ac_int<LINE_SIZE * 8 + TAG_SIZE, false> val2 = cacheMemory[place][1];
-        ac_int<LINE_SIZE * 8 + TAG_SIZE, false> val3 = cacheMemory[place][2];
-        ac_int<LINE_SIZE * 8 + TAG_SIZE, false> val4 = cacheMemory[place][3];
+#ifndef __HLS__
+    std::unique_lock<std::mutex> guard = lockBus();
+    if (opType != NONE) {
+      requestAddr   = addr;
+      requestMask   = mask;
+      requestOpType = opType;
+      requestData   = dataIn;
+    }
+#endif
 
-        ac_int<1, false> valid1 = dataValid[place][0];
-        ac_int<1, false> valid2 = dataValid[place][1];
-        ac_int<1, false> valid3 = dataValid[place][2];
-        ac_int<1, false> valid4 = dataValid[place][3];
+    if (writeBufferEntries != 0) {
+      writeBufferOccupancy += writeBufferCount;
+      writeBufferCycles++;
+      // The buffer is only bypassed when it is full
+      if (cacheState >= STATE_CACHE_LAST_STORE && cacheState < STATE_CACHE_MISS)
+        writeBufferFullCycles++;
+    }
 
+    // A prefetch or a write-back waiting for the next level does not prevent hits
+    if (!nextLevelWaitOut || prefetching || draining) {
 
-        ac_int<16, false> age1 = age[place][0];
-        ac_int<16, false> age2 = age[place][1];
-        ac_int<16, false> age3 = age[place][2];
-        ac_int<16, false> age4 = age[place][3];
+      if (hasPending()) {
+        if (atomic && opType == NONE)
+          atomicDone = true;
+        commitPending();
+        dataOut = dataOutStore;
+        waitOut = 0;
+        backgroundCycle();
+        return;
+      } else if (opType != NONE) {
 
-        ac_int<1, false> dirty1 = dirtyBit[place][0];
-        ac_int<1, false> dirty2 = dirtyBit[place][1];
-        ac_int<1, false> dirty3 = dirtyBit[place][2];
-        ac_int<1, false> dirty4 = dirtyBit[place][3];
+        ac_int<LINE_SIZE * 8 + TAG_SIZE, false> val[ASSOCIATIVITY];
+        ac_int<1, false> valid[ASSOCIATIVITY];
+        ac_int<1, false> dirty[ASSOCIATIVITY];
+        for (int oneSet = 0; oneSet < ASSOCIATIVITY; oneSet++) {
+          val[oneSet]   = cacheMemory[place][oneSet];
+          valid[oneSet] = dataValid[place][oneSet];
+          dirty[oneSet] = dirtyBit[place][oneSet];
+        }
 
         if (cacheState == 0) {
-          numberAccess++;
-
-          ac_int<TAG_SIZE, false> tag1 = val1.template slc<TAG_SIZE>(0);
-          ac_int<TAG_SIZE, false> tag2 = val2.template slc<TAG_SIZE>(0);
-          ac_int<TAG_SIZE, false> tag3 = val3.template slc<TAG_SIZE>(0);
-          ac_int<TAG_SIZE, false> tag4 = val4.template slc<TAG_SIZE>(0);
+          if (accessLatency.stall(addr)) {
+            waitOut = true;
+            backgroundCycle();
+            return;
+          }
 
-          bool hit1 = (tag1 == tag) && valid1;
-          bool hit2 = (tag2 == tag) && valid2;
-          bool hit3 = (tag3 == tag) && valid3;
-          bool hit4 = (tag4 == tag) && valid4;
-          bool hit  = hit1 | hit2 | hit3 | hit4;
+          const ac_int<32 - LOG_LINE_SIZE, false> line = addr.slc<32 - LOG_LINE_SIZE>(LOG_LINE_SIZE);
 
+          bool hit                              = false;
           ac_int<LOG_ASSOCIATIVITY, false> set = 0;
-          ac_int<LINE_SIZE * 8, false> selectedValue;
-          ac_int<TAG_SIZE, false> tag;
-
-          if (hit1) {
-            selectedValue = val1.template slc<LINE_SIZE * 8>(TAG_SIZE);
-            tag           = tag1;
-            set           = 0;
+          for (int oneSet = 0; oneSet < ASSOCIATIVITY; oneSet++) {
+            if (valid[oneSet] && val[oneSet].template slc<TAG_SIZE>(0) == tag) {
+              hit = true;
+              set = oneSet;
+            }
           }
 
-          if (hit2) {
-            selectedValue = val2.template slc<LINE_SIZE * 8>(TAG_SIZE);
-            tag           = tag2;
-            set           = 1;
+          // SC only writes a line it holds with its reservation
+          if (atomic && atomicOp == RISCV_ATOMIC_SC && opType == STORE && !(hit && reserved && reservedLine == line)) {
+            reserved        = false;
+            atomicContended = true;
+            dataOut         = 1;
+            waitOut         = false;
+            backgroundCycle();
+            return;
           }
 
-          if (hit3) {
-            selectedValue = val3.template slc<LINE_SIZE * 8>(TAG_SIZE);
-            tag           = tag3;
-            set           = 2;
+          // A miss waits for the end of the prefetch: once its first word has paid the latency of the next level,
+          // the rest of the line comes in a burst. The write buffer only has to finish the word being written.
+          if (!hit && (prefetching || draining)) {
+            waitOut = true;
+            backgroundCycle();
+            return;
           }
 
-          if (hit4) {
-            selectedValue = val4.template slc<LINE_SIZE * 8>(TAG_SIZE);
-            tag           = tag4;
-            set           = 3;
-          }
+          const bool newRequest = mask != LONG || opType != lastOpType || line != lastLine;
+          lastLine              = line;
+          lastOpType            = opType;
+          if (newRequest)
+            numberAccess++;
+
+          ac_int<LINE_SIZE * 8, false> bufferedLine = 0;
+          fromWriteBuffer = !hit && writeBufferCount != 0 && writeBufferTake(line, bufferedLine);
+          fromPrefetch    = !hit && !fromWriteBuffer && prefetcher.type != NO_PREFETCH && prefetcher.take(line, bufferedLine);
+          if (newRequest && prefetcher.type != NO_PREFETCH)
+            prefetcher.train(this->requestPc, addr, !hit && !fromPrefetch);
+
+          ac_int<LINE_SIZE * 8, false> selectedValue = val[set].template slc<LINE_SIZE * 8>(TAG_SIZE);
 
           ac_int<8, true> signedByte;
           ac_int<16, true> signedHalf;
@@ -197,24 +969,39 @@ public:
 
             // First we handle the store
             if (opType == STORE) {
+              ac_int<INTERFACE_SIZE * 8, false> storedValue = dataIn;
+              if (atomic) {
+                // The word read is given back when the store is written
+                const ac_int<32, false> word = selectedValue.template slc<32>(4 * 8 * offset);
+                storedValue  = atomicValue(atomicOp.to_uint(), word.to_uint(), dataIn.template slc<32>(0).to_uint());
+                dataOutStore = atomicOp == RISCV_ATOMIC_SC ? (ac_int<32, false>)0 : word;
+                reserved     = false;
+              }
               switch (mask) {
                 case BYTE:
                 case BYTE_U:
                   localValStore.set_slc((((int)addr.slc<2>(0)) << 3) + TAG_SIZE + 4 * 8 * offset,
-                                        dataIn.template slc<8>(0));
+                                        storedValue.template slc<8>(0));
                   break;
                 case HALF:
                 case HALF_U:
-                  localValStore.set_slc((addr[1] ? 16 : 0) + TAG_SIZE + 4 * 8 * offset, dataIn.template slc<16>(0));
+                  localValStore.set_slc((addr[1] ? 16 : 0) + TAG_SIZE + 4 * 8 * offset,
+                                        storedValue.template slc<16>(0));
                   break;
                 case WORD:
-                  localValStore.set_slc(TAG_SIZE + 4 * 8 * offset, dataIn.template slc<32>(0));
+                  localValStore.set_slc(TAG_SIZE + 4 * 8 * offset, storedValue.template slc<32>(0));
                   break;
                 case LONG:
-                  localValStore.set_slc(TAG_SIZE + 4 * 8 * offset, dataIn);
+                  localValStore.set_slc(TAG_SIZE + 4 * 8 * offset, storedValue);
                   break;
               }
 
+#ifndef __HLS__
+              if (bus && sharedBit[place][set]) {
+                const bool held = upgrade((unsigned int)line << LOG_LINE_SIZE);
+                atomicContended = atomicContended || (atomic && held);
+              }
+#endif
               placeStore = place;
               setStore   = set;
               valStore   = localValStore;
@@ -248,40 +1035,98 @@ public:
               }
 
               // printf("Hit read %x at %x\n", (unsigned int)dataOut.slc<32>(0), (unsigned int)addr);
+
+              if (atomic) {
+                reserved     = true;
+                reservedLine = line;
+              }
+
+              // Upper levels fill their lines from the last word down to the first one: once it has been read,
+              // the line has moved up
+              if (inclusion == EXCLUSIVE && mask == LONG && offset == 0) {
+                dataValid[place][set] = 0;
+                dirtyBit[place][set]  = 0;
+              }
             }
-            // age[place][set] = cycle;
+            policy.touch(place, set);
 
-          } else {
-            numberMiss++;
+          } else if (fromPrefetch || fromWriteBuffer) {
+            // The line is moved from the prefetch or the write buffer as if it had been read from the next level
+            if (newRequest && fromWriteBuffer)
+              numberMiss++;
+            newVal.set_slc(TAG_SIZE, bufferedLine);
             cacheState = STATE_CACHE_MISS;
+          } else {
+            if (newRequest)
+              numberMiss++;
+
+            if (inclusion == EXCLUSIVE && opType == LOAD) {
+              // Exclusive caches are only filled with the victims of the upper level
+              bypass          = true;
+              nextLevelAddr   = addr;
+              nextLevelOpType = LOAD;
+            } else {
+              // An upper level evicting a line to an exclusive cache writes all of it
+              fetchLine  = !(inclusion == EXCLUSIVE && mask == LONG);
+              cacheState = STATE_CACHE_MISS;
+            }
           }
         } else {
           // printf("Miss %d\n", (unsigned int)cacheState);
 
           if (cacheState == STATE_CACHE_MISS) {
-            newVal  = tag;
-            setMiss = (age1 < age2 && age1 < age3 && age1 < age4)
-                          ? 0
-                          : ((age2 < age1 && age2 < age3 && age2 < age4)
-                                 ? 1
-                                 : ((age3 < age2 && age3 < age1 && age3 < age4) ? 2 : 3));
-            oldVal = (age1 < age2 && age1 < age3 && age1 < age4)
-                         ? val1
-                         : ((age2 < age1 && age2 < age3 && age2 < age4)
-                                ? val2
-                                : ((age3 < age2 && age3 < age1 && age3 < age4) ? val3 : val4));
-            isValid = (age1 < age2 && age1 < age3 && age1 < age4)
-                          ? valid1
-                          : ((age2 < age1 && age2 < age3 && age2 < age4)
-                                 ? valid2
-                                 : ((age3 < age2 && age3 < age1 && age3 < age4) ? valid3 : valid4));
-            isDirty = (age1 < age2 && age1 < age3 && age1 < age4)
-                          ? dirty1
-                          : ((age2 < age1 && age2 < age3 && age2 < age4)
-                                 ? dirty2
-                                 : ((age3 < age2 && age3 < age1 && age3 < age4) ? dirty3 : dirty4));
-            if(isDirty == 0){
-             cacheState = STATE_CACHE_LAST_STORE - 1;
+            if (fromPrefetch || fromWriteBuffer)
+              newVal.set_slc(0, tag);
+            else
+              newVal = tag;
+            // Invalid lines are filled first, the policy only chooses among valid ones
+            bool hasInvalid = false;
+            for (int oneSet = ASSOCIATIVITY - 1; oneSet >= 0; oneSet--) {
+              if (!valid[oneSet]) {
+                hasInvalid = true;
+                setMiss    = oneSet;
+              }
+            }
+            if (!hasInvalid)
+              setMiss = policy.victim(place);
+
+            oldVal  = val[setMiss];
+            isValid = valid[setMiss];
+            isDirty = dirty[setMiss];
+            if (isValid && reserved &&
+                reservedLine == ((((int)oldVal.template slc<TAG_SIZE>(0)) << LOG_SET_SIZE) | (int)place))
+              reserved = false;
+
+#ifndef __HLS__
+            // Inclusion is kept by removing the victim from the upper levels, their dirty data being written back
+            if (inclusion == INCLUSIVE && isValid) {
+              const unsigned int victimAddr =
+                  ((unsigned int)oldVal.template slc<TAG_SIZE>(0) << (LOG_LINE_SIZE + LOG_SET_SIZE)) |
+                  ((unsigned int)place << LOG_LINE_SIZE);
+              unsigned char line[LINE_SIZE];
+              for (unsigned int i = 0; i < LINE_SIZE; i++)
+                line[i] = oldVal.template slc<8>(TAG_SIZE + 8 * i).to_uint();
+              bool upperDirty = false;
+              for (auto upper : upperLevels)
+                upperDirty |= upper->invalidateBlock(victimAddr, line, LINE_SIZE);
+              if (upperDirty) {
+                for (unsigned int i = 0; i < LINE_SIZE; i++)
+                  oldVal.set_slc(TAG_SIZE + 8 * i, (ac_int<8, false>)line[i]);
+                isDirty = true;
+              }
+            }
+#endif
+
+            if (isValid && (isDirty || writeBackClean)) {
+              numberWriteBack++;
+              if (writeBufferCount < writeBufferEntries) {
+                const ac_int<32 - LOG_LINE_SIZE, false> victimLine =
+                    (((int)oldVal.template slc<TAG_SIZE>(0)) << LOG_SET_SIZE) | (int)place;
+                writeBufferPush(victimLine, oldVal.template slc<LINE_SIZE * 8>(TAG_SIZE));
+                cacheState = STATE_CACHE_LAST_STORE - 1;
+              }
+            } else {
+              cacheState = STATE_CACHE_LAST_STORE - 1;
             }
             // printf("TAG is %x\n", oldVal.slc<TAG_SIZE>(0));
           }
@@ -300,6 +1145,11 @@ public:
             // printf("Writing back %x %x at %x\n", (unsigned int)nextLevelDataIn.slc<32>(0),
             //        (unsigned int)nextLevelDataIn.slc<32>(32), (unsigned int)nextLevelAddr);
 
+          } else if (cacheState >= STATE_CACHE_LAST_LOAD && (!fetchLine || fromPrefetch || fromWriteBuffer)) {
+            // The line is about to be entirely written, or comes from the prefetch or the write buffer: it is not
+            // read from the next level
+            cacheState      = STATE_CACHE_LAST_LOAD;
+            nextLevelOpType = NONE;
           } else if (cacheState >= STATE_CACHE_LAST_LOAD) {
             // Then we read values from next memory level
             if (cacheState != STATE_CACHE_FIRST_LOAD) {
@@ -318,22 +1168,45 @@ public:
           cacheState--;
 
           if (cacheState == 1) {
-            valDirty = 0;
+#ifndef __HLS__
+            // The line is requested on the coherence bus once it has been read: the data of a modified copy
+            // replaces the one of the memory. Without it, the line is read again, the memory having been written
+            // meanwhile when another cache took a modified copy or wrote it back (the words read would be stale,
+            // and an atomic instruction would lose the update of another core).
+            if (bus) {
+              unsigned char line[LINE_SIZE];
+              bool dirty;
+              const unsigned int lineAddr = addr.to_uint() & ~(LINE_SIZE - 1);
+              const bool held = bus->request(this, lineAddr, opType == STORE ? BUS_READ_EXCLUSIVE : BUS_READ, line, dirty);
+              valShared       = held && opType != STORE;
+              atomicContended = atomicContended || (atomic && held);
+              if (!dirty)
+                nextLevel->readBlock(lineAddr, line, LINE_SIZE);
+              for (unsigned int i = 0; i < LINE_SIZE; i++)
+                newVal.set_slc(TAG_SIZE + 8 * i, (ac_int<8, false>)line[i]);
+            }
+#endif
+            valDirty = fromWriteBuffer;
+            const ac_int<32, false> loadedWord = newVal.template slc<32>(4 * 8 * offset + TAG_SIZE);
             if (opType == STORE) {
+              ac_int<INTERFACE_SIZE * 8, false> storedValue = dataIn;
+              if (atomic)
+                storedValue = atomicValue(atomicOp.to_uint(), loadedWord.to_uint(), dataIn.template slc<32>(0).to_uint());
               switch (mask) {
                 case BYTE:
                 case BYTE_U:
-                  newVal.set_slc((((int)addr.slc<2>(0)) << 3) + TAG_SIZE + 4 * 8 * offset, dataIn.template slc<8>(0));
+                  newVal.set_slc((((int)addr.slc<2>(0)) << 3) + TAG_SIZE + 4 * 8 * offset,
+                                 storedValue.template slc<8>(0));
                   break;
                 case HALF:
                 case HALF_U:
-                  newVal.set_slc((addr[1] ? 16 : 0) + TAG_SIZE + 4 * 8 * offset, dataIn.template slc<16>(0));
+                  newVal.set_slc((addr[1] ? 16 : 0) + TAG_SIZE + 4 * 8 * offset, storedValue.template slc<16>(0));
                   break;
                 case WORD:
-                  newVal.set_slc(TAG_SIZE + 4 * 8 * offset, dataIn.template slc<32>(0));
+                  newVal.set_slc(TAG_SIZE + 4 * 8 * offset, storedValue.template slc<32>(0));
                   break;
                 case LONG:
-                  newVal.set_slc(TAG_SIZE + 4 * 8 * offset, dataIn);
+                  newVal.set_slc(TAG_SIZE + 4 * 8 * offset, storedValue);
                   break;
               }
               valDirty = 1;
@@ -343,9 +1216,6 @@ public:
             setStore   = setMiss;
             valStore   = newVal;
 
-            // cacheMemory[place][setMiss] = newVal;
-            // dataValid[place][setMiss] = 1;
-            // age[place][setMiss] = cycle;
             nextLevelOpType = NONE;
 
             ac_int<8, true> signedByte;
@@ -373,19 +1243,40 @@ public:
                 dataOut = newVal.template slc<16>((addr[1] ? 16 : 0) + 4 * 8 * offset + TAG_SIZE) & 0xffff;
                 break;
               case LONG:
-                dataOut = newVal.template slc<INTERFACE_SIZE * 8>(4 * 8 * offset);
+                dataOut = newVal.template slc<INTERFACE_SIZE * 8>(4 * 8 * offset + TAG_SIZE);
                 break;
             }
             // printf("After Miss read %x at %x\n", (unsigned int)dataOut.slc<32>(0), (unsigned int)addr);
 
             dataOutStore = dataOut;
+            if (atomic && opType == STORE) {
+              dataOutStore = atomicOp == RISCV_ATOMIC_SC ? (ac_int<32, false>)0 : loadedWord;
+            } else if (atomic) {
+              reserved     = true;
+              reservedLine = addr.slc<32 - LOG_LINE_SIZE>(LOG_LINE_SIZE);
+            }
           }
         }
       }
     }
 
-    this->nextLevel->process(nextLevelAddr, LONG, nextLevelOpType, nextLevelDataIn, nextLevelDataOut, nextLevelWaitOut);
-    waitOut = nextLevelWaitOut || cacheState || wasStore;
+    // The write buffer and the prefetches use the cycles in which the next level is not used by the cache itself
+    if (cacheState == 0 && !bypass && !nextLevelWaitOut)
+      backgroundIssue();
+
+    // While the state machine is frozen (no request from the upper level), the next level stays idle
+    const bool background        = prefetching || draining;
+    const memOpType issuedOpType = (opType == NONE && !nextLevelWaitOut && !background) ? NONE : nextLevelOpType;
+    this->nextLevel->process(nextLevelAddr, LONG, issuedOpType, nextLevelDataIn, nextLevelDataOut, nextLevelWaitOut);
+    const bool backgroundWaits = background && nextLevelWaitOut;
+    backgroundResponse();
+
+    if (bypass && !nextLevelWaitOut) {
+      dataOut         = nextLevelDataOut;
+      bypass          = false;
+      nextLevelOpType = NONE;
+    }
+    waitOut = (nextLevelWaitOut && !backgroundWaits) || cacheState || wasStore || bypass;
   }
 };
 
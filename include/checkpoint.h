@@ -0,0 +1,53 @@
+/** Copyright 2021 INRIA, Université de Rennes 1 and ENS Rennes
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#ifndef __CHECKPOINT_H__
+#define __CHECKPOINT_H__
+
+#include <cstdio>
+#include <string>
+
+#include "integerTypes.h"
+
+struct Core;
+
+/******************************************************************************************
+ * Binary checkpoints of the simulation state
+ *
+ * The same serialization code is used to save and to restore: every component exposes a
+ * serialize(Checkpoint&) function calling transfer() on its state, which writes the values
+ * when saving and overwrites them when loading.
+ *
+ * Components are raw-copied, a checkpoint can only be restored by the binary which created
+ * it (the header records a version and the size of Core to catch mismatches).
+ * ****************************************************************************************
+ */
+class Checkpoint {
+  FILE* file;
+  bool loading;
+
+public:
+  Checkpoint(const char* fileName, bool load);
+  ~Checkpoint();
+
+  bool isLoading() const { return loading; }
+
+  void transfer(void* data, size_t size);
+  void transfer(std::string& value);
+  template <class T> void transfer(T& value) { transfer(&value, sizeof(T)); }
+};
+
+// Architectural and micro-architectural state of the core, including the memory interfaces
+void serialize(Checkpoint& cp, struct Core& core);
+
+#endif // __CHECKPOINT_H__
@@ -0,0 +1,61 @@
+/** Copyright 2021 INRIA, Université de Rennes 1 and ENS Rennes
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#ifndef __COHERENCE_BUS_H__
+#define __COHERENCE_BUS_H__
+
+#include <mutex>
+#include <vector>
+
+#include "memoryInterface.h"
+
+/******************************************************************************************
+ * Snooping bus between the private L1 data caches of the cores (MESI)
+ *
+ * The state of a line is given by its valid, dirty and shared bits: invalid, shared (clean
+ * and maybe held by other caches), exclusive (clean and only held by this cache) or
+ * modified (dirty, only held by this cache). A cache puts a request on the bus when a miss
+ * gets its line (a read, or a read-exclusive for a store) and when a store hits a shared
+ * line (an upgrade): the other caches snoop it (see MemoryInterface::snoop). A modified
+ * line is given to the requester (intervention) and written back on a read, the copies
+ * are invalidated by the other requests. A line read while another cache holds it is
+ * shared, else it is exclusive and a store to it does not use the bus.
+ *
+ * The caches of the cores simulated on different host threads are only accessed with the
+ * lock of the bus held, a snoop changing the content of another cache.
+ * ****************************************************************************************
+ */
+template <unsigned int INTERFACE_SIZE> class CoherenceBus {
+public:
+  std::vector<MemoryInterface<INTERFACE_SIZE>*> caches;
+  std::mutex lock;
+
+  // Request of the cache from for the line at lineAddr, returns true if another cache holds it. The data of a
+  // modified line is copied in line (dirty is then set).
+  bool request(MemoryInterface<INTERFACE_SIZE>* from, const unsigned int lineAddr, const busRequest request,
+               unsigned char* line, bool& dirty)
+  {
+    bool shared = false;
+    dirty       = false;
+    for (auto cache : caches) {
+      if (cache == from)
+        continue;
+      bool lineDirty = false;
+      shared |= cache->snoop(lineAddr, request, line, lineDirty);
+      dirty |= lineDirty;
+    }
+    return shared;
+  }
+};
+
+#endif // __COHERENCE_BUS_H__
@@ -14,14 +14,16 @@
 #ifndef __CORE_H__
 #define __CORE_H__
 
-#include "ac_int.h"
+#include "integerTypes.h"
 #include "riscvISA.h"
 
 // all the possible memories
 #include "branchPredictor.h"
+#include "branchTargetBuffer.h"
 #include "cacheMemory.h"
 #include "memoryInterface.h"
 #include "pipelineRegisters.h"
+#include "returnAddressStack.h"
 
 #ifndef MEMORY_INTERFACE
 #define MEMORY_INTERFACE SimpleMemory
@@ -33,6 +35,63 @@
  */
 enum StallNames { STALL_FETCH = 0, STALL_DECODE = 1, STALL_EXECUTE = 2, STALL_MEMORY = 3, STALL_WRITEBACK = 4 };
 
+/******************************************************************************************
+ * Multiplier and divider of the M extension
+ *  - SINGLE_CYCLE_UNIT: the result is given by execute, like the other operations
+ *  - PIPELINED_UNIT: the unit spans execute and memory, its result is forwarded like the
+ *    one of a load
+ *  - RADIX2_UNIT, RADIX4_UNIT: iterative unit computing 1 or 2 bits per cycle, the
+ *    instruction stays in execute for 32 or 16 cycles and stalls the ones behind it
+ * ****************************************************************************************
+ */
+enum mulDivUnitType { SINGLE_CYCLE_UNIT = 0, PIPELINED_UNIT, RADIX2_UNIT, RADIX4_UNIT };
+
+/******************************************************************************************
+ * Components of the CPI stack
+ *
+ * Every cycle is given at commit to one component: the instruction retired by writeback, the
+ * memory the pipeline waits for, or the cause of the bubble found in writeback. A bubble gets
+ * its cause from the stage which inserted it and carries it down the pipeline.
+ * ****************************************************************************************
+ */
+enum cpiComponent {
+  CPI_RETIRED = 0,
+  CPI_ICACHE,   // the pipeline waits for the instruction cache
+  CPI_DCACHE,   // the pipeline waits for the data cache, or decode for a deferred load or before a FENCE
+  CPI_LOAD_USE, // decode waits for the result of a load or of a long instruction in execute (forwardUnit)
+  CPI_MULDIV,   // an iterative multiplier or divider holds execute
+  CPI_BRANCH,   // instructions squashed when decode or execute redirect fetch, second access of fetch after a jump
+  CPI_SYSCALL,  // a system instruction waits in decode for the outstanding misses
+  CPI_OTHER,    // pipeline filling after a start or a flush, global stall
+  CPI_COMPONENTS
+};
+
+/******************************************************************************************
+ * Counters of the CSR file (Zicsr and Zicntr)
+ *
+ * cycle, time (the same count) and instret, and the hardware performance counters 3 to 10
+ * which count the events below, mhpmevent3 to mhpmevent10 reading as their index. The
+ * other counters read as 0. A write to a machine counter sets its value, the count then
+ * going on from it.
+ * ****************************************************************************************
+ */
+#define CSR_COUNTERS 11
+enum hpmEvent {
+  HPM_L1I_MISSES = 3,
+  HPM_L1D_MISSES,
+  HPM_BRANCHES,
+  HPM_MISPREDICTIONS,
+  HPM_LOAD_USE_CYCLES, // cycles of the components of the CPI stack
+  HPM_ICACHE_CYCLES,
+  HPM_DCACHE_CYCLES,
+  HPM_BRANCH_CYCLES
+};
+
+struct MulDivConfig {
+  mulDivUnitType multiplier;
+  mulDivUnitType divider;
+};
+
 // This is ugly but otherwise with have a dependency : alu.h includes core.h
 // (for pipeline regs) and core.h includes alu.h...
 
@@ -42,9 +101,23 @@ struct Core {
   ExtoMem extoMem;
   MemtoWB memtoWB;
 
-  // Interface size are configured with 4 bytes interface size (32 bits)
-  MemoryInterface<4>*dm, *im;
+#if ISSUE_WIDTH == 2
+  // Second way of the dual-issue pipeline, holding the younger instruction of each pair. Both ways move together:
+  // a stage holds a pair, a single instruction in its first way, or a bubble.
+  FtoDC ftoDC1;
+  DCtoEx dctoEx1;
+  ExtoMem extoMem1;
+  MemtoWB memtoWB1;
+  unsigned long numberPairs;  // pairs issued by decode
+  unsigned int fetchLineSize; // line size of the instruction interface, 0 without a cache
+#endif
+
+  // The data interface is 4 bytes wide (32 bits), fetch reads one word per way
+  MemoryInterface<4>* dm;
+  MemoryInterface<FETCH_INTERFACE_SIZE>* im;
   BranchPredictor bp;
+  BranchTargetBuffer<BTB_ENTRIES, BTB_TAG_BITS> btb;
+  ReturnAddressStack<RAS_ENTRIES> ras;
 
   ac_int<32, true> regFile[32];
   ac_int<32, false> pc;
@@ -52,7 +125,32 @@ struct Core {
   // stall
   bool stallSignals[5] = {0, 0, 0, 0, 0};
   bool stallIm, stallDm;
+  ac_int<32, false> pendingLoads = 0;     // registers waiting for a load deferred by the data cache
+  bool lockupFree                = false; // the data cache has MSHRs, doCycle then tracks the deferred loads
+  bool directMemory              = false; // no caches, im and dm are MainMemory
+  ac_int<16 * ISSUE_WIDTH, false> fetchBuffer = 0; // realignment buffer of fetch: upper half of the last block read
+  ac_int<32, false> fetchBufferPC             = 0; // pc of the first half held in fetchBuffer
+  mulDivUnitType multiplier = SINGLE_CYCLE_UNIT, divider = SINGLE_CYCLE_UNIT;
+  ac_int<5, false> mulDivCycles = 0; // cycles spent in execute by the instruction using an iterative unit
   unsigned long cycle;
+  unsigned long instret; // instructions retired, by the pipeline or by the functional engine
+
+  // Atomic instructions made by the memory stage and the cycles they spent in it, indexed by contention (another
+  // core held the word, or the SC failed)
+  unsigned long numberAtomic[2], atomicCycles[2];
+  unsigned long numberFailedSC;
+  unsigned long atomicWait; // cycles spent so far by the atomic instruction in the memory stage
+
+  // Cycles of each component of the CPI stack and instructions retired by the pipeline (instret also counts the ones
+  // of the functional engines), cause of the bubble held by ftoDC, dctoEx, extoMem and memtoWB (indexed by the stage
+  // writing the register, see StallNames)
+  unsigned long cpiStack[CPI_COMPONENTS];
+  unsigned long cpiInstructions;
+  unsigned char bubbleCause[4];
+
+  // CSR file: value written to each counter minus its count at that time, and mscratch
+  unsigned long csrOffset[CSR_COUNTERS];
+  ac_int<32, false> mscratch;
   /// Multicycle operation
 
   /// Instruction cache
@@ -66,4 +164,30 @@ struct Core {
 
 void doCycle(struct Core& core, bool globalStall);
 
+// Accesses to the CSR file made by the CSR instructions, the unknown CSRs reading as 0 and ignoring writes. retiring
+// is the number of instructions retiring in the same cycle, ahead of the CSR instruction.
+ac_int<32, false> readCsr(const struct Core& core, const ac_int<12, false> csr, const unsigned int retiring);
+void writeCsr(struct Core& core, const ac_int<12, false> csr, const ac_int<32, false> value,
+              const unsigned int retiring);
+// Count of the events of a counter of the CSR file, before its offset
+unsigned long counterEvents(const struct Core& core, const int counter, const unsigned int retiring);
+
+#ifndef __HLS__
+// Completes the loads deferred by the data cache, commits the instruction waiting for writeback and an atomic
+// instruction in the memory stage, drops the younger ones and sets the pc to the oldest dropped instruction. Used to
+// leave the pipelined model for the functional one.
+void flushPipeline(struct Core& core);
+
+// Functional warming: effect on the caches and the predictors of the instructions run by a functional engine.
+// warmFetch is given the bytes of instructions fetched in sequence, warmData a load or a store, warmBranch a
+// conditional branch with its outcome and warmJump a JAL or a JALR (only the opcode, rd and rs1 of instruction are
+// used, to find calls and returns).
+void warmFetch(struct Core& core, const unsigned int start, const unsigned int end);
+void warmData(struct Core& core, const unsigned int addr, const bool isStore);
+void warmBranch(struct Core& core, const unsigned int pc, const unsigned int nextPC, const unsigned int target,
+                const bool taken);
+void warmJump(struct Core& core, const unsigned int pc, const unsigned int nextPC, const unsigned int target,
+              const unsigned int instruction);
+#endif
+
 #endif // __CORE_H__
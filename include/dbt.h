@@ -0,0 +1,115 @@
+/** Copyright 2021 INRIA, Université de Rennes 1 and ENS Rennes
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#ifndef __DBT_H__
+#define __DBT_H__
+
+#include <map>
+#include <unordered_map>
+#include <vector>
+
+#include "core.h"
+#include "iss.h"
+
+/******************************************************************************************
+ * Dynamic binary translation engine
+ *
+ * BinaryTranslator has the interface and the semantics of FunctionalCore (see iss.h), but
+ * translates the basic blocks of the program to x86-64 code when they are first reached.
+ * A block ends at a branch or a jump, before a system instruction, or after
+ * DBT_BLOCK_INSTRUCTIONS instructions. Blocks are kept in a code cache and chained: the exit
+ * of a block jumping to a known pc is patched into a direct jump to the block there, and
+ * JALR looks its target up in a table from the translated code.
+ *
+ * System instructions, and the last instructions before the limit given to run() when a
+ * whole block would go past it, are handed to the interpreter.
+ *
+ * Translated code is tracked by 64-byte granules of the guest memory: a store into a granule
+ * holding translated code leaves the block, and the code cache is flushed when the store
+ * overwrote a translated instruction. As for FunctionalCore, writes made from outside
+ * (syscalls) must be followed by a call to flush().
+ *
+ * Translation needs an x86-64 host, the interpreter runs the whole program on the others.
+ * ****************************************************************************************
+ */
+
+#ifndef DBT_CODE_CACHE_SIZE
+#define DBT_CODE_CACHE_SIZE (1 << 25) // bytes of host code, the cache is flushed when it is full
+#endif
+#define DBT_BLOCK_INSTRUCTIONS 64
+
+// Instructions executed in each basic block, by pc of its first instruction
+typedef std::map<unsigned int, unsigned long> BasicBlockVector;
+
+// State shared with the translated code, which keeps its address in rbx
+struct TranslatorContext {
+  unsigned int reg[33]; // reg[32] is the sink for writes to x0
+  unsigned int pc;      // pc reached when the translated code returns
+  unsigned int written; // address of the store into translated code which made it return, or DBT_NO_WRITE
+  unsigned long count;  // instructions retired
+  unsigned long limit;
+  unsigned char* memory;
+  unsigned char* codeGranules; // one word per 64-byte granule of the guest memory, a bit per halfword of code
+  void* lookup;                // table of the blocks searched by JALR
+  struct Core* core;           // warmed by the translated code
+};
+
+class BinaryTranslator {
+  // Translated block, without code when its first instruction is left to the interpreter
+  struct Block {
+    unsigned char* code;
+    unsigned int length;        // instructions
+    unsigned int end;           // pc following the last instruction
+    unsigned long instructions; // executed since the last collectProfile(), when profiling
+  };
+
+  FunctionalCore& interpreter;
+  TranslatorContext context;
+
+  unsigned char* codeCache;
+  unsigned char* codeEnd;
+  unsigned char* enter; // calls the translated code at the given address with the context
+
+  std::unordered_map<unsigned int, Block> blocks;
+  std::unordered_multimap<unsigned int, unsigned char*> pendingExits; // exits to a pc without code yet
+  std::vector<unsigned int> markedGranules; // granules not 0, cleared by flush()
+  BasicBlockVector flushedProfile;          // counts of the blocks dropped by flush()
+
+  Block& findBlock(const unsigned int pc);
+  void translate(const unsigned int pc, Block& block);
+  void markCode(const unsigned int start, const unsigned int end);
+  void chain(const unsigned int pc, unsigned char* code);
+  bool overlapsCode(const unsigned int addr);
+
+public:
+  BinaryTranslator(FunctionalCore& iss);
+  ~BinaryTranslator();
+
+  // Same contract as FunctionalCore::run
+  bool run(struct Core& core, unsigned char* memory, unsigned long& instret, const unsigned long limit);
+  void flush();
+
+  // Blocks count the instructions they execute when they are translated with profiling set (followed by a flush)
+  bool profiling = false;
+  // Moves the counts gathered since the last call to bbv
+  void collectProfile(BasicBlockVector& bbv);
+
+  // Blocks translated with warming set (followed by a flush) call the functional warming functions of core.h for
+  // their fetch, memory accesses, branches and jumps. Instructions run by the interpreter are not seen.
+  bool warming = false;
+
+  // Stats
+  unsigned long numberTranslated, numberFlush;
+};
+
+#endif // __DBT_H__
@@ -0,0 +1,244 @@
+/** Copyright 2021 INRIA, Université de Rennes 1 and ENS Rennes
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#ifndef __DECOMPRESSOR_H__
+#define __DECOMPRESSOR_H__
+
+#include "integerTypes.h"
+#include "riscvISA.h"
+
+/******************************************************************************************
+ * Decompressor of the C extension
+ *
+ * Each 16-bit instruction of RV32C is expanded to the 32-bit instruction it stands for, so
+ * that decode and the functional engine only handle the base encodings. The floating-point
+ * loads and stores, the RV64 forms and the reserved encodings give 0, an illegal
+ * instruction which is dropped like the other unknown opcodes.
+ * ****************************************************************************************
+ */
+
+inline ac_int<32, false> encodeI(const ac_int<12, false> imm, const ac_int<5, false> rs1,
+                                 const ac_int<3, false> funct3, const ac_int<5, false> rd,
+                                 const ac_int<7, false> opCode)
+{
+  ac_int<32, false> instruction = 0;
+  instruction.set_slc(20, imm);
+  instruction.set_slc(15, rs1);
+  instruction.set_slc(12, funct3);
+  instruction.set_slc(7, rd);
+  instruction.set_slc(0, opCode);
+  return instruction;
+}
+
+inline ac_int<32, false> encodeR(const ac_int<7, false> funct7, const ac_int<5, false> rs2,
+                                 const ac_int<5, false> rs1, const ac_int<3, false> funct3,
+                                 const ac_int<5, false> rd)
+{
+  ac_int<12, false> upper = 0;
+  upper.set_slc(5, funct7);
+  upper.set_slc(0, rs2);
+  return encodeI(upper, rs1, funct3, rd, RISCV_OP);
+}
+
+inline ac_int<32, false> encodeS(const ac_int<12, false> imm, const ac_int<5, false> rs2,
+                                 const ac_int<5, false> rs1, const ac_int<3, false> funct3,
+                                 const ac_int<7, false> opCode)
+{
+  ac_int<32, false> instruction = 0;
+  instruction.set_slc(25, imm.slc<7>(5));
+  instruction.set_slc(20, rs2);
+  instruction.set_slc(15, rs1);
+  instruction.set_slc(12, funct3);
+  instruction.set_slc(7, imm.slc<5>(0));
+  instruction.set_slc(0, opCode);
+  return instruction;
+}
+
+inline ac_int<32, false> encodeB(const ac_int<13, false> imm, const ac_int<5, false> rs1,
+                                 const ac_int<3, false> funct3)
+{
+  ac_int<32, false> instruction = 0;
+  instruction[31] = imm[12];
+  instruction.set_slc(25, imm.slc<6>(5));
+  instruction.set_slc(15, rs1);
+  instruction.set_slc(12, funct3);
+  instruction.set_slc(8, imm.slc<4>(1));
+  instruction[7] = imm[11];
+  instruction.set_slc(0, (ac_int<7, false>)RISCV_BR);
+  return instruction;
+}
+
+inline ac_int<32, false> encodeJ(const ac_int<21, false> imm, const ac_int<5, false> rd)
+{
+  ac_int<32, false> instruction = 0;
+  instruction[31] = imm[20];
+  instruction.set_slc(21, imm.slc<10>(1));
+  instruction[20] = imm[11];
+  instruction.set_slc(12, imm.slc<8>(12));
+  instruction.set_slc(7, rd);
+  instruction.set_slc(0, (ac_int<7, false>)RISCV_JAL);
+  return instruction;
+}
+
+inline ac_int<32, false> decompress(const ac_int<16, false> instruction)
+{
+  const ac_int<3, false> funct3 = instruction.slc<3>(13);
+  const ac_int<5, false> rd     = instruction.slc<5>(7); // also rs1
+  const ac_int<5, false> rs2    = instruction.slc<5>(2);
+  ac_int<5, false> rdShort      = 8; // rd' and rs1', x8 to x15
+  rdShort.set_slc(0, instruction.slc<3>(7));
+  ac_int<5, false> rs2Short = 8; // rd' of quadrant 0 and rs2'
+  rs2Short.set_slc(0, instruction.slc<3>(2));
+
+  // 6-bit signed immediate of C.ADDI, C.LI, C.ANDI and the shift amounts
+  ac_int<12, false> imm6 = 0;
+  imm6.set_slc(0, instruction.slc<5>(2));
+  for (int bit = 5; bit < 12; bit++)
+    imm6[bit] = instruction[12];
+
+  // Word offsets of C.LW and C.SW
+  ac_int<12, false> offsetLw = 0;
+  offsetLw.set_slc(3, instruction.slc<3>(10));
+  offsetLw[2] = instruction[6];
+  offsetLw[6] = instruction[5];
+
+  // Jump offset of C.J and C.JAL
+  ac_int<21, false> offsetJ = 0;
+  offsetJ.set_slc(1, instruction.slc<3>(3));
+  offsetJ[4] = instruction[11];
+  offsetJ[5] = instruction[2];
+  offsetJ[6] = instruction[7];
+  offsetJ[7] = instruction[6];
+  offsetJ.set_slc(8, instruction.slc<2>(9));
+  offsetJ[10] = instruction[8];
+  for (int bit = 11; bit < 21; bit++)
+    offsetJ[bit] = instruction[12];
+
+  // Branch offset of C.BEQZ and C.BNEZ
+  ac_int<13, false> offsetB = 0;
+  offsetB.set_slc(1, instruction.slc<2>(3));
+  offsetB.set_slc(3, instruction.slc<2>(10));
+  offsetB[5] = instruction[2];
+  offsetB.set_slc(6, instruction.slc<2>(5));
+  for (int bit = 8; bit < 13; bit++)
+    offsetB[bit] = instruction[12];
+
+  switch (instruction.slc<2>(0)) {
+    case 0:
+      if (funct3 == 0) { // C.ADDI4SPN
+        ac_int<12, false> imm = 0;
+        imm.set_slc(4, instruction.slc<2>(11));
+        imm.set_slc(6, instruction.slc<4>(7));
+        imm[2] = instruction[6];
+        imm[3] = instruction[5];
+        return imm == 0 ? (ac_int<32, false>)0 : encodeI(imm, 2, RISCV_OPI_ADDI, rs2Short, RISCV_OPI);
+      }
+      if (funct3 == 2) // C.LW
+        return encodeI(offsetLw, rdShort, RISCV_LD_LW, rs2Short, RISCV_LD);
+      if (funct3 == 6) // C.SW
+        return encodeS(offsetLw, rs2Short, rdShort, RISCV_ST_STW, RISCV_ST);
+      return 0;
+
+    case 1:
+      switch (funct3) {
+        case 0: // C.ADDI
+          return encodeI(imm6, rd, RISCV_OPI_ADDI, rd, RISCV_OPI);
+        case 1: // C.JAL
+          return encodeJ(offsetJ, 1);
+        case 2: // C.LI
+          return encodeI(imm6, 0, RISCV_OPI_ADDI, rd, RISCV_OPI);
+        case 3:
+          if (rd == 2) { // C.ADDI16SP
+            ac_int<12, false> imm = 0;
+            imm[4] = instruction[6];
+            imm[5] = instruction[2];
+            imm[6] = instruction[5];
+            imm.set_slc(7, instruction.slc<2>(3));
+            for (int bit = 9; bit < 12; bit++)
+              imm[bit] = instruction[12];
+            return encodeI(imm, 2, RISCV_OPI_ADDI, 2, RISCV_OPI);
+          } else { // C.LUI
+            ac_int<32, false> lui = 0;
+            lui.set_slc(12, instruction.slc<5>(2));
+            for (int bit = 17; bit < 32; bit++)
+              lui[bit] = instruction[12];
+            lui.set_slc(7, rd);
+            lui.set_slc(0, (ac_int<7, false>)RISCV_LUI);
+            return lui;
+          }
+        case 4:
+          switch (instruction.slc<2>(10)) {
+            case 0: // C.SRLI
+              return encodeI(imm6.slc<5>(0), rdShort, RISCV_OPI_SRI, rdShort, RISCV_OPI);
+            case 1: { // C.SRAI
+              ac_int<12, false> imm = imm6.slc<5>(0);
+              imm.set_slc(5, (ac_int<7, false>)RISCV_OPI_SRI_SRAI);
+              return encodeI(imm, rdShort, RISCV_OPI_SRI, rdShort, RISCV_OPI);
+            }
+            case 2: // C.ANDI
+              return encodeI(imm6, rdShort, RISCV_OPI_ANDI, rdShort, RISCV_OPI);
+            default:
+              if (instruction[12]) // SUBW and ADDW of RV64C
+                return 0;
+              switch (instruction.slc<2>(5)) {
+                case 0: // C.SUB
+                  return encodeR(RISCV_OP_ADD_SUB, rs2Short, rdShort, RISCV_OP_ADD, rdShort);
+                case 1: // C.XOR
+                  return encodeR(0, rs2Short, rdShort, RISCV_OP_XOR, rdShort);
+                case 2: // C.OR
+                  return encodeR(0, rs2Short, rdShort, RISCV_OP_OR, rdShort);
+                default: // C.AND
+                  return encodeR(0, rs2Short, rdShort, RISCV_OP_AND, rdShort);
+              }
+          }
+        case 5: // C.J
+          return encodeJ(offsetJ, 0);
+        case 6: // C.BEQZ
+          return encodeB(offsetB, rdShort, RISCV_BR_BEQ);
+        default: // C.BNEZ
+          return encodeB(offsetB, rdShort, RISCV_BR_BNE);
+      }
+
+    case 2:
+      if (funct3 == 0) // C.SLLI
+        return encodeI(imm6.slc<5>(0), rd, RISCV_OPI_SLLI, rd, RISCV_OPI);
+      if (funct3 == 2) { // C.LWSP
+        ac_int<12, false> offset = 0;
+        offset.set_slc(2, instruction.slc<3>(4));
+        offset[5] = instruction[12];
+        offset.set_slc(6, instruction.slc<2>(2));
+        return encodeI(offset, 2, RISCV_LD_LW, rd, RISCV_LD);
+      }
+      if (funct3 == 6) { // C.SWSP
+        ac_int<12, false> offset = 0;
+        offset.set_slc(2, instruction.slc<4>(9));
+        offset.set_slc(6, instruction.slc<2>(7));
+        return encodeS(offset, rs2, 2, RISCV_ST_STW, RISCV_ST);
+      }
+      if (funct3 == 4) {
+        if (!instruction[12])
+          return rs2 == 0 ? encodeI(0, rd, 0, 0, RISCV_JALR)       // C.JR
+                          : encodeR(0, rs2, 0, RISCV_OP_ADD, rd); // C.MV
+        if (rd == 0 && rs2 == 0) // C.EBREAK
+          return encodeI(RISCV_SYSTEM_ENV_EBREAK, 0, RISCV_SYSTEM_ENV, 0, RISCV_SYSTEM);
+        return rs2 == 0 ? encodeI(0, rd, 0, 1, RISCV_JALR)        // C.JALR
+                        : encodeR(0, rs2, rd, RISCV_OP_ADD, rd); // C.ADD
+      }
+      return 0;
+
+    default: // not a compressed instruction
+      return 0;
+  }
+}
+
+#endif // __DECOMPRESSOR_H__
@@ -24,7 +24,9 @@
 
 static constexpr uint8_t ELF_MAGIC[] = {ELFMAG0, ELFMAG1, ELFMAG2, ELFMAG3};
 
+static constexpr size_t E_PHOFF     = 0x1C;
 static constexpr size_t E_SHOFF     = 0x20;
+static constexpr size_t E_PHNUM     = 0x2C;
 static constexpr size_t E_SHENTSIZE = 0x2E;
 static constexpr size_t E_SHNUM     = 0x30;
 static constexpr size_t E_SHSTRNDX  = 0x32;
@@ -69,6 +71,17 @@ struct ElfSection {
   template <typename ElfShdr> ElfSection(const ElfShdr);
 };
 
+// Loadable segment, from the program header table
+struct ElfSegment {
+  unsigned int type;
+  unsigned int offset;
+  unsigned int address;
+  unsigned int fileSize;
+  unsigned int memorySize;
+
+  template <typename ElfPhdrT> ElfSegment(const ElfPhdrT);
+};
+
 struct ElfSymbol {
   unsigned int nameIndex;
   unsigned int type;
@@ -85,6 +98,7 @@ struct ElfSymbol {
 class ElfFile {
 public:
   std::vector<ElfSection> sectionTable;
+  std::vector<ElfSegment> segmentTable;
   std::vector<ElfSymbol> symbols;
   std::vector<uint8_t> content;
 
@@ -94,6 +108,7 @@ public:
 private:
   template <typename ElfSymT> void readSymbolTable();
   template <typename ElfShdrT> void fillSectionTable();
+  template <typename ElfPhdrT> void fillSegmentTable();
 
   void fillNameTable();
   void fillSymbolsName();
@@ -122,6 +137,17 @@ template <typename ElfShdrT> void ElfFile::fillSectionTable()
     sectionTable.push_back(ElfSection(rawSections[i]));
 }
 
+template <typename ElfPhdrT> void ElfFile::fillSegmentTable()
+{
+  const auto tableOffset  = little_endian<4>(&content[E_PHOFF]);
+  const auto tableSize    = little_endian<2>(&content[E_PHNUM]);
+  const auto* rawSegments = reinterpret_cast<ElfPhdrT*>(&content[tableOffset]);
+
+  segmentTable.reserve(tableSize);
+  for (int i = 0; i < tableSize; i++)
+    segmentTable.push_back(ElfSegment(rawSegments[i]));
+}
+
 template <typename ElfShdrT> ElfSection::ElfSection(const ElfShdrT header)
 {
   offset    = (header.sh_offset);
@@ -132,6 +158,15 @@ template <typename ElfShdrT> ElfSection::ElfSection(const ElfShdrT header)
   info      = (header.sh_info);
 }
 
+template <typename ElfPhdrT> ElfSegment::ElfSegment(const ElfPhdrT header)
+{
+  type       = header.p_type;
+  offset     = header.p_offset;
+  address    = header.p_vaddr;
+  fileSize   = header.p_filesz;
+  memorySize = header.p_memsz;
+}
+
 template <typename ElfSymT> ElfSymbol::ElfSymbol(const ElfSymT sym)
 {
   offset    = sym.st_value;
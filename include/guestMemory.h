@@ -0,0 +1,69 @@
+/** Copyright 2021 INRIA, Université de Rennes 1 and ENS Rennes
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#ifndef __GUEST_MEMORY_H__
+#define __GUEST_MEMORY_H__
+
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+#include "checkpoint.h"
+
+#define GUEST_MEMORY_DEFAULT_SIZE ((size_t)1 << 26) // 64 MiB
+#define GUEST_MEMORY_MAX_SIZE ((size_t)1 << 32)     // the whole RV32 address space
+#define GUEST_PAGE_SIZE 4096
+
+/******************************************************************************************
+ * Simulated DRAM
+ *
+ * The memory is an anonymous private mapping reserved without swap (MAP_NORESERVE): host
+ * pages are only allocated, and zero-filled, when the program first touches them, so the
+ * size can go up to the full 4 GiB address space at no cost.
+ *
+ * Loadable ELF segments can also be mapped copy-on-write from the binary instead of being
+ * copied: the pages of the program are then shared by every simulator running it.
+ *
+ * One extra page is mapped after the memory, so that a word access at the last address
+ * never goes out of the mapping.
+ * ****************************************************************************************
+ */
+class GuestMemory {
+  unsigned char* data;
+  size_t size;
+
+  // Page ranges mapped from a file, mincore() reports them as resident only when the file is in the page cache
+  std::vector<std::pair<unsigned int, unsigned int> > fileMappings;
+
+  void mapAnonymous(unsigned char* start, const size_t length);
+
+public:
+  GuestMemory(const size_t size);
+  ~GuestMemory();
+
+  unsigned char* base() const { return data; }
+  size_t getSize() const { return size; }
+
+  // Copies length bytes from a host buffer
+  void load(const unsigned int addr, const void* src, const size_t length);
+  // Maps fileSize bytes of the file at fileOffset to addr, the rest of memorySize being zero.
+  // Falls back to a copy when the file offset and the address are not congruent modulo the page size.
+  void mapFile(const char* fileName, const unsigned int fileOffset, const unsigned int addr,
+               const unsigned int fileSize, const unsigned int memorySize);
+
+  // Pages never touched by the program are skipped when saving, and the memory is cleared
+  // before restoring
+  void serialize(Checkpoint& cp);
+};
+
+#endif // __GUEST_MEMORY_H__
@@ -0,0 +1,30 @@
+/** Copyright 2021 INRIA, Université de Rennes 1 and ENS Rennes
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#ifndef __INTEGER_TYPES_H__
+#define __INTEGER_TYPES_H__
+
+/************************************************************************
+ * 	Integer types of the core. Synthesis uses the ac_int of the HLS
+ * 	tools; the simulator uses by default the same interface over native
+ * 	integers (nativeInt.h), which is faster. Building the simulator
+ * 	with -DSIMULATE_AC_INT brings back ac_int, to check that both give
+ * 	the same results.
+ ************************************************************************/
+#if defined(__HLS__) || defined(SIMULATE_AC_INT)
+#include "ac_int.h"
+#else
+#include "nativeInt.h"
+#endif
+
+#endif // __INTEGER_TYPES_H__
@@ -0,0 +1,147 @@
+/** Copyright 2021 INRIA, Université de Rennes 1 and ENS Rennes
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#ifndef __ISS_H__
+#define __ISS_H__
+
+#include <vector>
+
+#include "core.h"
+
+/******************************************************************************************
+ * Instruction-accurate execution engine
+ *
+ * FunctionalCore executes the program on the architectural state of the core (regFile and
+ * pc) without modeling the pipeline: pipeline registers, forwarding and stalls are not
+ * touched. Memory is accessed directly in the backing store, bypassing core.im and core.dm.
+ *
+ * Instructions are decoded once (compressed ones are expanded to the base encoding first)
+ * into blocks, which run up to the first control transfer and are found through a
+ * direct-mapped table indexed by the pc of their first instruction: the instructions of a
+ * block follow each other without looking up the table, each one jumping to the code of
+ * the next one when the compiler supports it, and the instruction count is checked against
+ * the limit once per block. A store made by the program into decoded instructions flushes
+ * the blocks; writes made from outside (syscalls) must be followed by a call to flush().
+ * ****************************************************************************************
+ */
+
+enum IssOperation {
+  ISS_NOP = 0,
+  ISS_LUI,
+  ISS_AUIPC,
+  ISS_JAL,
+  ISS_JALR,
+  ISS_BEQ,
+  ISS_BNE,
+  ISS_BLT,
+  ISS_BGE,
+  ISS_BLTU,
+  ISS_BGEU,
+  ISS_LB,
+  ISS_LH,
+  ISS_LW,
+  ISS_LBU,
+  ISS_LHU,
+  ISS_SB,
+  ISS_SH,
+  ISS_SW,
+  ISS_ADDI,
+  ISS_SLTI,
+  ISS_SLTIU,
+  ISS_XORI,
+  ISS_ORI,
+  ISS_ANDI,
+  ISS_SLLI,
+  ISS_SRLI,
+  ISS_SRAI,
+  ISS_ADD,
+  ISS_SUB,
+  ISS_SLL,
+  ISS_SLT,
+  ISS_SLTU,
+  ISS_XOR,
+  ISS_SRL,
+  ISS_SRA,
+  ISS_OR,
+  ISS_AND,
+  ISS_MUL,
+  ISS_MULH,
+  ISS_MULHSU,
+  ISS_MULHU,
+  ISS_DIV,
+  ISS_DIVU,
+  ISS_REM,
+  ISS_REMU,
+  ISS_ATOMIC, // LR, SC and the AMOs, imm holds funct5
+  ISS_CSR,    // imm holds the CSR number and funct3 (bits 0 to 2), rs1 the register or the immediate operand
+  ISS_ECALL,
+  ISS_SYSTEM, // other system instructions
+  ISS_END     // after the last instruction of a block, whose execution goes on at its pc
+};
+
+struct DecodedInstruction {
+  unsigned int pc;
+  unsigned char op;
+  unsigned char rd;
+  unsigned char rs1;
+  unsigned char rs2;
+  unsigned char size; // 2 for the instructions of the C extension
+  int imm;
+};
+
+class FunctionalCore {
+  static const int LOG_BLOCK_ENTRIES  = 16;
+  static const int BLOCK_ENTRIES      = 1 << LOG_BLOCK_ENTRIES;
+  static const int BLOCK_INSTRUCTIONS = 64;
+  static const int CODE_ENTRIES       = 1 << 18; // decoded instructions, the blocks are flushed when it is full
+
+  struct Block {
+    unsigned int pc;         // tag
+    unsigned int generation; // the entry is empty unless it is the current one
+    unsigned int first;      // index of the first instruction in code, followed by an ISS_END
+    unsigned int length;     // instructions, the ISS_END excluded
+  };
+
+  // Both tables are only touched where they are used, flush() starting a new generation of blocks
+  Block* blocks;
+  unsigned int generation;
+  DecodedInstruction* code;
+  unsigned int codeEnd;
+  // Copy of the instructions of a block run up to the limit, ending with an ISS_END
+  DecodedInstruction truncated[BLOCK_INSTRUCTIONS + 1];
+
+  // One word per 64-byte granule of the memory, a bit per halfword holding a decoded instruction
+  unsigned int* codeGranules;
+  std::vector<unsigned int> markedGranules; // granules not 0, cleared by flush()
+
+  // Word reserved by the last LR, ISS_INVALID_PC when there is none
+  unsigned int reservation;
+
+  Block& decodeBlock(const unsigned char* memory, const unsigned int pc);
+  void markCode(const unsigned int start, const unsigned int end);
+  bool overlapsCode(const unsigned int addr, const unsigned int halfwords);
+
+public:
+  FunctionalCore();
+  ~FunctionalCore();
+
+  // Decodes the instruction (its first half when it is compressed) found at pc
+  static void decode(const unsigned int pc, unsigned int instruction, DecodedInstruction& d);
+
+  // Executes instructions until an ECALL is reached (pc then points to it and true is returned)
+  // or until instret reaches limit (false is returned). Syscalls are left to the simulator.
+  bool run(struct Core& core, unsigned char* memory, unsigned long& instret, const unsigned long limit);
+  void flush();
+};
+
+#endif // __ISS_H__
@@ -0,0 +1,173 @@
+/** Copyright 2021 INRIA, Université de Rennes 1 and ENS Rennes
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#ifndef __MAIN_MEMORY_H__
+#define __MAIN_MEMORY_H__
+
+#include <cstring>
+
+#include "memoryInterface.h"
+
+/******************************************************************************************
+ * Simulation-only main memory
+ *
+ * Same behavior as SimpleMemory (no latency, HALF accesses ignore addr[0], WORD accesses
+ * ignore addr[1:0]) but the backing store is a contiguous little-endian byte array
+ * accessed with native integers, so that block transfers are plain memcpy. A fixed access
+ * latency can be set to model the DRAM behind a cache hierarchy.
+ *
+ * The memories of the cores of a multi-core simulation without caches share the same
+ * array: atomic instructions use the atomic operations of the host on it. SC succeeds when
+ * the word still holds the value read by LR.
+ * ****************************************************************************************
+ */
+template <unsigned int INTERFACE_SIZE> class MainMemory final : public MemoryInterface<INTERFACE_SIZE> {
+public:
+  unsigned char* data;
+  AccessLatency<INTERFACE_SIZE> accessLatency;
+
+  // Reservation of LR
+  bool reserved;
+  unsigned int reservedAddr, reservedValue;
+
+  MainMemory(unsigned char* arg) : reserved(false), reservedAddr(0), reservedValue(0) { data = arg; }
+
+  void process(const ac_int<32, false> addr, const memMask mask, const memOpType opType,
+               const ac_int<INTERFACE_SIZE * 8, false> dataIn, ac_int<INTERFACE_SIZE * 8, false>& dataOut,
+               bool& waitOut)
+  {
+    if (opType != NONE && accessLatency.stall(addr)) {
+      waitOut = true;
+      return;
+    }
+
+    const unsigned int address = addr.to_uint();
+    unsigned char* word        = data + (address & ~3);
+    unsigned int value;
+
+    switch (opType) {
+      case STORE:
+        switch (mask) {
+          case BYTE_U:
+          case BYTE:
+            word[address & 3] = dataIn.template slc<8>(0).to_uint();
+            break;
+          case HALF:
+          case HALF_U:
+            value = dataIn.template slc<16>(0).to_uint();
+            memcpy(word + (address & 2), &value, 2);
+            break;
+          case WORD:
+            value = dataIn.template slc<32>(0).to_uint();
+            memcpy(word, &value, 4);
+            break;
+          case LONG:
+            for (unsigned int oneWord = 0; oneWord < INTERFACE_SIZE / 4; oneWord++) {
+              value = dataIn.template slc<32>(32 * oneWord).to_uint();
+              memcpy(word + 4 * oneWord, &value, 4);
+            }
+            break;
+        }
+        break;
+      case LOAD:
+        switch (mask) {
+          case BYTE:
+            dataOut = (int)(signed char)word[address & 3];
+            break;
+          case HALF:
+            dataOut = (int)(short)(word[address & 2] | (word[(address & 2) + 1] << 8));
+            break;
+          case WORD:
+            memcpy(&value, word, 4);
+            dataOut = value;
+            break;
+          case LONG:
+            for (unsigned int oneWord = 0; oneWord < INTERFACE_SIZE / 4; oneWord++) {
+              memcpy(&value, word + 4 * oneWord, 4);
+              dataOut.set_slc(32 * oneWord, (ac_int<32, false>)value);
+            }
+            break;
+          case BYTE_U:
+            dataOut = word[address & 3];
+            break;
+          case HALF_U:
+            dataOut = word[address & 2] | (word[(address & 2) + 1] << 8);
+            break;
+        }
+        break;
+
+      default: // case NONE
+        break;
+    }
+    waitOut = false;
+  }
+
+  void processAtomic(const ac_int<32, false> addr, const ac_int<5, false> op,
+                     const ac_int<INTERFACE_SIZE * 8, false> dataIn, const bool active,
+                     ac_int<INTERFACE_SIZE * 8, false>& dataOut, bool& waitOut, bool& contended)
+  {
+    contended = false;
+    waitOut   = false;
+    if (!active)
+      return;
+    if (accessLatency.stall(addr)) {
+      waitOut = true;
+      return;
+    }
+
+    const unsigned int address = addr.to_uint() & ~3;
+    unsigned int* word         = (unsigned int*)(data + address);
+    const unsigned int operand = dataIn.template slc<32>(0).to_uint();
+    unsigned int value         = __atomic_load_n(word, __ATOMIC_SEQ_CST);
+    if (op == RISCV_ATOMIC_LR) {
+      reserved      = true;
+      reservedAddr  = address;
+      reservedValue = value;
+      dataOut       = value;
+    } else if (op == RISCV_ATOMIC_SC) {
+      value              = reservedValue;
+      const bool success = reserved && reservedAddr == address &&
+                           __atomic_compare_exchange_n(word, &value, operand, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+      reserved  = false;
+      contended = !success;
+      dataOut   = success ? 0 : 1;
+    } else {
+      // value is updated with the current content of the word when another core wrote it in the meantime
+      while (!__atomic_compare_exchange_n(word, &value, atomicValue(op.to_uint(), value, operand), false,
+                                          __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST))
+        contended = true;
+      dataOut = value;
+    }
+  }
+
+  void serialize(Checkpoint& cp)
+  {
+    cp.transfer(this->wait);
+    cp.transfer(accessLatency);
+    cp.transfer(reserved);
+    cp.transfer(reservedAddr);
+    cp.transfer(reservedValue);
+  }
+
+  void readBlock(const unsigned int addr, unsigned char* dst, const unsigned int size)
+  {
+    memcpy(dst, data + addr, size);
+  }
+
+  void writeBlock(const unsigned int addr, const unsigned char* src, const unsigned int size)
+  {
+    memcpy(data + addr, src, size);
+  }
+};
+
+#endif // __MAIN_MEMORY_H__
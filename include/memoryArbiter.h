@@ -0,0 +1,123 @@
+/** Copyright 2021 INRIA, Université de Rennes 1 and ENS Rennes
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#ifndef __MEMORY_ARBITER_H__
+#define __MEMORY_ARBITER_H__
+
+#include "memoryInterface.h"
+
+/******************************************************************************************
+ * Arbiter sharing one memory level between several requesters (e.g. the L1 instruction
+ * and data caches in front of a unified L2)
+ *
+ * Each requester is connected to one of the ports. A port owns the shared level from the
+ * start of an access until it goes idle (NONE), so that the words of a line transfer are
+ * not interleaved with other accesses; accesses from the other ports wait meanwhile. Idle
+ * ports do not reach the shared level.
+ * ****************************************************************************************
+ */
+template <unsigned int INTERFACE_SIZE, int PORTS> class MemoryArbiter {
+public:
+  class Port : public MemoryInterface<INTERFACE_SIZE> {
+  public:
+    MemoryArbiter* arbiter;
+    int id;
+
+    void process(const ac_int<32, false> addr, const memMask mask, const memOpType opType,
+                 const ac_int<INTERFACE_SIZE * 8, false> dataIn, ac_int<INTERFACE_SIZE * 8, false>& dataOut,
+                 bool& waitOut)
+    {
+      arbiter->process(id, addr, mask, opType, dataIn, dataOut, waitOut);
+    }
+
+#ifndef __HLS__
+    // The shared level is saved once, through the first port
+    void serialize(Checkpoint& cp)
+    {
+      if (id == 0)
+        arbiter->serialize(cp);
+    }
+
+    void readBlock(const unsigned int addr, unsigned char* dst, const unsigned int size)
+    {
+      arbiter->shared->readBlock(addr, dst, size);
+    }
+
+    void writeBlock(const unsigned int addr, const unsigned char* src, const unsigned int size)
+    {
+      arbiter->shared->writeBlock(addr, src, size);
+    }
+
+    bool invalidateBlock(const unsigned int addr, unsigned char* data, const unsigned int size)
+    {
+      return arbiter->shared->invalidateBlock(addr, data, size);
+    }
+
+    void flushAll() { arbiter->shared->flushAll(); }
+
+    void warm(const unsigned int addr, const unsigned int size, const bool isStore)
+    {
+      arbiter->shared->warm(addr, size, isStore);
+    }
+#endif
+  };
+
+  MemoryInterface<INTERFACE_SIZE>* shared;
+  Port ports[PORTS];
+  int owner; // port holding the shared level, -1 when it is free
+
+  // Stats
+  unsigned long conflictCycles;
+
+  MemoryArbiter(MemoryInterface<INTERFACE_SIZE>* sharedLevel)
+  {
+    shared = sharedLevel;
+    for (int onePort = 0; onePort < PORTS; onePort++) {
+      ports[onePort].arbiter = this;
+      ports[onePort].id      = onePort;
+    }
+    owner          = -1;
+    conflictCycles = 0;
+  }
+
+  void process(const int port, const ac_int<32, false> addr, const memMask mask, const memOpType opType,
+               const ac_int<INTERFACE_SIZE * 8, false> dataIn, ac_int<INTERFACE_SIZE * 8, false>& dataOut,
+               bool& waitOut)
+  {
+    if (owner != -1 && owner != port) {
+      waitOut = opType != NONE;
+      if (waitOut)
+        conflictCycles++;
+      return;
+    }
+    if (opType == NONE) {
+      waitOut = false;
+      owner   = -1;
+      return;
+    }
+
+    shared->process(addr, mask, opType, dataIn, dataOut, waitOut);
+    owner = port;
+  }
+
+#ifndef __HLS__
+  void serialize(Checkpoint& cp)
+  {
+    cp.transfer(owner);
+    cp.transfer(conflictCycles);
+    shared->serialize(cp);
+  }
+#endif
+};
+
+#endif // __MEMORY_ARBITER_H__
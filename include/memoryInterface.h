@@ -16,19 +16,167 @@
 #ifndef __MEMORY_INTERFACE_H__
 #define __MEMORY_INTERFACE_H__
 
-#include "ac_int.h"
+#include "integerTypes.h"
+#include "riscvISA.h"
+
+#ifndef __HLS__
+#include "checkpoint.h"
+#endif
 
 typedef enum { BYTE = 0, HALF, WORD, BYTE_U, HALF_U, LONG } memMask;
 
 typedef enum { NONE = 0, LOAD, STORE } memOpType;
 
+// Requests of the coherence bus between private caches (see coherenceBus.h)
+typedef enum { BUS_READ = 0, BUS_READ_EXCLUSIVE, BUS_UPGRADE } busRequest;
+
+/************************************************************************
+ * 	Issue width of the pipeline, chosen at build time: 1 for the scalar
+ * 	core, 2 for the dual-issue one (-DISSUE_WIDTH=2). Fetch reads one
+ * 	word per instruction issued, through an instruction interface of
+ * 	FETCH_INTERFACE_SIZE bytes.
+ ************************************************************************/
+#ifndef ISSUE_WIDTH
+#define ISSUE_WIDTH 1
+#endif
+#if ISSUE_WIDTH != 1 && ISSUE_WIDTH != 2
+#error "ISSUE_WIDTH must be 1 or 2"
+#endif
+#define FETCH_INTERFACE_SIZE (4 * ISSUE_WIDTH)
+
+// Fixed access latency of a memory level. It is charged once per burst: an access to the interface word right
+// before or after the previous one (line transfers between cache levels) does not pay it again.
+template <unsigned int INTERFACE_SIZE> class AccessLatency {
+public:
+  unsigned int latency;
+  unsigned int remaining;
+  bool pending;
+  ac_int<32, false> lastAddr;
+
+  AccessLatency() : latency(0), remaining(0), pending(false), lastAddr(0) {}
+
+  // Called when an access starts, returns true while it has to wait
+  bool stall(const ac_int<32, false> addr)
+  {
+    if (latency == 0) // bursts do not matter either
+      return false;
+    if (!pending) {
+      const bool burst = (addr == lastAddr + INTERFACE_SIZE) || (addr + INTERFACE_SIZE == lastAddr);
+      remaining        = burst ? 0 : latency;
+      pending          = true;
+    }
+    if (remaining > 0) {
+      remaining--;
+      return true;
+    }
+    pending  = false;
+    lastAddr = addr;
+    return false;
+  }
+};
+
 template <unsigned int INTERFACE_SIZE> class MemoryInterface {
 protected:
   bool wait;
+  ac_int<32, false> requestPc;
 
 public:
+  virtual ~MemoryInterface() {}
+
   virtual void process(const ac_int<32, false> addr, const memMask mask, const memOpType opType, const ac_int<INTERFACE_SIZE * 8, false> dataIn,
                        ac_int<INTERFACE_SIZE * 8, false>& dataOut, bool& waitOut) = 0;
+
+  // Lockup-free interfaces (see nonBlockingCacheMemory.h). With processNonBlocking, a load which misses can be
+  // accepted without its value (deferred is set): the value is returned later by completeLoad, with the tag the
+  // load was issued with. isDrained is false while misses are outstanding.
+  // Other interfaces handle every access as a regular one.
+  virtual void processNonBlocking(const ac_int<32, false> addr, const memMask mask, const memOpType opType,
+                                  const ac_int<INTERFACE_SIZE * 8, false> dataIn, const ac_int<5, false> tag,
+                                  ac_int<INTERFACE_SIZE * 8, false>& dataOut, bool& waitOut, bool& deferred)
+  {
+    deferred = false;
+    process(addr, mask, opType, dataIn, dataOut, waitOut);
+  }
+  virtual bool completeLoad(ac_int<5, false>& tag, ac_int<INTERFACE_SIZE * 8, false>& value) { return false; }
+  virtual bool isDrained() { return true; }
+
+  // Atomic instructions of the A extension, op being their funct5. The word at addr is read and written in a
+  // single access: LR reads it and reserves it, SC writes dataIn if the reservation is still held (dataOut is then
+  // 0, else 1) and an AMO writes atomicValue(op, word, dataIn), dataOut being the word read. The access is only made
+  // while active is set, the cycles in which it is not are idle ones. contended is set when the word was held by
+  // another core or the SC failed.
+  // The default version is for interfaces without latency nor other requesters, SC always succeeds.
+  virtual void processAtomic(const ac_int<32, false> addr, const ac_int<5, false> op,
+                             const ac_int<INTERFACE_SIZE * 8, false> dataIn, const bool active,
+                             ac_int<INTERFACE_SIZE * 8, false>& dataOut, bool& waitOut, bool& contended)
+  {
+    contended = false;
+    process(addr, WORD, active ? LOAD : NONE, 0, dataOut, waitOut);
+    if (!active || op == RISCV_ATOMIC_LR)
+      return;
+    const ac_int<32, false> word = dataOut.template slc<32>(0);
+    process(addr, WORD, STORE, atomicValue(op.to_uint(), word.to_uint(), dataIn.template slc<32>(0).to_uint()), dataOut,
+            waitOut);
+    dataOut = op == RISCV_ATOMIC_SC ? (ac_int<32, false>)0 : word;
+  }
+
+  // Pc of the instruction making the next access, for the prefetchers which track instructions. It is set every
+  // cycle, hence not virtual.
+  void hintPc(const ac_int<32, false> pc) { requestPc = pc; }
+
+#ifndef __HLS__
+  // Saves or restores the internal state of the interface (the memory content is handled by the simulator)
+  virtual void serialize(Checkpoint& cp) { cp.transfer(wait); }
+
+  // Cache hierarchy management, no-ops for interfaces which do not hold data.
+  // invalidateBlock drops the lines overlapping [addr, addr + size) (back-invalidation from an inclusive lower
+  // level): their dirty bytes are copied in data and true is returned if there were any.
+  // flushAll writes back every dirty line to the next level and empties the caches.
+  virtual bool invalidateBlock(const unsigned int addr, unsigned char* data, const unsigned int size) { return false; }
+  virtual void flushAll() {}
+
+  // Misses of the interface, counted by the performance counters of the core (none for the memories)
+  virtual unsigned long missCount() { return 0; }
+
+  // Coherence: request of another cache on the bus for the line at lineAddr. The data of a modified copy is copied
+  // in line (dirty is then set), and the copy is invalidated unless the request is a read. Returns true if the
+  // interface held the line.
+  virtual bool snoop(const unsigned int lineAddr, const busRequest request, unsigned char* line, bool& dirty)
+  {
+    dirty = false;
+    return false;
+  }
+
+  // Functional warming: applies the effect of an access to [addr, addr + size) on the tags and the replacement
+  // state of the caches in a single call, without timing, stats nor data (see CacheHierarchy::loadLines)
+  virtual void warm(const unsigned int addr, const unsigned int size, const bool isStore) {}
+
+  // Bulk copies between the host and the simulated memory, made in zero simulated time by the simulator
+  // (e.g. syscall emulation). They must only be used while the interface is idle (waitOut was false).
+  // The default versions go through process() one byte at a time.
+  virtual void readBlock(const unsigned int addr, unsigned char* dst, const unsigned int size)
+  {
+    ac_int<INTERFACE_SIZE * 8, false> value = 0;
+    bool waitOut                            = true;
+    for (unsigned int i = 0; i < size; i++) {
+      do {
+        process(addr + i, BYTE_U, LOAD, 0, value, waitOut);
+      } while (waitOut);
+      dst[i] = value.template slc<8>(0).to_uint();
+    }
+  }
+
+  virtual void writeBlock(const unsigned int addr, const unsigned char* src, const unsigned int size)
+  {
+    ac_int<INTERFACE_SIZE * 8, false> value = 0;
+    bool waitOut                            = true;
+    for (unsigned int i = 0; i < size; i++) {
+      do {
+        process(addr + i, BYTE, STORE, src[i], value, waitOut);
+      } while (waitOut);
+    }
+  }
+#endif
 };
 
 template <unsigned int INTERFACE_SIZE> class IncompleteMemory : public MemoryInterface<INTERFACE_SIZE> {
@@ -40,17 +188,30 @@ public:
   void process(const ac_int<32, false> addr, const memMask mask, const memOpType opType, const ac_int<INTERFACE_SIZE * 8, false> dataIn,
                ac_int<INTERFACE_SIZE * 8, false>& dataOut, bool& waitOut)
   {
-    // Incomplete memory only works for 32 bits
-    assert(INTERFACE_SIZE == 4);
-
+    // Incomplete memory only handles whole interface words
     // no latency, wait is always set to false
     waitOut = false;
-    if (opType == STORE) {
-      data[(addr >> 2) & 0xffffff] = dataIn;
-    } else if (opType == LOAD) {
-      dataOut = data[(addr >> 2) & 0xffffff];
+    for (unsigned int oneWord = 0; oneWord < INTERFACE_SIZE / 4; oneWord++) {
+      if (opType == STORE)
+        data[((addr >> 2) + oneWord) & 0xffffff] = dataIn.template slc<32>(32 * oneWord);
+      else if (opType == LOAD)
+        dataOut.set_slc(32 * oneWord, data[((addr >> 2) + oneWord) & 0xffffff]);
     }
   }
+
+#ifndef __HLS__
+  void readBlock(const unsigned int addr, unsigned char* dst, const unsigned int size)
+  {
+    for (unsigned int i = 0; i < size; i++)
+      dst[i] = data[((addr + i) >> 2) & 0xffffff].template slc<8>(((addr + i) & 3) << 3).to_uint();
+  }
+
+  void writeBlock(const unsigned int addr, const unsigned char* src, const unsigned int size)
+  {
+    for (unsigned int i = 0; i < size; i++)
+      data[((addr + i) >> 2) & 0xffffff].set_slc(((addr + i) & 3) << 3, (ac_int<8, false>)src[i]);
+  }
+#endif
 };
 
 template <unsigned int INTERFACE_SIZE> class SimpleMemory : public MemoryInterface<INTERFACE_SIZE> {
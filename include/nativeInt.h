@@ -0,0 +1,647 @@
+/** Copyright 2021 INRIA, Université de Rennes 1 and ENS Rennes
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#ifndef __NATIVE_INT_H__
+#define __NATIVE_INT_H__
+
+#include <assert.h>
+#include <iostream>
+#include <limits>
+#include <math.h>
+#include <ostream>
+#include <string>
+
+/******************************************************************************************
+ * Native integers of the simulator
+ *
+ * Replacement of ac_int<W, S> (see ac_int.h) used when the core is compiled as a simulator
+ * rather than synthesized, see integerTypes.h. It has the interface the sources use and the
+ * same bit-accurate semantics: values wrap around on W bits, operators give results of the
+ * widths ac_int gives, slc, set_slc and bit selections read and write the same bits.
+ *
+ * Values of up to 64 bits are held in a native unsigned integer of 32 or 64 bits, always
+ * normalized (sign-extended for the signed types), so that operations are a few machine
+ * instructions instead of the generic multi-word code of ac_int. Values of up to 128 bits
+ * use the 128-bit integers of the compiler. Wider ones, the cache lines, are plain arrays
+ * of 64-bit words, which support slices, bit selections, shifts and comparisons only.
+ * ****************************************************************************************
+ */
+template <int W, bool S> class ac_int;
+
+namespace native_int {
+
+typedef long long Slong;
+typedef unsigned long long Ulong;
+typedef __int128 Sxlong;
+typedef unsigned __int128 Uxlong;
+
+template <bool C, class T, class F> struct select {
+  typedef T t;
+};
+template <class T, class F> struct select<false, T, F> {
+  typedef F t;
+};
+
+template <int A, int B> struct max2 {
+  enum { v = A > B ? A : B };
+};
+template <int A, int B> struct min2 {
+  enum { v = A < B ? A : B };
+};
+
+// Storage of a value of W bits (up to 128), and the signed type in which values of W bits are computed
+template <int W> struct word {
+  typedef typename select<(W <= 32), unsigned, typename select<(W <= 64), Ulong, Uxlong>::t>::t t;
+};
+template <int W> struct calc {
+  typedef typename select<(W <= 64), Slong, Sxlong>::t t;
+};
+
+template <bool B> struct tag {};
+
+// Values of up to 128 bits
+template <int W, bool S> class small_base {
+public:
+  typedef typename word<W>::t word_t;
+  typedef typename select<(sizeof(word_t) == 4), int, typename calc<W>::t>::t sword_t;
+  typedef typename calc<W + !S>::t value_t; // holds every value of the type
+  static const int BITS = sizeof(word_t) * 8;
+
+  word_t v;
+
+  static word_t wrap(const word_t raw)
+  {
+    if (W == BITS)
+      return raw;
+    if (S)
+      return (word_t)((sword_t)(raw << (BITS - W) % BITS) >> (BITS - W) % BITS);
+    return raw & (((word_t)1 << W % BITS) - 1);
+  }
+  static word_t ones(const int n) { return n >= BITS ? ~(word_t)0 : ((word_t)1 << n) - 1; }
+
+  template <class T> T get() const { return S ? (T)(sword_t)v : (T)v; }
+  value_t value() const { return get<value_t>(); }
+
+  void setSigned(const Slong x) { v = wrap((word_t)x); }
+  void setUnsigned(const Ulong x) { v = wrap((word_t)x); }
+  Ulong low() const { return (Ulong)value(); }
+
+  // 64-bit chunks of the value, sign-extended beyond W bits
+  Ulong chunk(const int i) const
+  {
+    const Sxlong x = get<Sxlong>();
+    return i == 0 ? (Ulong)x : i == 1 ? (Ulong)(x >> 64) : (Ulong)(x >> 127);
+  }
+  void setChunk(const int i, const Ulong c)
+  {
+    Uxlong x = (Uxlong)v;
+    if (i == 0)
+      x = ((x >> 64) << 64) | c;
+    else if (i == 1)
+      x = (x & ~(Ulong)0) | ((Uxlong)c << 64);
+    v = (word_t)x;
+  }
+  void normalize() { v = wrap(v); }
+
+  bool bit(const unsigned i) const { return (v >> i) & 1; }
+  void setBit(const unsigned i, const bool b) { v = wrap((v & ~((word_t)1 << i)) | ((word_t)b << i)); }
+  bool isZero() const { return v == 0; }
+};
+
+// Values of up to 64 bits convert to the C integers, as ac_int does
+template <int W, bool S, int KIND> class base : public small_base<W, S> {};
+
+template <int W, bool S> class base<W, S, 0> : public small_base<W, S> {
+public:
+  operator typename select<S, Slong, Ulong>::t() const
+  {
+    return this->template get<typename select<S, Slong, Ulong>::t>();
+  }
+};
+
+// Values of more than 128 bits
+template <int W, bool S> class base<W, S, 2> {
+public:
+  static const int N = (W + 63) / 64;
+
+  Ulong w[N];
+
+  Ulong fill() const { return S ? (Ulong)((Slong)w[N - 1] >> 63) : 0; }
+  Ulong low() const { return w[0]; }
+  Ulong chunk(const int i) const { return i < N ? w[i] : fill(); }
+  void setChunk(const int i, const Ulong c)
+  {
+    if (i < N)
+      w[i] = c;
+  }
+  void normalize()
+  {
+    const int rem = W & 63;
+    if (rem && S)
+      w[N - 1] = (Ulong)((Slong)(w[N - 1] << (64 - rem)) >> (64 - rem));
+    else if (rem)
+      w[N - 1] &= ((Ulong)1 << rem) - 1;
+  }
+  void setSigned(const Slong x)
+  {
+    w[0] = x;
+    for (int i = 1; i < N; i++)
+      w[i] = x < 0 ? ~(Ulong)0 : 0;
+    normalize();
+  }
+  void setUnsigned(const Ulong x)
+  {
+    w[0] = x;
+    for (int i = 1; i < N; i++)
+      w[i] = 0;
+    normalize();
+  }
+
+  bool bit(const unsigned i) const { return (w[i >> 6] >> (i & 63)) & 1; }
+  void setBit(const unsigned i, const bool b)
+  {
+    w[i >> 6] = (w[i >> 6] & ~((Ulong)1 << (i & 63))) | ((Ulong)b << (i & 63));
+    normalize();
+  }
+  bool isZero() const
+  {
+    for (int i = 0; i < N; i++)
+      if (w[i])
+        return false;
+    return true;
+  }
+
+  // Writes the n (at most 64) low bits of c at pos
+  void insert(const unsigned pos, const Ulong c, const int n)
+  {
+    const Ulong mask = n >= 64 ? ~(Ulong)0 : ((Ulong)1 << n) - 1;
+    const int i = pos >> 6, off = pos & 63;
+    w[i]        = (w[i] & ~(mask << off)) | ((c & mask) << off);
+    if (off + n > 64 && i + 1 < N)
+      w[i + 1] = (w[i + 1] & ~(mask >> (64 - off))) | ((c & mask) >> (64 - off));
+  }
+};
+
+template <int W> struct kind {
+  enum { value = W <= 64 ? 0 : W <= 128 ? 1 : 2 };
+};
+
+} // namespace native_int
+
+template <int W, bool S> class ac_int : public native_int::base<W, S, native_int::kind<W>::value> {
+  typedef native_int::base<W, S, native_int::kind<W>::value> Base;
+  typedef native_int::Slong Slong;
+  typedef native_int::Ulong Ulong;
+  enum { SMALL = W <= 128 };
+
+  template <int W2, bool S2> friend class ac_int;
+
+  // 64 bits from pos on, zero below bit 0 and sign-extended beyond W bits
+  Ulong bitsAt(const int pos) const
+  {
+    if (pos < 0)
+      return pos <= -64 ? 0 : bitsAt(0) << -pos;
+    const int i = pos >> 6, off = pos & 63;
+    Ulong r     = Base::chunk(i) >> off;
+    if (off)
+      r |= Base::chunk(i + 1) << (64 - off);
+    return r;
+  }
+
+  template <class T> static ac_int fromRaw(const T x)
+  {
+    ac_int r;
+    r.v = Base::wrap((typename Base::word_t)x);
+    return r;
+  }
+
+  // Conversions between widths
+  template <int W2, bool S2> void assign(const ac_int<W2, S2>& op, native_int::tag<true>)
+  {
+    typedef typename native_int::calc<native_int::max2<W, W2 + !S2>::v>::t T;
+    this->v = Base::wrap((typename Base::word_t)op.template get<T>());
+  }
+  template <int W2, bool S2> void assign(const ac_int<W2, S2>& op, native_int::tag<false>)
+  {
+    for (int i = 0; i < (W + 63) / 64; i++)
+      Base::setChunk(i, op.chunk(i));
+    Base::normalize();
+  }
+
+  template <int W2, bool S2> bool equal(const ac_int<W2, S2>& op2, native_int::tag<true>) const
+  {
+    typedef typename native_int::calc<native_int::max2<W + !S, W2 + !S2>::v>::t T;
+    return this->template get<T>() == op2.template get<T>();
+  }
+  template <int W2, bool S2> bool equal(const ac_int<W2, S2>& op2, native_int::tag<false>) const
+  {
+    for (int i = 0; i < (native_int::max2<W, W2>::v + 63) / 64; i++)
+      if (Base::chunk(i) != op2.chunk(i))
+        return false;
+    return true;
+  }
+
+  template <int WS> ac_int<WS, S> slice(const unsigned lsb, native_int::tag<true>) const
+  {
+    typename Base::value_t x = Base::value();
+    x = lsb >= sizeof(x) * 8 ? (x < 0 ? -1 : 0) : x >> lsb;
+    return ac_int<WS, S>::fromRaw(x);
+  }
+  template <int WS> ac_int<WS, S> slice(const unsigned lsb, native_int::tag<false>) const
+  {
+    ac_int<WS, S> r(0); // setChunk keeps the other chunks of a 128-bit result
+    for (int i = 0; i < (WS + 63) / 64; i++)
+      r.setChunk(i, bitsAt(lsb + 64 * i));
+    r.normalize();
+    return r;
+  }
+
+  template <int W2, bool S2> void setSlice(const unsigned lsb, const ac_int<W2, S2>& slc, native_int::tag<true>)
+  {
+    typedef typename Base::word_t word_t;
+    const word_t mask = Base::ones(W2) << lsb;
+    this->v           = Base::wrap((this->v & ~mask) | (((word_t)slc.value() << lsb) & mask));
+  }
+  template <int W2, bool S2> void setSlice(const unsigned lsb, const ac_int<W2, S2>& slc, native_int::tag<false>)
+  {
+    for (int i = 0; i < (W2 + 63) / 64; i++)
+      Base::insert(lsb + 64 * i, slc.chunk(i), W2 - 64 * i < 64 ? W2 - 64 * i : 64);
+    Base::normalize();
+  }
+
+  ac_int shiftLeft(const unsigned s) const
+  {
+    if (s >= W)
+      return ac_int(0);
+    if (SMALL)
+      return fromRaw(this->v << (s % Base::BITS));
+    ac_int r;
+    for (int i = 0; i < (W + 63) / 64; i++)
+      r.setChunk(i, bitsAt(64 * i - (int)s));
+    r.normalize();
+    return r;
+  }
+  ac_int shiftRight(const unsigned s) const
+  {
+    if (SMALL) {
+      const typename Base::value_t x = Base::value();
+      return fromRaw(s >= sizeof(x) * 8 ? (x < 0 ? -1 : 0) : x >> s);
+    }
+    ac_int r;
+    for (int i = 0; i < (W + 63) / 64; i++)
+      r.setChunk(i, bitsAt(s >= (unsigned)W ? W : 64 * i + s));
+    r.normalize();
+    return r;
+  }
+
+public:
+  static const int width = W;
+  static const bool sign = S;
+
+  template <int W2, bool S2> struct rt {
+    enum {
+      mult_w  = W + W2,
+      mult_s  = S || S2,
+      plus_w  = native_int::max2<W + (S2 && !S), W2 + (S && !S2)>::v + 1,
+      plus_s  = S || S2,
+      minus_w = native_int::max2<W + (S2 && !S), W2 + (S && !S2)>::v + 1,
+      minus_s = true,
+      div_w   = W + S2,
+      div_s   = S || S2,
+      mod_w   = native_int::min2<W, W2 + (!S2 && S)>::v,
+      mod_s   = S,
+      logic_w = native_int::max2<W + (S2 && !S), W2 + (S && !S2)>::v,
+      logic_s = S || S2
+    };
+    typedef ac_int<mult_w, mult_s> mult;
+    typedef ac_int<plus_w, plus_s> plus;
+    typedef ac_int<minus_w, minus_s> minus;
+    typedef ac_int<logic_w, logic_s> logic;
+    typedef ac_int<div_w, div_s> div;
+    typedef ac_int<mod_w, mod_s> mod;
+    typedef ac_int<W, S> arg1;
+  };
+
+  struct rt_unary {
+    enum { neg_w = W + 1, neg_s = true };
+    typedef ac_int<neg_w, neg_s> neg;
+  };
+
+  ac_int() {}
+  template <int W2, bool S2> ac_int(const ac_int<W2, S2>& op)
+  {
+    assign(op, native_int::tag<SMALL && ac_int<W2, S2>::SMALL>());
+  }
+  ac_int(bool b) { Base::setUnsigned(b); }
+  ac_int(char b) { Base::setSigned(b); }
+  ac_int(signed char b) { Base::setSigned(b); }
+  ac_int(unsigned char b) { Base::setUnsigned(b); }
+  ac_int(signed short b) { Base::setSigned(b); }
+  ac_int(unsigned short b) { Base::setUnsigned(b); }
+  ac_int(signed int b) { Base::setSigned(b); }
+  ac_int(unsigned int b) { Base::setUnsigned(b); }
+  ac_int(signed long b) { Base::setSigned(b); }
+  ac_int(unsigned long b) { Base::setUnsigned(b); }
+  ac_int(Slong b) { Base::setSigned(b); }
+  ac_int(Ulong b) { Base::setUnsigned(b); }
+  ac_int(double d) { Base::setSigned((Slong)d); }
+
+  // Explicit conversions to the C integers, of the low bits
+  int to_int() const { return (int)Base::low(); }
+  unsigned to_uint() const { return (unsigned)Base::low(); }
+  long to_long() const { return (long)Base::low(); }
+  unsigned long to_ulong() const { return (unsigned long)Base::low(); }
+  Slong to_int64() const { return (Slong)Base::low(); }
+  Ulong to_uint64() const { return Base::low(); }
+  double to_double() const { return (double)Base::value(); }
+  int length() const { return W; }
+
+  std::string to_string() const
+  {
+    std::string r;
+    for (int i = (W + 3) / 4 - 1; i >= 0; i--)
+      r += "0123456789abcdef"[(bitsAt(4 * i) & 0xf)];
+    return "0x" + r;
+  }
+
+  // Arithmetic, on values of up to 128 bits
+  template <int W2, bool S2> typename rt<W2, S2>::mult operator*(const ac_int<W2, S2>& op2) const
+  {
+    typedef typename rt<W2, S2>::mult R;
+    typedef typename native_int::calc<R::width>::t T;
+    return R::fromRaw(this->template get<T>() * op2.template get<T>());
+  }
+  template <int W2, bool S2> typename rt<W2, S2>::plus operator+(const ac_int<W2, S2>& op2) const
+  {
+    typedef typename rt<W2, S2>::plus R;
+    typedef typename native_int::calc<R::width>::t T;
+    return R::fromRaw(this->template get<T>() + op2.template get<T>());
+  }
+  template <int W2, bool S2> typename rt<W2, S2>::minus operator-(const ac_int<W2, S2>& op2) const
+  {
+    typedef typename rt<W2, S2>::minus R;
+    typedef typename native_int::calc<R::width>::t T;
+    return R::fromRaw(this->template get<T>() - op2.template get<T>());
+  }
+  template <int W2, bool S2> typename rt<W2, S2>::div operator/(const ac_int<W2, S2>& op2) const
+  {
+    typedef typename rt<W2, S2>::div R;
+    typedef typename native_int::calc<native_int::max2<R::width, W2 + !S2>::v + 1>::t T;
+    const T divisor = op2.template get<T>();
+    return R::fromRaw(divisor == 0 ? 0 : this->template get<T>() / divisor);
+  }
+  template <int W2, bool S2> typename rt<W2, S2>::mod operator%(const ac_int<W2, S2>& op2) const
+  {
+    typedef typename rt<W2, S2>::mod R;
+    typedef typename native_int::calc<native_int::max2<W + !S, W2 + !S2>::v + 1>::t T;
+    const T divisor = op2.template get<T>();
+    return R::fromRaw(divisor == 0 ? 0 : this->template get<T>() % divisor);
+  }
+
+  template <int W2, bool S2> ac_int& operator*=(const ac_int<W2, S2>& op2) { return *this = *this * op2; }
+  template <int W2, bool S2> ac_int& operator+=(const ac_int<W2, S2>& op2) { return *this = *this + op2; }
+  template <int W2, bool S2> ac_int& operator-=(const ac_int<W2, S2>& op2) { return *this = *this - op2; }
+  template <int W2, bool S2> ac_int& operator/=(const ac_int<W2, S2>& op2) { return *this = *this / op2; }
+  template <int W2, bool S2> ac_int& operator%=(const ac_int<W2, S2>& op2) { return *this = *this % op2; }
+
+  ac_int& operator++() { return *this = fromRaw(Base::value() + 1); }
+  ac_int& operator--() { return *this = fromRaw(Base::value() - 1); }
+  const ac_int operator++(int)
+  {
+    const ac_int t = *this;
+    ++*this;
+    return t;
+  }
+  const ac_int operator--(int)
+  {
+    const ac_int t = *this;
+    --*this;
+    return t;
+  }
+
+  ac_int operator+() const { return *this; }
+  typename rt_unary::neg operator-() const { return rt_unary::neg::fromRaw(-Base::value()); }
+  bool operator!() const { return Base::isZero(); }
+  ac_int<W + !S, true> operator~() const { return ac_int<W + !S, true>::fromRaw(~Base::value()); }
+
+  // Bitwise operations
+  template <int W2, bool S2> typename rt<W2, S2>::logic operator&(const ac_int<W2, S2>& op2) const
+  {
+    typedef typename rt<W2, S2>::logic R;
+    typedef typename native_int::calc<R::width>::t T;
+    return R::fromRaw(this->template get<T>() & op2.template get<T>());
+  }
+  template <int W2, bool S2> typename rt<W2, S2>::logic operator|(const ac_int<W2, S2>& op2) const
+  {
+    typedef typename rt<W2, S2>::logic R;
+    typedef typename native_int::calc<R::width>::t T;
+    return R::fromRaw(this->template get<T>() | op2.template get<T>());
+  }
+  template <int W2, bool S2> typename rt<W2, S2>::logic operator^(const ac_int<W2, S2>& op2) const
+  {
+    typedef typename rt<W2, S2>::logic R;
+    typedef typename native_int::calc<R::width>::t T;
+    return R::fromRaw(this->template get<T>() ^ op2.template get<T>());
+  }
+  template <int W2, bool S2> ac_int& operator&=(const ac_int<W2, S2>& op2) { return *this = *this & op2; }
+  template <int W2, bool S2> ac_int& operator|=(const ac_int<W2, S2>& op2) { return *this = *this | op2; }
+  template <int W2, bool S2> ac_int& operator^=(const ac_int<W2, S2>& op2) { return *this = *this ^ op2; }
+
+  // Shifts keep the width of the left operand, a negative signed amount shifts the other way
+  template <int W2> ac_int operator<<(const ac_int<W2, true>& op2) const
+  {
+    const int s = op2.to_int();
+    return s < 0 ? shiftRight(-s) : shiftLeft(s);
+  }
+  template <int W2> ac_int operator<<(const ac_int<W2, false>& op2) const { return shiftLeft(op2.to_uint()); }
+  template <int W2> ac_int operator>>(const ac_int<W2, true>& op2) const
+  {
+    const int s = op2.to_int();
+    return s < 0 ? shiftLeft(-s) : shiftRight(s);
+  }
+  template <int W2> ac_int operator>>(const ac_int<W2, false>& op2) const { return shiftRight(op2.to_uint()); }
+  template <int W2, bool S2> ac_int& operator<<=(const ac_int<W2, S2>& op2) { return *this = *this << op2; }
+  template <int W2, bool S2> ac_int& operator>>=(const ac_int<W2, S2>& op2) { return *this = *this >> op2; }
+
+  // Comparisons of the values
+  template <int W2, bool S2> bool operator==(const ac_int<W2, S2>& op2) const
+  {
+    return equal(op2, native_int::tag<SMALL && ac_int<W2, S2>::SMALL>());
+  }
+  template <int W2, bool S2> bool operator!=(const ac_int<W2, S2>& op2) const { return !operator==(op2); }
+  template <int W2, bool S2> bool operator<(const ac_int<W2, S2>& op2) const
+  {
+    typedef typename native_int::calc<native_int::max2<W + !S, W2 + !S2>::v>::t T;
+    return this->template get<T>() < op2.template get<T>();
+  }
+  template <int W2, bool S2> bool operator>=(const ac_int<W2, S2>& op2) const { return !operator<(op2); }
+  template <int W2, bool S2> bool operator>(const ac_int<W2, S2>& op2) const { return op2.operator<(*this); }
+  template <int W2, bool S2> bool operator<=(const ac_int<W2, S2>& op2) const { return !op2.operator<(*this); }
+
+  // Slices: bits lsb to lsb + WS - 1, with the sign of the value beyond its width
+  template <int WS, int WX, bool SX> ac_int<WS, S> slc(const ac_int<WX, SX>& index) const
+  {
+    return slice<WS>(index.to_uint(), native_int::tag<SMALL>());
+  }
+  template <int WS> ac_int<WS, S> slc(signed index) const { return slice<WS>(index, native_int::tag<SMALL>()); }
+  template <int WS> ac_int<WS, S> slc(unsigned index) const { return slice<WS>(index, native_int::tag<SMALL>()); }
+
+  template <int W2, bool S2, int WX, bool SX> ac_int& set_slc(const ac_int<WX, SX> lsb, const ac_int<W2, S2>& slc)
+  {
+    setSlice(lsb.to_uint(), slc, native_int::tag<SMALL>());
+    return *this;
+  }
+  template <int W2, bool S2> ac_int& set_slc(signed lsb, const ac_int<W2, S2>& slc)
+  {
+    setSlice(lsb, slc, native_int::tag<SMALL>());
+    return *this;
+  }
+  template <int W2, bool S2> ac_int& set_slc(unsigned lsb, const ac_int<W2, S2>& slc)
+  {
+    setSlice(lsb, slc, native_int::tag<SMALL>());
+    return *this;
+  }
+
+  class ac_bitref {
+    ac_int& d_bv;
+    unsigned d_index;
+
+  public:
+    ac_bitref(ac_int* bv, unsigned index = 0) : d_bv(*bv), d_index(index) {}
+    ac_bitref(const ac_bitref& ref) = default;
+    operator bool() const { return d_index < W && d_bv.bit(d_index); }
+
+    template <int W2, bool S2> operator ac_int<W2, S2>() const { return operator bool(); }
+
+    ac_bitref operator=(int val)
+    {
+      if (d_index < W)
+        d_bv.setBit(d_index, val & 1);
+      return *this;
+    }
+    template <int W2, bool S2> ac_bitref operator=(const ac_int<W2, S2>& val) { return operator=(val.to_int()); }
+    ac_bitref operator=(const ac_bitref& val) { return operator=((int)(bool)val); }
+  };
+
+  ac_bitref operator[](unsigned int uindex) { return ac_bitref(this, uindex); }
+  ac_bitref operator[](int index) { return ac_bitref(this, index); }
+  template <int W2, bool S2> ac_bitref operator[](const ac_int<W2, S2>& index)
+  {
+    return ac_bitref(this, index.to_uint());
+  }
+  bool operator[](unsigned int uindex) const { return uindex < W && Base::bit(uindex); }
+  bool operator[](int index) const { return (unsigned)index < W && Base::bit(index); }
+  template <int W2, bool S2> bool operator[](const ac_int<W2, S2>& index) const
+  {
+    return index.to_uint() < W && Base::bit(index.to_uint());
+  }
+};
+
+template <int W, bool S> inline std::ostream& operator<<(std::ostream& os, const ac_int<W, S>& x)
+{
+  if (W <= 64 && (os.flags() & std::ios::hex) == 0)
+    return os << (S ? x.to_int64() : (native_int::Slong)x.to_uint64());
+  return os << x.to_string();
+}
+
+// Operators with the C integers, which stand for ac_int of their width as in ac_int.h
+#define NATIVE_BIN_OP_WITH_INT(BIN_OP, C_TYPE, WI, SI, RTYPE)                                                         \
+  template <int W, bool S>                                                                                             \
+  inline typename ac_int<WI, SI>::template rt<W, S>::RTYPE operator BIN_OP(C_TYPE i_op, const ac_int<W, S>& op)        \
+  {                                                                                                                    \
+    return ac_int<WI, SI>(i_op).operator BIN_OP(op);                                                                   \
+  }                                                                                                                    \
+  template <int W, bool S>                                                                                             \
+  inline typename ac_int<W, S>::template rt<WI, SI>::RTYPE operator BIN_OP(const ac_int<W, S>& op, C_TYPE i_op)        \
+  {                                                                                                                    \
+    return op.operator BIN_OP(ac_int<WI, SI>(i_op));                                                                   \
+  }
+
+#define NATIVE_REL_OP_WITH_INT(REL_OP, C_TYPE, W2, S2)                                                                 \
+  template <int W, bool S> inline bool operator REL_OP(const ac_int<W, S>& op, C_TYPE op2)                             \
+  {                                                                                                                    \
+    return op.operator REL_OP(ac_int<W2, S2>(op2));                                                                    \
+  }                                                                                                                    \
+  template <int W, bool S> inline bool operator REL_OP(C_TYPE op2, const ac_int<W, S>& op)                             \
+  {                                                                                                                    \
+    return ac_int<W2, S2>(op2).operator REL_OP(op);                                                                    \
+  }
+
+#define NATIVE_ASSIGN_OP_WITH_INT(ASSIGN_OP, C_TYPE, W2, S2)                                                           \
+  template <int W, bool S> inline ac_int<W, S>& operator ASSIGN_OP(ac_int<W, S>& op, C_TYPE op2)                       \
+  {                                                                                                                    \
+    return op.operator ASSIGN_OP(ac_int<W2, S2>(op2));                                                                 \
+  }
+
+#define NATIVE_OPS_WITH_INT(C_TYPE, WI, SI)                                                                            \
+  NATIVE_BIN_OP_WITH_INT(*, C_TYPE, WI, SI, mult)                                                                      \
+  NATIVE_BIN_OP_WITH_INT(+, C_TYPE, WI, SI, plus)                                                                      \
+  NATIVE_BIN_OP_WITH_INT(-, C_TYPE, WI, SI, minus)                                                                     \
+  NATIVE_BIN_OP_WITH_INT(/, C_TYPE, WI, SI, div)                                                                       \
+  NATIVE_BIN_OP_WITH_INT(%, C_TYPE, WI, SI, mod)                                                                       \
+  NATIVE_BIN_OP_WITH_INT(>>, C_TYPE, WI, SI, arg1)                                                                     \
+  NATIVE_BIN_OP_WITH_INT(<<, C_TYPE, WI, SI, arg1)                                                                     \
+  NATIVE_BIN_OP_WITH_INT(&, C_TYPE, WI, SI, logic)                                                                     \
+  NATIVE_BIN_OP_WITH_INT(|, C_TYPE, WI, SI, logic)                                                                     \
+  NATIVE_BIN_OP_WITH_INT(^, C_TYPE, WI, SI, logic)                                                                     \
+                                                                                                                       \
+  NATIVE_REL_OP_WITH_INT(==, C_TYPE, WI, SI)                                                                           \
+  NATIVE_REL_OP_WITH_INT(!=, C_TYPE, WI, SI)                                                                           \
+  NATIVE_REL_OP_WITH_INT(>, C_TYPE, WI, SI)                                                                            \
+  NATIVE_REL_OP_WITH_INT(>=, C_TYPE, WI, SI)                                                                           \
+  NATIVE_REL_OP_WITH_INT(<, C_TYPE, WI, SI)                                                                            \
+  NATIVE_REL_OP_WITH_INT(<=, C_TYPE, WI, SI)                                                                           \
+                                                                                                                       \
+  NATIVE_ASSIGN_OP_WITH_INT(+=, C_TYPE, WI, SI)                                                                        \
+  NATIVE_ASSIGN_OP_WITH_INT(-=, C_TYPE, WI, SI)                                                                        \
+  NATIVE_ASSIGN_OP_WITH_INT(*=, C_TYPE, WI, SI)                                                                        \
+  NATIVE_ASSIGN_OP_WITH_INT(/=, C_TYPE, WI, SI)                                                                        \
+  NATIVE_ASSIGN_OP_WITH_INT(%=, C_TYPE, WI, SI)                                                                        \
+  NATIVE_ASSIGN_OP_WITH_INT(>>=, C_TYPE, WI, SI)                                                                       \
+  NATIVE_ASSIGN_OP_WITH_INT(<<=, C_TYPE, WI, SI)                                                                       \
+  NATIVE_ASSIGN_OP_WITH_INT(&=, C_TYPE, WI, SI)                                                                        \
+  NATIVE_ASSIGN_OP_WITH_INT(|=, C_TYPE, WI, SI)                                                                        \
+  NATIVE_ASSIGN_OP_WITH_INT(^=, C_TYPE, WI, SI)
+
+NATIVE_OPS_WITH_INT(bool, 1, false)
+NATIVE_OPS_WITH_INT(char, 8, true)
+NATIVE_OPS_WITH_INT(signed char, 8, true)
+NATIVE_OPS_WITH_INT(unsigned char, 8, false)
+NATIVE_OPS_WITH_INT(short, 16, true)
+NATIVE_OPS_WITH_INT(unsigned short, 16, false)
+NATIVE_OPS_WITH_INT(int, 32, true)
+NATIVE_OPS_WITH_INT(unsigned int, 32, false)
+NATIVE_OPS_WITH_INT(long, (int)sizeof(long) * 8, true)
+NATIVE_OPS_WITH_INT(unsigned long, (int)sizeof(long) * 8, false)
+NATIVE_OPS_WITH_INT(native_int::Slong, 64, true)
+NATIVE_OPS_WITH_INT(native_int::Ulong, 64, false)
+
+#undef NATIVE_OPS_WITH_INT
+#undef NATIVE_ASSIGN_OP_WITH_INT
+#undef NATIVE_REL_OP_WITH_INT
+#undef NATIVE_BIN_OP_WITH_INT
+
+template <typename T, int W, bool S> T* operator+(T* ptr, const ac_int<W, S>& op2)
+{
+  return ptr + op2.to_int64();
+}
+template <typename T, int W, bool S> T* operator+(const ac_int<W, S>& op2, T* ptr)
+{
+  return ptr + op2.to_int64();
+}
+template <typename T, int W, bool S> T* operator-(T* ptr, const ac_int<W, S>& op2)
+{
+  return ptr - op2.to_int64();
+}
+
+#endif // __NATIVE_INT_H__
@@ -0,0 +1,532 @@
+/** Copyright 2021 INRIA, Université de Rennes 1 and ENS Rennes
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#ifndef __NON_BLOCKING_CACHE_MEMORY_H__
+#define __NON_BLOCKING_CACHE_MEMORY_H__
+
+#include "cacheMemory.h"
+
+#ifndef __HLS__
+#include <cstdio>
+#include <cstdlib>
+#endif
+
+/******************************************************************************************
+ * Lockup-free cache
+ *
+ * Misses are recorded in miss status holding registers (MSHRs) and the lines are fetched
+ * in the background, one at a time in allocation order, while the accesses which hit are
+ * served as usual (hit-under-miss). Each MSHR holds the address of a missing line and up
+ * to TARGETS accesses to it (the primary miss and the secondary ones), which are replayed
+ * in order when the line is installed.
+ *
+ * A load which misses is accepted without its value when it comes through
+ * processNonBlocking: the value is returned by completeLoad once the line is installed,
+ * one load per cycle. Stores which miss are always accepted. The requester only waits when
+ * the active MSHRs, or the targets of the MSHR of the line, are all used. Through process(),
+ * accesses which miss wait until their line is present, as in CacheMemory. Atomic
+ * instructions wait for the outstanding misses, then are made as in CacheMemory.
+ *
+ * 	Following values are templates:
+ * 		- INTERFACE_SIZE, LINE_SIZE, SET_SIZE, ASSOCIATIVITY, POLICY: see CacheMemory
+ * 		- MSHRS: number of MSHRs, activeMshrs can use fewer of them at run time
+ * 		- TARGETS: accesses merged in each MSHR
+ * ****************************************************************************************
+ */
+template <unsigned int INTERFACE_SIZE, int LINE_SIZE, int SET_SIZE, int ASSOCIATIVITY, template <int, int> class POLICY,
+          int MSHRS, int TARGETS>
+class NonBlockingCacheMemory : public CacheMemory<INTERFACE_SIZE, LINE_SIZE, SET_SIZE, ASSOCIATIVITY, POLICY> {
+
+  static const int LOG_SET_SIZE       = log2const<SET_SIZE>::value;
+  static const int LOG_LINE_SIZE      = log2const<LINE_SIZE>::value;
+  static const int TAG_SIZE           = (32 - LOG_LINE_SIZE - LOG_SET_SIZE);
+  static const int LOG_ASSOCIATIVITY  = log2const<ASSOCIATIVITY>::value;
+  static const int LOG_INTERFACE_SIZE = log2const<INTERFACE_SIZE>::value;
+  static const int WORDS              = LINE_SIZE / INTERFACE_SIZE;
+
+  static_assert(MSHRS >= 1 && MSHRS < 128 && TARGETS >= 1 && TARGETS < 128,
+                "A lockup-free cache needs between 1 and 127 MSHRs and targets");
+
+  typedef enum { FILL_IDLE = 0, FILL_WRITEBACK, FILL_LOAD, FILL_INSTALL } fillStates;
+
+  // Value read by a load of the given size at offset (in bytes) in the data of a line
+  static ac_int<INTERFACE_SIZE * 8, false> readLine(const ac_int<LINE_SIZE * 8, false> line,
+                                                    const ac_int<LOG_LINE_SIZE, false> offset, const memMask mask)
+  {
+    const int bit = ((int)offset) << 3;
+    ac_int<INTERFACE_SIZE * 8, false> result = 0;
+    ac_int<8, true> signedByte;
+    ac_int<16, true> signedHalf;
+    ac_int<32, true> signedWord;
+
+    switch (mask) {
+      case BYTE:
+        signedByte = line.template slc<8>(bit);
+        signedWord = signedByte;
+        result.set_slc(0, signedWord);
+        break;
+      case HALF:
+        signedHalf = line.template slc<16>(bit & ~15);
+        signedWord = signedHalf;
+        result.set_slc(0, signedWord);
+        break;
+      case WORD:
+        result = line.template slc<32>(bit & ~31);
+        break;
+      case BYTE_U:
+        result = line.template slc<8>(bit);
+        break;
+      case HALF_U:
+        result = line.template slc<16>(bit & ~15);
+        break;
+      case LONG:
+        result = line.template slc<INTERFACE_SIZE * 8>(bit & ~31);
+        break;
+    }
+    return result;
+  }
+
+  static void writeLine(ac_int<LINE_SIZE * 8, false>& line, const ac_int<LOG_LINE_SIZE, false> offset,
+                        const memMask mask, const ac_int<INTERFACE_SIZE * 8, false> data)
+  {
+    const int bit = ((int)offset) << 3;
+    switch (mask) {
+      case BYTE:
+      case BYTE_U:
+        line.set_slc(bit, data.template slc<8>(0));
+        break;
+      case HALF:
+      case HALF_U:
+        line.set_slc(bit & ~15, data.template slc<16>(0));
+        break;
+      case WORD:
+        line.set_slc(bit & ~31, data.template slc<32>(0));
+        break;
+      case LONG:
+        line.set_slc(bit & ~31, data);
+        break;
+    }
+  }
+
+public:
+  typedef CacheMemory<INTERFACE_SIZE, LINE_SIZE, SET_SIZE, ASSOCIATIVITY, POLICY> BlockingCache;
+
+  int activeMshrs; // between 1 and MSHRS
+
+  // MSHRs, a circular queue in allocation order. Targets hold the store data, then the loaded values.
+  ac_int<32 - LOG_LINE_SIZE, false> mshrLine[MSHRS];
+  bool mshrValid[MSHRS];
+  ac_int<7, false> mshrTargets[MSHRS];
+  bool targetIsStore[MSHRS][TARGETS];
+  memMask targetMask[MSHRS][TARGETS];
+  ac_int<LOG_LINE_SIZE, false> targetOffset[MSHRS][TARGETS];
+  ac_int<INTERFACE_SIZE * 8, false> targetData[MSHRS][TARGETS];
+  ac_int<5, false> targetTag[MSHRS][TARGETS];
+  ac_int<7, false> mshrHead, mshrCount;
+
+  // Line fill of the MSHR at the head of the queue: the victim (in oldVal) is written back if needed, then the
+  // line is read into newVal from the last word to the first one
+  ac_int<2, false> fillState;
+  ac_int<7, false> fillWord;
+  ac_int<32, false> victimAddr;
+
+  // Loads of the last installed line, returned one per cycle
+  ac_int<5, false> returnTag[TARGETS];
+  ac_int<INTERFACE_SIZE * 8, false> returnValue[TARGETS];
+  ac_int<7, false> returnCount, returnIndex;
+  bool completed;
+  ac_int<5, false> completedTag;
+  ac_int<INTERFACE_SIZE * 8, false> completedValue;
+
+  bool retrying; // the requester presents again an access which had to wait
+
+  // Stats
+  unsigned long numberSecondaryMiss, numberHitUnderMiss, numberMshrFullCycles;
+
+  NonBlockingCacheMemory(MemoryInterface<INTERFACE_SIZE>* nextLevel, bool v) : BlockingCache(nextLevel, v)
+  {
+    activeMshrs = MSHRS;
+    for (int oneMshr = 0; oneMshr < MSHRS; oneMshr++) {
+      mshrValid[oneMshr]   = false;
+      mshrTargets[oneMshr] = 0;
+    }
+    mshrHead             = 0;
+    mshrCount            = 0;
+    fillState            = FILL_IDLE;
+    fillWord             = 0;
+    returnCount          = 0;
+    returnIndex          = 0;
+    completed            = false;
+    retrying             = false;
+    numberSecondaryMiss  = 0;
+    numberHitUnderMiss   = 0;
+    numberMshrFullCycles = 0;
+  }
+
+  void process(ac_int<32, false> addr, memMask mask, memOpType opType, ac_int<INTERFACE_SIZE * 8, false> dataIn,
+               ac_int<INTERFACE_SIZE * 8, false>& dataOut, bool& waitOut)
+  {
+    bool deferred;
+    access(addr, mask, opType, dataIn, 0, false, dataOut, waitOut, deferred);
+  }
+
+  void processNonBlocking(const ac_int<32, false> addr, const memMask mask, const memOpType opType,
+                          const ac_int<INTERFACE_SIZE * 8, false> dataIn, const ac_int<5, false> tag,
+                          ac_int<INTERFACE_SIZE * 8, false>& dataOut, bool& waitOut, bool& deferred)
+  {
+    access(addr, mask, opType, dataIn, tag, true, dataOut, waitOut, deferred);
+  }
+
+  // The misses in progress are completed first, the atomic instruction then goes through the blocking cache
+  void processAtomic(const ac_int<32, false> addr, const ac_int<5, false> op,
+                     const ac_int<INTERFACE_SIZE * 8, false> dataIn, const bool active,
+                     ac_int<INTERFACE_SIZE * 8, false>& dataOut, bool& waitOut, bool& contended)
+  {
+    if (!this->atomic && !isDrained()) {
+      bool deferred;
+      access(addr, WORD, NONE, 0, 0, false, dataOut, waitOut, deferred);
+      waitOut   = true;
+      contended = false;
+      return;
+    }
+    BlockingCache::processAtomic(addr, op, dataIn, active, dataOut, waitOut, contended);
+  }
+
+  bool completeLoad(ac_int<5, false>& tag, ac_int<INTERFACE_SIZE * 8, false>& value)
+  {
+    const bool result = completed;
+    tag               = completedTag;
+    value             = completedValue;
+    completed         = false;
+    return result;
+  }
+
+  bool isDrained() { return mshrCount == 0 && fillState == FILL_IDLE && returnIndex == returnCount && !this->wasStore; }
+
+  void access(const ac_int<32, false> addr, const memMask mask, const memOpType opType,
+              const ac_int<INTERFACE_SIZE * 8, false> dataIn, const ac_int<5, false> tag, const bool canDefer,
+              ac_int<INTERFACE_SIZE * 8, false>& dataOut, bool& waitOut, bool& deferred)
+  {
+    deferred  = false;
+    waitOut   = false;
+    completed = false;
+
+    if (this->writeBufferEntries != 0) {
+      this->writeBufferOccupancy += this->writeBufferCount;
+      this->writeBufferCycles++;
+      if (fillState == FILL_WRITEBACK)
+        this->writeBufferFullCycles++;
+    }
+
+    // A store which hit in the previous cycle is written, this completes the access presented again
+    const bool storeDone = this->wasStore;
+    if (this->wasStore) {
+      this->cacheMemory[this->placeStore][this->setStore] = this->valStore;
+      this->dirtyBit[this->placeStore][this->setStore]    = 1;
+      this->wasStore                                      = false;
+      retrying                                            = false;
+    }
+
+    // Background line fill. The MSHR is released when the line is installed, its loads being returned from
+    // another buffer so that the next fill can start.
+    if (!this->nextLevelWaitOut) {
+      if (fillState == FILL_INSTALL && returnIndex == returnCount) {
+        const ac_int<32 - LOG_LINE_SIZE, false> line = mshrLine[mshrHead];
+        const ac_int<LOG_SET_SIZE, false> place      = line.template slc<LOG_SET_SIZE>(0);
+
+        ac_int<LINE_SIZE * 8, false> lineData = this->newVal.template slc<LINE_SIZE * 8>(TAG_SIZE);
+        bool dirty                            = this->fromWriteBuffer;
+        returnCount                           = 0;
+        for (int oneTarget = 0; oneTarget < TARGETS; oneTarget++) {
+          if (oneTarget < mshrTargets[mshrHead]) {
+            if (targetIsStore[mshrHead][oneTarget]) {
+              writeLine(lineData, targetOffset[mshrHead][oneTarget], targetMask[mshrHead][oneTarget],
+                        targetData[mshrHead][oneTarget]);
+              dirty = true;
+            } else {
+              returnTag[returnCount] = targetTag[mshrHead][oneTarget];
+              returnValue[returnCount] =
+                  readLine(lineData, targetOffset[mshrHead][oneTarget], targetMask[mshrHead][oneTarget]);
+              returnCount++;
+            }
+          }
+        }
+        returnIndex = 0;
+
+        this->newVal.set_slc(TAG_SIZE, lineData);
+        this->cacheMemory[place][this->setMiss] = this->newVal;
+        this->dataValid[place][this->setMiss]   = 1;
+        this->dirtyBit[place][this->setMiss]    = dirty;
+        this->sharedBit[place][this->setMiss]   = 0;
+        this->policy.insert(place, this->setMiss);
+
+        mshrValid[mshrHead]   = false;
+        mshrTargets[mshrHead] = 0;
+        mshrHead              = (mshrHead == MSHRS - 1) ? (ac_int<7, false>)0 : (ac_int<7, false>)(mshrHead + 1);
+        mshrCount--;
+        fillState          = FILL_IDLE;
+        this->fromPrefetch    = false;
+        this->fromWriteBuffer = false;
+      }
+
+      // A fill starts once the prefetch in progress is over (the write buffer is stopped between two words)
+      if (fillState == FILL_IDLE && mshrCount != 0 && !this->prefetching) {
+        const ac_int<32 - LOG_LINE_SIZE, false> line = mshrLine[mshrHead];
+        const ac_int<LOG_SET_SIZE, false> place      = line.template slc<LOG_SET_SIZE>(0);
+
+        // Invalid lines are filled first, the policy only chooses among valid ones
+        bool hasInvalid = false;
+        for (int oneSet = ASSOCIATIVITY - 1; oneSet >= 0; oneSet--) {
+          if (!this->dataValid[place][oneSet]) {
+            hasInvalid    = true;
+            this->setMiss = oneSet;
+          }
+        }
+        if (!hasInvalid)
+          this->setMiss = this->policy.victim(place);
+
+        // The victim leaves the cache right away, later accesses to it miss
+        this->oldVal  = this->cacheMemory[place][this->setMiss];
+        victimAddr    = (((int)this->oldVal.template slc<TAG_SIZE>(0)) << (LOG_LINE_SIZE + LOG_SET_SIZE)) |
+                        (((int)place) << LOG_LINE_SIZE);
+        this->isValid = this->dataValid[place][this->setMiss];
+        this->isDirty = this->dirtyBit[place][this->setMiss];
+        this->dataValid[place][this->setMiss] = 0;
+        this->dirtyBit[place][this->setMiss]  = 0;
+
+        this->newVal = line.template slc<TAG_SIZE>(LOG_SET_SIZE);
+        ac_int<LINE_SIZE * 8, false> bufferedLine = 0;
+        this->fromWriteBuffer = this->writeBufferCount != 0 && this->writeBufferTake(line, bufferedLine);
+        this->fromPrefetch    = !this->fromWriteBuffer && this->prefetcher.type != NO_PREFETCH &&
+                             this->prefetcher.take(line, bufferedLine);
+        const bool buffered = this->fromPrefetch || this->fromWriteBuffer;
+        if (buffered)
+          this->newVal.set_slc(TAG_SIZE, bufferedLine);
+
+        fillWord = WORDS - 1;
+        if (this->isValid && (this->isDirty || this->writeBackClean)) {
+          this->numberWriteBack++;
+          if (this->writeBufferCount < this->writeBufferEntries) {
+            this->writeBufferPush(victimAddr >> LOG_LINE_SIZE, this->oldVal.template slc<LINE_SIZE * 8>(TAG_SIZE));
+            fillState = buffered ? FILL_INSTALL : FILL_LOAD;
+          } else {
+            fillState = FILL_WRITEBACK;
+          }
+        } else {
+          fillState = buffered ? FILL_INSTALL : FILL_LOAD;
+        }
+      }
+    }
+
+    if (fillState == FILL_WRITEBACK) {
+      this->nextLevelAddr   = victimAddr + (((int)fillWord) << LOG_INTERFACE_SIZE);
+      this->nextLevelDataIn = this->oldVal.template slc<INTERFACE_SIZE * 8>(fillWord * INTERFACE_SIZE * 8 + TAG_SIZE);
+      this->nextLevelOpType = STORE;
+    } else if (fillState == FILL_LOAD) {
+      this->nextLevelAddr   = (((int)mshrLine[mshrHead]) << LOG_LINE_SIZE) + (((int)fillWord) << LOG_INTERFACE_SIZE);
+      this->nextLevelOpType = LOAD;
+    } else {
+      // The next level is free for the write buffer and the prefetcher
+      const bool busy = this->nextLevelWaitOut ? (this->prefetching || this->draining) : this->backgroundIssue();
+      if (!busy)
+        this->nextLevelOpType = NONE;
+    }
+
+    if (returnIndex != returnCount) {
+      completed      = true;
+      completedTag   = returnTag[returnIndex];
+      completedValue = returnValue[returnIndex];
+      returnIndex++;
+    }
+
+    // Access from the requester
+    if (opType != NONE && !storeDone) {
+      const ac_int<32 - LOG_LINE_SIZE, false> line = addr.slc<32 - LOG_LINE_SIZE>(LOG_LINE_SIZE);
+      const ac_int<LOG_SET_SIZE, false> place      = addr.slc<LOG_SET_SIZE>(LOG_LINE_SIZE);
+      const ac_int<TAG_SIZE, false> lineTag        = addr.slc<TAG_SIZE>(LOG_LINE_SIZE + LOG_SET_SIZE);
+      const ac_int<LOG_LINE_SIZE, false> offset    = addr.slc<LOG_LINE_SIZE>(0);
+      const bool newRequest                        = !retrying;
+
+      if (newRequest)
+        this->numberAccess++;
+
+      bool hit                             = false;
+      ac_int<LOG_ASSOCIATIVITY, false> set = 0;
+      for (int oneSet = 0; oneSet < ASSOCIATIVITY; oneSet++) {
+        if (this->dataValid[place][oneSet] && this->cacheMemory[place][oneSet].template slc<TAG_SIZE>(0) == lineTag) {
+          hit = true;
+          set = oneSet;
+        }
+      }
+
+      bool pending          = false;
+      ac_int<7, false> mshr = 0;
+      for (int oneMshr = 0; oneMshr < MSHRS; oneMshr++) {
+        if (mshrValid[oneMshr] && mshrLine[oneMshr] == line) {
+          pending = true;
+          mshr    = oneMshr;
+        }
+      }
+
+      // Lines waiting in the prefetch buffer are moved into the cache by a fill which does not read the next level
+      const bool prefetched = this->prefetcher.type != NO_PREFETCH && this->prefetcher.inBuffer(line);
+      if (newRequest && this->prefetcher.type != NO_PREFETCH)
+        this->prefetcher.train(this->requestPc, addr, !hit && !pending && !prefetched);
+
+      if (hit) {
+        if (newRequest && mshrCount != 0)
+          numberHitUnderMiss++;
+
+        ac_int<LINE_SIZE * 8, false> lineData = this->cacheMemory[place][set].template slc<LINE_SIZE * 8>(TAG_SIZE);
+        if (opType == STORE) {
+          writeLine(lineData, offset, mask, dataIn);
+          this->valStore = this->cacheMemory[place][set];
+          this->valStore.set_slc(TAG_SIZE, lineData);
+          this->placeStore = place;
+          this->setStore   = set;
+          this->wasStore   = true;
+          waitOut          = true;
+        } else {
+          dataOut = readLine(lineData, offset, mask);
+        }
+        this->policy.touch(place, set);
+
+      } else {
+        if (newRequest) {
+          if (pending)
+            numberSecondaryMiss++;
+          else if (!prefetched)
+            this->numberMiss++;
+        }
+
+        if (!pending) {
+          if (mshrCount < activeMshrs) {
+            // Allocation at the tail of the queue
+            ac_int<8, false> tail = mshrHead + mshrCount;
+            if (tail >= MSHRS)
+              tail -= MSHRS;
+            mshr              = tail;
+            mshrLine[mshr]    = line;
+            mshrValid[mshr]   = true;
+            mshrTargets[mshr] = 0;
+            mshrCount++;
+            pending = true;
+          } else {
+            numberMshrFullCycles++;
+          }
+        }
+
+        if (!pending || !canDefer) {
+          // Waiting for a free MSHR, or for the line when the access cannot be deferred
+          waitOut = true;
+        } else if (mshrTargets[mshr] == TARGETS) {
+          numberMshrFullCycles++;
+          waitOut = true;
+        } else {
+          const ac_int<7, false> target = mshrTargets[mshr];
+          targetIsStore[mshr][target]   = opType == STORE;
+          targetMask[mshr][target]      = mask;
+          targetOffset[mshr][target]    = offset;
+          targetData[mshr][target]      = dataIn;
+          targetTag[mshr][target]       = tag;
+          mshrTargets[mshr]             = target + 1;
+          deferred                      = opType == LOAD;
+        }
+      }
+      retrying = waitOut;
+    }
+
+    this->nextLevel->process(this->nextLevelAddr, LONG, this->nextLevelOpType, this->nextLevelDataIn,
+                             this->nextLevelDataOut, this->nextLevelWaitOut);
+
+    this->backgroundResponse();
+    if (!this->nextLevelWaitOut) {
+      if (fillState == FILL_WRITEBACK) {
+        if (fillWord == 0) {
+          fillWord  = WORDS - 1;
+          fillState = (this->fromPrefetch || this->fromWriteBuffer) ? FILL_INSTALL : FILL_LOAD;
+        } else {
+          fillWord--;
+        }
+      } else if (fillState == FILL_LOAD) {
+        this->newVal.set_slc(TAG_SIZE + fillWord * INTERFACE_SIZE * 8, this->nextLevelDataOut);
+        if (fillWord == 0)
+          fillState = FILL_INSTALL;
+        else
+          fillWord--;
+      }
+    }
+  }
+
+#ifndef __HLS__
+  void serialize(Checkpoint& cp)
+  {
+    BlockingCache::serialize(cp);
+
+    cp.transfer(activeMshrs);
+    cp.transfer(mshrLine);
+    cp.transfer(mshrValid);
+    cp.transfer(mshrTargets);
+    cp.transfer(targetIsStore);
+    cp.transfer(targetMask);
+    cp.transfer(targetOffset);
+    cp.transfer(targetData);
+    cp.transfer(targetTag);
+    cp.transfer(mshrHead);
+    cp.transfer(mshrCount);
+    cp.transfer(fillState);
+    cp.transfer(fillWord);
+    cp.transfer(victimAddr);
+    cp.transfer(returnTag);
+    cp.transfer(returnValue);
+    cp.transfer(returnCount);
+    cp.transfer(returnIndex);
+    cp.transfer(completed);
+    cp.transfer(completedTag);
+    cp.transfer(completedValue);
+    cp.transfer(retrying);
+    cp.transfer(numberSecondaryMiss);
+    cp.transfer(numberHitUnderMiss);
+    cp.transfer(numberMshrFullCycles);
+  }
+
+  // Block transfers and flushes see the content of the cache only, they must happen once the cache is drained
+  void readBlock(const unsigned int addr, unsigned char* dst, const unsigned int size)
+  {
+    checkDrained();
+    BlockingCache::readBlock(addr, dst, size);
+  }
+
+  void writeBlock(const unsigned int addr, const unsigned char* src, const unsigned int size)
+  {
+    checkDrained();
+    BlockingCache::writeBlock(addr, src, size);
+  }
+
+  void flushAll()
+  {
+    checkDrained();
+    BlockingCache::flushAll();
+  }
+
+  void checkDrained()
+  {
+    if (!isDrained()) {
+      fprintf(stderr, "Error: direct access to a lockup-free cache with outstanding misses\n");
+      exit(-1);
+    }
+  }
+#endif
+};
+
+#endif // __NON_BLOCKING_CACHE_MEMORY_H__
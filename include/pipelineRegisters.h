@@ -32,12 +32,18 @@ struct ForwardReg {
   bool forwardExtoVal1;
   bool forwardExtoVal2;
   bool forwardExtoVal3;
+
+  // The forwarded value comes from the second way of the dual-issue pipeline
+  bool forwardSecondWayVal1;
+  bool forwardSecondWayVal2;
+  bool forwardSecondWayVal3;
 };
 
 struct FtoDC {
-  FtoDC() : pc(0), instruction(0x13), we(1) {}
+  FtoDC() : pc(0), instruction(0x13), isCompressed(0), we(1) {}
   ac_int<32, false> pc;          // PC where to fetch
   ac_int<32, false> instruction; // Instruction to execute
+  bool isCompressed;             // 16-bit instruction, expanded by fetch
   ac_int<32, false> nextPCFetch; // Next pc according to fetch
 
   // Register for all stages
@@ -47,6 +53,7 @@ struct FtoDC {
 struct DCtoEx {
   ac_int<32, false> pc; // used for branch
   ac_int<32, false> instruction;
+  bool isCompressed;
 
   ac_int<7, false> opCode; // opCode = instruction[6:0]
   ac_int<7, false> funct7; // funct7 = instruction[31:25]
@@ -107,6 +114,8 @@ struct MemtoWB {
   ac_int<4, false> byteEnable;
   bool isStore;
   bool isLoad;
+  bool isAtomic;             // read-modify-write of the A extension, the value read is the result
+  ac_int<5, false> atomicOp; // its funct5
 
   // Register for all stages
   bool we;
@@ -0,0 +1,258 @@
+/** Copyright 2021 INRIA, Université de Rennes 1 and ENS Rennes
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#ifndef __PREFETCHER_H__
+#define __PREFETCHER_H__
+
+#include "integerTypes.h"
+#include "logarithm.h"
+
+#ifndef __HLS__
+#include "checkpoint.h"
+#endif
+
+/************************************************************************
+ * 	Sizes of the prefetcher structures:
+ * 		- PREFETCH_BUFFER_SIZE: lines held in the prefetch buffer
+ * 		- PREFETCH_QUEUE_SIZE: lines waiting to be prefetched
+ * 		- PREFETCH_TABLE_SIZE: entries of the stride table (power of two)
+ ************************************************************************/
+#ifndef PREFETCH_BUFFER_SIZE
+#define PREFETCH_BUFFER_SIZE 4
+#endif
+#ifndef PREFETCH_QUEUE_SIZE
+#define PREFETCH_QUEUE_SIZE 4
+#endif
+#ifndef PREFETCH_TABLE_SIZE
+#define PREFETCH_TABLE_SIZE 16
+#endif
+
+// Prefetchers attached to a cache:
+// 	- next-line: a miss, or a hit on a prefetched line, prefetches the following line (tagged prefetching)
+// 	- stride: per-pc reference prediction table (Chen and Baer), the line at addr + stride is prefetched once the
+// 	  same stride has been seen twice in a row
+// 	- stream: stream buffer (Jouppi, ISCA 1990), a miss restarts a stream of PREFETCH_BUFFER_SIZE sequential lines
+// 	  after the missing one, and each hit in the buffer prefetches one more line of the stream
+typedef enum { NO_PREFETCH = 0, NEXT_LINE_PREFETCH, STRIDE_PREFETCH, STREAM_PREFETCH } prefetcherType;
+
+/******************************************************************************************
+ * Prediction part of a prefetcher and its prefetch buffer
+ *
+ * The cache calls train() on each access, fetches the lines given by peek() into its idle
+ * cycles and gives them to fill(). Prefetched lines are held in a small fully associative
+ * buffer (FIFO replacement) until a miss moves them into the cache with take(), so that
+ * useless prefetches never evict useful lines.
+ * ****************************************************************************************
+ */
+template <int LINE_SIZE> class Prefetcher {
+  static const int LOG_LINE_SIZE  = log2const<LINE_SIZE>::value;
+  static const int LOG_TABLE_SIZE = log2const<PREFETCH_TABLE_SIZE>::value;
+  typedef ac_int<32 - LOG_LINE_SIZE, false> lineAddress;
+
+  // Lines waiting to be prefetched, a circular queue
+  lineAddress queue[PREFETCH_QUEUE_SIZE];
+  ac_int<8, false> queueHead, queueCount;
+
+  // Prefetch buffer
+  lineAddress bufferLine[PREFETCH_BUFFER_SIZE];
+  bool bufferValid[PREFETCH_BUFFER_SIZE];
+  ac_int<LINE_SIZE * 8, false> bufferData[PREFETCH_BUFFER_SIZE];
+  ac_int<8, false> bufferNext;
+
+  // Stride table, indexed by the pc
+  ac_int<32, false> tablePc[PREFETCH_TABLE_SIZE];
+  ac_int<32, false> tableAddr[PREFETCH_TABLE_SIZE];
+  ac_int<32, false> tableStride[PREFETCH_TABLE_SIZE];
+  ac_int<2, false> tableConfidence[PREFETCH_TABLE_SIZE];
+
+  // Stream: next line of the stream and lines which can still be prefetched ahead
+  lineAddress streamNext;
+  ac_int<8, false> streamAhead;
+
+  void push(const lineAddress line)
+  {
+    for (int oneEntry = 0; oneEntry < PREFETCH_QUEUE_SIZE; oneEntry++)
+      if (oneEntry < queueCount && queue[(queueHead + oneEntry) % PREFETCH_QUEUE_SIZE] == line)
+        return;
+    if (queueCount == PREFETCH_QUEUE_SIZE)
+      return;
+    queue[(queueHead + queueCount) % PREFETCH_QUEUE_SIZE] = line;
+    queueCount++;
+  }
+
+public:
+  prefetcherType type;
+
+  // Stats: lines fetched into the buffer and misses served from the buffer
+  unsigned long numberPrefetch, numberUseful;
+
+  Prefetcher()
+  {
+    type = NO_PREFETCH;
+    clear();
+    for (int oneEntry = 0; oneEntry < PREFETCH_TABLE_SIZE; oneEntry++) {
+      tablePc[oneEntry]         = 0;
+      tableAddr[oneEntry]       = 0;
+      tableStride[oneEntry]     = 0;
+      tableConfidence[oneEntry] = 0;
+    }
+    numberPrefetch = 0;
+    numberUseful   = 0;
+  }
+
+  // Empties the queue, the buffer and the stream
+  void clear()
+  {
+    queueHead  = 0;
+    queueCount = 0;
+    for (int oneEntry = 0; oneEntry < PREFETCH_BUFFER_SIZE; oneEntry++)
+      bufferValid[oneEntry] = false;
+    bufferNext  = 0;
+    streamNext  = 0;
+    streamAhead = 0;
+  }
+
+  // Called on each access from the upper level, miss being false on a hit in the cache or in the buffer
+  void train(const ac_int<32, false> pc, const ac_int<32, false> addr, const bool miss)
+  {
+    const lineAddress line = addr.slc<32 - LOG_LINE_SIZE>(LOG_LINE_SIZE);
+
+    if (type == NEXT_LINE_PREFETCH) {
+      if (miss)
+        push(line + 1);
+    } else if (type == STRIDE_PREFETCH) {
+      const ac_int<LOG_TABLE_SIZE, false> index = pc.slc<LOG_TABLE_SIZE>(2);
+      if (tablePc[index] != pc) {
+        tablePc[index]         = pc;
+        tableStride[index]     = 0;
+        tableConfidence[index] = 0;
+      } else {
+        const ac_int<32, false> stride = addr - tableAddr[index];
+        if (stride == tableStride[index]) {
+          if (tableConfidence[index] != 3)
+            tableConfidence[index]++;
+        } else if (tableConfidence[index] != 0) {
+          tableConfidence[index]--;
+        } else {
+          tableStride[index] = stride;
+        }
+
+        const ac_int<32, false> next = addr + tableStride[index];
+        const lineAddress nextLine   = next.slc<32 - LOG_LINE_SIZE>(LOG_LINE_SIZE);
+        if (tableConfidence[index] >= 2 && nextLine != line)
+          push(nextLine);
+      }
+      tableAddr[index] = addr;
+    } else if (type == STREAM_PREFETCH) {
+      if (miss) {
+        clear();
+        streamNext  = line + 1;
+        streamAhead = PREFETCH_BUFFER_SIZE;
+      }
+    }
+  }
+
+  // Next line to prefetch, removed with pop() once handled
+  bool peek(lineAddress& line)
+  {
+    if (type == STREAM_PREFETCH) {
+      line = streamNext;
+      return streamAhead != 0;
+    }
+    line = queue[queueHead];
+    return queueCount != 0;
+  }
+
+  void pop()
+  {
+    if (type == STREAM_PREFETCH) {
+      streamNext++;
+      streamAhead--;
+    } else {
+      queueHead = (queueHead + 1) % PREFETCH_QUEUE_SIZE;
+      queueCount--;
+    }
+  }
+
+  bool inBuffer(const lineAddress line)
+  {
+    bool result = false;
+    for (int oneEntry = 0; oneEntry < PREFETCH_BUFFER_SIZE; oneEntry++)
+      if (bufferValid[oneEntry] && bufferLine[oneEntry] == line)
+        result = true;
+    return result;
+  }
+
+  // A prefetched line arrived
+  void fill(const lineAddress line, const ac_int<LINE_SIZE * 8, false> data)
+  {
+    bufferLine[bufferNext]  = line;
+    bufferData[bufferNext]  = data;
+    bufferValid[bufferNext] = true;
+    bufferNext              = (bufferNext + 1) % PREFETCH_BUFFER_SIZE;
+    numberPrefetch++;
+  }
+
+  // Looks for a missing line in the buffer, the line leaves the buffer for the cache
+  bool take(const lineAddress line, ac_int<LINE_SIZE * 8, false>& data)
+  {
+    bool found = false;
+    for (int oneEntry = 0; oneEntry < PREFETCH_BUFFER_SIZE; oneEntry++) {
+      if (bufferValid[oneEntry] && bufferLine[oneEntry] == line) {
+        found                 = true;
+        data                  = bufferData[oneEntry];
+        bufferValid[oneEntry] = false;
+      }
+    }
+    if (found) {
+      numberUseful++;
+      if (type == NEXT_LINE_PREFETCH)
+        push(line + 1);
+      else if (type == STREAM_PREFETCH)
+        streamAhead++;
+    }
+    return found;
+  }
+
+  // The content of the line changed behind the prefetcher (e.g. simulator writes)
+  void invalidate(const lineAddress line)
+  {
+    for (int oneEntry = 0; oneEntry < PREFETCH_BUFFER_SIZE; oneEntry++)
+      if (bufferLine[oneEntry] == line)
+        bufferValid[oneEntry] = false;
+  }
+
+#ifndef __HLS__
+  void serialize(Checkpoint& cp)
+  {
+    cp.transfer(type);
+    cp.transfer(queue);
+    cp.transfer(queueHead);
+    cp.transfer(queueCount);
+    cp.transfer(bufferLine);
+    cp.transfer(bufferValid);
+    cp.transfer(bufferData);
+    cp.transfer(bufferNext);
+    cp.transfer(tablePc);
+    cp.transfer(tableAddr);
+    cp.transfer(tableStride);
+    cp.transfer(tableConfidence);
+    cp.transfer(streamNext);
+    cp.transfer(streamAhead);
+    cp.transfer(numberPrefetch);
+    cp.transfer(numberUseful);
+  }
+#endif
+};
+
+#endif // __PREFETCHER_H__
@@ -0,0 +1,57 @@
+/** Copyright 2021 INRIA, Université de Rennes 1 and ENS Rennes
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#ifndef __QUANTUM_POOL_H__
+#define __QUANTUM_POOL_H__
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/******************************************************************************************
+ * Host threads of the multi-core simulation
+ *
+ * The harts are simulated by quanta of cycles: run() gives the tasks of a quantum (one per
+ * running hart) to the threads, which take them one after the other, and returns once all
+ * of them are done, so that no hart starts the next quantum before the others reached the
+ * end of this one. The calling thread takes tasks as well, a pool of one thread runs them
+ * in order without any other thread.
+ * ****************************************************************************************
+ */
+class QuantumPool {
+  std::vector<std::thread> workers;
+  std::mutex lock;
+  std::condition_variable start, done;
+  unsigned long generation; // quanta given to the workers
+  int busy;                 // workers still running tasks of the quantum
+  bool stopping;
+
+  const std::function<void(unsigned int)>* task;
+  unsigned int count;
+  std::atomic<unsigned int> next; // next task to take
+
+  void work();
+  void worker();
+
+public:
+  QuantumPool(const int threads);
+  ~QuantumPool();
+
+  // Calls task(i) for i in [0, count) on the threads
+  void run(const unsigned int count, const std::function<void(unsigned int)>& task);
+};
+
+#endif // __QUANTUM_POOL_H__
@@ -0,0 +1,194 @@
+/** Copyright 2021 INRIA, Université de Rennes 1 and ENS Rennes
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#ifndef __REPLACEMENT_POLICY_H__
+#define __REPLACEMENT_POLICY_H__
+
+#include "integerTypes.h"
+#include "logarithm.h"
+
+#ifndef __HLS__
+#include "checkpoint.h"
+#endif
+
+/************************************************************************
+ * Replacement policies for CacheMemory
+ *
+ * Each policy is a template on SET_SIZE and ASSOCIATIVITY and provides:
+ * 	- victim(place): the way to evict when the set has no invalid line
+ * 	- touch(place, way): called on a hit
+ * 	- insert(place, way): called when a line is filled
+ * All loops have constant bounds so that they are unrolled by HLS.
+ ************************************************************************/
+
+// True LRU: each line holds its rank in the set (0 is the most recently used), LOG_ASSOCIATIVITY bits per line
+template <int SET_SIZE, int ASSOCIATIVITY> class LruPolicy {
+  static const int LOG_ASSOCIATIVITY = log2const<ASSOCIATIVITY>::value;
+
+  ac_int<LOG_ASSOCIATIVITY, false> rank[SET_SIZE][ASSOCIATIVITY];
+
+public:
+  LruPolicy()
+  {
+    for (int oneSetElement = 0; oneSetElement < SET_SIZE; oneSetElement++)
+      for (int oneSet = 0; oneSet < ASSOCIATIVITY; oneSet++)
+        rank[oneSetElement][oneSet] = oneSet;
+  }
+
+  ac_int<LOG_ASSOCIATIVITY, false> victim(const ac_int<log2const<SET_SIZE>::value, false> place)
+  {
+    ac_int<LOG_ASSOCIATIVITY, false> result = 0;
+    for (int oneSet = 0; oneSet < ASSOCIATIVITY; oneSet++)
+      if (rank[place][oneSet] == ASSOCIATIVITY - 1)
+        result = oneSet;
+    return result;
+  }
+
+  void touch(const ac_int<log2const<SET_SIZE>::value, false> place, const ac_int<LOG_ASSOCIATIVITY, false> way)
+  {
+    const ac_int<LOG_ASSOCIATIVITY, false> oldRank = rank[place][way];
+    for (int oneSet = 0; oneSet < ASSOCIATIVITY; oneSet++)
+      if (rank[place][oneSet] < oldRank)
+        rank[place][oneSet]++;
+    rank[place][way] = 0;
+  }
+
+  void insert(const ac_int<log2const<SET_SIZE>::value, false> place, const ac_int<LOG_ASSOCIATIVITY, false> way)
+  {
+    touch(place, way);
+  }
+
+#ifndef __HLS__
+  void serialize(Checkpoint& cp) { cp.transfer(rank); }
+#endif
+};
+
+// Tree pseudo-LRU: ASSOCIATIVITY - 1 bits per set, each node points to the half of its subtree to evict next
+template <int SET_SIZE, int ASSOCIATIVITY> class TreePlruPolicy {
+  static const int LOG_ASSOCIATIVITY = log2const<ASSOCIATIVITY>::value;
+
+  // Node i has children 2i+1 and 2i+2, leaves are the ways
+  ac_int<ASSOCIATIVITY, false> tree[SET_SIZE];
+
+public:
+  TreePlruPolicy()
+  {
+    for (int oneSetElement = 0; oneSetElement < SET_SIZE; oneSetElement++)
+      tree[oneSetElement] = 0;
+  }
+
+  ac_int<LOG_ASSOCIATIVITY, false> victim(const ac_int<log2const<SET_SIZE>::value, false> place)
+  {
+    int node = 0;
+    for (int level = 0; level < LOG_ASSOCIATIVITY; level++)
+      node = 2 * node + 1 + tree[place][node];
+    return node - (ASSOCIATIVITY - 1);
+  }
+
+  void touch(const ac_int<log2const<SET_SIZE>::value, false> place, const ac_int<LOG_ASSOCIATIVITY, false> way)
+  {
+    // Walk up from the leaf and make every node on the path point away from it
+    int node = way + ASSOCIATIVITY - 1;
+    for (int level = 0; level < LOG_ASSOCIATIVITY; level++) {
+      const int parent = (node - 1) >> 1;
+      tree[place][parent] = (node == 2 * parent + 1);
+      node = parent;
+    }
+  }
+
+  void insert(const ac_int<log2const<SET_SIZE>::value, false> place, const ac_int<LOG_ASSOCIATIVITY, false> way)
+  {
+    touch(place, way);
+  }
+
+#ifndef __HLS__
+  void serialize(Checkpoint& cp) { cp.transfer(tree); }
+#endif
+};
+
+// Pseudo-random: the victim is taken from a 16-bit Fibonacci LFSR (x^16 + x^14 + x^13 + x^11 + 1), shared by all sets
+template <int SET_SIZE, int ASSOCIATIVITY> class RandomPolicy {
+  static const int LOG_ASSOCIATIVITY = log2const<ASSOCIATIVITY>::value;
+
+  ac_int<16, false> lfsr;
+
+public:
+  RandomPolicy() { lfsr = 0xace1; }
+
+  ac_int<LOG_ASSOCIATIVITY, false> victim(const ac_int<log2const<SET_SIZE>::value, false> place)
+  {
+    const ac_int<1, false> feedback = lfsr[0] ^ lfsr[2] ^ lfsr[3] ^ lfsr[5];
+    lfsr                            = (lfsr >> 1) | (ac_int<16, false>(feedback) << 15);
+    return lfsr.template slc<LOG_ASSOCIATIVITY>(0);
+  }
+
+  void touch(const ac_int<log2const<SET_SIZE>::value, false> place, const ac_int<LOG_ASSOCIATIVITY, false> way) {}
+
+  void insert(const ac_int<log2const<SET_SIZE>::value, false> place, const ac_int<LOG_ASSOCIATIVITY, false> way) {}
+
+#ifndef __HLS__
+  void serialize(Checkpoint& cp) { cp.transfer(lfsr); }
+#endif
+};
+
+// Static RRIP (Jaleel et al., ISCA 2010) with 2-bit re-reference prediction values: lines are inserted with a
+// long re-reference interval (2), promoted to 0 on a hit, and the victim is a line predicted as distant (3), all
+// the lines of the set being aged until one is found.
+template <int SET_SIZE, int ASSOCIATIVITY> class SrripPolicy {
+  static const int LOG_ASSOCIATIVITY = log2const<ASSOCIATIVITY>::value;
+  static const int RRPV_DISTANT      = 3;
+  static const int RRPV_LONG         = 2;
+
+  ac_int<2, false> rrpv[SET_SIZE][ASSOCIATIVITY];
+
+public:
+  SrripPolicy()
+  {
+    for (int oneSetElement = 0; oneSetElement < SET_SIZE; oneSetElement++)
+      for (int oneSet = 0; oneSet < ASSOCIATIVITY; oneSet++)
+        rrpv[oneSetElement][oneSet] = RRPV_DISTANT;
+  }
+
+  ac_int<LOG_ASSOCIATIVITY, false> victim(const ac_int<log2const<SET_SIZE>::value, false> place)
+  {
+    // Aging until a line reaches RRPV_DISTANT is done in one step by adding the distance of the oldest line
+    ac_int<2, false> oldest                 = 0;
+    ac_int<LOG_ASSOCIATIVITY, false> result = 0;
+    for (int oneSet = ASSOCIATIVITY - 1; oneSet >= 0; oneSet--) {
+      if (rrpv[place][oneSet] >= oldest) {
+        oldest = rrpv[place][oneSet];
+        result = oneSet;
+      }
+    }
+    const ac_int<2, false> distance = RRPV_DISTANT - oldest;
+    for (int oneSet = 0; oneSet < ASSOCIATIVITY; oneSet++)
+      rrpv[place][oneSet] += distance;
+    return result;
+  }
+
+  void touch(const ac_int<log2const<SET_SIZE>::value, false> place, const ac_int<LOG_ASSOCIATIVITY, false> way)
+  {
+    rrpv[place][way] = 0;
+  }
+
+  void insert(const ac_int<log2const<SET_SIZE>::value, false> place, const ac_int<LOG_ASSOCIATIVITY, false> way)
+  {
+    rrpv[place][way] = RRPV_LONG;
+  }
+
+#ifndef __HLS__
+  void serialize(Checkpoint& cp) { cp.transfer(rrpv); }
+#endif
+};
+
+#endif // __REPLACEMENT_POLICY_H__
@@ -0,0 +1,215 @@
+/** Copyright 2021 INRIA, Université de Rennes 1 and ENS Rennes
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#ifndef __RETURN_ADDRESS_STACK_H__
+#define __RETURN_ADDRESS_STACK_H__
+
+#include "integerTypes.h"
+#include "logarithm.h"
+#include "riscvISA.h"
+
+#ifndef __HLS__
+#include <cstdio>
+#include <cstdlib>
+
+#include "checkpoint.h"
+#endif
+
+/************************************************************************
+ * 	Largest number of entries of the return address stack (power of two),
+ * 	the number used is chosen at run time
+ ************************************************************************/
+#ifndef RAS_ENTRIES
+#define RAS_ENTRIES 16
+#endif
+
+// Registers holding return addresses in the calling convention, see the hints of JAL and JALR in the ISA
+inline bool isLinkRegister(const ac_int<5, false> reg)
+{
+  return reg == 1 || reg == 5;
+}
+
+// Calls push their return address, returns pop the address they go back to
+inline bool isCall(const ac_int<7, false> opCode, const ac_int<5, false> rd)
+{
+  return (opCode == RISCV_JAL || opCode == RISCV_JALR) && isLinkRegister(rd);
+}
+
+inline bool isReturn(const ac_int<7, false> opCode, const ac_int<5, false> rd, const ac_int<5, false> rs1)
+{
+  return opCode == RISCV_JALR && isLinkRegister(rs1) && (!isLinkRegister(rd) || rd != rs1);
+}
+
+/******************************************************************************************
+ * Return address stack
+ *
+ * Circular stack of the return addresses of the calls decoded so far. Decode pops it on a
+ * return and goes to the address on top instead of waiting for execute to compute the
+ * target of the JALR. Older entries are overwritten when there are more nested calls than
+ * entries, and returns find an empty stack once the stack has been unwound further.
+ *
+ * Decode updates the stack before it knows whether execute squashes the instruction, so
+ * the state before the last update is kept (top, number of entries and the entry it
+ * overwrote) and restored when execute redirects fetch.
+ * ****************************************************************************************
+ */
+template <int ENTRIES> class ReturnAddressStack {
+  static const int LOG_ENTRIES = log2const<ENTRIES>::value;
+
+  ac_int<32, false> stack[ENTRIES];
+  ac_int<LOG_ENTRIES, false> top;
+  ac_int<LOG_ENTRIES + 1, false> count;
+
+  // State before the instruction handled by decode in the last cycle: a push may have overwritten an entry
+  ac_int<LOG_ENTRIES, false> savedTop;
+  ac_int<LOG_ENTRIES + 1, false> savedCount;
+  ac_int<32, false> savedEntry;
+  bool savedPush, savedOverflow;
+
+  ac_int<LOG_ENTRIES, false> next(const ac_int<LOG_ENTRIES, false> entry)
+  {
+    return entry == entries - 1 ? (ac_int<LOG_ENTRIES, false>)0 : (ac_int<LOG_ENTRIES, false>)(entry + 1);
+  }
+  ac_int<LOG_ENTRIES, false> previous(const ac_int<LOG_ENTRIES, false> entry)
+  {
+    return entry == 0 ? (ac_int<LOG_ENTRIES, false>)(entries - 1) : (ac_int<LOG_ENTRIES, false>)(entry - 1);
+  }
+
+public:
+  int entries; // 0 when there is no RAS
+
+  // Stats: returns executed, returns whose target was on top of the stack, calls which overwrote an entry
+  unsigned long numberReturn, numberHit, numberOverflow;
+
+  ReturnAddressStack() { configure(0); }
+
+  void configure(const int rasEntries)
+  {
+    entries = rasEntries;
+    for (int oneEntry = 0; oneEntry < ENTRIES; oneEntry++)
+      stack[oneEntry] = 0;
+    top            = 0;
+    count          = 0;
+    savedTop       = 0;
+    savedCount     = 0;
+    savedEntry     = 0;
+    savedPush      = false;
+    savedOverflow  = false;
+    numberReturn   = 0;
+    numberHit      = 0;
+    numberOverflow = 0;
+  }
+
+  // Called in every cycle in which decode hands an instruction (valid) or a bubble to execute, with the address
+  // following the instruction. On a return, predicted tells whether there was an address to go back to and target
+  // gives it.
+  void process(const bool valid, const ac_int<32, false> nextPC, const ac_int<7, false> opCode,
+               const ac_int<5, false> rd, const ac_int<5, false> rs1, bool& predicted, ac_int<32, false>& target)
+  {
+    savedTop      = top;
+    savedCount    = count;
+    savedPush     = false;
+    savedOverflow = false;
+    predicted     = false;
+    if (!valid || entries == 0)
+      return;
+
+    if (isReturn(opCode, rd, rs1) && count != 0) {
+      predicted = true;
+      target    = stack[top];
+      top       = previous(top);
+      count--;
+    }
+    if (isCall(opCode, rd)) {
+      top        = next(top);
+      savedPush  = true;
+      savedEntry = stack[top];
+      stack[top] = nextPC;
+      if (count == entries) {
+        savedOverflow = true;
+        numberOverflow++;
+      } else {
+        count++;
+      }
+    }
+  }
+
+  // Called when execute redirects fetch: the instruction decode handled in this cycle is squashed
+  void repair()
+  {
+    if (savedPush)
+      stack[top] = savedEntry;
+    if (savedOverflow)
+      numberOverflow--;
+    top           = savedTop;
+    count         = savedCount;
+    savedPush     = false;
+    savedOverflow = false;
+  }
+
+  // Called when execute resolves a return, with whether decode went to the right address
+  void update(const bool hit)
+  {
+    numberReturn++;
+    numberHit += hit;
+  }
+
+  // Functional warming: the pushes and pops of process() without the state kept for repair() nor the stats.
+  // Returns true on a return finding an address, given in target.
+  bool warm(const ac_int<32, false> nextPC, const bool call, const bool ret, ac_int<32, false>& target)
+  {
+    bool predicted = false;
+    if (entries == 0)
+      return predicted;
+
+    if (ret && count != 0) {
+      predicted = true;
+      target    = stack[top];
+      top       = previous(top);
+      count--;
+    }
+    if (call) {
+      top        = next(top);
+      stack[top] = nextPC;
+      if (count != entries)
+        count++;
+    }
+    return predicted;
+  }
+
+#ifndef __HLS__
+  void serialize(Checkpoint& cp)
+  {
+    int savedEntries = entries;
+    cp.transfer(savedEntries);
+    if (savedEntries != entries) {
+      fprintf(stderr, "Error: the checkpoint was made with another return address stack\n");
+      exit(-1);
+    }
+
+    cp.transfer(stack);
+    cp.transfer(top);
+    cp.transfer(count);
+    cp.transfer(savedTop);
+    cp.transfer(savedCount);
+    cp.transfer(savedEntry);
+    cp.transfer(savedPush);
+    cp.transfer(savedOverflow);
+    cp.transfer(numberReturn);
+    cp.transfer(numberHit);
+    cp.transfer(numberOverflow);
+  }
+#endif
+};
+
+#endif // __RETURN_ADDRESS_STACK_H__
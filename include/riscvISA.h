@@ -161,6 +161,17 @@ std::string printDecodedInstrRISCV(unsigned int oneInstruction);
 #define RISCV_CSR_MINSTRET 0xB02  // MRW minstret Machine instructions-retired counter.
 #define RISCV_CSR_MCYCLEH 0xB80   // MRW mcycleh Upper 32 bits of mcycle, RV32I only.
 #define RISCV_CSR_MINSTRETH 0xB82 // MRW minstreth Upper 32 bits of minstret, RV32I only.
+#define RISCV_CSR_MHPMCOUNTER3 0xB03  // MRW mhpmcounter3 to mhpmcounter31 Machine performance-monitoring counters.
+#define RISCV_CSR_MHPMCOUNTER3H 0xB83 // MRW mhpmcounter3h to mhpmcounter31h Upper 32 bits, RV32I only.
+#define RISCV_CSR_MHPMEVENT3 0x323    // MRW mhpmevent3 to mhpmevent31 Machine performance-monitoring event selectors.
+
+// User Counter/Timers, read-only shadows of the machine counters
+#define RISCV_CSR_CYCLE 0xC00        // URO cycle Cycle counter for RDCYCLE instruction.
+#define RISCV_CSR_TIME 0xC01         // URO time Timer for RDTIME instruction.
+#define RISCV_CSR_INSTRET 0xC02      // URO instret Instructions-retired counter for RDINSTRET instruction.
+#define RISCV_CSR_HPMCOUNTER3 0xC03  // URO hpmcounter3 to hpmcounter31 Performance-monitoring counters.
+#define RISCV_CSR_CYCLEH 0xC80       // URO cycleh Upper 32 bits of cycle, RV32I only.
+#define RISCV_CSR_HPMCOUNTER3H 0xC83 // URO hpmcounter3h to hpmcounter31h Upper 32 bits, RV32I only.
 
 /******************************************************************************************************
  * Specification of the standard M extension
@@ -207,6 +218,32 @@ std::string printDecodedInstrRISCV(unsigned int oneInstruction);
 #define RISCV_ATOMIC_MINU 0x18
 #define RISCV_ATOMIC_MAXU 0x1C
 
+// Word written to memory by the atomic instruction of the given funct5 (an AMO, or SC which writes operand) over
+// the word old read from it
+static inline unsigned int atomicValue(const unsigned int funct5, const unsigned int old, const unsigned int operand)
+{
+  switch (funct5) {
+    case RISCV_ATOMIC_ADD:
+      return old + operand;
+    case RISCV_ATOMIC_XOR:
+      return old ^ operand;
+    case RISCV_ATOMIC_AND:
+      return old & operand;
+    case RISCV_ATOMIC_OR:
+      return old | operand;
+    case RISCV_ATOMIC_MIN:
+      return (int)old < (int)operand ? old : operand;
+    case RISCV_ATOMIC_MAX:
+      return (int)old > (int)operand ? old : operand;
+    case RISCV_ATOMIC_MINU:
+      return old < operand ? old : operand;
+    case RISCV_ATOMIC_MAXU:
+      return old > operand ? old : operand;
+    default: // RISCV_ATOMIC_SWAP, RISCV_ATOMIC_SC
+      return operand;
+  }
+}
+
 #ifndef __CATAPULT
 #ifndef __NIOS
 // std::string printDecodedInstrRISCV(uint32 instruction);
@@ -217,6 +254,7 @@ extern const char* riscvNamesOPIW[8];
 extern const char* riscvNamesLD[8];
 extern const char* riscvNamesST[8];
 extern const char* riscvNamesBR[8];
+extern const char* riscvNamesATOMIC[32];
 extern const char* riscvNames[8];
 #endif
 #endif
@@ -265,6 +303,12 @@ extern const char* riscvNames[8];
 // Custom syscall
 #define SYS_threadstart 0x1234
 #define SYS_nbcore 0x4321
+// Statistics: SYS_stats_reset restarts them, SYS_stats_dump prints them, SYS_roi_begin and SYS_roi_end do the same
+// around the region of interest, which is the only one simulated by the pipeline with --roi
+#define SYS_roi_begin 0x1235
+#define SYS_roi_end 0x1236
+#define SYS_stats_reset 0x1237
+#define SYS_stats_dump 0x1238
 // end of custom syscall
 
 // Translation of flags from riscv to local machine
@@ -0,0 +1,65 @@
+/** Copyright 2021 INRIA, Université de Rennes 1 and ENS Rennes
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#ifndef __SIMPOINT_H__
+#define __SIMPOINT_H__
+
+#include <vector>
+
+#include "dbt.h"
+
+/******************************************************************************************
+ * Sampled simulation
+ *
+ * The program is cut in intervals of a fixed number of instructions, whose basic block
+ * vectors are gathered by the binary translator. As in SimPoint, the vectors are normalized,
+ * projected on SIMPOINT_DIMENSIONS random dimensions and clustered with k-means; k is the
+ * smallest number of clusters whose BIC reaches SIMPOINT_BIC_THRESHOLD of the range of the
+ * scores up to the maximum given. Each cluster is represented by the interval closest to its
+ * centroid, followed by members drawn at random which give the variance of the CPI in the
+ * cluster, hence the error bounds of the estimate (stratified sampling).
+ * ****************************************************************************************
+ */
+
+#define SIMPOINT_DIMENSIONS 15
+#define SIMPOINT_BIC_THRESHOLD 0.9
+#define SIMPOINT_KMEANS_SEEDS 5
+#define SIMPOINT_KMEANS_ITERATIONS 100
+
+struct SimPoint {
+  unsigned long interval; // index of the interval
+  unsigned int cluster;
+  unsigned long clusterIntervals;
+  double weight; // fraction of the instructions of the program it stands for
+};
+
+struct SimPointSet {
+  unsigned long intervalSize; // instructions
+  unsigned int clusters;
+  std::vector<SimPoint> points; // in program order
+};
+
+// Clusters the intervals and picks up to samplesPerCluster of each cluster
+SimPointSet pickSimPoints(const std::vector<BasicBlockVector>& intervals, const unsigned long intervalSize,
+                          const unsigned int maxClusters, const unsigned int samplesPerCluster);
+
+// Weighted CPI of the samples (cpi is in the order of set.points) and half width of its 95% confidence interval,
+// negative when a cluster was sampled once out of several intervals
+void estimateCPI(const SimPointSet& set, const std::vector<double>& cpi, double& estimate, double& error);
+
+// Vectors in the format of the SimPoint tool, one line per interval
+void writeBasicBlockVectors(const char* fileName, const std::vector<BasicBlockVector>& intervals);
+void writeSimPoints(const char* fileName, const SimPointSet& set);
+SimPointSet readSimPoints(const char* fileName);
+
+#endif // __SIMPOINT_H__
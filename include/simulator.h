@@ -16,17 +16,22 @@
 #ifndef __SIMULATOR_H__
 #define __SIMULATOR_H__
 
+#include <atomic>
+#include <string>
+
 #include "core.h"
 
 class Simulator {
 protected:
   Core core;
-  bool exitFlag;
+  std::atomic<bool> exitFlag; // also read by the host threads of the multi-core simulation
 
 
 public:
   int breakpoint;
   int timeout;
+  long checkpointAt = -1;
+  std::string checkpointFile;
   virtual void run()
   {
     exitFlag = false;
@@ -41,6 +46,12 @@ public:
       printf("Reached break\n");
       }
 
+      if (this->checkpointAt >= 0 && this->core.cycle == (unsigned long)this->checkpointAt) {
+        saveCheckpoint(checkpointFile.c_str());
+        printf("Checkpoint saved at cycle %ld\n", this->core.cycle);
+        return;
+      }
+
       if (this->core.cycle >= this->timeout){
         printf("Timeout!\n");
         break;
@@ -49,9 +60,17 @@ public:
     printEnd();
 	printCoreReg();
 	printf("\nCore cycle: %ld\n", this->core.cycle); 
+    printf("Instructions retired: %ld\n", this->core.instret);
   }
 
 
+  // Instruction-accurate execution, bypassing the pipeline (see iss.h)
+  virtual void runFunctional() = 0;
+
+  // Binary snapshot of the whole simulation state (see checkpoint.h)
+  virtual void saveCheckpoint(const char* fileName) = 0;
+  virtual void loadCheckpoint(const char* fileName) = 0;
+
   virtual void printCycle()   = 0;
   virtual void printEnd()     = 0;
   virtual void extend()       = 0;
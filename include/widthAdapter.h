@@ -0,0 +1,114 @@
+/** Copyright 2021 INRIA, Université de Rennes 1 and ENS Rennes
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#ifndef __WIDTH_ADAPTER_H__
+#define __WIDTH_ADAPTER_H__
+
+#include "memoryInterface.h"
+
+/******************************************************************************************
+ * Width adapter
+ *
+ * Connects a level with a wide interface (the instruction cache of the dual-issue core,
+ * which gives fetch a block of two words) to a narrower level below it. Accesses to a
+ * whole interface word (LONG) are split into consecutive accesses to the narrow level,
+ * from the last part down like the line transfers of the caches so that they continue
+ * their burst, and smaller ones are passed through. The narrow level sees the wide
+ * one through upperPort when it back-invalidates the levels above it.
+ * ****************************************************************************************
+ */
+template <unsigned int WIDE, unsigned int NARROW> class WidthAdapter : public MemoryInterface<WIDE> {
+  static const int PARTS = WIDE / NARROW;
+
+  MemoryInterface<NARROW>* narrow;
+  ac_int<WIDE * 8, false> buffer;
+  int part; // narrow access in progress, counted from the last one
+
+public:
+  class UpperPort : public MemoryInterface<NARROW> {
+  public:
+    MemoryInterface<WIDE>* upper;
+
+    void process(const ac_int<32, false> addr, const memMask mask, const memOpType opType,
+                 const ac_int<NARROW * 8, false> dataIn, ac_int<NARROW * 8, false>& dataOut, bool& waitOut)
+    {
+      waitOut = false;
+    }
+
+#ifndef __HLS__
+    bool invalidateBlock(const unsigned int addr, unsigned char* data, const unsigned int size)
+    {
+      return upper->invalidateBlock(addr, data, size);
+    }
+#endif
+  } upperPort;
+
+  WidthAdapter(MemoryInterface<NARROW>* narrowLevel) : narrow(narrowLevel), buffer(0), part(0)
+  {
+    upperPort.upper = NULL;
+  }
+
+  // The wide level is the one back-invalidated through upperPort
+  void setUpper(MemoryInterface<WIDE>* upper) { upperPort.upper = upper; }
+
+  void process(const ac_int<32, false> addr, const memMask mask, const memOpType opType,
+               const ac_int<WIDE * 8, false> dataIn, ac_int<WIDE * 8, false>& dataOut, bool& waitOut)
+  {
+    ac_int<NARROW * 8, false> narrowOut = 0;
+    if (mask != LONG || opType == NONE) {
+      narrow->process(addr, mask, opType, dataIn.template slc<NARROW * 8>(0), narrowOut, waitOut);
+      dataOut = narrowOut;
+      return;
+    }
+
+    const int index = PARTS - 1 - part;
+    narrow->process(addr + index * NARROW, LONG, opType, dataIn.template slc<NARROW * 8>(index * NARROW * 8),
+                    narrowOut, waitOut);
+    if (waitOut)
+      return;
+    buffer.set_slc(index * NARROW * 8, narrowOut);
+    if (part < PARTS - 1) {
+      part++;
+      waitOut = true;
+      return;
+    }
+    part    = 0;
+    dataOut = buffer;
+  }
+
+#ifndef __HLS__
+  void serialize(Checkpoint& cp)
+  {
+    cp.transfer(this->wait);
+    cp.transfer(buffer);
+    cp.transfer(part);
+    narrow->serialize(cp);
+  }
+
+  void flushAll() { narrow->flushAll(); }
+
+  void warm(const unsigned int addr, const unsigned int size, const bool isStore) { narrow->warm(addr, size, isStore); }
+
+  void readBlock(const unsigned int addr, unsigned char* dst, const unsigned int size)
+  {
+    narrow->readBlock(addr, dst, size);
+  }
+
+  void writeBlock(const unsigned int addr, const unsigned char* src, const unsigned int size)
+  {
+    narrow->writeBlock(addr, src, size);
+  }
+#endif
+};
+
+#endif // __WIDTH_ADAPTER_H__
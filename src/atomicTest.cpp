@@ -82,7 +82,7 @@ int main(int argc, char** argv)
     Core core;
     ac_int<32, false> im[8192], dm[8192];
 
-    core.im = new CacheMemory<4, 16, 64>(new IncompleteMemory<4>(im), false);
+    core.im = new CacheMemory<FETCH_INTERFACE_SIZE, 16, 64>(new IncompleteMemory<FETCH_INTERFACE_SIZE>(im), false);
     core.dm = new CacheMemory<4, 16, 64>(new IncompleteMemory<4>(dm), true);
 
     core.pc = initialState.pc;
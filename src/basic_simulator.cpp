@@ -17,9 +17,12 @@
 #include <fcntl.h>
 #include <cstdio>
 #include <cstdlib>
+#include <climits>
 #include <cstring>
+#include <algorithm>
 #include <sys/stat.h>
 #include <fstream>
+#include <map>
 
 #include <sys/time.h>
 #include <unistd.h>
@@ -28,31 +31,131 @@
 #include "basic_simulator.h"
 #include "core.h"
 #include "elfFile.h"
+#include "iss.h"
+#include "quantumPool.h"
 
 #define DEBUG 0
 
-BasicSimulator::BasicSimulator(const std::string binaryFile, const std::vector<std::string> args,
-                               const std::string inFile, const std::string outFile,
-                               const std::string tFile, const std::string sFile)
+static const char* predictorNames[] = {"bimodal", "gshare", "perceptron", "tage"};
+
+// Checks the geometry against the largest one of the predictor, 0 selecting its default
+static void configureBranchPredictor(BranchPredictor& bp, const BranchPredictorConfig& config)
 {
+  static const int defaultEntries[] = {4, 1024, 64, 1024};
+  static const int maxEntries[]     = {BP_MAX_ENTRIES, BP_MAX_ENTRIES, BP_PERCEPTRON_ENTRIES, BP_TAGE_ENTRIES};
+  static const int defaultHistory[] = {0, 0, 16, 32};
+  static const int maxHistory[]     = {0, BP_MAX_HISTORY, BP_PERCEPTRON_HISTORY, BP_MAX_HISTORY};
+  const int entries                 = config.entries ? config.entries : defaultEntries[config.type];
+  int history                       = config.history ? config.history : defaultHistory[config.type];
+
+  // By default, the history of gshare is as long as the index
+  if (config.type == GSHARE_PREDICTOR && config.history == 0)
+    while ((1 << history) < entries)
+      history++;
+
+  if (entries < 2 || entries > maxEntries[config.type] || (entries & (entries - 1)) != 0) {
+    fprintf(stderr, "Error: the %s predictor needs a power of two of entries between 2 and %d\n",
+            predictorNames[config.type], maxEntries[config.type]);
+    exit(-1);
+  }
+  if (history < 0 || history > maxHistory[config.type]) {
+    fprintf(stderr, "Error: the %s predictor uses at most %d bits of history\n", predictorNames[config.type],
+            maxHistory[config.type]);
+    exit(-1);
+  }
+  // The shortest table of TAGE uses history >> (BP_TAGE_TABLES - 1) bits
+  if (config.type == TAGE_PREDICTOR && history < (1 << (BP_TAGE_TABLES - 1))) {
+    fprintf(stderr, "Error: the tage predictor needs at least %d bits of history\n", 1 << (BP_TAGE_TABLES - 1));
+    exit(-1);
+  }
 
-  memset((char*)&core, 0, sizeof(Core));
+  bp.configure(config.type, entries, history);
+}
 
-  mem.reserve(DRAM_SIZE >> 2);
+static void configureBranchTargetBuffer(BranchTargetBuffer<BTB_ENTRIES, BTB_TAG_BITS>& btb,
+                                        const BranchPredictorConfig& config)
+{
+  if (config.btbEntries < 0 || config.btbEntries > BTB_ENTRIES || (config.btbEntries & (config.btbEntries - 1)) != 0) {
+    fprintf(stderr, "Error: the branch target buffer has a power of two of entries up to %d\n", BTB_ENTRIES);
+    exit(-1);
+  }
+  btb.configure(config.btbEntries);
+}
 
-  core.im = new SimpleMemory<4>(mem.data());
-  core.dm = new SimpleMemory<4>(mem.data());
+static void configureReturnAddressStack(ReturnAddressStack<RAS_ENTRIES>& ras, const BranchPredictorConfig& config)
+{
+  if (config.rasEntries < 0 || config.rasEntries > RAS_ENTRIES) {
+    fprintf(stderr, "Error: the return address stack has at most %d entries\n", RAS_ENTRIES);
+    exit(-1);
+  }
+  ras.configure(config.rasEntries);
+}
+
+static void configureCore(Core& core, CacheHierarchy& caches, BranchProfile& branchProfile,
+                          const BranchPredictorConfig& predictorConfig, const MulDivConfig& mulDivConfig)
+{
+  memset((char*)&core, 0, sizeof(Core));
+  for (int stage = STALL_FETCH; stage <= STALL_MEMORY; stage++)
+    core.bubbleCause[stage] = CPI_OTHER;
+
+  configureBranchPredictor(core.bp, predictorConfig);
+  configureBranchTargetBuffer(core.btb, predictorConfig);
+  configureReturnAddressStack(core.ras, predictorConfig);
+  core.bp.profile = &branchProfile;
+  core.multiplier = mulDivConfig.multiplier;
+  core.divider    = mulDivConfig.divider;
+
+  core.im           = caches.instructionInterface();
+  core.dm           = caches.dataInterface();
+  core.lockupFree   = caches.l1dNonBlocking != NULL;
+  core.directMemory = caches.l1d == NULL;
+#if ISSUE_WIDTH == 2
+  core.fetchLineSize = caches.instructionLineSize();
+#endif
+}
 
-  // core.im = new CacheMemory<4, 16, 64>(new IncompleteMemory<4>(mem.data()), false);
-  // core.dm = new CacheMemory<4, 16, 64>(new IncompleteMemory<4>(mem.data()), false);
+BasicSimulator::BasicSimulator(const std::string binaryFile, const std::vector<std::string> args,
+                               const std::string inFile, const std::string outFile,
+                               const std::string tFile, const std::string sFile, const size_t memorySize,
+                               const bool mapElf, const CacheConfig& cacheConfig,
+                               const BranchPredictorConfig& predictorConfig, const MulDivConfig& mulDivConfig,
+                               const int cores)
+    : memory(memorySize), caches(memory.base(), cacheConfig), dbt(iss)
+{
+
+  configureCore(core, caches, branchProfile, predictorConfig, mulDivConfig);
+
+  mem       = memory.base();
+  stackInit = memory.getSize() - STACK_OFFSET;
+
+  harts.resize(cores);
+  for (int oneHart = 0; oneHart < cores; oneHart++) {
+    Hart& hart = harts[oneHart];
+    if (oneHart == 0) {
+      hart.core          = &core;
+      hart.caches        = &caches;
+      hart.branchProfile = &branchProfile;
+    } else {
+      hart.core          = new Core;
+      hart.caches        = new CacheHierarchy(mem, cacheConfig);
+      hart.branchProfile = new BranchProfile;
+      configureCore(*hart.core, *hart.caches, *hart.branchProfile, predictorConfig, mulDivConfig);
+    }
+    hart.state        = HART_IDLE;
+    hart.exited       = false;
+    hart.statsInstret = 0;
+    if (cores > 1)
+      hart.caches->connect(coherenceBus);
+  }
+  caller = &harts[0];
 
   openFiles(inFile, outFile, tFile, sFile);
 
-  readElf(binaryFile.c_str());
+  readElf(binaryFile.c_str(), mapElf);
 
   pushArgsOnStack(args);
 
-  core.regFile[2] = STACK_INIT;
+  core.regFile[2] = stackInit;
 }
 
 FILE* fopenCheck(const char* fname, const char* mode){
@@ -75,13 +178,24 @@ void BasicSimulator::openFiles(const std::string inFile, const std::string outFi
   signatureFile = openOrDefault(sFile, "wb", NULL);
 }
 
-void BasicSimulator::readElf(const char *binaryFile){
+void BasicSimulator::readElf(const char *binaryFile, const bool mapSegments){
   heapAddress = 0;
   ElfFile elfFile(binaryFile);
+
+  // A binary without loadable segments (no program headers) has its sections copied, even with --map-elf
+  bool mapped = false;
+  if (mapSegments) {
+    for (const auto& segment : elfFile.segmentTable)
+      if (segment.type == PT_LOAD) {
+        memory.mapFile(binaryFile, segment.offset, segment.address, segment.fileSize, segment.memorySize);
+        mapped = true;
+      }
+  }
+
   for(const auto &section : elfFile.sectionTable){
     if(section.address != 0){
-      for (unsigned i = 0; i < section.size; i++)
-        setByte(section.address + i, elfFile.content[section.offset + i]);
+      if (!mapped)
+        memory.load(section.address, &elfFile.content[section.offset], section.size);
 
        // update the size of the heap
        if (section.name != ".text") {
@@ -104,19 +218,15 @@ void BasicSimulator::readElf(const char *binaryFile){
 void BasicSimulator::pushArgsOnStack(const std::vector<std::string> args){
   unsigned int argc = args.size();
 
-  mem[STACK_INIT >> 2] = argc;
+  memcpy(mem + stackInit, &argc, 4);
 
-  auto currentPlaceStrings = STACK_INIT + 4 + 4 * argc;
+  unsigned int currentPlaceStrings = stackInit + 4 + 4 * argc;
   for (unsigned oneArg = 0; oneArg < argc; oneArg++) {
-    mem[(STACK_INIT + 4 * oneArg + 4) >> 2] = currentPlaceStrings;
+    memcpy(mem + stackInit + 4 * oneArg + 4, &currentPlaceStrings, 4);
 
-    int oneCharIndex = 0;
-    for(const auto c : args[oneArg]){
-      setByte(currentPlaceStrings + oneCharIndex, c);
-      oneCharIndex++;
-    }
-    setByte(currentPlaceStrings + oneCharIndex, 0);
-    currentPlaceStrings += oneCharIndex + 1;
+    // c_str() includes the terminating null byte
+    memcpy(mem + currentPlaceStrings, args[oneArg].c_str(), args[oneArg].size() + 1);
+    currentPlaceStrings += args[oneArg].size() + 1;
   }
   if(DEBUG){
     printf("Populate Data Memory done.\n");
@@ -125,6 +235,11 @@ void BasicSimulator::pushArgsOnStack(const std::vector<std::string> args){
 
 BasicSimulator::~BasicSimulator()
 {
+  for (unsigned int oneHart = 1; oneHart < harts.size(); oneHart++) {
+    delete harts[oneHart].core;
+    delete harts[oneHart].caches;
+    delete harts[oneHart].branchProfile;
+  }
   if (inputFile)
     fclose(inputFile);
   if (outputFile)
@@ -133,10 +248,20 @@ BasicSimulator::~BasicSimulator()
     fclose(traceFile);
   if(signatureFile)
     fclose(signatureFile);
+  if (cpiFile)
+    fclose(cpiFile);
 }
 
 void BasicSimulator::printCycle()
 {
+  // Lines of the CPI file at the multiples of cpiInterval, the cycle count jumping over some of them when a
+  // functional engine ran
+  if (core.cycle >= cpiNextCycle) {
+    if (core.cycle % cpiInterval == 0)
+      writeCpiInterval();
+    cpiNextCycle = (core.cycle / cpiInterval + 1) * cpiInterval;
+  }
+
   //print something every cycle
   if(DEBUG){
     if (!core.stallSignals[0] && !core.stallIm && !core.stallDm) {
@@ -150,6 +275,67 @@ void BasicSimulator::printCycle()
   }
 }
 
+static const char* cpiNames[CPI_COMPONENTS] = {"retired", "icache", "dcache", "load-use",
+                                               "muldiv",  "branch", "syscall", "other"};
+
+// Cycles of each component, and its share of the CPI of the instructions retired by the pipeline
+static void printCpiStack(FILE* out, const Core& core)
+{
+  unsigned long cycles = 0;
+  for (int oneComponent = 0; oneComponent < CPI_COMPONENTS; oneComponent++)
+    cycles += core.cpiStack[oneComponent];
+  if (core.cpiInstructions == 0)
+    return;
+
+  fprintf(out, "CPI stack: %lu cycles, %lu instructions, CPI %.4f\n", cycles, core.cpiInstructions,
+          (double)cycles / core.cpiInstructions);
+  for (int oneComponent = 0; oneComponent < CPI_COMPONENTS; oneComponent++)
+    if (core.cpiStack[oneComponent] != 0)
+      fprintf(out, "  %-8s %12lu cycles (%6.2f%%) %8.4f\n", cpiNames[oneComponent], core.cpiStack[oneComponent],
+              100.0 * core.cpiStack[oneComponent] / cycles, (double)core.cpiStack[oneComponent] / core.cpiInstructions);
+}
+
+void BasicSimulator::openCpiStats(const std::string& fileName, const unsigned long interval)
+{
+  cpiFile      = fopenCheck(fileName.c_str(), "w");
+  cpiInterval  = interval;
+  cpiNextCycle = (core.cycle / interval + 1) * interval;
+  fprintf(cpiFile, "cycle,instructions");
+  for (int oneComponent = 0; oneComponent < CPI_COMPONENTS; oneComponent++) {
+    fprintf(cpiFile, ",%s", cpiNames[oneComponent]);
+    cpiLast[oneComponent] = core.cpiStack[oneComponent];
+  }
+  fprintf(cpiFile, "\n");
+  cpiLast[CPI_COMPONENTS] = core.cpiInstructions;
+}
+
+// One line per interval, ending at the current cycle: the instructions retired and the cycles of each component
+void BasicSimulator::writeCpiInterval()
+{
+  fprintf(cpiFile, "%lu,%lu", core.cycle, core.cpiInstructions - cpiLast[CPI_COMPONENTS]);
+  for (int oneComponent = 0; oneComponent < CPI_COMPONENTS; oneComponent++) {
+    fprintf(cpiFile, ",%lu", core.cpiStack[oneComponent] - cpiLast[oneComponent]);
+    cpiLast[oneComponent] = core.cpiStack[oneComponent];
+  }
+  fprintf(cpiFile, "\n");
+  cpiLast[CPI_COMPONENTS] = core.cpiInstructions;
+}
+
+// Cycles spent by the atomic instructions in the memory stage, a contended one found the line in another cache or
+// the reservation lost
+static void printAtomicStats(FILE* out, const Core& core)
+{
+  const unsigned long total = core.numberAtomic[0] + core.numberAtomic[1];
+  if (total == 0)
+    return;
+  fprintf(out, "Atomics: %lu uncontended in %lu cycles (%.2f per atomic), %lu contended in %lu cycles (%.2f), %lu "
+               "failed SC\n",
+          core.numberAtomic[0], core.atomicCycles[0],
+          core.numberAtomic[0] ? (double)core.atomicCycles[0] / core.numberAtomic[0] : 0.0, core.numberAtomic[1],
+          core.atomicCycles[1], core.numberAtomic[1] ? (double)core.atomicCycles[1] / core.numberAtomic[1] : 0.0,
+          core.numberFailedSC);
+}
+
 void BasicSimulator::printEnd()
 {
   /*
@@ -170,100 +356,231 @@ void BasicSimulator::printEnd()
       fprintf(signatureFile, "%08x\n", (unsigned int)ldw(wordNumber));
     }
   }
+
+  printStats();
+
+  // The last interval is partial
+  unsigned long lastCycles = 0;
+  for (int oneComponent = 0; cpiFile && oneComponent < CPI_COMPONENTS; oneComponent++)
+    lastCycles += core.cpiStack[oneComponent] - cpiLast[oneComponent];
+  if (lastCycles != 0)
+    writeCpiInterval();
 }
 
-std::string BasicSimulator::string_from_mem(const unsigned addr) {
-  int i = 0;
-  std::string str;
-  for(char c = ldb(addr); c != 0; i++){
-    c = ldb(addr + i);
-    str.push_back(c);
+// Statistics since the last SYS_stats_reset (or the start of the simulation)
+void BasicSimulator::printStats()
+{
+  caches.printStats(stdout, core.instret - harts[0].statsInstret);
+  printBranchStats(stdout);
+#if ISSUE_WIDTH == 2
+  printf("Dual issue: %lu pairs issued\n", core.numberPairs);
+#endif
+  printAtomicStats(stdout, core);
+  printCpiStack(stdout, core);
+
+  // The other harts of a multi-core simulation, the branch statistics being only given for the first one
+  for (unsigned int oneHart = 1; oneHart < harts.size(); oneHart++) {
+    const Core& hartCore             = *harts[oneHart].core;
+    const unsigned long instructions = hartCore.instret - harts[oneHart].statsInstret;
+    if (instructions == 0)
+      continue;
+    printf("Hart %u: %lu instructions retired, %lu branches %lu mispredicted, up to cycle %lu\n", oneHart,
+           instructions, hartCore.bp.numberBranch, hartCore.bp.numberMispredict, hartCore.cycle);
+    harts[oneHart].caches->printStats(stdout, instructions);
+    printAtomicStats(stdout, hartCore);
+    printCpiStack(stdout, hartCore);
   }
+}
 
-  return str;
+// The counters of the statistics restart from 0, the ones of the CPI stack after the interval in progress is written
+// to the CPI file. instret and cycle go on, the statistics being given from their values at the reset, and so do the
+// hardware performance counters of the program, whose offsets take the events cleared.
+void BasicSimulator::resetStats()
+{
+  unsigned long lastCycles = 0;
+  for (int oneComponent = 0; cpiFile && oneComponent < CPI_COMPONENTS; oneComponent++)
+    lastCycles += core.cpiStack[oneComponent] - cpiLast[oneComponent];
+  if (lastCycles != 0)
+    writeCpiInterval();
+
+  for (auto& hart : harts) {
+    Core& oneCore     = *hart.core;
+    hart.statsInstret = oneCore.instret;
+    // The translator gives the syscalls the main memory in place of the data cache counting the misses
+    MemoryInterface<4>* const dataInterface = oneCore.dm;
+    oneCore.dm                              = hart.caches->dataInterface();
+    unsigned long events[CSR_COUNTERS];
+    for (int counter = HPM_L1I_MISSES; counter < CSR_COUNTERS; counter++)
+      events[counter] = counterEvents(oneCore, counter, 0);
+    hart.caches->resetStats();
+    hart.branchProfile->clear();
+    oneCore.bp.numberBranch     = 0;
+    oneCore.bp.numberMispredict = 0;
+    oneCore.btb.numberHit       = 0;
+    oneCore.btb.numberMiss      = 0;
+    oneCore.btb.numberAlias     = 0;
+    oneCore.ras.numberReturn    = 0;
+    oneCore.ras.numberHit       = 0;
+    oneCore.ras.numberOverflow  = 0;
+    oneCore.numberFailedSC      = 0;
+    oneCore.cpiInstructions     = 0;
+#if ISSUE_WIDTH == 2
+    oneCore.numberPairs = 0;
+#endif
+    for (int oneComponent = 0; oneComponent < CPI_COMPONENTS; oneComponent++)
+      oneCore.cpiStack[oneComponent] = 0;
+    for (int contended = 0; contended < 2; contended++) {
+      oneCore.numberAtomic[contended] = 0;
+      oneCore.atomicCycles[contended] = 0;
+    }
+    for (int counter = HPM_L1I_MISSES; counter < CSR_COUNTERS; counter++)
+      oneCore.csrOffset[counter] += events[counter] - counterEvents(oneCore, counter, 0);
+    oneCore.dm = dataInterface;
+  }
+  for (int oneComponent = 0; oneComponent <= CPI_COMPONENTS; oneComponent++)
+    cpiLast[oneComponent] = 0;
+  statsCycle = core.cycle;
 }
 
-void BasicSimulator::setByte(const unsigned addr, const ac_int<8, true> value){
-  mem[addr >> 2].set_slc((addr % 4) * 8, value);
+// Statistics syscalls, made by the program around the parts it wants to measure
+void BasicSimulator::solveStatsRequest(const int syscallId)
+{
+  switch (syscallId) {
+    case SYS_roi_begin:
+    case SYS_stats_reset:
+      resetStats();
+      break;
+    default: // SYS_roi_end and SYS_stats_dump
+      printf("%s: %lu cycles, %lu instructions (cycle %lu, instruction %lu)\n",
+             syscallId == SYS_roi_end ? "Region of interest" : "Statistics", core.cycle - statsCycle,
+             core.instret - harts[0].statsInstret, core.cycle, core.instret);
+      printStats();
+      break;
+  }
+}
+
+static bool lowerPc(const std::pair<unsigned int, BranchCounters>& a, const std::pair<unsigned int, BranchCounters>& b)
+{
+  return a.first < b.first;
+}
+
+static bool moreMispredicted(const std::pair<unsigned int, BranchCounters>& a,
+                             const std::pair<unsigned int, BranchCounters>& b)
+{
+  return a.second.mispredicted > b.second.mispredicted;
+}
+
+// Totals and the branches with the most mispredictions, every branch goes to branchStatsFile (CSV)
+void BasicSimulator::printBranchStats(FILE* out)
+{
+  if (core.bp.numberBranch == 0)
+    return;
+
+  fprintf(out, "Branch predictor: %s, %d entries, %d bits of history\n", predictorNames[core.bp.type],
+          core.bp.entries, core.bp.historyLength);
+  fprintf(out, "%12lu branches %12lu mispredicted (%6.2f%%)\n", core.bp.numberBranch, core.bp.numberMispredict,
+          100.0 * core.bp.numberMispredict / core.bp.numberBranch);
+  // Hits redirect fetch to the right pc, aliases to a wrong one; decode redirects fetch after misses and aliases
+  if (core.btb.entries != 0)
+    fprintf(out, "BTB: %d entries, %lu hits, %lu misses, %lu aliases\n", core.btb.entries, core.btb.numberHit,
+            core.btb.numberMiss, core.btb.numberAlias);
+  if (core.ras.entries != 0)
+    fprintf(out, "RAS: %d entries, %lu returns, %lu hits (%6.2f%%), %lu overflows\n", core.ras.entries,
+            core.ras.numberReturn, core.ras.numberHit,
+            core.ras.numberReturn ? 100.0 * core.ras.numberHit / core.ras.numberReturn : 0.0, core.ras.numberOverflow);
+
+  std::vector<std::pair<unsigned int, BranchCounters> > branches(branchProfile.begin(), branchProfile.end());
+  std::sort(branches.begin(), branches.end(), lowerPc);
+  if (!branchStatsFile.empty()) {
+    FILE* statsFile = fopenCheck(branchStatsFile.c_str(), "w");
+    fprintf(statsFile, "pc,executed,taken,mispredicted\n");
+    for (const auto& branch : branches)
+      fprintf(statsFile, "%x,%lu,%lu,%lu\n", branch.first, branch.second.executed, branch.second.taken,
+              branch.second.mispredicted);
+    fclose(statsFile);
+  }
+
+  std::stable_sort(branches.begin(), branches.end(), moreMispredicted);
+  for (unsigned int oneBranch = 0; oneBranch < branches.size() && oneBranch < 5; oneBranch++) {
+    const BranchCounters& counters = branches[oneBranch].second;
+    if (counters.mispredicted == 0)
+      break;
+    fprintf(out, "  pc %08x %12lu executed %6.2f%% taken %12lu mispredicted (%6.2f%%)\n", branches[oneBranch].first,
+            counters.executed, 100.0 * counters.taken / counters.executed, counters.mispredicted,
+            100.0 * counters.mispredicted / counters.executed);
+  }
 }
 
-// Function for handling memory accesses
+std::string BasicSimulator::string_from_mem(const unsigned addr) {
+  // Strings are read by chunks which never cross a 64-byte boundary, so that a chunk never
+  // goes past the page holding the terminating null byte
+  std::string str;
+  unsigned char chunk[64];
+  for (unsigned current = addr;;) {
+    const unsigned size = 64 - (current & 63);
+    caller->core->dm->readBlock(current, chunk, size);
+    const unsigned char* end = (const unsigned char*)memchr(chunk, 0, size);
+    if (end != NULL) {
+      str.append((const char*)chunk, end - chunk);
+      return str;
+    }
+    str.append((const char*)chunk, size);
+    current += size;
+  }
+}
+
+// Function for handling memory accesses: each one is a single block transfer through the data
+// memory interface of the hart making the syscall, in little endian
 void BasicSimulator::stb(const ac_int<32, false> addr, const ac_int<8, true> value)
 {
-  ac_int<32, false> wordRes = 0;
-  bool stall                = true;
-  while (stall)
-    core.dm->process(addr, BYTE, STORE, value, wordRes, stall);
+  const unsigned char local = value.to_int();
+  caller->core->dm->writeBlock(addr.to_uint(), &local, 1);
 }
 
 void BasicSimulator::sth(const ac_int<32, false> addr, const ac_int<16, true> value)
 {
-  stb(addr + 1, value.slc<8>(8));
-  stb(addr + 0, value.slc<8>(0));
+  const unsigned short local = value.to_int();
+  caller->core->dm->writeBlock(addr.to_uint(), (const unsigned char*)&local, 2);
 }
 
 void BasicSimulator::stw(const ac_int<32, false> addr, const ac_int<32, true> value)
 {
-  stb(addr + 3, value.slc<8>(24));
-  stb(addr + 2, value.slc<8>(16));
-  stb(addr + 1, value.slc<8>(8));
-  stb(addr + 0, value.slc<8>(0));
+  const unsigned int local = value.to_int();
+  caller->core->dm->writeBlock(addr.to_uint(), (const unsigned char*)&local, 4);
 }
 
 void BasicSimulator::std(const ac_int<32, false> addr, const ac_int<64, true> value)
 {
-  stb(addr + 7, value.slc<8>(56));
-  stb(addr + 6, value.slc<8>(48));
-  stb(addr + 5, value.slc<8>(40));
-  stb(addr + 4, value.slc<8>(32));
-  stb(addr + 3, value.slc<8>(24));
-  stb(addr + 2, value.slc<8>(16));
-  stb(addr + 1, value.slc<8>(8));
-  stb(addr + 0, value.slc<8>(0));
+  const unsigned long long local = value.to_int64();
+  caller->core->dm->writeBlock(addr.to_uint(), (const unsigned char*)&local, 8);
 }
 
 ac_int<8, true> BasicSimulator::ldb(const ac_int<32, false> addr)
 {
-  bool stall = true;
-  ac_int<32, false> wordRes = 0;
-  while (stall)
-    core.dm->process(addr, BYTE_U, LOAD, 0, wordRes, stall);
-
-  return wordRes.slc<8>(0);
+  signed char local;
+  caller->core->dm->readBlock(addr.to_uint(), (unsigned char*)&local, 1);
+  return local;
 }
 
-// Little endian version
 ac_int<16, true> BasicSimulator::ldh(const ac_int<32, false> addr)
 {
-  ac_int<16, true> result = 0;
-  result.set_slc(8, ldb(addr + 1));
-  result.set_slc(0, ldb(addr));
-  return result;
+  short local;
+  caller->core->dm->readBlock(addr.to_uint(), (unsigned char*)&local, 2);
+  return local;
 }
 
 ac_int<32, true> BasicSimulator::ldw(const ac_int<32, false> addr)
 {
-  ac_int<32, true> result = 0;
-  result.set_slc(24, ldb(addr + 3));
-  result.set_slc(16, ldb(addr + 2));
-  result.set_slc(8, ldb(addr + 1));
-  result.set_slc(0, ldb(addr));
-  return result;
+  int local;
+  caller->core->dm->readBlock(addr.to_uint(), (unsigned char*)&local, 4);
+  return local;
 }
 
 ac_int<32, true> BasicSimulator::ldd(const ac_int<32, false> addr)
 {
-  ac_int<32, true> result = 0;
-  result.set_slc(56, ldb(addr + 7));
-  result.set_slc(48, ldb(addr + 6));
-  result.set_slc(40, ldb(addr + 5));
-  result.set_slc(32, ldb(addr + 4));
-  result.set_slc(24, ldb(addr + 3));
-  result.set_slc(16, ldb(addr + 2));
-  result.set_slc(8, ldb(addr + 1));
-  result.set_slc(0, ldb(addr));
-
-  return result;
+  long long local;
+  caller->core->dm->readBlock(addr.to_uint(), (unsigned char*)&local, 8);
+  return local;
 }
 
 /********************************************************************************************************************
@@ -271,218 +588,696 @@ ac_int<32, true> BasicSimulator::ldd(const ac_int<32, false> addr)
 **
 ** Currently all system calls are solved in the simulator. The function solveSyscall check the opcode in the
 ** extoMem pipeline registers and verifies whether it is a syscall or not. If it is, they solve the forwarding,
-** and switch to the correct function according to reg[17].
+** and switch to the correct function according to reg[17]. The functional engine calls doSyscall directly with the
+** values of the register file.
 *********************************************************************************************************************/
 void BasicSimulator::solveSyscall()
 {
+  solveSyscall(harts[0]);
+}
+
+// The check is kept apart from the handling so that the common case costs no more than a few compares per cycle
+void BasicSimulator::solveSyscall(Hart& hart)
+{
+  const Core& core = *hart.core;
 
-  if ((core.extoMem.opCode == RISCV_SYSTEM) && core.extoMem.instruction.slc<12>(20) == 0 && !core.stallSignals[2] &&
-      !core.stallIm && !core.stallDm) {
-
-    ac_int<32, true> syscallId = core.regFile[17];
-    ac_int<32, true> arg1      = core.regFile[10];
-    ac_int<32, true> arg2      = core.regFile[11];
-    ac_int<32, true> arg3      = core.regFile[12];
-    ac_int<32, true> arg4      = core.regFile[13];
-
-    if (core.memtoWB.useRd && core.memtoWB.we && !core.stallSignals[3]) {
-      if (core.memtoWB.rd == 10)
-        arg1 = core.memtoWB.result;
-      else if (core.memtoWB.rd == 11)
-        arg2 = core.memtoWB.result;
-      else if (core.memtoWB.rd == 12)
-        arg3 = core.memtoWB.result;
-      else if (core.memtoWB.rd == 13)
-        arg4 = core.memtoWB.result;
-      else if (core.memtoWB.rd == 17)
-        syscallId = core.memtoWB.result;
-    }
+  if ((core.extoMem.opCode == RISCV_SYSTEM) && core.extoMem.instruction.slc<12>(20) == 0 && core.extoMem.we &&
+      !core.stallSignals[2] && !core.stallIm && !core.stallDm)
+    handleSyscall(hart);
+}
+
+void BasicSimulator::handleSyscall(Hart& hart)
+{
+  Core& core = *hart.core;
+
+  ac_int<32, true> syscallId = core.regFile[17];
+  ac_int<32, true> arg1      = core.regFile[10];
+  ac_int<32, true> arg2      = core.regFile[11];
+  ac_int<32, true> arg3      = core.regFile[12];
+  ac_int<32, true> arg4      = core.regFile[13];
+
+  if (core.memtoWB.useRd && core.memtoWB.we && !core.stallSignals[3]) {
+    if (core.memtoWB.rd == 10)
+      arg1 = core.memtoWB.result;
+    else if (core.memtoWB.rd == 11)
+      arg2 = core.memtoWB.result;
+    else if (core.memtoWB.rd == 12)
+      arg3 = core.memtoWB.result;
+    else if (core.memtoWB.rd == 13)
+      arg4 = core.memtoWB.result;
+    else if (core.memtoWB.rd == 17)
+      syscallId = core.memtoWB.result;
+  }
+#if ISSUE_WIDTH == 2
+  // The instructions of a pair write different registers
+  if (core.memtoWB1.useRd && core.memtoWB1.we && !core.stallSignals[3]) {
+    if (core.memtoWB1.rd == 10)
+      arg1 = core.memtoWB1.result;
+    else if (core.memtoWB1.rd == 11)
+      arg2 = core.memtoWB1.result;
+    else if (core.memtoWB1.rd == 12)
+      arg3 = core.memtoWB1.result;
+    else if (core.memtoWB1.rd == 13)
+      arg4 = core.memtoWB1.result;
+    else if (core.memtoWB1.rd == 17)
+      syscallId = core.memtoWB1.result;
+  }
+#endif
 
-    ac_int<32, true> result = 0;
+  ac_int<32, true> result;
+  {
+    std::lock_guard<std::mutex> guard(syscallLock);
+    // The other harts are stopped once the program exited
+    if (exitFlag)
+      return;
+    caller = &hart;
+    result = doSyscall(syscallId, arg1, arg2, arg3, arg4);
+  }
+
+  // The pipeline stops at the exit: the instructions in writeback and the ECALL retire with it, as in the ISS
+  if (exitFlag || hart.exited) {
+    core.instret += core.memtoWB.we + 1;
+#if ISSUE_WIDTH == 2
+    core.instret += core.memtoWB1.we;
+#endif
+  }
+
+  // The result takes the place of the instruction in memtoWB, which is committed first
+  if (core.memtoWB.useRd && core.memtoWB.we && !core.stallSignals[3] && core.memtoWB.rd != 0)
+    core.regFile[core.memtoWB.rd] = core.memtoWB.result;
+#if ISSUE_WIDTH == 2
+  if (core.memtoWB1.useRd && core.memtoWB1.we && !core.stallSignals[3] && core.memtoWB1.rd != 0)
+    core.regFile[core.memtoWB1.rd] = core.memtoWB1.result;
+  core.memtoWB1.useRd = 0;
+#endif
+
+  // We write the result and forward
+  core.memtoWB.result = result;
+  core.memtoWB.rd     = 10;
+  core.memtoWB.useRd  = 1;
+
+  if (core.dctoEx.useRs1 && (core.dctoEx.rs1 == 10))
+    core.dctoEx.lhs = result;
+  if (core.dctoEx.useRs2 && (core.dctoEx.rs2 == 10))
+    core.dctoEx.rhs = result;
+  if (core.dctoEx.useRs3 && (core.dctoEx.rs3 == 10))
+    core.dctoEx.datac = result;
+#if ISSUE_WIDTH == 2
+  if (core.dctoEx1.useRs1 && (core.dctoEx1.rs1 == 10))
+    core.dctoEx1.lhs = result;
+  if (core.dctoEx1.useRs2 && (core.dctoEx1.rs2 == 10))
+    core.dctoEx1.rhs = result;
+#endif
+}
 
-    switch (syscallId) {
-      case SYS_exit:
+ac_int<32, true> BasicSimulator::doSyscall(const ac_int<32, true> syscallId, const ac_int<32, true> arg1,
+                                           const ac_int<32, true> arg2, const ac_int<32, true> arg3,
+                                           const ac_int<32, true> arg4)
+{
+  ac_int<32, true> result = 0;
+
+  switch (syscallId) {
+    case SYS_exit:
+      // Only the first hart ends the program, the others are stopped
+      if (caller == &harts[0])
         exitFlag = 1; // Currently we break on ECALL
-        break;
-      case SYS_read:
-        result = doRead(arg1, arg2, arg3);
-        break;
-      case SYS_write:
-        result = doWrite(arg1, arg2, arg3);
-        break;
-      case SYS_brk:
-        result = doSbrk(arg1);
-        break;
-      case SYS_open:
-        result = doOpen(arg1, arg2, arg3);
-        break;
-      case SYS_openat:
-        result = doOpenat(arg1, arg2, arg3, arg4);
-        break;
-      case SYS_lseek:
-        result = doLseek(arg1, arg2, arg3);
-        break;
-      case SYS_close:
-        result = doClose(arg1);
-        break;
-      case SYS_fstat:
-        result = doFstat(arg1, arg2);
-        break;
-      case SYS_stat:
-        result = doStat(arg1, arg2);
-        break;
-      case SYS_gettimeofday:
-        result = doGettimeofday(arg1);
-        break;
-      case SYS_unlink:
-        result = doUnlink(arg1);
-        break;
-      case SYS_exit_group:
-        fprintf(stderr, "Syscall : SYS_exit_group\n");
-        exitFlag = 1;
-        break;
-      case SYS_getpid:
-        fprintf(stderr, "Syscall : SYS_getpid\n");
-        exitFlag = 1;
-        break;
-      case SYS_kill:
-        fprintf(stderr, "Syscall : SYS_kill\n");
-        exitFlag = 1;
-        break;
-      case SYS_link:
-        fprintf(stderr, "Syscall : SYS_link\n");
-        exitFlag = 1;
-        break;
-      case SYS_mkdir:
-        fprintf(stderr, "Syscall : SYS_mkdir\n");
-        exitFlag = 1;
-        break;
-      case SYS_chdir:
-        fprintf(stderr, "Syscall : SYS_chdir\n");
-        exitFlag = 1;
-        break;
-      case SYS_getcwd:
-        fprintf(stderr, "Syscall : SYS_getcwd\n");
-        exitFlag = 1;
-        break;
-      case SYS_lstat:
-        fprintf(stderr, "Syscall : SYS_lstat\n");
-        exitFlag = 1;
-        break;
-      case SYS_fstatat:
-        fprintf(stderr, "Syscall : SYS_fstatat\n");
-        exitFlag = 1;
-        break;
-      case SYS_access:
-        fprintf(stderr, "Syscall : SYS_access\n");
-        exitFlag = 1;
-        break;
-      case SYS_faccessat:
-        fprintf(stderr, "Syscall : SYS_faccessat\n");
-        exitFlag = 1;
-        break;
-      case SYS_pread:
-        fprintf(stderr, "Syscall : SYS_pread\n");
-        exitFlag = 1;
-        break;
-      case SYS_pwrite:
-        fprintf(stderr, "Syscall : SYS_pwrite\n");
-        exitFlag = 1;
-        break;
-      case SYS_uname:
-        fprintf(stderr, "Syscall : SYS_uname\n");
-        exitFlag = 1;
-        break;
-      case SYS_getuid:
-        fprintf(stderr, "Syscall : SYS_getuid\n");
-        exitFlag = 1;
-        break;
-      case SYS_geteuid:
-        fprintf(stderr, "Syscall : SYS_geteuid\n");
-        exitFlag = 1;
-        break;
-      case SYS_getgid:
-        fprintf(stderr, "Syscall : SYS_getgid\n");
-        exitFlag = 1;
-        break;
-      case SYS_getegid:
-        fprintf(stderr, "Syscall : SYS_getegid\n");
-        exitFlag = 1;
-        break;
-      case SYS_mmap:
-        fprintf(stderr, "Syscall : SYS_mmap\n");
-        exitFlag = 1;
-        break;
-      case SYS_munmap:
-        fprintf(stderr, "Syscall : SYS_munmap\n");
-        exitFlag = 1;
-        break;
-      case SYS_mremap:
-        fprintf(stderr, "Syscall : SYS_mremap\n");
-        exitFlag = 1;
-        break;
-      case SYS_time:
-        fprintf(stderr, "Syscall : SYS_time\n");
-        exitFlag = 1;
-        break;
-      case SYS_getmainvars:
-        fprintf(stderr, "Syscall : SYS_getmainvars\n");
-        exitFlag = 1;
-        break;
-      case SYS_rt_sigaction:
-        fprintf(stderr, "Syscall : SYS_rt_sigaction\n");
-        exitFlag = 1;
-        break;
-      case SYS_writev:
-        fprintf(stderr, "Syscall : SYS_writev\n");
-        exitFlag = 1;
-        break;
-      case SYS_times:
-        fprintf(stderr, "Syscall : SYS_times\n");
-        exitFlag = 1;
-        break;
-      case SYS_fcntl:
-        fprintf(stderr, "Syscall : SYS_fcntl\n");
-        exitFlag = 1;
-        break;
-      case SYS_getdents:
-        fprintf(stderr, "Syscall : SYS_getdents\n");
-        exitFlag = 1;
-        break;
-      case SYS_dup:
-        fprintf(stderr, "Syscall : SYS_dup\n");
-        exitFlag = 1;
-        break;
-
-        // Custom syscalls
-      case SYS_threadstart:
-        result = 0;
-        break;
-      case SYS_nbcore:
-        result = 1;
-        break;
-
-      default:
-        fprintf(stderr, "Syscall : Unknown system call, %d (%x) with arguments :\n", syscallId.to_int(),
-                syscallId.to_int());
-        fprintf(stderr, "%d (%x)\n%d (%x)\n%d (%x)\n%d (%x)\n", arg1.to_int(), arg1.to_int(), arg2.to_int(),
-                arg2.to_int(), arg3.to_int(), arg3.to_int(), arg4.to_int(), arg4.to_int());
-        exitFlag = 1;
-        break;
+      else
+        caller->exited = true;
+      break;
+    case SYS_read:
+      result = doRead(arg1, arg2, arg3);
+      break;
+    case SYS_write:
+      result = doWrite(arg1, arg2, arg3);
+      break;
+    case SYS_brk:
+      result = doSbrk(arg1);
+      break;
+    case SYS_open:
+      result = doOpen(arg1, arg2, arg3);
+      break;
+    case SYS_openat:
+      result = doOpenat(arg1, arg2, arg3, arg4);
+      break;
+    case SYS_lseek:
+      result = doLseek(arg1, arg2, arg3);
+      break;
+    case SYS_close:
+      result = doClose(arg1);
+      break;
+    case SYS_fstat:
+      result = doFstat(arg1, arg2);
+      break;
+    case SYS_stat:
+      result = doStat(arg1, arg2);
+      break;
+    case SYS_gettimeofday:
+      result = doGettimeofday(arg1);
+      break;
+    case SYS_unlink:
+      result = doUnlink(arg1);
+      break;
+    case SYS_exit_group:
+      fprintf(stderr, "Syscall : SYS_exit_group\n");
+      exitFlag = 1;
+      break;
+    case SYS_getpid:
+      fprintf(stderr, "Syscall : SYS_getpid\n");
+      exitFlag = 1;
+      break;
+    case SYS_kill:
+      fprintf(stderr, "Syscall : SYS_kill\n");
+      exitFlag = 1;
+      break;
+    case SYS_link:
+      fprintf(stderr, "Syscall : SYS_link\n");
+      exitFlag = 1;
+      break;
+    case SYS_mkdir:
+      fprintf(stderr, "Syscall : SYS_mkdir\n");
+      exitFlag = 1;
+      break;
+    case SYS_chdir:
+      fprintf(stderr, "Syscall : SYS_chdir\n");
+      exitFlag = 1;
+      break;
+    case SYS_getcwd:
+      fprintf(stderr, "Syscall : SYS_getcwd\n");
+      exitFlag = 1;
+      break;
+    case SYS_lstat:
+      fprintf(stderr, "Syscall : SYS_lstat\n");
+      exitFlag = 1;
+      break;
+    case SYS_fstatat:
+      fprintf(stderr, "Syscall : SYS_fstatat\n");
+      exitFlag = 1;
+      break;
+    case SYS_access:
+      fprintf(stderr, "Syscall : SYS_access\n");
+      exitFlag = 1;
+      break;
+    case SYS_faccessat:
+      fprintf(stderr, "Syscall : SYS_faccessat\n");
+      exitFlag = 1;
+      break;
+    case SYS_pread:
+      fprintf(stderr, "Syscall : SYS_pread\n");
+      exitFlag = 1;
+      break;
+    case SYS_pwrite:
+      fprintf(stderr, "Syscall : SYS_pwrite\n");
+      exitFlag = 1;
+      break;
+    case SYS_uname:
+      fprintf(stderr, "Syscall : SYS_uname\n");
+      exitFlag = 1;
+      break;
+    case SYS_getuid:
+      fprintf(stderr, "Syscall : SYS_getuid\n");
+      exitFlag = 1;
+      break;
+    case SYS_geteuid:
+      fprintf(stderr, "Syscall : SYS_geteuid\n");
+      exitFlag = 1;
+      break;
+    case SYS_getgid:
+      fprintf(stderr, "Syscall : SYS_getgid\n");
+      exitFlag = 1;
+      break;
+    case SYS_getegid:
+      fprintf(stderr, "Syscall : SYS_getegid\n");
+      exitFlag = 1;
+      break;
+    case SYS_mmap:
+      fprintf(stderr, "Syscall : SYS_mmap\n");
+      exitFlag = 1;
+      break;
+    case SYS_munmap:
+      fprintf(stderr, "Syscall : SYS_munmap\n");
+      exitFlag = 1;
+      break;
+    case SYS_mremap:
+      fprintf(stderr, "Syscall : SYS_mremap\n");
+      exitFlag = 1;
+      break;
+    case SYS_time:
+      fprintf(stderr, "Syscall : SYS_time\n");
+      exitFlag = 1;
+      break;
+    case SYS_getmainvars:
+      fprintf(stderr, "Syscall : SYS_getmainvars\n");
+      exitFlag = 1;
+      break;
+    case SYS_rt_sigaction:
+      fprintf(stderr, "Syscall : SYS_rt_sigaction\n");
+      exitFlag = 1;
+      break;
+    case SYS_writev:
+      fprintf(stderr, "Syscall : SYS_writev\n");
+      exitFlag = 1;
+      break;
+    case SYS_times:
+      fprintf(stderr, "Syscall : SYS_times\n");
+      exitFlag = 1;
+      break;
+    case SYS_fcntl:
+      fprintf(stderr, "Syscall : SYS_fcntl\n");
+      exitFlag = 1;
+      break;
+    case SYS_getdents:
+      fprintf(stderr, "Syscall : SYS_getdents\n");
+      exitFlag = 1;
+      break;
+    case SYS_dup:
+      fprintf(stderr, "Syscall : SYS_dup\n");
+      exitFlag = 1;
+      break;
+
+      // Custom syscalls
+    case SYS_threadstart:
+      result = doThreadstart(arg1, arg2, arg3);
+      break;
+    case SYS_nbcore:
+      result = harts.size();
+      break;
+    case SYS_roi_begin:
+    case SYS_roi_end:
+    case SYS_stats_reset:
+    case SYS_stats_dump:
+      // The other harts may be running, the statistics are solved at the end of the quantum
+      if (harts.size() > 1)
+        statsRequests.push_back(syscallId.to_int());
+      else
+        solveStatsRequest(syscallId.to_int());
+      // With --roi, the engine changes at the first marker entering or leaving the region
+      if (regionOnly && ((syscallId == SYS_roi_begin && !inRegion) || (syscallId == SYS_roi_end && inRegion))) {
+        inRegion     = !inRegion;
+        switchEngine = true;
+      }
+      break;
+
+    default:
+      fprintf(stderr, "Syscall : Unknown system call, %d (%x) with arguments :\n", syscallId.to_int(),
+              syscallId.to_int());
+      fprintf(stderr, "%d (%x)\n%d (%x)\n%d (%x)\n%d (%x)\n", arg1.to_int(), arg1.to_int(), arg2.to_int(),
+              arg2.to_int(), arg3.to_int(), arg3.to_int(), arg4.to_int(), arg4.to_int());
+      exitFlag = 1;
+      break;
+  }
+
+  return result;
+}
+
+// Runs the functional engine (the binary translator when translate is set) until instret reaches limit or the
+// program exits, solving the syscalls on the way
+void BasicSimulator::runEngine(const unsigned long limit)
+{
+  while (!exitFlag && !switchEngine && core.instret < limit) {
+    const bool isSyscall =
+        translate ? dbt.run(core, mem, core.instret, limit) : iss.run(core, mem, core.instret, limit);
+    if (!isSyscall)
+      break;
+
+    // Caches warmed by the translator do not follow the data, the syscall accesses the memory itself
+    MemoryInterface<4>* const dataInterface = core.dm;
+    if (translate && dbt.warming)
+      core.dm = caches.mainMemory;
+    const ac_int<32, true> syscallId = core.regFile[17];
+    const ac_int<32, true> result =
+        doSyscall(syscallId, core.regFile[10], core.regFile[11], core.regFile[12], core.regFile[13]);
+    core.dm = dataInterface;
+    core.instret++; // the ECALL retires, the one of the exit included as in the pipeline
+    core.cycle++;
+    if (exitFlag)
+      break;
+    // The syscall may have written into memory behind the engine's back
+    if (syscallId != SYS_write) {
+      if (translate)
+        dbt.flush();
+      else
+        iss.flush();
+    }
+    core.regFile[10] = result;
+    core.pc += 4;
+  }
+}
+
+// The state may come from the pipelined model (checkpoint), and goes back to it after a fast-forward. The engines
+// access the memory directly: the dirty lines are written back, and the caches emptied unless they are warmed.
+void BasicSimulator::leavePipeline(const bool warm)
+{
+  flushPipeline(core);
+  caches.settle();
+  if (warm) {
+    caches.storeLines();
+  } else {
+    core.im->flushAll();
+    core.dm->flushAll();
+  }
+}
+
+void BasicSimulator::runFunctional()
+{
+  exitFlag                 = false;
+  const unsigned long stop = (this->timeout < 0) ? ULONG_MAX : this->timeout;
+
+  leavePipeline(false);
+  iss.flush();
+  dbt.flush();
+
+  while (!exitFlag) {
+    // Execution is split at the breakpoint and at the checkpoint so that they happen at the exact instruction
+    const bool beforeBreak      = this->breakpoint >= 0 && core.instret < (unsigned long)this->breakpoint;
+    const bool beforeCheckpoint = this->checkpointAt >= 0 && core.instret < (unsigned long)this->checkpointAt;
+    unsigned long limit         = stop;
+    if (beforeBreak)
+      limit = std::min<unsigned long>(this->breakpoint, limit);
+    if (beforeCheckpoint)
+      limit = std::min<unsigned long>(this->checkpointAt, limit);
+
+    runEngine(limit);
+    if (exitFlag) {
+      break;
+    } else if (beforeCheckpoint && core.instret == (unsigned long)this->checkpointAt) {
+      saveCheckpoint(checkpointFile.c_str());
+      printf("Checkpoint saved after %ld instructions\n", core.instret);
+      return;
+    } else if (beforeBreak && core.instret == (unsigned long)this->breakpoint) {
+      printCoreReg("BeforeInj.txt");
+      printf("Reached break\n");
+    } else {
+      printf("Timeout!\n");
+      break;
     }
+  }
+  printEnd();
+  printCoreReg("default");
+  printf("\nInstructions retired: %ld\n", core.instret);
+  if (translate)
+    printf("DBT: %lu blocks translated, %lu flushes\n", dbt.numberTranslated, dbt.numberFlush);
+}
 
-    // We write the result and forward
-    core.memtoWB.result = result;
-    core.memtoWB.rd     = 10;
-    core.memtoWB.useRd  = 1;
+bool BasicSimulator::fastForward(const unsigned long instructions)
+{
+  exitFlag = false;
+  leavePipeline(warming);
+  dbt.warming = warming;
+  dbt.flush();
+
+  const bool wasTranslating = translate;
+  translate                 = true;
+  runEngine(core.instret + instructions);
+  translate   = wasTranslating;
+  dbt.warming = false;
+
+  if (exitFlag) {
+    printEnd();
+    printCoreReg("default");
+    printf("\nInstructions retired: %ld\n", core.instret);
+    return false;
+  }
+  printf("Fast-forwarded to instruction %lu (%lu blocks translated)\n", core.instret, dbt.numberTranslated);
+  if (warming)
+    caches.loadLines();
+  return true;
+}
 
-    if (core.dctoEx.useRs1 && (core.dctoEx.rs1 == 10))
-      core.dctoEx.lhs = result;
-    if (core.dctoEx.useRs2 && (core.dctoEx.rs2 == 10))
-      core.dctoEx.rhs = result;
-    if (core.dctoEx.useRs3 && (core.dctoEx.rs3 == 10))
-      core.dctoEx.datac = result;
+// The translator runs the program up to SYS_roi_begin and after SYS_roi_end, warming the caches and the predictors
+// with --warm, and the pipeline runs the region between them (which the program may enter several times)
+void BasicSimulator::runRegionOfInterest()
+{
+  exitFlag = false;
+  leavePipeline(warming);
+  translate   = true;
+  dbt.warming = warming;
+  dbt.flush();
+
+  while (!exitFlag) {
+    switchEngine = false;
+    runEngine(ULONG_MAX);
+    if (exitFlag)
+      break;
+
+    if (warming)
+      caches.loadLines();
+    switchEngine = false;
+    while (!exitFlag && !switchEngine) {
+      doCycle(core, 0);
+      solveSyscall();
+      extend();
+      printCycle();
+    }
+    if (!exitFlag) {
+      leavePipeline(warming);
+      dbt.flush();
+    }
   }
+  dbt.warming = false;
+
+  printEnd();
+  printCoreReg("default");
+  printf("\nCore cycle: %ld\n", core.cycle);
+  printf("Instructions retired: %ld\n", core.instret);
+}
+
+// Runs the pipeline until instret reaches until or the program exits
+void BasicSimulator::runDetailed(const unsigned long until)
+{
+  while (!exitFlag && core.instret < until) {
+    doCycle(core, 0);
+    solveSyscall();
+    extend();
+    printCycle();
+  }
+}
+
+void BasicSimulator::profile(const unsigned long intervalSize, const unsigned int maxClusters,
+                             const unsigned int samplesPerCluster, const std::string& simPointFile,
+                             const std::string& bbvFile)
+{
+  exitFlag = false;
+  leavePipeline(false);
+  translate     = true;
+  dbt.profiling = true;
+  dbt.flush();
+
+  std::vector<BasicBlockVector> intervals;
+  while (!exitFlag) {
+    runEngine(core.instret + intervalSize);
+    intervals.push_back(BasicBlockVector());
+    dbt.collectProfile(intervals.back());
+    if (intervals.back().empty())
+      intervals.pop_back();
+  }
+
+  const SimPointSet set = pickSimPoints(intervals, intervalSize, maxClusters, samplesPerCluster);
+  writeSimPoints(simPointFile.c_str(), set);
+  if (!bbvFile.empty())
+    writeBasicBlockVectors(bbvFile.c_str(), intervals);
+
+  printf("\nInstructions retired: %ld\n", core.instret);
+  printf("SimPoint: %lu intervals of %lu instructions, %u clusters, %lu samples\n", intervals.size(), intervalSize,
+         set.clusters, set.points.size());
+  for (const auto& onePoint : set.points)
+    printf("  interval %lu: cluster %u, weight %.4f\n", onePoint.interval, onePoint.cluster, onePoint.weight);
+}
+
+void BasicSimulator::runSampled(const SimPointSet& set, const unsigned long warmup)
+{
+  exitFlag             = false;
+  bool inPipeline      = false;
+  unsigned long cycles = 0, instructions = 0;
+  std::vector<double> cpi;
+
+  leavePipeline(warming);
+  translate   = true;
+  dbt.warming = warming;
+  dbt.flush();
+
+  for (const auto& onePoint : set.points) {
+    // The translator runs up to the warm-up of the sample, which starts cold unless the translator warmed the caches
+    // and the predictors
+    const unsigned long start = onePoint.interval * set.intervalSize;
+    const unsigned long warm  = start > warmup ? start - warmup : 0;
+    if (core.instret < warm) {
+      if (inPipeline)
+        leavePipeline(warming);
+      inPipeline = false;
+      runEngine(warm);
+    }
+    if (!inPipeline && warming)
+      caches.loadLines();
+    inPipeline = true;
+    runDetailed(start);
+
+    const unsigned long startCycle = core.cycle, startInstret = core.instret;
+    runDetailed(start + set.intervalSize);
+    if (core.instret == startInstret) {
+      fprintf(stderr, "Error: the program ended before interval %lu of the simulation points\n", onePoint.interval);
+      exit(-1);
+    }
+    cycles += core.cycle - startCycle;
+    instructions += core.instret - startInstret;
+    cpi.push_back((double)(core.cycle - startCycle) / (core.instret - startInstret));
+    if (exitFlag)
+      break;
+  }
+
+  // The estimate only uses the samples reached before the end of the program
+  SimPointSet simulated = set;
+  simulated.points.resize(cpi.size());
+  double estimate, error;
+  estimateCPI(simulated, cpi, estimate, error);
+
+  printEnd();
+  printf("\nSampled simulation: %lu samples of %lu instructions, %lu instructions measured in %lu cycles\n",
+         cpi.size(), set.intervalSize, instructions, cycles);
+  for (unsigned long i = 0; i < cpi.size(); i++)
+    printf("  interval %lu: cluster %u, weight %.4f, CPI %.4f\n", set.points[i].interval, set.points[i].cluster,
+           set.points[i].weight, cpi[i]);
+  if (error >= 0)
+    printf("Estimated CPI: %.4f +- %.4f (95%% confidence)\n", estimate, error);
+  else
+    printf("Estimated CPI: %.4f (no error bound, a cluster was sampled once)\n", estimate);
+}
+
+// The hart starts at the end of the quantum, with the global pointer of the caller, the argument in a0 and its
+// index in a1
+void BasicSimulator::startHart(Hart& hart, const unsigned long cycle)
+{
+  Core& oneCore = *hart.core;
+  for (int oneReg = 0; oneReg < 32; oneReg++)
+    oneCore.regFile[oneReg] = 0;
+  oneCore.regFile[2]  = hart.stack;
+  oneCore.regFile[3]  = hart.globalPointer;
+  oneCore.regFile[10] = hart.argument;
+  oneCore.regFile[11] = (unsigned int)(&hart - &harts[0]);
+  oneCore.pc          = hart.pc;
+  oneCore.cycle       = cycle;
+  hart.exited         = false;
+  hart.state          = HART_RUNNING;
+}
+
+// Runs the pipeline of the hart up to the end of the quantum
+void BasicSimulator::runHart(Hart& hart, const unsigned long end)
+{
+  Core& oneCore = *hart.core;
+  while (oneCore.cycle < end && !hart.exited && !exitFlag) {
+    doCycle(oneCore, 0);
+    solveSyscall(hart);
+    if (&hart == &harts[0])
+      printCycle();
+  }
+}
+
+void BasicSimulator::runMultiCore(const int threads, const unsigned long quantum)
+{
+  exitFlag                 = false;
+  const unsigned long stop = (this->timeout < 0) ? ULONG_MAX : this->timeout;
+  QuantumPool pool(threads);
+
+  harts[0].state = HART_RUNNING;
+  std::vector<Hart*> running;
+  unsigned long time = core.cycle;
+  while (!exitFlag && time < stop) {
+    const unsigned long end = std::min(time + quantum, stop);
+    running.clear();
+    for (auto& hart : harts) {
+      if (hart.state == HART_STARTING)
+        startHart(hart, time);
+      if (hart.state == HART_RUNNING)
+        running.push_back(&hart);
+    }
+    pool.run(running.size(), [this, &running, end](const unsigned int oneHart) { runHart(*running[oneHart], end); });
+    time = end;
+
+    for (const int request : statsRequests)
+      solveStatsRequest(request);
+    statsRequests.clear();
+
+    // A stopped hart is emptied and its caches are left idle, until it is started again
+    for (auto hart : running) {
+      if (hart->exited) {
+        flushPipeline(*hart->core);
+        hart->caches->settle();
+        hart->state = HART_IDLE;
+      }
+    }
+  }
+  if (!exitFlag)
+    printf("Timeout!\n");
+
+  caller = &harts[0];
+  printEnd();
+  printCoreReg("default");
+  printf("\nCore cycle: %ld\n", core.cycle);
+  printf("Instructions retired: %ld\n", core.instret);
+}
+
+void BasicSimulator::serialize(Checkpoint& cp)
+{
+  caches.serialize(cp);
+  ::serialize(cp, core);
+
+  cp.transfer(heapAddress);
+  cp.transfer(statsCycle);
+  cp.transfer(harts[0].statsInstret);
+
+  // Position in the file given as standard input (when it can be seeked)
+  long inputOffset = (inputFile != stdin) ? lseek(fileno(inputFile), 0, SEEK_CUR) : -1;
+  cp.transfer(inputOffset);
+  if (cp.isLoading() && inputOffset >= 0)
+    lseek(fileno(inputFile), inputOffset, SEEK_SET);
+
+  // Files opened by the program are reopened on the same descriptor at the same position
+  unsigned int numberOfFiles = openedFiles.size();
+  cp.transfer(numberOfFiles);
+  auto oneFile = openedFiles.begin();
+  for (unsigned int i = 0; i < numberOfFiles; i++) {
+    int fd;
+    OpenedFile desc;
+    long offset = 0;
+    if (!cp.isLoading()) {
+      fd     = oneFile->first;
+      desc   = oneFile->second;
+      offset = lseek(fd, 0, SEEK_CUR);
+      oneFile++;
+    }
+    cp.transfer(fd);
+    cp.transfer(desc.path);
+    cp.transfer(desc.flags);
+    cp.transfer(desc.mode);
+    cp.transfer(offset);
+
+    if (cp.isLoading()) {
+      const int newFd = open(desc.path.c_str(), desc.flags & ~(O_TRUNC | O_EXCL), desc.mode);
+      if (newFd < 0) {
+        fprintf(stderr, "Error: cannot reopen %s from checkpoint\n", desc.path.c_str());
+        exit(-1);
+      }
+      if (newFd != fd) {
+        dup2(newFd, fd);
+        close(newFd);
+      }
+      lseek(fd, offset, SEEK_SET);
+      openedFiles[fd] = desc;
+    }
+  }
+
+  memory.serialize(cp);
+}
+
+void BasicSimulator::saveCheckpoint(const char* fileName)
+{
+  Checkpoint cp(fileName, false);
+  serialize(cp);
+}
+
+void BasicSimulator::loadCheckpoint(const char* fileName)
+{
+  Checkpoint cp(fileName, true);
+  serialize(cp);
 }
 
 ac_int<32, true> BasicSimulator::doRead(const unsigned file, const unsigned bufferAddr, const unsigned size)
@@ -495,20 +1290,16 @@ ac_int<32, true> BasicSimulator::doRead(const unsigned file, const unsigned buff
   else
     result = read(file, localBuffer.data(), size);
 
-  for (int i(0); i < result; i++) {
-    stb(bufferAddr + i, localBuffer[i]);
-  }
+  if (result > 0)
+    caller->core->dm->writeBlock(bufferAddr, (const unsigned char*)localBuffer.data(), result);
 
   return result;
 }
 
 ac_int<32, true> BasicSimulator::doWrite(const unsigned file, const unsigned bufferAddr, const unsigned size)
 {
-  std::vector<char> localBuffer;
-  localBuffer.reserve(size);
-
-  for (int i = 0; i < size; i++)
-    localBuffer.push_back(ldb(bufferAddr + i));
+  std::vector<char> localBuffer(size);
+  caller->core->dm->readBlock(bufferAddr, (unsigned char*)localBuffer.data(), size);
 
   if (file == 1 || outputFile)
     fflush(stdout);
@@ -518,6 +1309,39 @@ ac_int<32, true> BasicSimulator::doWrite(const unsigned file, const unsigned buf
   return write(fn, localBuffer.data(), size);
 }
 
+// Copies a host stat structure in the layout of the newlib stat structure, with a single block transfer
+void BasicSimulator::writeStat(const ac_int<32, false> stataddr, const struct stat& filestat)
+{
+  unsigned char buffer[104];
+  const auto put32 = [&buffer](const unsigned offset, const unsigned int value) { memcpy(buffer + offset, &value, 4); };
+  const auto put64 = [&buffer](const unsigned offset, const unsigned long long value) {
+    memcpy(buffer + offset, &value, 8);
+  };
+
+  put64(0, filestat.st_dev);              // unsigned long long
+  put64(8, filestat.st_ino);              // unsigned long long
+  put32(16, filestat.st_mode);            // unsigned int
+  put32(20, filestat.st_nlink);           // unsigned int
+  put32(24, filestat.st_uid);             // unsigned int
+  put32(28, filestat.st_gid);             // unsigned int
+  put64(32, filestat.st_rdev);            // unsigned long long
+  put64(40, filestat.__pad0);             // unsigned long long
+  put64(48, filestat.st_size);            // long long
+  put32(56, filestat.st_blksize);         // int
+  put32(60, filestat.__pad0);             // int
+  put64(64, filestat.st_blocks);          // long long
+  put32(72, filestat.st_atim.tv_sec);     // long
+  put32(76, filestat.st_atim.tv_nsec);    // long
+  put32(80, filestat.st_mtim.tv_sec);     // long
+  put32(84, filestat.st_mtim.tv_nsec);    // long
+  put32(88, filestat.st_ctim.tv_sec);     // long
+  put32(92, filestat.st_ctim.tv_nsec);    // long
+  put32(96, filestat.__pad0);             // long
+  put32(100, filestat.__pad0);            // long
+
+  caller->core->dm->writeBlock(stataddr.to_uint(), buffer, sizeof(buffer));
+}
+
 ac_int<32, true> BasicSimulator::doFstat(const unsigned file, const ac_int<32, false> stataddr)
 {
   ac_int<32, true> result = 0;
@@ -526,26 +1350,7 @@ ac_int<32, true> BasicSimulator::doFstat(const unsigned file, const ac_int<32, f
   if (file != 1)
     result = fstat(file, &filestat);
 
-  std(stataddr, filestat.st_dev);               // unsigned long long
-  std(stataddr + 8, filestat.st_ino);           // unsigned long long
-  stw(stataddr + 16, filestat.st_mode);         // unsigned int
-  stw(stataddr + 20, filestat.st_nlink);        // unsigned int
-  stw(stataddr + 24, filestat.st_uid);          // unsigned int
-  stw(stataddr + 28, filestat.st_gid);          // unsigned int
-  std(stataddr + 32, filestat.st_rdev);         // unsigned long long
-  std(stataddr + 40, filestat.__pad0);          // unsigned long long
-  std(stataddr + 48, filestat.st_size);         // long long
-  stw(stataddr + 56, filestat.st_blksize);      // int
-  stw(stataddr + 60, filestat.__pad0);          // int
-  std(stataddr + 64, filestat.st_blocks);       // long long
-  stw(stataddr + 72, filestat.st_atim.tv_sec);  // long
-  stw(stataddr + 76, filestat.st_atim.tv_nsec); // long
-  stw(stataddr + 80, filestat.st_mtim.tv_sec);  // long
-  stw(stataddr + 84, filestat.st_mtim.tv_nsec); // long
-  stw(stataddr + 88, filestat.st_ctim.tv_sec);  // long
-  stw(stataddr + 92, filestat.st_ctim.tv_nsec); // long
-  stw(stataddr + 96, filestat.__pad0);          // long
-  stw(stataddr + 100, filestat.__pad0);         // long
+  writeStat(stataddr, filestat);
 
   return result;
 }
@@ -601,7 +1406,12 @@ ac_int<32, true> BasicSimulator::doOpen(const unsigned path, const unsigned flag
   }
 
   const auto localPath = string_from_mem(path);
-  return open(localPath.c_str(), unixflags, static_cast<int>(mode));
+  const int fd         = open(localPath.c_str(), unixflags, static_cast<int>(mode));
+
+  // Kept to reopen the file when restoring a checkpoint
+  if (fd >= 0)
+    openedFiles[fd] = {localPath, unixflags, static_cast<int>(mode)};
+  return fd;
 }
 
 ac_int<32, true> BasicSimulator::doOpenat(const unsigned dir, const unsigned path, const unsigned flags, const unsigned mode)
@@ -612,8 +1422,10 @@ ac_int<32, true> BasicSimulator::doOpenat(const unsigned dir, const unsigned pat
 
 ac_int<32, true> BasicSimulator::doClose(const unsigned file)
 {
-  if (file > 2) // don't close simulator's stdin, stdout & stderr
+  if (file > 2) { // don't close simulator's stdin, stdout & stderr
+    openedFiles.erase(file);
     return close(file);
+  }
 
   return 0;
 }
@@ -629,26 +1441,7 @@ ac_int<32, true> BasicSimulator::doStat(ac_int<32, false> filename, ac_int<32, f
   struct stat filestat;
   int result = stat(localPath.c_str(), &filestat);
 
-  std(stataddr, filestat.st_dev);               // unsigned long long
-  std(stataddr + 8, filestat.st_ino);           // unsigned long long
-  stw(stataddr + 16, filestat.st_mode);         // unsigned int
-  stw(stataddr + 20, filestat.st_nlink);        // unsigned int
-  stw(stataddr + 24, filestat.st_uid);          // unsigned int
-  stw(stataddr + 28, filestat.st_gid);          // unsigned int
-  std(stataddr + 32, filestat.st_rdev);         // unsigned long long
-  std(stataddr + 40, filestat.__pad0);          // unsigned long long
-  std(stataddr + 48, filestat.st_size);         // long long
-  stw(stataddr + 56, filestat.st_blksize);      // int
-  stw(stataddr + 60, filestat.__pad0);          // int
-  std(stataddr + 64, filestat.st_blocks);       // long long
-  stw(stataddr + 72, filestat.st_atim.tv_sec);  // long
-  stw(stataddr + 76, filestat.st_atim.tv_nsec); // long
-  stw(stataddr + 80, filestat.st_mtim.tv_sec);  // long
-  stw(stataddr + 84, filestat.st_mtim.tv_nsec); // long
-  stw(stataddr + 88, filestat.st_ctim.tv_sec);  // long
-  stw(stataddr + 92, filestat.st_ctim.tv_nsec); // long
-  stw(stataddr + 96, filestat.__pad0);          // long
-  stw(stataddr + 100, filestat.__pad0);         // long
+  writeStat(stataddr, filestat);
 
   return result;
 }
@@ -667,12 +1460,29 @@ ac_int<32, true> BasicSimulator::doGettimeofday(const ac_int<32, false> timeValP
   struct timeval oneTimeVal;
   int result = gettimeofday(&oneTimeVal, NULL);
 
-  stw(timeValPtr, oneTimeVal.tv_sec);
-  stw(timeValPtr + 4, oneTimeVal.tv_usec);
+  const unsigned int localTimeVal[2] = {(unsigned int)oneTimeVal.tv_sec, (unsigned int)oneTimeVal.tv_usec};
+  caller->core->dm->writeBlock(timeValPtr.to_uint(), (const unsigned char*)localTimeVal, 8);
 
   return result;
 }
 
+// Takes the first idle hart, which is started at the end of the quantum. Returns its index, or -1 when every hart
+// is busy.
+ac_int<32, true> BasicSimulator::doThreadstart(const unsigned pc, const unsigned stack, const unsigned argument)
+{
+  for (auto& hart : harts) {
+    if (hart.state == HART_IDLE) {
+      hart.state         = HART_STARTING;
+      hart.pc            = pc;
+      hart.stack         = stack;
+      hart.argument      = argument;
+      hart.globalPointer = caller->core->regFile[3];
+      return &hart - &harts[0];
+    }
+  }
+  return -1;
+}
+
 ac_int<32, true> BasicSimulator::doUnlink(const unsigned path)
 {
   const auto localPath = string_from_mem(path);
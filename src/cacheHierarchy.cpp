@@ -0,0 +1,277 @@
+/** Copyright 2021 INRIA, Université de Rennes 1 and ENS Rennes
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include <cstdlib>
+
+#include "cacheHierarchy.h"
+
+CacheHierarchy::CacheHierarchy(unsigned char* data, const CacheConfig& cacheConfig) : config(cacheConfig)
+{
+  instructionMemory = NULL;
+  l1i               = NULL;
+  l1iAdapter        = NULL;
+  l1d               = NULL;
+  l1dNonBlocking    = NULL;
+  arbiter           = NULL;
+  l2                = NULL;
+  l3                = NULL;
+
+  if (config.levels < 0 || config.levels > 3) {
+    fprintf(stderr, "Error: the number of cache levels must be between 0 and 3\n");
+    exit(-1);
+  }
+  if (config.inclusion == EXCLUSIVE && ((config.levels >= 2 && L1_LINE_SIZE != L2_LINE_SIZE) ||
+                                        (config.levels == 3 && L2_LINE_SIZE != L3_LINE_SIZE))) {
+    fprintf(stderr, "Error: exclusive caches need the same line size at every level\n");
+    exit(-1);
+  }
+
+  if (config.mshrs < 0 || config.mshrs > L1D_MSHRS) {
+    fprintf(stderr, "Error: the L1 data cache has at most %d MSHRs\n", L1D_MSHRS);
+    exit(-1);
+  }
+  if (config.mshrs > 0 && config.levels == 0) {
+    fprintf(stderr, "Error: MSHRs need a data cache\n");
+    exit(-1);
+  }
+  const bool prefetch = config.l1iPrefetcher != NO_PREFETCH || config.l1dPrefetcher != NO_PREFETCH;
+  if (prefetch && config.levels == 0) {
+    fprintf(stderr, "Error: prefetchers need caches\n");
+    exit(-1);
+  }
+  // Exclusive levels give their lines to the L1, which could then only be held in a prefetch buffer
+  if (prefetch && config.inclusion == EXCLUSIVE) {
+    fprintf(stderr, "Error: prefetchers cannot be used with exclusive caches\n");
+    exit(-1);
+  }
+  if (config.writeBuffer < 0 || config.writeBuffer > WRITE_BUFFER_SIZE) {
+    fprintf(stderr, "Error: the write buffer holds at most %d lines\n", WRITE_BUFFER_SIZE);
+    exit(-1);
+  }
+  if (config.writeBuffer > 0 && config.levels == 0) {
+    fprintf(stderr, "Error: the write buffer needs a data cache\n");
+    exit(-1);
+  }
+  // The victims of the L1 move down to an exclusive level, they would then be in two places
+  if (config.writeBuffer > 0 && config.inclusion == EXCLUSIVE) {
+    fprintf(stderr, "Error: the write buffer cannot be used with exclusive caches\n");
+    exit(-1);
+  }
+
+  mainMemory = new MainMemory<4>(data);
+  if (config.levels == 0) {
+    instructionMemory = new MainMemory<FETCH_INTERFACE_SIZE>(data);
+    return;
+  }
+  mainMemory->accessLatency.latency = config.memoryLatency;
+
+  MemoryInterface<4>* belowL1 = mainMemory;
+  if (config.levels == 3) {
+    l3                        = new L3Cache(mainMemory, false);
+    l3->accessLatency.latency = config.l3Latency;
+    l3->inclusion             = config.inclusion;
+  }
+  if (config.levels >= 2) {
+    l2                        = new L2Cache(l3 ? (MemoryInterface<4>*)l3 : mainMemory, false);
+    l2->accessLatency.latency = config.l2Latency;
+    l2->inclusion             = config.inclusion;
+    l2->writeBackClean        = l3 && config.inclusion == EXCLUSIVE;
+    if (l3)
+      l3->upperLevels.push_back(l2);
+    belowL1 = l2;
+  }
+
+  arbiter = new MemoryArbiter<4, 2>(belowL1);
+  l1iAdapter = new WidthAdapter<FETCH_INTERFACE_SIZE, 4>(&arbiter->ports[0]);
+  l1i        = new L1ICache(l1iAdapter, false);
+  l1iAdapter->setUpper(l1i);
+  if (config.mshrs > 0) {
+    l1dNonBlocking              = new L1NonBlockingCache(&arbiter->ports[1], false);
+    l1dNonBlocking->activeMshrs = config.mshrs;
+    l1d                         = l1dNonBlocking;
+  } else {
+    l1d = new L1Cache(&arbiter->ports[1], false);
+  }
+  l1i->writeBackClean = l1d->writeBackClean = l2 && config.inclusion == EXCLUSIVE;
+  l1i->prefetcher.type = config.l1iPrefetcher;
+  l1d->prefetcher.type = config.l1dPrefetcher;
+  l1d->writeBufferEntries = config.writeBuffer;
+  if (l2) {
+    l2->upperLevels.push_back(&l1iAdapter->upperPort);
+    l2->upperLevels.push_back(l1d);
+  }
+}
+
+CacheHierarchy::~CacheHierarchy()
+{
+  delete l1i;
+  delete l1iAdapter;
+  if (l1dNonBlocking)
+    delete l1dNonBlocking;
+  else
+    delete l1d;
+  delete arbiter;
+  delete l2;
+  delete l3;
+  delete mainMemory;
+  delete instructionMemory;
+}
+
+MemoryInterface<FETCH_INTERFACE_SIZE>* CacheHierarchy::instructionInterface()
+{
+  return l1i ? (MemoryInterface<FETCH_INTERFACE_SIZE>*)l1i : instructionMemory;
+}
+
+MemoryInterface<4>* CacheHierarchy::dataInterface()
+{
+  return l1d ? (MemoryInterface<4>*)l1d : mainMemory;
+}
+
+void CacheHierarchy::settle()
+{
+  if (config.levels == 0)
+    return;
+  // The L1 caches share the arbiter: the one which is done goes on with idle cycles, which release it
+  while (l1i->busy() || l1d->busy()) {
+    l1i->settleCycle();
+    l1d->settleCycle();
+  }
+  if (l2 && l2->hasPending())
+    l2->commitPending();
+  if (l3 && l3->hasPending())
+    l3->commitPending();
+}
+
+void CacheHierarchy::storeLines()
+{
+  if (config.levels == 0)
+    return;
+  if (l3)
+    l3->storeLines(mainMemory->data);
+  if (l2)
+    l2->storeLines(mainMemory->data);
+  l1d->storeLines(mainMemory->data);
+  l1i->storeLines(mainMemory->data);
+}
+
+void CacheHierarchy::loadLines()
+{
+  if (config.levels == 0)
+    return;
+  l1i->loadLines(mainMemory->data);
+  l1d->loadLines(mainMemory->data);
+  if (l2)
+    l2->loadLines(mainMemory->data);
+  if (l3)
+    l3->loadLines(mainMemory->data);
+}
+
+void CacheHierarchy::connect(CoherenceBus<4>& bus)
+{
+  if (config.levels == 0)
+    return;
+  l1d->bus = &bus;
+  bus.caches.push_back(l1d);
+}
+
+// Misses are also given per thousand instructions retired (MPKI)
+static void printCacheStats(FILE* out, const char* name, const unsigned long access, const unsigned long miss,
+                            const unsigned long writeBack, const unsigned long instructions)
+{
+  fprintf(out, "%-4s %12lu accesses %12lu misses (%6.2f%%, %8.2f MPKI) %12lu write-backs\n", name, access, miss,
+          access ? 100.0 * miss / access : 0.0, instructions ? 1000.0 * miss / instructions : 0.0, writeBack);
+}
+
+// Accuracy: prefetched lines which were used, coverage: misses which were avoided by a prefetch
+template <int LINE_SIZE>
+static void printPrefetchStats(FILE* out, const char* name, const Prefetcher<LINE_SIZE>& prefetcher,
+                               const unsigned long miss)
+{
+  if (prefetcher.type == NO_PREFETCH)
+    return;
+  const unsigned long useful = prefetcher.numberUseful;
+  const unsigned long prefetch = prefetcher.numberPrefetch;
+  fprintf(out, "%s prefetcher: %lu prefetches, %lu useful, accuracy %6.2f%%, coverage %6.2f%%\n", name, prefetch,
+          useful, prefetch ? 100.0 * useful / prefetch : 0.0, (useful + miss) ? 100.0 * useful / (useful + miss) : 0.0);
+}
+
+void CacheHierarchy::printStats(FILE* out, const unsigned long instructions)
+{
+  if (config.levels == 0)
+    return;
+
+  printCacheStats(out, "L1I", l1i->numberAccess, l1i->numberMiss, l1i->numberWriteBack, instructions);
+  printCacheStats(out, "L1D", l1d->numberAccess, l1d->numberMiss, l1d->numberWriteBack, instructions);
+  if (l1dNonBlocking)
+    fprintf(out, "L1D MSHRs: %lu secondary misses, %lu hits under miss, %lu cycles waiting for an MSHR\n",
+            l1dNonBlocking->numberSecondaryMiss, l1dNonBlocking->numberHitUnderMiss,
+            l1dNonBlocking->numberMshrFullCycles);
+  printPrefetchStats(out, "L1I", l1i->prefetcher, l1i->numberMiss);
+  printPrefetchStats(out, "L1D", l1d->prefetcher, l1d->numberMiss);
+  if (config.writeBuffer > 0)
+    fprintf(out,
+            "L1D write buffer: %lu lines buffered, %lu taken back by a miss, %.2f lines on average, %lu cycles "
+            "writing back with a full buffer\n",
+            l1d->numberBuffered, l1d->numberTakenBack,
+            l1d->writeBufferCycles ? (double)l1d->writeBufferOccupancy / l1d->writeBufferCycles : 0.0,
+            l1d->writeBufferFullCycles);
+  if (l1d->bus)
+    fprintf(out, "L1D coherence: %lu upgrades, %lu invalidations, %lu interventions\n", l1d->numberUpgrade,
+            l1d->numberInvalidation, l1d->numberIntervention);
+  if (l2)
+    printCacheStats(out, "L2", l2->numberAccess, l2->numberMiss, l2->numberWriteBack, instructions);
+  if (l3)
+    printCacheStats(out, "L3", l3->numberAccess, l3->numberMiss, l3->numberWriteBack, instructions);
+  fprintf(out, "L1 arbitration conflicts: %lu cycles\n", arbiter->conflictCycles);
+}
+
+void CacheHierarchy::resetStats()
+{
+  if (config.levels == 0)
+    return;
+
+  l1i->resetStats();
+  l1d->resetStats();
+  if (l1dNonBlocking) {
+    l1dNonBlocking->numberSecondaryMiss  = 0;
+    l1dNonBlocking->numberHitUnderMiss   = 0;
+    l1dNonBlocking->numberMshrFullCycles = 0;
+  }
+  if (l2)
+    l2->resetStats();
+  if (l3)
+    l3->resetStats();
+  arbiter->conflictCycles = 0;
+}
+
+void CacheHierarchy::serialize(Checkpoint& cp)
+{
+  int levels                   = config.levels;
+  inclusionPolicy inclusion    = config.inclusion;
+  int mshrs                    = config.mshrs;
+  prefetcherType l1iPrefetcher = config.l1iPrefetcher;
+  prefetcherType l1dPrefetcher = config.l1dPrefetcher;
+  int writeBuffer              = config.writeBuffer;
+  cp.transfer(levels);
+  cp.transfer(inclusion);
+  cp.transfer(mshrs);
+  cp.transfer(l1iPrefetcher);
+  cp.transfer(l1dPrefetcher);
+  cp.transfer(writeBuffer);
+  if (levels != config.levels || inclusion != config.inclusion || mshrs != config.mshrs ||
+      l1iPrefetcher != config.l1iPrefetcher || l1dPrefetcher != config.l1dPrefetcher ||
+      writeBuffer != config.writeBuffer) {
+    fprintf(stderr, "Error: the checkpoint was made with another cache configuration\n");
+    exit(-1);
+  }
+}
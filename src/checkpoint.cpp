@@ -0,0 +1,126 @@
+/** Copyright 2021 INRIA, Université de Rennes 1 and ENS Rennes
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include <cstdlib>
+#include <cstring>
+
+#include "checkpoint.h"
+#include "core.h"
+
+#define CHECKPOINT_MAGIC "COMETCKP"
+// Values are saved as they are laid out in memory, which depends on the integer types of the build
+#ifdef SIMULATE_AC_INT
+#define CHECKPOINT_VERSION 0x80000011
+#else
+#define CHECKPOINT_VERSION 17
+#endif
+
+Checkpoint::Checkpoint(const char* fileName, bool load) : loading(load)
+{
+  file = fopen(fileName, load ? "rb" : "wb");
+  if (file == NULL) {
+    fprintf(stderr, "Error: cannot open checkpoint file %s\n", fileName);
+    exit(-1);
+  }
+
+  // Header: magic, version and size of the core to detect checkpoints made by another build
+  char magic[8];
+  unsigned int version  = CHECKPOINT_VERSION;
+  unsigned int coreSize = sizeof(Core);
+  memcpy(magic, CHECKPOINT_MAGIC, 8);
+
+  transfer(magic, 8);
+  transfer(version);
+  transfer(coreSize);
+
+  if (memcmp(magic, CHECKPOINT_MAGIC, 8) != 0 || version != CHECKPOINT_VERSION || coreSize != sizeof(Core)) {
+    fprintf(stderr, "Error: %s is not a checkpoint made by this version of the simulator\n", fileName);
+    exit(-1);
+  }
+}
+
+Checkpoint::~Checkpoint()
+{
+  fclose(file);
+}
+
+void Checkpoint::transfer(void* data, size_t size)
+{
+  const size_t done = loading ? fread(data, 1, size, file) : fwrite(data, 1, size, file);
+  if (done != size) {
+    fprintf(stderr, "Error: checkpoint file is truncated or cannot be written\n");
+    exit(-1);
+  }
+}
+
+void Checkpoint::transfer(std::string& value)
+{
+  unsigned int length = value.size();
+  transfer(length);
+  if (loading)
+    value.resize(length);
+  if (length)
+    transfer(&value[0], length);
+}
+
+void serialize(Checkpoint& cp, struct Core& core)
+{
+  cp.transfer(core.regFile);
+  cp.transfer(core.pc);
+
+  cp.transfer(core.ftoDC);
+  cp.transfer(core.dctoEx);
+  cp.transfer(core.extoMem);
+  cp.transfer(core.memtoWB);
+#if ISSUE_WIDTH == 2
+  cp.transfer(core.ftoDC1);
+  cp.transfer(core.dctoEx1);
+  cp.transfer(core.extoMem1);
+  cp.transfer(core.memtoWB1);
+  cp.transfer(core.numberPairs);
+#endif
+
+  cp.transfer(core.stallSignals);
+  cp.transfer(core.stallIm);
+  cp.transfer(core.stallDm);
+  cp.transfer(core.pendingLoads);
+  cp.transfer(core.mulDivCycles);
+  cp.transfer(core.fetchBuffer);
+  cp.transfer(core.fetchBufferPC);
+  cp.transfer(core.cycle);
+  cp.transfer(core.instret);
+  cp.transfer(core.numberAtomic);
+  cp.transfer(core.atomicCycles);
+  cp.transfer(core.numberFailedSC);
+  cp.transfer(core.atomicWait);
+  cp.transfer(core.cpiStack);
+  cp.transfer(core.cpiInstructions);
+  cp.transfer(core.bubbleCause);
+  cp.transfer(core.csrOffset);
+  cp.transfer(core.mscratch);
+
+  mulDivUnitType multiplier = core.multiplier, divider = core.divider;
+  cp.transfer(multiplier);
+  cp.transfer(divider);
+  if (multiplier != core.multiplier || divider != core.divider) {
+    fprintf(stderr, "Error: the checkpoint was made with another multiplier or divider\n");
+    exit(-1);
+  }
+
+  core.bp.serialize(cp);
+  core.btb.serialize(cp);
+  core.ras.serialize(cp);
+
+  core.im->serialize(cp);
+  core.dm->serialize(cp);
+}
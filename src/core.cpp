@@ -12,18 +12,150 @@
  */
 
 #include "core.h"
-#include "ac_int.h"
+#include "integerTypes.h"
 #include "cacheMemory.h"
+#include "decompressor.h"
+#include "mainMemory.h"
 
-void fetch(const ac_int<32, false> pc, struct FtoDC& ftoDC, const ac_int<32, false> instruction)
+// Pc of the instruction following the one at pc in memory
+static ac_int<32, false> followingPC(const ac_int<32, false> pc, const bool isCompressed)
 {
-  ftoDC.instruction = instruction;
-  ftoDC.pc          = pc;
-  ftoDC.nextPCFetch = pc + 4;
-  ftoDC.we          = 1;
+  return pc + (isCompressed ? 2 : 4);
 }
 
-void decode(const struct FtoDC ftoDC, struct DCtoEx& dctoEx, const ac_int<32, true> registerFile[32])
+// Instructions are 2-byte aligned with the C extension. Fetch reads the word holding the start of the
+// instruction, and keeps its upper half in a realignment buffer, valid for the pc given with it: when
+// the next instruction starts there, fetch reads the word following it to get its second half. A 32-bit
+// instruction in the upper half of a word which is not in the buffer (after a jump) takes a second cycle.
+static inline void fetch(const ac_int<32, false> pc, const ac_int<32, false> word, const bool bufferHit,
+                         const ac_int<16, false> buffer, struct FtoDC& ftoDC, ac_int<16, false>& nextBuffer,
+                         ac_int<32, false>& nextBufferPC)
+{
+  nextBuffer = word.slc<16>(16);
+
+  // Common case, a 32-bit instruction at the start of the word, which needs neither realignment nor decompression
+  if (!bufferHit && !pc[1] && word.slc<2>(0) == 3) {
+    ftoDC.pc           = pc;
+    ftoDC.isCompressed = false;
+    ftoDC.instruction  = word;
+    ftoDC.we           = 1;
+    ftoDC.nextPCFetch  = pc + 4;
+    nextBufferPC       = pc + 2;
+    return;
+  }
+
+  const ac_int<16, false> low  = bufferHit ? buffer : pc[1] ? word.slc<16>(16) : word.slc<16>(0);
+  const ac_int<16, false> high = bufferHit ? word.slc<16>(0) : word.slc<16>(16);
+  const bool isCompressed      = low.slc<2>(0) != 3;
+
+  ac_int<32, false> instruction = 0;
+  instruction.set_slc(0, low);
+  instruction.set_slc(16, high);
+
+  ftoDC.pc           = pc;
+  ftoDC.isCompressed = isCompressed;
+  ftoDC.instruction  = isCompressed ? decompress(low) : instruction;
+  ftoDC.we           = isCompressed || bufferHit || !pc[1];
+  ftoDC.nextPCFetch  = ftoDC.we ? followingPC(pc, isCompressed) : pc;
+
+  if (bufferHit && isCompressed) { // the word was not read
+    nextBuffer   = buffer;
+    nextBufferPC = pc;
+  } else if (bufferHit)
+    nextBufferPC = pc + 4;
+  else {
+    nextBufferPC    = pc;
+    nextBufferPC[1] = 1;
+  }
+}
+
+#if ISSUE_WIDTH == 2
+// Instructions which can be the second one of a pair: integer operations which neither access memory, transfer
+// control nor use the multiplier and divider
+static bool isSimpleInstruction(const ac_int<32, false> instruction)
+{
+  const ac_int<7, false> opCode = instruction.slc<7>(0);
+  return opCode == RISCV_LUI || opCode == RISCV_AUIPC || opCode == RISCV_OPI ||
+         (opCode == RISCV_OP && !instruction[25]);
+}
+
+// Pairing rules of the dual-issue core: the second instruction is simple, the first one does not jump (a conditional
+// branch may only be taken at the end of the pair) and the second one neither reads nor writes the register written
+// by the first. Memory accesses, branches and long instructions thus only go through the first way, and the two
+// instructions never depend on each other.
+static bool canPair(const ac_int<32, false> first, const ac_int<32, false> second)
+{
+  const ac_int<7, false> firstOpCode = first.slc<7>(0);
+  const ac_int<5, false> firstRd     = first.slc<5>(7);
+  const ac_int<7, false> opCode      = second.slc<7>(0);
+
+  if (!isSimpleInstruction(second) || firstOpCode == RISCV_JAL || firstOpCode == RISCV_JALR ||
+      firstOpCode == RISCV_SYSTEM)
+    return false;
+  if (firstOpCode == RISCV_BR || firstOpCode == RISCV_ST || firstOpCode == RISCV_MISC_MEM || firstRd == 0)
+    return true;
+  const bool readsRs1 = opCode == RISCV_OPI || opCode == RISCV_OP;
+  const bool readsRs2 = opCode == RISCV_OP;
+  return second.slc<5>(7) != firstRd && !(readsRs1 && second.slc<5>(15) == firstRd) &&
+         !(readsRs2 && second.slc<5>(20) == firstRd);
+}
+
+// Fetch of the dual-issue core: the aligned block of two words holding pc is read, or the next one when pc is in the
+// upper word of the previous block, kept in the realignment buffer (blockRead is false when it is not read). The
+// instruction at pc goes to the first way and the one following it to the second way when it is also in the halves
+// read and the two can be paired. Pairs are formed here rather than in decode, so that decode never has to split them.
+static void fetchPair(const ac_int<32, false> pc, const ac_int<32, false> blockAddress, const ac_int<64, false> block,
+                      const bool blockRead, const bool bufferHit, const ac_int<32, false> buffer,
+                      const ac_int<32, false> bufferPC, struct FtoDC& ftoDC, struct FtoDC& ftoDC1,
+                      ac_int<32, false>& nextBuffer, ac_int<32, false>& nextBufferPC)
+{
+  // Halves from pc on, four of them are enough for two instructions
+  ac_int<96, false> halves = 0;
+  ac_int<3, false> available;
+  if (bufferHit) {
+    halves.set_slc(0, buffer);
+    halves.set_slc(32, block);
+    halves    = halves >> (16 * pc[1]);
+    available = (blockRead ? 6 : 2) - pc[1];
+  } else {
+    halves.set_slc(0, block);
+    halves    = halves >> (16 * pc.slc<2>(1));
+    available = 4 - pc.slc<2>(1);
+  }
+
+  const ac_int<16, false> low  = halves.slc<16>(0);
+  const bool isCompressed      = low.slc<2>(0) != 3;
+  ftoDC.pc                     = pc;
+  ftoDC.isCompressed           = isCompressed;
+  ftoDC.instruction            = isCompressed ? decompress(low) : (ac_int<32, false>)halves.slc<32>(0);
+  ftoDC.we                     = available >= (isCompressed ? 1 : 2);
+
+  const ac_int<48, false> rest = isCompressed ? halves.slc<48>(16) : halves.slc<48>(32);
+  const ac_int<16, false> low1 = rest.slc<16>(0);
+  const bool isCompressed1     = low1.slc<2>(0) != 3;
+  ftoDC1.pc                    = followingPC(pc, isCompressed);
+  ftoDC1.isCompressed          = isCompressed1;
+  ftoDC1.instruction           = isCompressed1 ? decompress(low1) : (ac_int<32, false>)rest.slc<32>(0);
+  ftoDC1.we = ftoDC.we && available >= (isCompressed ? 1 : 2) + (isCompressed1 ? 1 : 2) &&
+              canPair(ftoDC.instruction, ftoDC1.instruction);
+
+  ftoDC.nextPCFetch  = !ftoDC.we ? pc : ftoDC1.we ? followingPC(ftoDC1.pc, isCompressed1) : ftoDC1.pc;
+  ftoDC1.nextPCFetch = ftoDC.nextPCFetch;
+
+  // The buffer is kept while fetch has not gone past it
+  ac_int<32, false> nextWord = ftoDC.nextPCFetch;
+  nextWord.set_slc(0, (ac_int<2, false>)0);
+  if (bufferHit && (nextWord == bufferPC || !blockRead)) {
+    nextBuffer   = buffer;
+    nextBufferPC = bufferPC;
+  } else {
+    nextBuffer   = block.slc<32>(32);
+    nextBufferPC = blockAddress + 4;
+  }
+}
+#endif
+
+static inline void decode(const struct FtoDC& ftoDC, struct DCtoEx& dctoEx, const ac_int<32, true> registerFile[32])
 {
   const ac_int<32, false> pc          = ftoDC.pc;
   const ac_int<32, false> instruction = ftoDC.instruction;
@@ -70,15 +202,16 @@ void decode(const struct FtoDC ftoDC, struct DCtoEx& dctoEx, const ac_int<32, tr
   const ac_int<32, false> valueReg1 = registerFile[rs1];
   const ac_int<32, false> valueReg2 = registerFile[rs2];
 
-  dctoEx.rs1         = rs1;
-  dctoEx.rs2         = rs2;
-  dctoEx.rs3         = rs2;
-  dctoEx.rd          = rd;
-  dctoEx.opCode      = opCode;
-  dctoEx.funct3      = funct3;
-  dctoEx.funct7      = funct7;
-  dctoEx.instruction = instruction;
-  dctoEx.pc          = pc;
+  dctoEx.rs1          = rs1;
+  dctoEx.rs2          = rs2;
+  dctoEx.rs3          = rs2;
+  dctoEx.rd           = rd;
+  dctoEx.opCode       = opCode;
+  dctoEx.funct3       = funct3;
+  dctoEx.funct7       = funct7;
+  dctoEx.instruction  = instruction;
+  dctoEx.isCompressed = ftoDC.isCompressed;
+  dctoEx.pc           = pc;
 
   // Initialization of control bits
   dctoEx.useRs1   = 0;
@@ -105,7 +238,7 @@ void decode(const struct FtoDC ftoDC, struct DCtoEx& dctoEx, const ac_int<32, tr
       dctoEx.useRd  = 1;
       break;
     case RISCV_JAL:
-      dctoEx.lhs      = ftoDC.pc + 4;
+      dctoEx.lhs      = followingPC(ftoDC.pc, ftoDC.isCompressed);
       dctoEx.rhs      = 0;
       dctoEx.nextPCDC = ftoDC.pc + imm21_1_signed;
       dctoEx.useRs1   = 0;
@@ -156,6 +289,15 @@ void decode(const struct FtoDC ftoDC, struct DCtoEx& dctoEx, const ac_int<32, tr
       dctoEx.useRd  = 0;
       dctoEx.rd     = 0;
       break;
+    case RISCV_ATOMIC:
+      dctoEx.lhs    = valueReg1;
+      dctoEx.rhs    = 0;
+      dctoEx.datac  = valueReg2; // Operand of the AMO or value stored by SC
+      dctoEx.useRs1 = 1;
+      dctoEx.useRs2 = 0;
+      dctoEx.useRs3 = 1;
+      dctoEx.useRd  = 1;
+      break;
     case RISCV_OPI:
       dctoEx.lhs    = valueReg1;
       dctoEx.rhs    = imm12_I_signed;
@@ -176,8 +318,15 @@ void decode(const struct FtoDC ftoDC, struct DCtoEx& dctoEx, const ac_int<32, tr
 
       break;
     case RISCV_SYSTEM:
-      // TODO
-
+      // CSR instructions: the CSR is read by the memory stage, lhs is the operand (rs1 or its 5-bit immediate)
+      if (funct3 != RISCV_SYSTEM_ENV) {
+        dctoEx.lhs    = funct3[2] ? (ac_int<32, false>)rs1 : valueReg1;
+        dctoEx.rhs    = 0;
+        dctoEx.useRs1 = !funct3[2];
+        dctoEx.useRs2 = 0;
+        dctoEx.useRs3 = 0;
+        dctoEx.useRd  = 1;
+      }
       break;
     default:
 
@@ -199,7 +348,7 @@ void decode(const struct FtoDC ftoDC, struct DCtoEx& dctoEx, const ac_int<32, tr
   }
 }
 
-void execute(const struct DCtoEx dctoEx, struct ExtoMem& extoMem)
+static void execute(const struct DCtoEx& dctoEx, struct ExtoMem& extoMem)
 {
   extoMem.pc                = dctoEx.pc;
   extoMem.opCode            = dctoEx.opCode;
@@ -242,8 +391,10 @@ void execute(const struct DCtoEx dctoEx, struct ExtoMem& extoMem)
       // The value to store in rd (pc+4) is stored in lhs
       extoMem.nextPC   = dctoEx.rhs + dctoEx.lhs;
       extoMem.isBranch = 1;
+      // Decode may already have gone to the target, taken from the return address stack
+      extoMem.predBranch = dctoEx.predBranch && extoMem.nextPC == dctoEx.nextPCDC;
 
-      extoMem.result = dctoEx.pc + 4;
+      extoMem.result = followingPC(dctoEx.pc, dctoEx.isCompressed);
       break;
     case RISCV_BR:
       switch (dctoEx.funct3) {
@@ -266,7 +417,7 @@ void execute(const struct DCtoEx dctoEx, struct ExtoMem& extoMem)
           extoMem.isBranch = ((ac_int<32, false>)dctoEx.lhs >= (ac_int<32, false>)dctoEx.rhs);
           break;
       }
-      extoMem.nextPC = extoMem.isBranch ? dctoEx.nextPCDC : (ac_int<32, false>)(extoMem.pc + 4);
+      extoMem.nextPC = extoMem.isBranch ? dctoEx.nextPCDC : followingPC(dctoEx.pc, dctoEx.isCompressed);
       break;
     case RISCV_LD:
       extoMem.isLongInstruction = 1;
@@ -276,6 +427,12 @@ void execute(const struct DCtoEx dctoEx, struct ExtoMem& extoMem)
       extoMem.datac  = dctoEx.datac;
       extoMem.result = dctoEx.lhs + dctoEx.rhs;
       break;
+    case RISCV_ATOMIC:
+      // The word read by the memory stage is the result, as for a load
+      extoMem.isLongInstruction = 1;
+      extoMem.datac             = dctoEx.datac;
+      extoMem.result            = dctoEx.lhs;
+      break;
     case RISCV_OPI:
       switch (dctoEx.funct3) {
         case RISCV_OPI_ADDI:
@@ -312,7 +469,37 @@ void execute(const struct DCtoEx dctoEx, struct ExtoMem& extoMem)
     case RISCV_OP:
       if (dctoEx.funct7[0]) // M Extension
       {
-
+        // One signed 33-bit multiplier and divider serve the signed and unsigned operations
+        const bool lhsSigned = dctoEx.funct3 == RISCV_OP_M_MUL || dctoEx.funct3 == RISCV_OP_M_MULH ||
+                               dctoEx.funct3 == RISCV_OP_M_MULHSU || dctoEx.funct3 == RISCV_OP_M_DIV ||
+                               dctoEx.funct3 == RISCV_OP_M_REM;
+        const bool rhsSigned = dctoEx.funct3 == RISCV_OP_M_MUL || dctoEx.funct3 == RISCV_OP_M_MULH ||
+                               dctoEx.funct3 == RISCV_OP_M_DIV || dctoEx.funct3 == RISCV_OP_M_REM;
+        ac_int<33, true> lhs = dctoEx.lhs;
+        ac_int<33, true> rhs = dctoEx.rhs;
+        lhs[32]              = lhsSigned && dctoEx.lhs[31];
+        rhs[32]              = rhsSigned && dctoEx.rhs[31];
+
+        const ac_int<66, true> product = lhs * rhs;
+        switch (dctoEx.funct3) {
+          case RISCV_OP_M_MUL:
+            extoMem.result = product.slc<32>(0);
+            break;
+          case RISCV_OP_M_MULH:
+          case RISCV_OP_M_MULHSU:
+          case RISCV_OP_M_MULHU:
+            extoMem.result = product.slc<32>(32);
+            break;
+          // The overflow of DIV (-2^31 / -1) gives -2^31 and 0 as required once truncated
+          case RISCV_OP_M_DIV:
+          case RISCV_OP_M_DIVU:
+            extoMem.result = (rhs == 0) ? (ac_int<32, true>)-1 : (ac_int<32, true>)(lhs / rhs).slc<32>(0);
+            break;
+          case RISCV_OP_M_REM:
+          case RISCV_OP_M_REMU:
+            extoMem.result = (rhs == 0) ? dctoEx.lhs : (ac_int<32, true>)(lhs % rhs).slc<32>(0);
+            break;
+        }
       } else {
         switch (dctoEx.funct3) {
           case RISCV_OP_ADD:
@@ -348,8 +535,8 @@ void execute(const struct DCtoEx dctoEx, struct ExtoMem& extoMem)
         }
       }
       break;
-    case RISCV_MISC_MEM: // this does nothing because all memory accesses are
-                         // ordered and we have only one core
+    case RISCV_MISC_MEM: // FENCE waits in decode for the misses of a lockup-free data cache, the other accesses
+                         // being made in order by a data cache kept coherent with the ones of the other cores
       break;
 
     case RISCV_SYSTEM:
@@ -362,29 +549,10 @@ void execute(const struct DCtoEx dctoEx, struct ExtoMem& extoMem)
           // dctoEx.datac, dctoEx.datad, dctoEx.datae, exit);
 #endif
           break;
-        case RISCV_SYSTEM_CSRRW:       // lhs is from csr, rhs is from reg[rs1]
-          extoMem.datac  = dctoEx.rhs; // written back to csr
-          extoMem.result = dctoEx.lhs; // written back to rd
-          break;
-        case RISCV_SYSTEM_CSRRS:
-          extoMem.datac  = dctoEx.lhs | dctoEx.rhs;
-          extoMem.result = dctoEx.lhs;
-          break;
-        case RISCV_SYSTEM_CSRRC:
-          extoMem.datac  = dctoEx.lhs & ((ac_int<32, false>)~dctoEx.rhs);
-          extoMem.result = dctoEx.lhs;
-          break;
-        case RISCV_SYSTEM_CSRRWI:
-          extoMem.datac  = dctoEx.rhs;
-          extoMem.result = dctoEx.lhs;
-          break;
-        case RISCV_SYSTEM_CSRRSI:
-          extoMem.datac  = dctoEx.lhs | dctoEx.rhs;
-          extoMem.result = dctoEx.lhs;
-          break;
-        case RISCV_SYSTEM_CSRRCI:
-          extoMem.datac  = dctoEx.lhs & ((ac_int<32, false>)~dctoEx.rhs);
-          extoMem.result = dctoEx.lhs;
+        default: // CSR instructions: the read-modify-write of the CSR is made by the memory stage (see csrValue),
+                 // which gives the result
+          extoMem.datac             = dctoEx.lhs;
+          extoMem.isLongInstruction = 1;
           break;
       }
       break;
@@ -398,7 +566,7 @@ void execute(const struct DCtoEx dctoEx, struct ExtoMem& extoMem)
   }
 }
 
-void memory(const struct ExtoMem extoMem, struct MemtoWB& memtoWB)
+static void memory(const struct ExtoMem& extoMem, struct MemtoWB& memtoWB)
 {
   memtoWB.we     = extoMem.we;
   memtoWB.useRd  = extoMem.useRd;
@@ -424,28 +592,40 @@ void memory(const struct ExtoMem extoMem, struct MemtoWB& memtoWB)
       memtoWB.valueToWrite = extoMem.datac;
       memtoWB.byteEnable   = 0xf;
 
+      break;
+    case RISCV_ATOMIC:
+      memtoWB.isAtomic     = 1;
+      memtoWB.atomicOp     = extoMem.instruction.slc<5>(27);
+      memtoWB.address      = extoMem.result;
+      memtoWB.valueToWrite = extoMem.datac;
       break;
   }
 }
 
-void writeback(const struct MemtoWB memtoWB, struct WBOut& wbOut)
+static void writeback(const struct MemtoWB& memtoWB, struct WBOut& wbOut)
 {
-  wbOut.we = memtoWB.we;
-  if ((memtoWB.rd != 0) && (memtoWB.we) && memtoWB.useRd) {
-    wbOut.rd    = memtoWB.rd;
-    wbOut.value = memtoWB.result;
-    wbOut.useRd = 1;
-  }
+  wbOut.we    = memtoWB.we;
+  wbOut.rd    = memtoWB.rd;
+  wbOut.value = memtoWB.result;
+  wbOut.useRd = (memtoWB.rd != 0) & memtoWB.we & memtoWB.useRd;
 }
 
-void branchUnit(const ac_int<32, false> nextPC_fetch, const ac_int<32, false> nextPC_decode, const bool isBranch_decode,
-                const ac_int<32, false> nextPC_execute, const bool isBranch_execute, ac_int<32, false>& pc,
-                bool& we_fetch, bool& we_decode, const bool stall_fetch, BranchPredictor& bp)
+// Pc following the instruction in decode, according to decode
+static ac_int<32, false> decodeNextPC(const struct DCtoEx& dctoEx)
+{
+  return (dctoEx.isBranch || dctoEx.predBranch) ? dctoEx.nextPCDC : followingPC(dctoEx.pc, dctoEx.isCompressed);
+}
+
+static void branchUnit(const ac_int<32, false> nextPC_fetch, const ac_int<32, false> nextPC_decode,
+                       const bool isBranch_decode, const ac_int<32, false> nextPC_execute, const bool isBranch_execute,
+                       ac_int<32, false>& pc, bool& we_fetch, bool& we_decode, const bool stall_fetch,
+                       BranchPredictor& bp, ReturnAddressStack<RAS_ENTRIES>& ras)
 {
 
   if (!stall_fetch) {
     if (isBranch_execute) {
       bp.undo();
+      ras.repair();
       we_fetch  = 0;
       we_decode = 0;
       pc        = nextPC_execute;
@@ -458,60 +638,219 @@ void branchUnit(const ac_int<32, false> nextPC_fetch, const ac_int<32, false> ne
   }
 }
 
-void forwardUnit(const ac_int<5, false> decodeRs1, const bool decodeUseRs1, const ac_int<5, false> decodeRs2,
-                 const bool decodeUseRs2, const ac_int<5, false> decodeRs3, const bool decodeUseRs3,
-                 const ac_int<5, false> executeRd, const bool executeUseRd, const bool executeIsLongComputation,
-                 const ac_int<5, false> memoryRd, const bool memoryUseRd, const ac_int<5, false> writebackRd,
-                 const bool writebackUseRd, bool stall[5], struct ForwardReg& forwardRegisters)
+// Source of a register read by decode: the youngest instruction writing it, in execute, memory or writeback and in
+// either way of the pipeline (the instructions of a pair never write the same register, so a stage holds at most
+// one writer). A long instruction in execute has no value yet and stalls fetch and decode.
+static void forwardSource(const ac_int<5, false> decodeRs, const ac_int<5, false> executeRd, const bool executeUseRd,
+                          const bool executeIsLongComputation, const ac_int<5, false> memoryRd, const bool memoryUseRd,
+                          const ac_int<5, false> writebackRd, const bool writebackUseRd,
+                          const ac_int<5, false> executeRd1, const bool executeUseRd1, const ac_int<5, false> memoryRd1,
+                          const bool memoryUseRd1, const ac_int<5, false> writebackRd1, const bool writebackUseRd1,
+                          bool stall[5], bool& forwardEx, bool& forwardMem, bool& forwardWB, bool& forwardSecondWay)
 {
-
-  if (decodeUseRs1) {
-    if (executeUseRd && decodeRs1 == executeRd) {
-      if (executeIsLongComputation) {
-        stall[0] = 1;
-        stall[1] = 1;
-      } else {
-        forwardRegisters.forwardExtoVal1 = 1;
-      }
-    } else if (memoryUseRd && decodeRs1 == memoryRd) {
-      forwardRegisters.forwardMemtoVal1 = 1;
-    } else if (writebackUseRd && decodeRs1 == writebackRd) {
-      forwardRegisters.forwardWBtoVal1 = 1;
+  const bool fromExecute1   = executeUseRd1 && decodeRs == executeRd1;
+  const bool fromMemory1    = memoryUseRd1 && decodeRs == memoryRd1;
+  const bool fromWriteback1 = writebackUseRd1 && decodeRs == writebackRd1;
+
+  if ((executeUseRd && decodeRs == executeRd) || fromExecute1) {
+    if (executeIsLongComputation && !fromExecute1) {
+      stall[0] = 1;
+      stall[1] = 1;
+    } else {
+      forwardEx        = 1;
+      forwardSecondWay = fromExecute1;
     }
+  } else if ((memoryUseRd && decodeRs == memoryRd) || fromMemory1) {
+    forwardMem       = 1;
+    forwardSecondWay = fromMemory1;
+  } else if ((writebackUseRd && decodeRs == writebackRd) || fromWriteback1) {
+    forwardWB        = 1;
+    forwardSecondWay = fromWriteback1;
   }
+}
 
-  if (decodeUseRs2) {
-    if (executeUseRd && decodeRs2 == executeRd) {
-      if (executeIsLongComputation) {
-        stall[0] = 1;
-        stall[1] = 1;
-      } else {
-        forwardRegisters.forwardExtoVal2 = 1;
-      }
-    } else if (memoryUseRd && decodeRs2 == memoryRd)
-      forwardRegisters.forwardMemtoVal2 = 1;
-    else if (writebackUseRd && decodeRs2 == writebackRd)
-      forwardRegisters.forwardWBtoVal2 = 1;
+// The registers ending with 1 are the ones written by the second way of the dual-issue core (never a long
+// instruction), which does not use them otherwise
+static inline void forwardUnit(const ac_int<5, false> decodeRs1, const bool decodeUseRs1,
+                               const ac_int<5, false> decodeRs2, const bool decodeUseRs2,
+                               const ac_int<5, false> decodeRs3, const bool decodeUseRs3,
+                               const ac_int<5, false> executeRd, const bool executeUseRd,
+                               const bool executeIsLongComputation, const ac_int<5, false> memoryRd,
+                               const bool memoryUseRd, const ac_int<5, false> writebackRd, const bool writebackUseRd,
+                               const ac_int<5, false> executeRd1, const bool executeUseRd1,
+                               const ac_int<5, false> memoryRd1, const bool memoryUseRd1,
+                               const ac_int<5, false> writebackRd1, const bool writebackUseRd1, bool stall[5],
+                               struct ForwardReg& forwardRegisters)
+{
+  if (decodeUseRs1)
+    forwardSource(decodeRs1, executeRd, executeUseRd, executeIsLongComputation, memoryRd, memoryUseRd, writebackRd,
+                  writebackUseRd, executeRd1, executeUseRd1, memoryRd1, memoryUseRd1, writebackRd1, writebackUseRd1,
+                  stall, forwardRegisters.forwardExtoVal1, forwardRegisters.forwardMemtoVal1,
+                  forwardRegisters.forwardWBtoVal1, forwardRegisters.forwardSecondWayVal1);
+
+  if (decodeUseRs2)
+    forwardSource(decodeRs2, executeRd, executeUseRd, executeIsLongComputation, memoryRd, memoryUseRd, writebackRd,
+                  writebackUseRd, executeRd1, executeUseRd1, memoryRd1, memoryUseRd1, writebackRd1, writebackUseRd1,
+                  stall, forwardRegisters.forwardExtoVal2, forwardRegisters.forwardMemtoVal2,
+                  forwardRegisters.forwardWBtoVal2, forwardRegisters.forwardSecondWayVal2);
+
+  if (decodeUseRs3)
+    forwardSource(decodeRs3, executeRd, executeUseRd, executeIsLongComputation, memoryRd, memoryUseRd, writebackRd,
+                  writebackUseRd, executeRd1, executeUseRd1, memoryRd1, memoryUseRd1, writebackRd1, writebackUseRd1,
+                  stall, forwardRegisters.forwardExtoVal3, forwardRegisters.forwardMemtoVal3,
+                  forwardRegisters.forwardWBtoVal3, forwardRegisters.forwardSecondWayVal3);
+}
+
+// Operand of the instruction entering execute, replaced by the value the forwarding unit chose for it
+static void forwardOperand(const bool forwardEx, const bool forwardMem, const bool forwardWB,
+                           const bool forwardSecondWay, const struct ExtoMem& extoMem, const struct ExtoMem& extoMem1,
+                           const struct MemtoWB& memtoWB, const struct MemtoWB& memtoWB1, const struct WBOut& wbOut,
+                           const struct WBOut& wbOut1, ac_int<32, true>& operand)
+{
+  const struct ExtoMem& executeOut   = forwardSecondWay ? extoMem1 : extoMem;
+  const struct MemtoWB& memoryOut    = forwardSecondWay ? memtoWB1 : memtoWB;
+  const struct WBOut& writebackOut   = forwardSecondWay ? wbOut1 : wbOut;
+  if (forwardEx && executeOut.we)
+    operand = executeOut.result;
+  else if (forwardMem && memoryOut.we)
+    operand = memoryOut.result;
+  else if (forwardWB && writebackOut.we)
+    operand = writebackOut.value;
+}
+
+static inline void forwardOperands(const struct ForwardReg& forwardRegisters, const struct ExtoMem& extoMem,
+                                   const struct ExtoMem& extoMem1, const struct MemtoWB& memtoWB,
+                                   const struct MemtoWB& memtoWB1, const struct WBOut& wbOut,
+                                   const struct WBOut& wbOut1, struct DCtoEx& dctoEx)
+{
+  forwardOperand(forwardRegisters.forwardExtoVal1, forwardRegisters.forwardMemtoVal1, forwardRegisters.forwardWBtoVal1,
+                 forwardRegisters.forwardSecondWayVal1, extoMem, extoMem1, memtoWB, memtoWB1, wbOut, wbOut1,
+                 dctoEx.lhs);
+  forwardOperand(forwardRegisters.forwardExtoVal2, forwardRegisters.forwardMemtoVal2, forwardRegisters.forwardWBtoVal2,
+                 forwardRegisters.forwardSecondWayVal2, extoMem, extoMem1, memtoWB, memtoWB1, wbOut, wbOut1,
+                 dctoEx.rhs);
+  forwardOperand(forwardRegisters.forwardExtoVal3, forwardRegisters.forwardMemtoVal3, forwardRegisters.forwardWBtoVal3,
+                 forwardRegisters.forwardSecondWayVal3, extoMem, extoMem1, memtoWB, memtoWB1, wbOut, wbOut1,
+                 dctoEx.datac);
+}
+
+unsigned long counterEvents(const struct Core& core, const int counter, const unsigned int retiring)
+{
+  switch (counter) {
+    case 0: // cycle
+    case 1: // time
+      return core.cycle;
+    case 2:
+      return core.instret + retiring;
+#ifndef __HLS__
+    case HPM_L1I_MISSES:
+      return core.im->missCount();
+    case HPM_L1D_MISSES:
+      return core.dm->missCount();
+#endif
+    case HPM_BRANCHES:
+      return core.bp.numberBranch;
+    case HPM_MISPREDICTIONS:
+      return core.bp.numberMispredict;
+    case HPM_LOAD_USE_CYCLES:
+      return core.cpiStack[CPI_LOAD_USE];
+    case HPM_ICACHE_CYCLES:
+      return core.cpiStack[CPI_ICACHE];
+    case HPM_DCACHE_CYCLES:
+      return core.cpiStack[CPI_DCACHE];
+    case HPM_BRANCH_CYCLES:
+      return core.cpiStack[CPI_BRANCH];
+    default:
+      return 0;
   }
+}
 
-  if (decodeUseRs3) {
-    if (executeUseRd && decodeRs3 == executeRd) {
-      if (executeIsLongComputation) {
-        stall[0] = 1;
-        stall[1] = 1;
-      } else {
-        forwardRegisters.forwardExtoVal3 = 1;
-      }
-    } else if (memoryUseRd && decodeRs3 == memoryRd)
-      forwardRegisters.forwardMemtoVal3 = 1;
-    else if (writebackUseRd && decodeRs3 == writebackRd)
-      forwardRegisters.forwardWBtoVal3 = 1;
+// Counter accessed through csr (machine or user one, high is set for the upper half), -1 for the other CSRs
+static int csrCounter(const ac_int<12, false> csr, bool& high)
+{
+  ac_int<12, false> low = csr;
+  low[7]                = 0;
+  high                  = csr[7];
+  if (low >= RISCV_CSR_CYCLE && low < RISCV_CSR_CYCLE + CSR_COUNTERS)
+    return low - RISCV_CSR_CYCLE;
+  if (low >= RISCV_CSR_MCYCLE && low < RISCV_CSR_MCYCLE + CSR_COUNTERS && low != RISCV_CSR_MCYCLE + 1)
+    return low - RISCV_CSR_MCYCLE;
+  return -1;
+}
+
+ac_int<32, false> readCsr(const struct Core& core, const ac_int<12, false> csr, const unsigned int retiring)
+{
+  bool high;
+  const int counter = csrCounter(csr, high);
+  if (counter >= 0) {
+    const unsigned long value = counterEvents(core, counter, retiring) + core.csrOffset[counter];
+    return high ? value >> 32 : value;
+  }
+  if (csr >= RISCV_CSR_MHPMEVENT3 && csr < RISCV_CSR_MHPMEVENT3 + CSR_COUNTERS - 3)
+    return csr - RISCV_CSR_MHPMEVENT3 + 3;
+  switch (csr) {
+    case RISCV_CSR_MISA: // RV32IMAC
+      return 0x40001105;
+    case RISCV_CSR_MSCRATCH:
+      return core.mscratch;
+    default:
+      return 0;
   }
 }
+
+// The user counters are read-only
+void writeCsr(struct Core& core, const ac_int<12, false> csr, const ac_int<32, false> value,
+              const unsigned int retiring)
+{
+  bool high;
+  const int counter = csrCounter(csr, high);
+  if (counter >= 0 && csr < RISCV_CSR_CYCLE) {
+    const unsigned long events  = counterEvents(core, counter, retiring);
+    const unsigned long current = events + core.csrOffset[counter];
+    const unsigned long written = high ? (current & 0xffffffffUL) | ((unsigned long)value.to_uint() << 32)
+                                       : (current & ~0xffffffffUL) | value.to_uint();
+    core.csrOffset[counter] = written - events;
+  } else if (csr == RISCV_CSR_MSCRATCH) {
+    core.mscratch = value;
+  }
+}
+
+// New value of the CSR written by a CSR instruction, operand being rs1 or its immediate
+static ac_int<32, false> csrValue(const ac_int<3, false> funct3, const ac_int<32, false> csr,
+                                  const ac_int<32, false> operand)
+{
+  switch (funct3.slc<2>(0)) {
+    case RISCV_SYSTEM_CSRRW:
+      return operand;
+    case RISCV_SYSTEM_CSRRS:
+      return csr | operand;
+    default: // RISCV_SYSTEM_CSRRC
+      return csr & ~operand;
+  }
+}
+
 #include <iostream>
 
-void doCycle(struct Core& core, // Core containing all values
-             bool globalStall)
+// Access of the pipeline to a memory, a call of MainMemory which can be inlined when there is no cache
+template <bool DIRECT_MEMORY, unsigned int INTERFACE_SIZE>
+static inline void memoryAccess(MemoryInterface<INTERFACE_SIZE>* memory, const ac_int<32, false> addr,
+                                const memMask mask, const memOpType opType,
+                                const ac_int<INTERFACE_SIZE * 8, false> dataIn,
+                                ac_int<INTERFACE_SIZE * 8, false>& dataOut, bool& waitOut)
+{
+  if (DIRECT_MEMORY)
+    static_cast<MainMemory<INTERFACE_SIZE>*>(memory)->process(addr, mask, opType, dataIn, dataOut, waitOut);
+  else
+    memory->process(addr, mask, opType, dataIn, dataOut, waitOut);
+}
+
+// Cycle of the pipeline, specialized on the features chosen at run time which are off by default: the tracking of
+// the loads deferred by a lockup-free data cache (LOCKUP_FREE) and the BTB and the return address stack
+// (PREDICTS_TARGETS), and the caches, the memories of a core without them being called directly (DIRECT_MEMORY).
+// The pipeline of a core without these features does not carry their code.
+template <bool LOCKUP_FREE, bool PREDICTS_TARGETS, bool DIRECT_MEMORY>
+static void pipelineCycle(struct Core& core, // Core containing all values
+                          bool globalStall)
 {
   // printf("PC : %x\n", core.pc);
   bool localStall = globalStall;
@@ -545,41 +884,180 @@ void doCycle(struct Core& core, // Core containing all values
   extoMem_temp.we       = 0;
   struct MemtoWB memtoWB_temp;
   memtoWB_temp.useRd   = 0;
-  memtoWB_temp.isStore = 0;
-  memtoWB_temp.we      = 0;
-  memtoWB_temp.isLoad  = 0;
+  memtoWB_temp.isStore  = 0;
+  memtoWB_temp.we       = 0;
+  memtoWB_temp.isLoad   = 0;
+  memtoWB_temp.isAtomic = 0;
   struct WBOut wbOut_temp;
   wbOut_temp.useRd = 0;
   wbOut_temp.we    = 0;
   wbOut_temp.rd    = 0;
   struct ForwardReg forwardRegisters;
-  forwardRegisters.forwardExtoVal1  = 0;
-  forwardRegisters.forwardExtoVal2  = 0;
-  forwardRegisters.forwardExtoVal3  = 0;
-  forwardRegisters.forwardMemtoVal1 = 0;
-  forwardRegisters.forwardMemtoVal2 = 0;
-  forwardRegisters.forwardMemtoVal3 = 0;
-  forwardRegisters.forwardWBtoVal1  = 0;
-  forwardRegisters.forwardWBtoVal2  = 0;
-  forwardRegisters.forwardWBtoVal3  = 0;
+  forwardRegisters.forwardExtoVal1      = 0;
+  forwardRegisters.forwardExtoVal2      = 0;
+  forwardRegisters.forwardExtoVal3      = 0;
+  forwardRegisters.forwardMemtoVal1     = 0;
+  forwardRegisters.forwardMemtoVal2     = 0;
+  forwardRegisters.forwardMemtoVal3     = 0;
+  forwardRegisters.forwardWBtoVal1      = 0;
+  forwardRegisters.forwardWBtoVal2      = 0;
+  forwardRegisters.forwardWBtoVal3      = 0;
+  forwardRegisters.forwardSecondWayVal1 = 0;
+  forwardRegisters.forwardSecondWayVal2 = 0;
+  forwardRegisters.forwardSecondWayVal3 = 0;
+
+  // Second way of the dual-issue core, always empty in the scalar one
+  // Its registers are cleared field by field as the ones above: copying them whole right after the stores of
+  // their fields would slow the simulator down
+  struct FtoDC ftoDC1_temp;
+  ftoDC1_temp.pc          = 0;
+  ftoDC1_temp.instruction = 0;
+  ftoDC1_temp.nextPCFetch = 0;
+  ftoDC1_temp.we          = 0;
+  struct DCtoEx dctoEx1_temp;
+  dctoEx1_temp.isBranch   = 0;
+  dctoEx1_temp.predBranch = 0;
+  dctoEx1_temp.useRs1     = 0;
+  dctoEx1_temp.useRs2     = 0;
+  dctoEx1_temp.useRs3     = 0;
+  dctoEx1_temp.useRd      = 0;
+  dctoEx1_temp.we         = 0;
+  struct ExtoMem extoMem1_temp;
+  extoMem1_temp.useRd    = 0;
+  extoMem1_temp.isBranch = 0;
+  extoMem1_temp.we       = 0;
+  struct MemtoWB memtoWB1_temp;
+  memtoWB1_temp.useRd   = 0;
+  memtoWB1_temp.isStore  = 0;
+  memtoWB1_temp.we       = 0;
+  memtoWB1_temp.isLoad   = 0;
+  memtoWB1_temp.isAtomic = 0;
+  struct WBOut wbOut1_temp;
+  wbOut1_temp.useRd = 0;
+  wbOut1_temp.we    = 0;
+  wbOut1_temp.rd    = 0;
+#if ISSUE_WIDTH == 2
+  struct ForwardReg forwardRegisters1;
+  forwardRegisters1.forwardExtoVal1      = 0;
+  forwardRegisters1.forwardExtoVal2      = 0;
+  forwardRegisters1.forwardExtoVal3      = 0;
+  forwardRegisters1.forwardMemtoVal1     = 0;
+  forwardRegisters1.forwardMemtoVal2     = 0;
+  forwardRegisters1.forwardMemtoVal3     = 0;
+  forwardRegisters1.forwardWBtoVal1      = 0;
+  forwardRegisters1.forwardWBtoVal2      = 0;
+  forwardRegisters1.forwardWBtoVal3      = 0;
+  forwardRegisters1.forwardSecondWayVal1 = 0;
+  forwardRegisters1.forwardSecondWayVal2 = 0;
+  forwardRegisters1.forwardSecondWayVal3 = 0;
+#endif
 
+#if ISSUE_WIDTH == 2
+  // The block holding pc is read, or the next one when the realignment buffer holds the upper word of the block
+  const bool fetchBufferHit = core.pc[2] && core.fetchBufferPC.slc<30>(2) == core.pc.slc<30>(2);
+  ac_int<32, false> fetchAddress = fetchBufferHit ? (ac_int<32, false>)(core.pc + 4) : core.pc;
+  fetchAddress.set_slc(0, (ac_int<3, false>)0);
+  // When the buffer holds the whole instruction at pc, the next block would only give the second instruction of a
+  // pair: it is not read when it starts another line of the instruction cache, which the instruction at pc may jump
+  // over. The instruction then goes alone, and the line is read in the next cycle if it is needed.
+  const bool bufferHoldsInstruction = fetchBufferHit && (!core.pc[1] || core.fetchBuffer.slc<2>(16) != 3);
+  const bool fetchReads =
+      !bufferHoldsInstruction || core.fetchLineSize == 0 || (fetchAddress.to_uint() & (core.fetchLineSize - 1)) != 0;
+  ac_int<64, false> nextBlock = 0;
+  core.im->hintPc(core.pc);
+  memoryAccess<DIRECT_MEMORY>(core.im, fetchAddress, LONG, (!localStall && !core.stallDm && fetchReads) ? LOAD : NONE,
+                              0, nextBlock, core.stallIm);
+
+  ac_int<32, false> nextFetchBuffer;
+  ac_int<32, false> nextFetchBufferPC;
+  fetchPair(core.pc, fetchAddress, nextBlock, fetchReads, fetchBufferHit, core.fetchBuffer, core.fetchBufferPC,
+            ftoDC_temp, ftoDC1_temp, nextFetchBuffer, nextFetchBufferPC);
+  // A taken branch predicted by the BTB ends the pair, the second way only holds instructions falling through
+  if (PREDICTS_TARGETS && ftoDC_temp.we && core.btb.entries != 0) {
+    const ac_int<32, false> following = followingPC(core.pc, ftoDC_temp.isCompressed);
+    const ac_int<32, false> predicted = core.btb.predict(core.pc, following);
+    if (predicted != following) {
+      ftoDC1_temp.we         = 0;
+      ftoDC_temp.nextPCFetch = predicted;
+    }
+  }
+  decode(core.ftoDC1, dctoEx1_temp, core.regFile);
+  execute(core.dctoEx1, extoMem1_temp);
+  memory(core.extoMem1, memtoWB1_temp);
+  writeback(core.memtoWB1, wbOut1_temp);
+#else
   // declare temporary register file
   ac_int<32, false> nextInst;
 
-  core.im->process(core.pc, WORD, (!localStall && !core.stallDm) ? LOAD : NONE, 0, nextInst, core.stallIm);
-
-  fetch(core.pc, ftoDC_temp, nextInst);
+  // The word holding the start of the instruction is read, or the next one when the realignment buffer holds
+  // the first half; a compressed instruction in the buffer needs no access
+  const bool fetchBufferHit = core.pc[1] && core.fetchBufferPC == core.pc;
+  const bool fetchReads     = !fetchBufferHit || core.fetchBuffer.slc<2>(0) == 3;
+  ac_int<32, false> fetchAddress = fetchBufferHit ? (ac_int<32, false>)(core.pc + 2) : core.pc;
+  fetchAddress.set_slc(0, (ac_int<2, false>)0);
+  core.im->hintPc(core.pc);
+  memoryAccess<DIRECT_MEMORY>(core.im, fetchAddress, WORD, (!localStall && !core.stallDm && fetchReads) ? LOAD : NONE,
+                              0, nextInst, core.stallIm);
+
+  ac_int<16, false> nextFetchBuffer;
+  ac_int<32, false> nextFetchBufferPC;
+  fetch(core.pc, nextInst, fetchBufferHit, core.fetchBuffer, ftoDC_temp, nextFetchBuffer, nextFetchBufferPC);
+  if (PREDICTS_TARGETS && ftoDC_temp.we && core.btb.entries != 0)
+    ftoDC_temp.nextPCFetch = core.btb.predict(core.pc, ftoDC_temp.nextPCFetch);
+#endif
   decode(core.ftoDC, dctoEx_temp, core.regFile);
   execute(core.dctoEx, extoMem_temp);
   memory(core.extoMem, memtoWB_temp);
   writeback(core.memtoWB, wbOut_temp);
 
+  // CSR instructions read the CSR in the memory stage and write it when they leave it, CSRRS and CSRRC do not write
+  // it when their operand is x0 (or a zero immediate). The instructions in writeback retire in the same cycle, ahead
+  // of them.
+  ac_int<12, false> csr        = 0;
+  unsigned int retiring        = 0;
+  bool csrWrites               = false;
+  ac_int<32, false> csrWritten = 0;
+  if (core.extoMem.opCode == RISCV_SYSTEM && core.extoMem.we && core.extoMem.funct3 != RISCV_SYSTEM_ENV) {
+    csr       = core.extoMem.instruction.slc<12>(20);
+    retiring  = core.memtoWB.we;
+    csrWrites = core.extoMem.funct3.slc<2>(0) == RISCV_SYSTEM_CSRRW || core.extoMem.instruction.slc<5>(15) != 0;
+#if ISSUE_WIDTH == 2
+    retiring += core.memtoWB1.we;
+#endif
+    memtoWB_temp.result = readCsr(core, csr, retiring);
+    csrWritten          = csrValue(core.extoMem.funct3, memtoWB_temp.result, core.extoMem.datac);
+  }
+
+  // A pipelined multiplier or divider gives its result at the end of memory, like a load, and an iterative one
+  // keeps the instruction in execute until its last bits are computed
+  bool mulDivBusy = false;
+  if (core.dctoEx.opCode == RISCV_OP && core.dctoEx.funct7[0] && core.dctoEx.we) {
+    const mulDivUnitType unit          = core.dctoEx.funct3[2] ? core.divider : core.multiplier;
+    const ac_int<6, false> iterations  = unit == RADIX2_UNIT ? 32 : unit == RADIX4_UNIT ? 16 : 1;
+    extoMem_temp.isLongInstruction     = unit == PIPELINED_UNIT;
+    mulDivBusy                         = core.mulDivCycles + 1 < iterations;
+    core.stallSignals[STALL_FETCH]     = mulDivBusy;
+    core.stallSignals[STALL_DECODE]    = mulDivBusy;
+    core.stallSignals[STALL_EXECUTE]   = mulDivBusy;
+  }
+
   // resolve stalls, forwards
-  if (!localStall)
+  if (!localStall) {
     forwardUnit(dctoEx_temp.rs1, dctoEx_temp.useRs1, dctoEx_temp.rs2, dctoEx_temp.useRs2, dctoEx_temp.rs3,
                 dctoEx_temp.useRs3, extoMem_temp.rd, extoMem_temp.useRd, extoMem_temp.isLongInstruction,
-                memtoWB_temp.rd, memtoWB_temp.useRd, wbOut_temp.rd, wbOut_temp.useRd, core.stallSignals,
-                forwardRegisters);
+                memtoWB_temp.rd, memtoWB_temp.useRd, wbOut_temp.rd, wbOut_temp.useRd, extoMem1_temp.rd,
+                extoMem1_temp.useRd, memtoWB1_temp.rd, memtoWB1_temp.useRd, wbOut1_temp.rd, wbOut1_temp.useRd,
+                core.stallSignals, forwardRegisters);
+#if ISSUE_WIDTH == 2
+    forwardUnit(dctoEx1_temp.rs1, dctoEx1_temp.useRs1, dctoEx1_temp.rs2, dctoEx1_temp.useRs2, dctoEx1_temp.rs3,
+                dctoEx1_temp.useRs3, extoMem_temp.rd, extoMem_temp.useRd, extoMem_temp.isLongInstruction,
+                memtoWB_temp.rd, memtoWB_temp.useRd, wbOut_temp.rd, wbOut_temp.useRd, extoMem1_temp.rd,
+                extoMem1_temp.useRd, memtoWB1_temp.rd, memtoWB1_temp.useRd, wbOut1_temp.rd, wbOut1_temp.useRd,
+                core.stallSignals, forwardRegisters1);
+#endif
+  }
+  // Cause of the bubble inserted by decode when it stalls
+  unsigned char decodeBubble = core.stallSignals[STALL_DECODE] ? CPI_LOAD_USE : CPI_DCACHE;
 
   memMask mask;
   // TODO: carry the data size to memToWb
@@ -605,89 +1083,403 @@ void doCycle(struct Core& core, // Core containing all values
       break;
   }
 
-  memOpType opType =
-      (!core.stallSignals[STALL_MEMORY] && !localStall && memtoWB_temp.we && !core.stallIm && memtoWB_temp.isLoad)
-          ? LOAD
-          : (!core.stallSignals[STALL_MEMORY] && !localStall && memtoWB_temp.we && !core.stallIm && memtoWB_temp.isStore
-                 ? STORE
-                 : NONE);
+  const bool memoryAccesses = !core.stallSignals[STALL_MEMORY] && !localStall && memtoWB_temp.we && !core.stallIm;
+  memOpType opType          = !memoryAccesses ? NONE : memtoWB_temp.isLoad ? LOAD : memtoWB_temp.isStore ? STORE : NONE;
+
+  // With a lockup-free data cache, a load which misses leaves the memory stage without its value and its
+  // destination register is marked as pending until the cache returns it. Instructions reading or writing a
+  // pending register wait in decode; the ones which already went past decode wait in the memory stage.
+  bool waitsPendingLoad = false;
+  if (LOCKUP_FREE) {
+    waitsPendingLoad = (memtoWB_temp.we && memtoWB_temp.useRd && core.pendingLoads[memtoWB_temp.rd]) ||
+                       (memtoWB1_temp.we && memtoWB1_temp.useRd && core.pendingLoads[memtoWB1_temp.rd]);
+    if (waitsPendingLoad)
+      opType = NONE;
+  }
 
-  core.dm->process(memtoWB_temp.address, mask, opType, memtoWB_temp.valueToWrite, memtoWB_temp.result, core.stallDm);
+  // System calls are solved with the registers and the memory seen by the simulator: the access right before
+  // one is not deferred, and the system instruction waits in decode for the outstanding misses, as does a FENCE.
+  // An atomic instruction makes its read-modify-write through processAtomic, its cycles in the memory stage being
+  // counted from the first one in which the access is made.
+  bool loadDeferred = false;
+  core.dm->hintPc(core.extoMem.pc);
+  if (memtoWB_temp.we && memtoWB_temp.isAtomic) {
+    const bool active = !core.stallSignals[STALL_MEMORY] && !localStall && !core.stallIm && !waitsPendingLoad;
+    bool contended;
+    core.dm->processAtomic(memtoWB_temp.address, memtoWB_temp.atomicOp, memtoWB_temp.valueToWrite, active,
+                           memtoWB_temp.result, core.stallDm, contended);
+    if (active || core.atomicWait != 0)
+      core.atomicWait++;
+    if (active && !core.stallDm) {
+      core.numberAtomic[contended]++;
+      core.atomicCycles[contended] += core.atomicWait;
+      core.numberFailedSC += memtoWB_temp.atomicOp == RISCV_ATOMIC_SC && memtoWB_temp.result != 0;
+      core.atomicWait = 0;
+    }
+  } else if (LOCKUP_FREE && !(extoMem_temp.we && extoMem_temp.opCode == RISCV_SYSTEM))
+    core.dm->processNonBlocking(memtoWB_temp.address, mask, opType, memtoWB_temp.valueToWrite, memtoWB_temp.rd,
+                                memtoWB_temp.result, core.stallDm, loadDeferred);
+  else
+    memoryAccess<DIRECT_MEMORY>(core.dm, memtoWB_temp.address, mask, opType, memtoWB_temp.valueToWrite,
+                                memtoWB_temp.result, core.stallDm);
+
+  // The instruction in decode is not held when a mispredicted branch in execute squashes it: stalling fetch
+  // would keep the branch unit from redirecting the pc
+  const bool decodeSquashed = extoMem_temp.isBranch != extoMem_temp.predBranch;
+  ac_int<5, false> completedRd;
+  ac_int<32, false> completedValue;
+  bool loadCompleted             = false;
+  ac_int<32, false> pendingLoads = core.pendingLoads;
+  if (LOCKUP_FREE) {
+    core.stallDm  = core.stallDm || waitsPendingLoad;
+    loadCompleted = core.dm->completeLoad(completedRd, completedValue);
+
+    if (loadDeferred) {
+      if (memtoWB_temp.useRd && memtoWB_temp.rd != 0)
+        pendingLoads[memtoWB_temp.rd] = 1;
+      memtoWB_temp.useRd = 0;
+    }
+    const bool waitsDrain = dctoEx_temp.we &&
+                            (dctoEx_temp.opCode == RISCV_SYSTEM || dctoEx_temp.opCode == RISCV_MISC_MEM) &&
+                            (pendingLoads != 0 || !core.dm->isDrained());
+    if (!decodeSquashed &&
+        ((dctoEx_temp.useRs1 && pendingLoads[dctoEx_temp.rs1]) ||
+         (dctoEx_temp.useRs2 && pendingLoads[dctoEx_temp.rs2]) ||
+         (dctoEx_temp.useRs3 && pendingLoads[dctoEx_temp.rs3]) || (dctoEx_temp.useRd && pendingLoads[dctoEx_temp.rd]) ||
+         waitsDrain || (dctoEx1_temp.useRs1 && pendingLoads[dctoEx1_temp.rs1]) ||
+         (dctoEx1_temp.useRs2 && pendingLoads[dctoEx1_temp.rs2]) ||
+         (dctoEx1_temp.useRd && pendingLoads[dctoEx1_temp.rd]))) {
+      if (!core.stallSignals[STALL_DECODE] && waitsDrain && dctoEx_temp.opCode == RISCV_SYSTEM)
+        decodeBubble = CPI_SYSCALL;
+      core.stallSignals[STALL_FETCH]  = 1;
+      core.stallSignals[STALL_DECODE] = 1;
+    }
+  }
+
+  // CPI stack: the cycle is given to writeback, or to the memory the pipeline waits for. The causes of the bubbles
+  // move with the pipeline registers, the ones of the bubbles inserted by the stages being set below. The memory
+  // stage never stalls, and a stage which stalls stalls the ones before it.
+  const bool frozen = localStall || core.stallIm || core.stallDm;
+  if (frozen)
+    core.cpiStack[core.stallDm ? CPI_DCACHE : core.stallIm ? CPI_ICACHE : CPI_OTHER]++;
+  else {
+    // The causes are selected rather than branched on, the stalls being hard to predict. Fetch gives nothing when
+    // it needs a second access for an instruction, which only happens after a jump, and the instructions squashed
+    // by branchUnit are bubbles of the same kind.
+    const bool executeStalled          = core.stallSignals[STALL_EXECUTE];
+    const bool decodeStalled           = core.stallSignals[STALL_DECODE];
+    const unsigned char fetchCause     = core.bubbleCause[STALL_FETCH];
+    const unsigned char decodeCause    = core.bubbleCause[STALL_DECODE];
+    const unsigned char decodeInserted = executeStalled ? decodeCause : decodeBubble;
+    core.cpiStack[wbOut_temp.we ? (unsigned char)CPI_RETIRED : core.bubbleCause[STALL_MEMORY]]++;
+    core.bubbleCause[STALL_MEMORY]  = core.bubbleCause[STALL_EXECUTE];
+    core.bubbleCause[STALL_EXECUTE] = executeStalled ? (unsigned char)CPI_MULDIV : decodeCause;
+    core.bubbleCause[STALL_DECODE]  = decodeStalled ? decodeInserted : fetchCause;
+    core.bubbleCause[STALL_FETCH]   = decodeStalled ? fetchCause : (unsigned char)CPI_BRANCH;
+  }
+
+  // Pc fetched after the instruction in decode, read before the fetch register is overwritten
+#if ISSUE_WIDTH == 2
+  const ac_int<32, false> decodeFetchedNextPC = core.ftoDC1.we ? core.ftoDC1.pc : core.ftoDC.nextPCFetch;
+#else
+  const ac_int<32, false> decodeFetchedNextPC = core.ftoDC.nextPCFetch;
+#endif
 
   // commit the changes to the pipeline register
-  if (!core.stallSignals[STALL_FETCH] && !localStall && !core.stallIm && !core.stallDm) {
-    core.ftoDC = ftoDC_temp;
+  if (!core.stallSignals[STALL_FETCH] && !frozen) {
+#if ISSUE_WIDTH == 2
+    core.ftoDC1 = ftoDC1_temp;
+#endif
+    core.ftoDC         = ftoDC_temp;
+    core.fetchBuffer   = nextFetchBuffer;
+    core.fetchBufferPC = nextFetchBufferPC;
   }
 
-  if (!core.stallSignals[STALL_DECODE] && !localStall && !core.stallIm && !core.stallDm) {
+  if (!core.stallSignals[STALL_DECODE] && !frozen) {
     // branch predictor
     if (dctoEx_temp.opCode == RISCV_BR && dctoEx_temp.we) {
       core.bp.process(dctoEx_temp.pc, dctoEx_temp.predBranch);
     }
+    if (PREDICTS_TARGETS && core.ras.entries != 0) {
+      bool returnPredicted;
+      ac_int<32, false> returnAddress;
+      core.ras.process(dctoEx_temp.we, followingPC(dctoEx_temp.pc, dctoEx_temp.isCompressed), dctoEx_temp.opCode,
+                       dctoEx_temp.rd, dctoEx_temp.rs1, returnPredicted, returnAddress);
+      if (returnPredicted) {
+        dctoEx_temp.predBranch = 1;
+        dctoEx_temp.nextPCDC   = returnAddress;
+      }
+    }
+    if (PREDICTS_TARGETS && dctoEx_temp.we && !decodeSquashed && core.btb.entries != 0)
+      core.btb.update(dctoEx_temp.pc, followingPC(dctoEx_temp.pc, dctoEx_temp.isCompressed), decodeFetchedNextPC,
+                      decodeNextPC(dctoEx_temp));
     core.dctoEx = dctoEx_temp;
+    forwardOperands(forwardRegisters, extoMem_temp, extoMem1_temp, memtoWB_temp, memtoWB1_temp, wbOut_temp,
+                    wbOut1_temp, core.dctoEx);
+#if ISSUE_WIDTH == 2
+    // The second instruction is dropped when the first one is predicted to jump
+    core.dctoEx1 = dctoEx1_temp;
+    forwardOperands(forwardRegisters1, extoMem_temp, extoMem1_temp, memtoWB_temp, memtoWB1_temp, wbOut_temp,
+                    wbOut1_temp, core.dctoEx1);
+    if (decodeNextPC(dctoEx_temp) != followingPC(dctoEx_temp.pc, dctoEx_temp.isCompressed))
+      core.dctoEx1.we = 0;
+    core.numberPairs += core.dctoEx1.we;
+#endif
+  }
 
-    if (forwardRegisters.forwardExtoVal1 && extoMem_temp.we)
-      core.dctoEx.lhs = extoMem_temp.result;
-    else if (forwardRegisters.forwardMemtoVal1 && memtoWB_temp.we)
-      core.dctoEx.lhs = memtoWB_temp.result;
-    else if (forwardRegisters.forwardWBtoVal1 && wbOut_temp.we)
-      core.dctoEx.lhs = wbOut_temp.value;
-
-    if (forwardRegisters.forwardExtoVal2 && extoMem_temp.we)
-      core.dctoEx.rhs = extoMem_temp.result;
-    else if (forwardRegisters.forwardMemtoVal2 && memtoWB_temp.we)
-      core.dctoEx.rhs = memtoWB_temp.result;
-    else if (forwardRegisters.forwardWBtoVal2 && wbOut_temp.we)
-      core.dctoEx.rhs = wbOut_temp.value;
-
-    if (forwardRegisters.forwardExtoVal3 && extoMem_temp.we)
-      core.dctoEx.datac = extoMem_temp.result;
-    else if (forwardRegisters.forwardMemtoVal3 && memtoWB_temp.we)
-      core.dctoEx.datac = memtoWB_temp.result;
-    else if (forwardRegisters.forwardWBtoVal3 && wbOut_temp.we)
-      core.dctoEx.datac = wbOut_temp.value;
-  }
-
-  if (core.stallSignals[STALL_DECODE] && !core.stallSignals[STALL_EXECUTE] && !core.stallIm && !core.stallDm &&
-      !localStall) {
+  if (core.stallSignals[STALL_DECODE] && !core.stallSignals[STALL_EXECUTE] && !frozen) {
     core.dctoEx.we          = 0;
     core.dctoEx.useRd       = 0;
     core.dctoEx.isBranch    = 0;
     core.dctoEx.instruction = 0;
     core.dctoEx.pc          = 0;
+#if ISSUE_WIDTH == 2
+    core.dctoEx1.we    = 0;
+    core.dctoEx1.useRd = 0;
+#endif
   }
 
-  if (!core.stallSignals[STALL_EXECUTE] && !localStall && !core.stallIm && !core.stallDm) {
+  if (!core.stallSignals[STALL_EXECUTE] && !frozen) {
     if (extoMem_temp.opCode == RISCV_BR && extoMem_temp.we) {
       core.bp.update(extoMem_temp.pc, extoMem_temp.isBranch);
     }
+    if (PREDICTS_TARGETS && extoMem_temp.we && core.ras.entries != 0 &&
+        isReturn(extoMem_temp.opCode, extoMem_temp.rd, extoMem_temp.instruction.slc<5>(15)))
+      core.ras.update(extoMem_temp.predBranch);
     core.extoMem = extoMem_temp;
+#if ISSUE_WIDTH == 2
+    core.extoMem1 = extoMem1_temp;
+#endif
+  } else if (core.stallSignals[STALL_EXECUTE] && !core.stallSignals[STALL_MEMORY] && !frozen) {
+    core.extoMem.we                = 0;
+    core.extoMem.useRd             = 0;
+    core.extoMem.isBranch          = 0;
+    core.extoMem.predBranch        = 0;
+    core.extoMem.isLongInstruction = 0;
+    core.extoMem.opCode            = 0;
+#if ISSUE_WIDTH == 2
+    core.extoMem1.we    = 0;
+    core.extoMem1.useRd = 0;
+#endif
   }
 
-  if (!core.stallSignals[STALL_MEMORY] && !localStall && !core.stallIm && !core.stallDm) {
+  // The iterative unit works while the rest of the pipeline waits for the memories
+  if (mulDivBusy && !localStall)
+    core.mulDivCycles++;
+  else if (!core.stallSignals[STALL_EXECUTE] && !frozen)
+    core.mulDivCycles = 0;
+
+  if (!core.stallSignals[STALL_MEMORY] && !frozen) {
+    if (csrWrites)
+      writeCsr(core, csr, csrWritten, retiring);
     core.memtoWB = memtoWB_temp;
+#if ISSUE_WIDTH == 2
+    core.memtoWB1 = memtoWB1_temp;
+#endif
   }
 
-  if (wbOut_temp.we && wbOut_temp.useRd && !localStall && !core.stallIm && !core.stallDm) {
-    core.regFile[wbOut_temp.rd] = wbOut_temp.value;
+  if (!frozen) {
+    if (wbOut_temp.we && wbOut_temp.useRd)
+      core.regFile[wbOut_temp.rd] = wbOut_temp.value;
+    core.instret += wbOut_temp.we;
+    core.cpiInstructions += wbOut_temp.we;
+  }
+#if ISSUE_WIDTH == 2
+  if (wbOut1_temp.we && wbOut1_temp.useRd && !frozen)
+    core.regFile[wbOut1_temp.rd] = wbOut1_temp.value;
+  if (wbOut1_temp.we && !frozen) {
+    core.instret++;
+    core.cpiInstructions++;
   }
+#endif
 
-  branchUnit(ftoDC_temp.nextPCFetch, dctoEx_temp.nextPCDC, dctoEx_temp.isBranch || dctoEx_temp.predBranch,
-             extoMem_temp.nextPC, extoMem_temp.isBranch != extoMem_temp.predBranch, core.pc, core.ftoDC.we,
-             core.dctoEx.we, core.stallSignals[STALL_FETCH] || core.stallIm || core.stallDm || localStall, core.bp);
+  // Loads returned by the data cache use a second write port of the register file
+  if (loadCompleted) {
+    if (completedRd != 0)
+      core.regFile[completedRd] = completedValue;
+    pendingLoads[completedRd] = 0;
+  }
+  core.pendingLoads = pendingLoads;
+
+  // Decode redirects fetch when the instruction fetched behind the one it handles is not the one it predicts
+  ac_int<32, false> nextPCDecode = decodeNextPC(dctoEx_temp);
+#if ISSUE_WIDTH == 2
+  if (dctoEx1_temp.we && nextPCDecode == dctoEx1_temp.pc)
+    nextPCDecode = followingPC(dctoEx1_temp.pc, dctoEx1_temp.isCompressed);
+#endif
+  const bool fetchStalled = core.stallSignals[STALL_FETCH] || frozen;
+  const bool executeMispredicted = extoMem_temp.isBranch != extoMem_temp.predBranch;
+  branchUnit(ftoDC_temp.nextPCFetch, nextPCDecode, dctoEx_temp.we && nextPCDecode != core.pc, extoMem_temp.nextPC,
+             executeMispredicted, core.pc, core.ftoDC.we, core.dctoEx.we, fetchStalled, core.bp, core.ras);
+  if (!fetchStalled && executeMispredicted)
+    core.bubbleCause[STALL_DECODE] = CPI_BRANCH;
+#if ISSUE_WIDTH == 2
+  // The second way follows the first one when it is squashed, as does the instruction paired with a mispredicted
+  // branch
+  if (!core.ftoDC.we)
+    core.ftoDC1.we = 0;
+  if (!core.dctoEx.we) {
+    core.dctoEx1.we    = 0;
+    core.dctoEx1.useRd = 0;
+  }
+  if (!fetchStalled && executeMispredicted) {
+    core.extoMem1.we    = 0;
+    core.extoMem1.useRd = 0;
+  }
+#endif
 
   core.cycle++;
 }
 
+void doCycle(struct Core& core, bool globalStall)
+{
+  const bool predictsTargets = core.btb.entries != 0 || core.ras.entries != 0;
+  if (core.directMemory) {
+    if (predictsTargets)
+      pipelineCycle<false, true, true>(core, globalStall);
+    else
+      pipelineCycle<false, false, true>(core, globalStall);
+  } else if (core.lockupFree) {
+    if (predictsTargets)
+      pipelineCycle<true, true, false>(core, globalStall);
+    else
+      pipelineCycle<true, false, false>(core, globalStall);
+  } else if (predictsTargets)
+    pipelineCycle<false, true, false>(core, globalStall);
+  else
+    pipelineCycle<false, false, false>(core, globalStall);
+}
+
+#ifndef __HLS__
+void flushPipeline(struct Core& core)
+{
+  // Loads still waiting for a line fill are completed first
+  ac_int<32, false> dataOut;
+  ac_int<5, false> completedRd;
+  ac_int<32, false> completedValue;
+  bool waitOut, deferred;
+  while (!core.dm->isDrained()) {
+    core.dm->processNonBlocking(0, WORD, NONE, 0, 0, dataOut, waitOut, deferred);
+    if (core.dm->completeLoad(completedRd, completedValue) && completedRd != 0)
+      core.regFile[completedRd] = completedValue;
+  }
+  core.pendingLoads = 0;
+  core.mulDivCycles = 0;
+  core.bp.flush();
+
+  // Only writeback remains for the instruction in memtoWB, memory has already been accessed
+  if (core.memtoWB.we && core.memtoWB.useRd && core.memtoWB.rd != 0)
+    core.regFile[core.memtoWB.rd] = core.memtoWB.result;
+  if (core.memtoWB.we)
+    core.instret++;
+#if ISSUE_WIDTH == 2
+  if (core.memtoWB1.we && core.memtoWB1.useRd && core.memtoWB1.rd != 0)
+    core.regFile[core.memtoWB1.rd] = core.memtoWB1.result;
+  if (core.memtoWB1.we)
+    core.instret++;
+#endif
+
+  // Younger instructions have no architectural effect yet and are restarted from the oldest one.
+  // An ECALL in extoMem has already been solved by the simulator, execution resumes after it. An atomic instruction
+  // in extoMem may have started its access, making it again would apply it twice: it is completed and retired. The
+  // second way only holds an instruction when the first one does, the oldest one is always in the first way.
+  if (core.extoMem.we && core.extoMem.opCode == RISCV_ATOMIC) {
+    struct MemtoWB access;
+    memory(core.extoMem, access);
+    ac_int<32, false> result;
+    bool contended;
+    do {
+      core.dm->processAtomic(access.address, access.atomicOp, access.valueToWrite, true, result, waitOut, contended);
+      core.atomicWait++;
+    } while (waitOut);
+    core.numberAtomic[contended]++;
+    core.atomicCycles[contended] += core.atomicWait;
+    core.numberFailedSC += access.atomicOp == RISCV_ATOMIC_SC && result != 0;
+    core.atomicWait = 0;
+    if (core.extoMem.useRd && core.extoMem.rd != 0)
+      core.regFile[core.extoMem.rd] = result;
+    core.instret++;
+    core.pc = core.extoMem.pc + 4;
+  } else if (core.extoMem.we) {
+    const bool isSyscall = core.extoMem.opCode == RISCV_SYSTEM && core.extoMem.instruction.slc<12>(20) == 0;
+    core.pc              = isSyscall ? (ac_int<32, false>)(core.extoMem.pc + 4) : core.extoMem.pc;
+    if (isSyscall)
+      core.instret++;
+  } else if (core.dctoEx.we) {
+    core.pc = core.dctoEx.pc;
+  } else if (core.ftoDC.we) {
+    core.pc = core.ftoDC.pc;
+  }
+
+  core.ftoDC.we         = 0;
+  core.dctoEx.we        = 0;
+  core.dctoEx.useRd     = 0;
+  core.dctoEx.isBranch  = 0;
+  core.extoMem.we       = 0;
+  core.extoMem.useRd    = 0;
+  core.extoMem.isBranch = 0;
+  core.extoMem.opCode   = 0;
+  core.memtoWB.we       = 0;
+  core.memtoWB.useRd    = 0;
+  core.memtoWB.isLoad   = 0;
+  core.memtoWB.isStore  = 0;
+  for (int stage = STALL_FETCH; stage <= STALL_MEMORY; stage++)
+    core.bubbleCause[stage] = CPI_OTHER;
+#if ISSUE_WIDTH == 2
+  core.ftoDC1.we      = 0;
+  core.dctoEx1.we     = 0;
+  core.dctoEx1.useRd  = 0;
+  core.extoMem1.we    = 0;
+  core.extoMem1.useRd = 0;
+  core.memtoWB1.we    = 0;
+  core.memtoWB1.useRd = 0;
+#endif
+}
+
+// Fetch also reads the block following the last instruction before decode redirects it
+void warmFetch(struct Core& core, const unsigned int start, const unsigned int end)
+{
+  core.im->warm(start, end - start + FETCH_INTERFACE_SIZE, false);
+}
+
+void warmData(struct Core& core, const unsigned int addr, const bool isStore)
+{
+  core.dm->warm(addr, 1, isStore);
+}
+
+// Decode trains the BTB with the pc it goes to: the target of a branch predicted taken or of JAL, the address
+// predicted by the RAS for a return, the following instruction otherwise (see decodeNextPC)
+void warmBranch(struct Core& core, const unsigned int pc, const unsigned int nextPC, const unsigned int target,
+                const bool taken)
+{
+  const bool predicted = core.bp.warm(pc, taken);
+  core.btb.warm(pc, nextPC, predicted ? target : nextPC);
+}
+
+void warmJump(struct Core& core, const unsigned int pc, const unsigned int nextPC, const unsigned int target,
+              const unsigned int instruction)
+{
+  const ac_int<32, false> word  = instruction;
+  const ac_int<7, false> opCode = word.slc<7>(0);
+  const ac_int<5, false> rd     = word.slc<5>(7);
+  const ac_int<5, false> rs1    = word.slc<5>(15);
+  ac_int<32, false> returnAddress;
+  const bool returnPredicted = core.ras.warm(nextPC, isCall(opCode, rd), isReturn(opCode, rd, rs1), returnAddress);
+  const unsigned int decodeTarget = opCode == RISCV_JAL ? target : returnPredicted ? returnAddress.to_uint() : nextPC;
+  core.btb.warm(pc, nextPC, decodeTarget);
+}
+#endif
+
 // void doCore(IncompleteMemory im, IncompleteMemory dm, bool globalStall)
 void doCore(bool globalStall, ac_int<32, false> imData[1 << 24], ac_int<32, false> dmData[1 << 24])
 {
   Core core;
-  IncompleteMemory<4> imInterface = IncompleteMemory<4>(imData);
-  IncompleteMemory<4> dmInterface = IncompleteMemory<4>(dmData);
+  IncompleteMemory<FETCH_INTERFACE_SIZE> imInterface = IncompleteMemory<FETCH_INTERFACE_SIZE>(imData);
+  IncompleteMemory<4> dmInterface                    = IncompleteMemory<4>(dmData);
 
   CacheMemory<4, 16, 64> dmCache = CacheMemory<4, 16, 64>(&dmInterface, false);
-  CacheMemory<4, 16, 64> imCache = CacheMemory<4, 16, 64>(&imInterface, false);
+  CacheMemory<FETCH_INTERFACE_SIZE, 16, 64> imCache =
+      CacheMemory<FETCH_INTERFACE_SIZE, 16, 64>(&imInterface, false);
 
   core.im = &imCache;
   core.dm = &dmCache;
@@ -0,0 +1,825 @@
+/** Copyright 2021 INRIA, Université de Rennes 1 and ENS Rennes
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sys/mman.h>
+
+#include "dbt.h"
+
+// The translated code follows the semantics of FunctionalCore::run, instruction by instruction: the guest
+// registers live in the context (rbx), the guest memory is addressed from r12 and the code granules from r14.
+// eax, ecx, edx (and edi, esi, r8 for the calls) are scratch registers.
+
+#define DBT_NO_WRITE 0xffffffff
+#define DBT_LOG_GRANULE 6
+#define DBT_GRANULES (1u << (32 - DBT_LOG_GRANULE))
+#define DBT_LOG_LOOKUP_ENTRIES 16
+#define DBT_MAX_BLOCK_CODE (1 << 14) // bytes of host code of a block, stubs included
+#define DBT_TRAMPOLINE_SIZE 64
+
+// Entry of the table searched by JALR, the layout is the one expected by the translated code
+struct LookupEntry {
+  unsigned int pc;
+  unsigned int unused;
+  unsigned char* code;
+};
+
+#define CONTEXT(field) ((int)offsetof(TranslatorContext, field))
+#define REG(r) (CONTEXT(reg) + 4 * (r))
+
+// Divisions are made by helpers, with the results required by the ISA for a zero divisor and the overflow
+static unsigned int divHelper(const unsigned int lhs, const unsigned int rhs)
+{
+  return rhs == 0 ? 0xffffffff : (lhs == 0x80000000 && rhs == 0xffffffff) ? lhs : (int)lhs / (int)rhs;
+}
+static unsigned int divuHelper(const unsigned int lhs, const unsigned int rhs)
+{
+  return rhs == 0 ? 0xffffffff : lhs / rhs;
+}
+static unsigned int remHelper(const unsigned int lhs, const unsigned int rhs)
+{
+  return rhs == 0 ? lhs : (lhs == 0x80000000 && rhs == 0xffffffff) ? 0 : (int)lhs % (int)rhs;
+}
+static unsigned int remuHelper(const unsigned int lhs, const unsigned int rhs)
+{
+  return rhs == 0 ? lhs : lhs % rhs;
+}
+
+// Functional warming, the core being given in rdi
+static void warmFetchHelper(Core* core, const unsigned int start, const unsigned int end)
+{
+  warmFetch(*core, start, end);
+}
+static void warmDataHelper(Core* core, const unsigned int addr, const unsigned int isStore)
+{
+  warmData(*core, addr, isStore);
+}
+static void warmBranchHelper(Core* core, const unsigned int pc, const unsigned int taken, const unsigned int nextPC,
+                             const unsigned int target)
+{
+  warmBranch(*core, pc, nextPC, target, taken);
+}
+static void warmJumpHelper(Core* core, const unsigned int pc, const unsigned int nextPC, const unsigned int target,
+                           const unsigned int instruction)
+{
+  warmJump(*core, pc, nextPC, target, instruction);
+}
+
+#ifdef __x86_64__
+
+// x86-64 encoder, limited to the forms used by the translation
+class Emitter {
+public:
+  unsigned char* p;
+
+  Emitter(unsigned char* start) : p(start) {}
+
+  void byte(const unsigned int b) { *p++ = b; }
+  void bytes(const unsigned int b0, const unsigned int b1)
+  {
+    byte(b0);
+    byte(b1);
+  }
+  void dword(const unsigned int d)
+  {
+    memcpy(p, &d, 4);
+    p += 4;
+  }
+  void qword(const unsigned long q)
+  {
+    memcpy(p, &q, 8);
+    p += 8;
+  }
+
+  // op reg, [rbx + disp] (or op [rbx + disp], reg), for the 32-bit registers up to edi
+  void rbxOperand(const unsigned int opcode, const int reg, const int disp)
+  {
+    if (opcode > 0xff)
+      byte(opcode >> 8);
+    byte(opcode & 0xff);
+    byte(0x83 | (reg << 3));
+    dword(disp);
+  }
+  void load(const int reg, const int disp) { rbxOperand(0x8b, reg, disp); }
+  void store(const int disp, const int reg) { rbxOperand(0x89, reg, disp); }
+  void storeImmediate(const int disp, const unsigned int imm)
+  {
+    rbxOperand(0xc7, 0, disp);
+    dword(imm);
+  }
+  // mov reg, imm32, for the 32-bit registers up to r9d
+  void moveImmediate(const int reg, const unsigned int imm)
+  {
+    if (reg >= 8)
+      byte(0x41);
+    byte(0xb8 | (reg & 7));
+    dword(imm);
+  }
+  // add reg, imm32
+  void addImmediate(const int reg, const unsigned int imm)
+  {
+    bytes(0x81, 0xc0 | reg);
+    dword(imm);
+  }
+  // Call of a function following the System V calling convention, through rax
+  void call(const unsigned long function)
+  {
+    bytes(0x48, 0xb8); // mov rax, function
+    qword(function);
+    bytes(0xff, 0xd0); // call rax
+  }
+  // add, or, and, sub, xor, cmp eax, imm32
+  void aluEax(const unsigned int opcode, const unsigned int imm)
+  {
+    byte(opcode);
+    dword(imm);
+  }
+  // rel32 jump or jcc, the offset is patched later
+  unsigned char* jump(const int condition)
+  {
+    if (condition < 0)
+      byte(0xe9);
+    else
+      bytes(0x0f, 0x80 | condition);
+    dword(0);
+    return p - 4;
+  }
+  void patch(unsigned char* rel, const unsigned char* target)
+  {
+    const int offset = target - (rel + 4);
+    memcpy(rel, &offset, 4);
+  }
+};
+
+enum { EAX = 0, ECX = 1, EDX = 2, ESI = 6, EDI = 7, R8D = 8 };
+enum { CC_B = 0x2, CC_AE = 0x3, CC_E = 0x4, CC_NE = 0x5, CC_L = 0xc, CC_GE = 0xd };
+enum { OP_ADD = 0x03, OP_OR = 0x0b, OP_AND = 0x23, OP_SUB = 0x2b, OP_XOR = 0x33, OP_CMP = 0x3b };
+
+// Conditions of the branches taken, from ISS_BEQ to ISS_BGEU
+static const int branchConditions[] = {CC_E, CC_NE, CC_L, CC_GE, CC_B, CC_AE};
+
+// Calls made before an instruction when the caches and the predictors are warmed: the address of a memory access
+// and the outcome of a branch are computed from the registers as the instruction does
+static void emitWarming(Emitter& e, const DecodedInstruction& d)
+{
+  const int rs1 = REG(d.rs1), rs2 = REG(d.rs2);
+  unsigned long helper = 0;
+  if (d.op >= ISS_LB && d.op <= ISS_SW) {
+    e.load(ESI, rs1);
+    e.addImmediate(ESI, d.imm);
+    e.moveImmediate(EDX, d.op >= ISS_SB);
+    helper = (unsigned long)warmDataHelper;
+  } else if (d.op >= ISS_BEQ && d.op <= ISS_BGEU) {
+    e.bytes(0x31, 0xd2); // xor edx, edx
+    e.load(EAX, rs1);
+    e.rbxOperand(OP_CMP, EAX, rs2);
+    e.bytes(0x0f, 0x90 | branchConditions[d.op - ISS_BEQ]); // setcc dl
+    e.byte(0xc2);
+    e.moveImmediate(ESI, d.pc);
+    e.moveImmediate(ECX, d.pc + d.size);
+    e.moveImmediate(R8D, d.pc + d.imm);
+    helper = (unsigned long)warmBranchHelper;
+  } else if (d.op == ISS_JAL || d.op == ISS_JALR) {
+    if (d.op == ISS_JAL) {
+      e.moveImmediate(ECX, d.pc + d.imm);
+    } else {
+      e.load(ECX, rs1);
+      e.addImmediate(ECX, d.imm);
+    }
+    e.moveImmediate(ESI, d.pc);
+    e.moveImmediate(EDX, d.pc + d.size);
+    // Fields of the instruction telling calls and returns apart, rd 0 being kept as the sink register
+    e.moveImmediate(R8D, (d.op == ISS_JAL ? RISCV_JAL : RISCV_JALR) | ((d.rd & 0x1f) << 7) | (d.rs1 << 15));
+    helper = (unsigned long)warmJumpHelper;
+  }
+  if (helper) {
+    e.byte(0x48); // mov rdi, [rbx + core]
+    e.load(EDI, CONTEXT(core));
+    e.call(helper);
+  }
+}
+
+// The granules are written as soon as they hold a translated instruction, the others are never touched
+static unsigned int* allocateGranules()
+{
+  void* mapping = mmap(NULL, (size_t)DBT_GRANULES * 4, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if (mapping == MAP_FAILED) {
+    fprintf(stderr, "Error: cannot map the code granules of the binary translator\n");
+    exit(-1);
+  }
+  return (unsigned int*)mapping;
+}
+
+BinaryTranslator::BinaryTranslator(FunctionalCore& iss) : interpreter(iss)
+{
+  void* mapping = mmap(NULL, DBT_CODE_CACHE_SIZE, PROT_READ | PROT_WRITE | PROT_EXEC, MAP_PRIVATE | MAP_ANONYMOUS,
+                       -1, 0);
+  if (mapping == MAP_FAILED) {
+    fprintf(stderr, "Error: cannot map the code cache of the binary translator\n");
+    exit(-1);
+  }
+  codeCache = (unsigned char*)mapping;
+
+  memset(&context, 0, sizeof(context));
+  context.codeGranules = (unsigned char*)allocateGranules();
+  context.lookup       = new LookupEntry[1 << DBT_LOG_LOOKUP_ENTRIES];
+
+  // Entry trampoline, enter(context, code): saves the callee-saved registers used by the translated code, which
+  // returns to it with ret. Four pushes keep the stack aligned on 16 bytes for the calls made by the blocks.
+  Emitter e(codeCache);
+  e.byte(0x53);             // push rbx
+  e.bytes(0x41, 0x54);      // push r12
+  e.bytes(0x41, 0x55);      // push r13
+  e.bytes(0x41, 0x56);      // push r14
+  e.byte(0x48);             // mov rbx, rdi
+  e.bytes(0x89, 0xfb);
+  e.bytes(0x4c, 0x8b);      // mov r12, [rbx + memory]
+  e.byte(0xa3);
+  e.dword(CONTEXT(memory));
+  e.bytes(0x4c, 0x8b);      // mov r14, [rbx + codeGranules]
+  e.byte(0xb3);
+  e.dword(CONTEXT(codeGranules));
+  e.bytes(0xff, 0xd6);      // call rsi
+  e.bytes(0x41, 0x5e);      // pop r14
+  e.bytes(0x41, 0x5d);      // pop r13
+  e.bytes(0x41, 0x5c);      // pop r12
+  e.byte(0x5b);             // pop rbx
+  e.byte(0xc3);             // ret
+  enter = codeCache;
+
+  numberTranslated = 0;
+  numberFlush      = 0;
+  flush();
+  numberFlush = 0;
+}
+
+void BinaryTranslator::collectProfile(BasicBlockVector& bbv)
+{
+  bbv.swap(flushedProfile);
+  flushedProfile.clear();
+  for (auto& oneBlock : blocks) {
+    if (oneBlock.second.instructions) {
+      bbv[oneBlock.first] += oneBlock.second.instructions;
+      oneBlock.second.instructions = 0;
+    }
+  }
+}
+
+BinaryTranslator::~BinaryTranslator()
+{
+  munmap(codeCache, DBT_CODE_CACHE_SIZE);
+  munmap(context.codeGranules, (size_t)DBT_GRANULES * 4);
+  delete[](LookupEntry*) context.lookup;
+}
+
+void BinaryTranslator::flush()
+{
+  // The trampoline stays at the start of the cache
+  codeEnd = enter + DBT_TRAMPOLINE_SIZE;
+  for (const auto& oneBlock : blocks)
+    if (oneBlock.second.instructions)
+      flushedProfile[oneBlock.first] += oneBlock.second.instructions;
+  blocks.clear();
+  pendingExits.clear();
+
+  unsigned int* granules = (unsigned int*)context.codeGranules;
+  for (const unsigned int oneGranule : markedGranules)
+    granules[oneGranule] = 0;
+  markedGranules.clear();
+
+  LookupEntry* lookup = (LookupEntry*)context.lookup;
+  for (int i = 0; i < (1 << DBT_LOG_LOOKUP_ENTRIES); i++)
+    lookup[i].pc = 1; // never a valid pc
+
+  // The interpreter may hold stale copies of the instructions as well
+  interpreter.flush();
+  numberFlush++;
+}
+
+// Each granule has one bit per halfword holding a translated instruction
+void BinaryTranslator::markCode(const unsigned int start, const unsigned int end)
+{
+  unsigned int* granules = (unsigned int*)context.codeGranules;
+  for (unsigned int half = start; half != end; half += 2) {
+    unsigned int& granule = granules[half >> DBT_LOG_GRANULE];
+    if (granule == 0)
+      markedGranules.push_back(half >> DBT_LOG_GRANULE);
+    granule |= 1u << ((half >> 1) & 31);
+  }
+}
+
+// The word written by the store, which made the block return, may hold an instruction or only share its granule
+bool BinaryTranslator::overlapsCode(const unsigned int addr)
+{
+  const unsigned int word    = addr & ~3;
+  const unsigned int granule = ((unsigned int*)context.codeGranules)[word >> DBT_LOG_GRANULE];
+  return (granule >> ((word >> 1) & 31)) & 3;
+}
+
+// Exits of the translated blocks jumping to pc now go straight to its code
+void BinaryTranslator::chain(const unsigned int pc, unsigned char* code)
+{
+  const auto range = pendingExits.equal_range(pc);
+  for (auto oneExit = range.first; oneExit != range.second; oneExit++) {
+    Emitter e(oneExit->second);
+    e.patch(e.jump(-1), code);
+  }
+  pendingExits.erase(range.first, range.second);
+
+  LookupEntry& entry = ((LookupEntry*)context.lookup)[(pc >> 1) & ((1 << DBT_LOG_LOOKUP_ENTRIES) - 1)];
+  entry.pc           = pc;
+  entry.code         = code;
+}
+
+void BinaryTranslator::translate(const unsigned int start, Block& block)
+{
+  block.code         = NULL;
+  block.length       = 0;
+  block.instructions = 0;
+
+  // Instructions of the block, up to the one which ends it
+  DecodedInstruction instructions[DBT_BLOCK_INSTRUCTIONS];
+  unsigned int pc = start;
+  while (block.length < DBT_BLOCK_INSTRUCTIONS) {
+    unsigned int raw;
+    memcpy(&raw, context.memory + pc, 4);
+    DecodedInstruction& d = instructions[block.length];
+    FunctionalCore::decode(pc, raw, d);
+    if (d.op == ISS_ATOMIC || d.op == ISS_CSR || d.op == ISS_ECALL || d.op == ISS_SYSTEM)
+      break;
+    block.length++;
+    pc += d.size;
+    if (d.op >= ISS_JAL && d.op <= ISS_BGEU)
+      break;
+  }
+  block.end = pc;
+
+  // A system, CSR or atomic instruction is left to the interpreter, its bytes are tracked as the ones of translated code so that
+  // a store into it flushes the copy kept by the interpreter
+  if (block.length == 0) {
+    DecodedInstruction d;
+    unsigned int raw;
+    memcpy(&raw, context.memory + start, 4);
+    FunctionalCore::decode(start, raw, d);
+    markCode(start, start + d.size);
+    return;
+  }
+
+  Emitter e(codeEnd);
+  block.code = codeEnd;
+
+  // Prologue: the whole block is counted, when it would go past the limit it returns to run() instead
+  e.bytes(0x48, 0x8b); // mov rax, [rbx + count]
+  e.byte(0x83);
+  e.dword(CONTEXT(count));
+  e.bytes(0x48, 0x05); // add rax, length
+  e.dword(block.length);
+  e.bytes(0x48, 0x3b); // cmp rax, [rbx + limit]
+  e.byte(0x83);
+  e.dword(CONTEXT(limit));
+  unsigned char* overLimit = e.jump(0x7); // ja
+  e.bytes(0x48, 0x89); // mov [rbx + count], rax
+  e.byte(0x83);
+  e.dword(CONTEXT(count));
+  if (profiling) {
+    e.bytes(0x48, 0xb8); // mov rax, &block.instructions
+    e.qword((unsigned long)&block.instructions);
+    e.bytes(0x48, 0x81); // add qword [rax], length
+    e.byte(0x00);
+    e.dword(block.length);
+  }
+  if (warming) {
+    e.moveImmediate(ESI, start);
+    e.moveImmediate(EDX, block.end);
+    e.byte(0x48); // mov rdi, [rbx + core]
+    e.load(EDI, CONTEXT(core));
+    e.call((unsigned long)warmFetchHelper);
+  }
+
+  // Stores into code leave the block after the store
+  struct WriteExit {
+    unsigned char* rel;
+    unsigned int nextPC;
+    unsigned int remaining;
+  } writeExits[DBT_BLOCK_INSTRUCTIONS];
+  int numberWriteExits = 0;
+
+  // Exits to constant pcs, chained later
+  struct ConstantExit {
+    unsigned char* rel; // NULL for the fall through
+    unsigned int target;
+  } constantExits[2];
+  int numberConstantExits = 0;
+  bool dynamicExit        = false;
+
+  for (unsigned int i = 0; i < block.length; i++) {
+    const DecodedInstruction& d = instructions[i];
+    const int rd = REG(d.rd), rs1 = REG(d.rs1), rs2 = REG(d.rs2);
+    static const unsigned int aluOpcodes[] = {OP_ADD, OP_SUB, OP_XOR, OP_OR, OP_AND};
+    static const unsigned int immOpcodes[] = {0x05, 0x2d, 0x35, 0x0d, 0x25}; // the same ones on eax, imm32
+    static const unsigned int shiftExtensions[] = {0xe0, 0xe8, 0xf8};       // shl, shr, sar (modrm of eax)
+    unsigned int setCondition = 0;
+    int shift                 = -1;
+    int alu                   = -1;
+    int aluImmediate          = -1;
+    unsigned long helper      = 0;
+
+    if (warming)
+      emitWarming(e, d);
+
+    switch (d.op) {
+      case ISS_NOP:
+        break;
+      case ISS_LUI:
+        e.storeImmediate(rd, d.imm);
+        break;
+      case ISS_AUIPC:
+        e.storeImmediate(rd, d.pc + d.imm);
+        break;
+      case ISS_JAL:
+        e.storeImmediate(rd, d.pc + d.size);
+        constantExits[numberConstantExits].rel      = NULL;
+        constantExits[numberConstantExits++].target = d.pc + d.imm;
+        break;
+      case ISS_JALR:
+        e.load(EAX, rs1);
+        e.aluEax(0x05, d.imm);
+        e.storeImmediate(rd, d.pc + d.size);
+        dynamicExit = true;
+        break;
+      case ISS_BEQ:
+      case ISS_BNE:
+      case ISS_BLT:
+      case ISS_BGE:
+      case ISS_BLTU:
+      case ISS_BGEU:
+        e.load(EAX, rs1);
+        e.rbxOperand(OP_CMP, EAX, rs2);
+        constantExits[numberConstantExits].rel      = e.jump(branchConditions[d.op - ISS_BEQ]);
+        constantExits[numberConstantExits++].target = d.pc + d.imm;
+        constantExits[numberConstantExits].rel      = NULL;
+        constantExits[numberConstantExits++].target = d.pc + d.size;
+        break;
+      case ISS_LB:
+      case ISS_LH:
+      case ISS_LW:
+      case ISS_LBU:
+      case ISS_LHU: {
+        // movsx/movzx/mov edx, [r12 + rax]
+        static const unsigned int loads[][3] = {
+            {0x0f, 0xbe}, {0x0f, 0xbf}, {0x8b, 0}, {0x0f, 0xb6}, {0x0f, 0xb7}};
+        const unsigned int* load = loads[d.op - ISS_LB];
+        e.load(EAX, rs1);
+        e.aluEax(0x05, d.imm);
+        if (d.op == ISS_LH || d.op == ISS_LHU)
+          e.aluEax(0x25, ~1u);
+        else if (d.op == ISS_LW)
+          e.aluEax(0x25, ~3u);
+        e.byte(0x41);
+        e.byte(load[0]);
+        if (load[1])
+          e.byte(load[1]);
+        e.bytes(0x14, 0x04);
+        e.store(rd, EDX);
+        break;
+      }
+      case ISS_SB:
+      case ISS_SH:
+      case ISS_SW:
+        e.load(EAX, rs1);
+        e.aluEax(0x05, d.imm);
+        if (d.op == ISS_SH)
+          e.aluEax(0x25, ~1u);
+        else if (d.op == ISS_SW)
+          e.aluEax(0x25, ~3u);
+        e.load(EDX, rs2);
+        if (d.op == ISS_SB) {
+          e.bytes(0x41, 0x88); // mov [r12 + rax], dl
+        } else {
+          if (d.op == ISS_SH)
+            e.byte(0x66);
+          e.bytes(0x41, 0x89); // mov [r12 + rax], dx / edx
+        }
+        e.bytes(0x14, 0x04);
+        e.bytes(0x89, 0xc1); // mov ecx, eax
+        e.bytes(0xc1, 0xe9); // shr ecx, DBT_LOG_GRANULE
+        e.byte(DBT_LOG_GRANULE);
+        e.bytes(0x41, 0x83); // cmp dword [r14 + rcx * 4], 0
+        e.bytes(0x3c, 0x8e);
+        e.byte(0);
+        writeExits[numberWriteExits].rel         = e.jump(CC_NE);
+        writeExits[numberWriteExits].nextPC      = d.pc + d.size;
+        writeExits[numberWriteExits++].remaining = block.length - i - 1;
+        break;
+      case ISS_ADDI:
+        aluImmediate = 0;
+        break;
+      case ISS_XORI:
+        aluImmediate = 2;
+        break;
+      case ISS_ORI:
+        aluImmediate = 3;
+        break;
+      case ISS_ANDI:
+        aluImmediate = 4;
+        break;
+      case ISS_SLTI:
+      case ISS_SLTIU:
+        e.bytes(0x31, 0xd2); // xor edx, edx
+        e.load(EAX, rs1);
+        e.aluEax(0x3d, d.imm);
+        setCondition = d.op == ISS_SLTI ? CC_L : CC_B;
+        break;
+      case ISS_SLLI:
+      case ISS_SRLI:
+      case ISS_SRAI:
+        e.load(EAX, rs1);
+        e.bytes(0xc1, shiftExtensions[d.op - ISS_SLLI]);
+        e.byte(d.op == ISS_SLLI ? d.imm : d.rs2);
+        e.store(rd, EAX);
+        break;
+      case ISS_ADD:
+        alu = 0;
+        break;
+      case ISS_SUB:
+        alu = 1;
+        break;
+      case ISS_XOR:
+        alu = 2;
+        break;
+      case ISS_OR:
+        alu = 3;
+        break;
+      case ISS_AND:
+        alu = 4;
+        break;
+      case ISS_SLL:
+        shift = 0;
+        break;
+      case ISS_SRL:
+        shift = 1;
+        break;
+      case ISS_SRA:
+        shift = 2;
+        break;
+      case ISS_SLT:
+      case ISS_SLTU:
+        e.bytes(0x31, 0xd2); // xor edx, edx
+        e.load(EAX, rs1);
+        e.rbxOperand(OP_CMP, EAX, rs2);
+        setCondition = d.op == ISS_SLT ? CC_L : CC_B;
+        break;
+      case ISS_MUL:
+        e.load(EAX, rs1);
+        e.rbxOperand(0x0faf, EAX, rs2); // imul eax, [rbx + rs2]
+        e.store(rd, EAX);
+        break;
+      case ISS_MULH:
+      case ISS_MULHSU:
+      case ISS_MULHU:
+        // 64-bit product of the operands extended to 64 bits, then its upper half
+        if (d.op == ISS_MULHU) {
+          e.load(EAX, rs1);
+        } else {
+          e.byte(0x48); // movsxd rax, [rbx + rs1]
+          e.rbxOperand(0x63, EAX, rs1);
+        }
+        if (d.op == ISS_MULH) {
+          e.byte(0x48); // movsxd rcx, [rbx + rs2]
+          e.rbxOperand(0x63, ECX, rs2);
+        } else {
+          e.load(ECX, rs2);
+        }
+        e.bytes(0x48, 0x0f); // imul rax, rcx
+        e.bytes(0xaf, 0xc1);
+        e.bytes(0x48, 0xc1); // shr rax, 32
+        e.bytes(0xe8, 32);
+        e.store(rd, EAX);
+        break;
+      case ISS_DIV:
+        helper = (unsigned long)divHelper;
+        break;
+      case ISS_DIVU:
+        helper = (unsigned long)divuHelper;
+        break;
+      case ISS_REM:
+        helper = (unsigned long)remHelper;
+        break;
+      case ISS_REMU:
+        helper = (unsigned long)remuHelper;
+        break;
+    }
+
+    if (aluImmediate >= 0) {
+      e.load(EAX, rs1);
+      e.aluEax(immOpcodes[aluImmediate], d.imm);
+      e.store(rd, EAX);
+    } else if (alu >= 0) {
+      e.load(EAX, rs1);
+      e.rbxOperand(aluOpcodes[alu], EAX, rs2);
+      e.store(rd, EAX);
+    } else if (shift >= 0) {
+      // x86 shifts take the amount modulo 32, as RISC-V ones
+      e.load(EAX, rs1);
+      e.load(ECX, rs2);
+      e.bytes(0xd3, shiftExtensions[shift]);
+      e.store(rd, EAX);
+    } else if (setCondition) {
+      e.bytes(0x0f, 0x90 | setCondition); // setcc dl
+      e.byte(0xc2);
+      e.store(rd, EDX);
+    } else if (helper) {
+      e.load(EDI, rs1);
+      e.load(ESI, rs2);
+      e.call(helper);
+      e.store(rd, EAX);
+    }
+  }
+
+  // A block which does not end with a jump falls through to the next instruction
+  if (numberConstantExits == 0 && !dynamicExit) {
+    constantExits[0].rel    = NULL;
+    constantExits[0].target = pc;
+    numberConstantExits     = 1;
+  }
+
+  // Exits: the fall through first, right after the block, then the taken branch. Each one stores the next pc and
+  // returns, until it is patched into a jump to the block there.
+  std::vector<std::pair<unsigned int, unsigned char*> > stubs;
+  for (int i = numberConstantExits - 1; i >= 0; i--) {
+    if (constantExits[i].rel)
+      e.patch(constantExits[i].rel, e.p);
+    stubs.push_back(std::make_pair(constantExits[i].target, e.p));
+    e.storeImmediate(CONTEXT(pc), constantExits[i].target);
+    e.byte(0xc3); // ret
+  }
+
+  if (dynamicExit) {
+    // The target of JALR is searched in the lookup table, and run() is left when it misses
+    e.store(CONTEXT(pc), EAX);
+    e.bytes(0x89, 0xc1); // mov ecx, eax
+    e.bytes(0xd1, 0xe9); // shr ecx, 1
+    e.bytes(0x81, 0xe1); // and ecx, entries - 1
+    e.dword((1 << DBT_LOG_LOOKUP_ENTRIES) - 1);
+    e.bytes(0x48, 0xc1); // shl rcx, 4
+    e.bytes(0xe1, 4);
+    e.byte(0x48); // add rcx, [rbx + lookup]
+    e.rbxOperand(0x03, ECX, CONTEXT(lookup));
+    e.bytes(0x3b, 0x01); // cmp eax, [rcx]
+    e.bytes(0x75, 0x03); // jne ret
+    e.bytes(0xff, 0x61); // jmp [rcx + 8]
+    e.byte(8);
+    e.byte(0xc3); // ret
+  }
+
+  // The store into code gives the address it wrote and the pc following it, the rest of the block is uncounted
+  for (int i = 0; i < numberWriteExits; i++) {
+    e.patch(writeExits[i].rel, e.p);
+    e.store(CONTEXT(written), EAX);
+    e.storeImmediate(CONTEXT(pc), writeExits[i].nextPC);
+    e.byte(0x48); // sub qword [rbx + count], remaining
+    e.rbxOperand(0x81, 5, CONTEXT(count));
+    e.dword(writeExits[i].remaining);
+    e.byte(0xc3);
+  }
+
+  e.patch(overLimit, e.p);
+  e.storeImmediate(CONTEXT(pc), start);
+  e.byte(0xc3);
+
+  codeEnd = e.p;
+  markCode(start, block.end);
+
+  // Exits to blocks already translated are chained right away
+  for (const auto& oneStub : stubs) {
+    const auto target = blocks.find(oneStub.first);
+    if (target != blocks.end() && target->second.code) {
+      Emitter patcher(oneStub.second);
+      patcher.patch(patcher.jump(-1), target->second.code);
+    } else {
+      pendingExits.insert(oneStub);
+    }
+  }
+  numberTranslated++;
+}
+
+BinaryTranslator::Block& BinaryTranslator::findBlock(const unsigned int pc)
+{
+  const auto found = blocks.find(pc);
+  if (found != blocks.end())
+    return found->second;
+
+  if (codeEnd + DBT_MAX_BLOCK_CODE > codeCache + DBT_CODE_CACHE_SIZE)
+    flush();
+  // The block is translated in place, its counter stays at the same address until the next flush
+  Block& block = blocks[pc];
+  translate(pc, block);
+  if (block.code)
+    chain(pc, block.code);
+  return block;
+}
+
+bool BinaryTranslator::run(struct Core& core, unsigned char* memory, unsigned long& instret,
+                           const unsigned long limit)
+{
+  if (memory != context.memory) {
+    flush();
+    context.memory = memory;
+  }
+
+  for (int i = 0; i < 32; i++)
+    context.reg[i] = core.regFile[i].to_int();
+  context.pc    = core.pc.to_uint();
+  context.count = instret;
+  context.limit = limit;
+  context.core  = &core;
+  // One cycle per instruction, as in the interpreter
+  const unsigned long cycleBase = core.cycle - instret;
+
+  bool isSyscall = false;
+  while (context.count < limit) {
+    Block& block = findBlock(context.pc);
+
+    // System, CSR and atomic instructions, or the last instructions before the limit, are run by the interpreter
+    if (!block.code || context.count + block.length > limit) {
+      for (int i = 1; i < 32; i++)
+        core.regFile[i] = (int)context.reg[i];
+      core.pc    = context.pc;
+      core.cycle = cycleBase + context.count;
+
+      // The interpreter decodes whole blocks, of which only the first instruction is tracked here: the copies it
+      // holds are dropped around a run going further than this instruction
+      const unsigned long before = context.count;
+      if (block.code)
+        interpreter.flush();
+      isSyscall = interpreter.run(core, memory, context.count, block.code ? limit : context.count + 1);
+      block.instructions += context.count - before;
+      if (block.code)
+        interpreter.flush();
+
+      for (int i = 0; i < 32; i++)
+        context.reg[i] = core.regFile[i].to_int();
+      context.pc = core.pc.to_uint();
+      if (isSyscall)
+        break;
+      continue;
+    }
+
+    context.written = DBT_NO_WRITE;
+    ((void (*)(TranslatorContext*, unsigned char*))enter)(&context, block.code);
+    if (context.written != DBT_NO_WRITE && overlapsCode(context.written))
+      flush();
+  }
+
+  for (int i = 1; i < 32; i++)
+    core.regFile[i] = (int)context.reg[i];
+  core.pc    = context.pc;
+  core.cycle = cycleBase + context.count;
+  instret    = context.count;
+  return isSyscall;
+}
+
+#else
+
+// Other hosts run the whole program with the interpreter
+
+BinaryTranslator::BinaryTranslator(FunctionalCore& iss) : interpreter(iss)
+{
+  codeCache        = NULL;
+  numberTranslated = 0;
+  numberFlush      = 0;
+}
+
+BinaryTranslator::~BinaryTranslator() {}
+
+void BinaryTranslator::collectProfile(BasicBlockVector& bbv)
+{
+  bbv.clear();
+}
+
+void BinaryTranslator::flush()
+{
+  interpreter.flush();
+}
+
+bool BinaryTranslator::run(struct Core& core, unsigned char* memory, unsigned long& instret,
+                           const unsigned long limit)
+{
+  return interpreter.run(core, memory, instret, limit);
+}
+
+#endif
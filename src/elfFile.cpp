@@ -66,6 +66,7 @@ ElfFile::ElfFile(const char* pathToElfFile)
   content.assign(std::istreambuf_iterator<char>(elfFile), {});
   checkElf(content);
   fillSectionTable<Elf32_Shdr>();
+  fillSegmentTable<Elf32_Phdr>();
   fillNameTable();
   readSymbolTable<Elf32_Sym>();
   fillSymbolsName();
@@ -0,0 +1,149 @@
+/** Copyright 2021 INRIA, Université de Rennes 1 and ENS Rennes
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <vector>
+
+#include "guestMemory.h"
+
+#define CHECKPOINT_LAST_PAGE 0xffffffff
+
+GuestMemory::GuestMemory(const size_t requestedSize) : size(requestedSize)
+{
+  if (size == 0 || size > GUEST_MEMORY_MAX_SIZE || size % GUEST_PAGE_SIZE != 0) {
+    fprintf(stderr, "Error: memory size must be a multiple of %d bytes and at most 4 GiB\n", GUEST_PAGE_SIZE);
+    exit(-1);
+  }
+
+  void* mapping = mmap(NULL, size + GUEST_PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE,
+                       -1, 0);
+  if (mapping == MAP_FAILED) {
+    fprintf(stderr, "Error: cannot map %zu bytes of simulated memory\n", size);
+    exit(-1);
+  }
+  data = (unsigned char*)mapping;
+}
+
+GuestMemory::~GuestMemory()
+{
+  munmap(data, size + GUEST_PAGE_SIZE);
+}
+
+void GuestMemory::mapAnonymous(unsigned char* start, const size_t length)
+{
+  if (mmap(start, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_FIXED, -1, 0) ==
+      MAP_FAILED) {
+    fprintf(stderr, "Error: cannot remap the simulated memory\n");
+    exit(-1);
+  }
+}
+
+void GuestMemory::load(const unsigned int addr, const void* src, const size_t length)
+{
+  if (addr + length > size) {
+    fprintf(stderr, "Error: cannot load %zu bytes at 0x%x, the simulated memory is %zu bytes\n", length, addr, size);
+    exit(-1);
+  }
+  memcpy(data + addr, src, length);
+}
+
+void GuestMemory::mapFile(const char* fileName, const unsigned int fileOffset, const unsigned int addr,
+                          const unsigned int fileSize, const unsigned int memorySize)
+{
+  if (memorySize < fileSize) {
+    fprintf(stderr, "Error: segment at 0x%x is smaller in memory than in %s\n", addr, fileName);
+    exit(-1);
+  }
+  if ((size_t)addr + memorySize > size) {
+    fprintf(stderr, "Error: segment at 0x%x does not fit in the %zu bytes of simulated memory\n", addr, size);
+    exit(-1);
+  }
+
+  const int fd = open(fileName, O_RDONLY);
+  if (fd < 0) {
+    fprintf(stderr, "Error: cannot open file %s\n", fileName);
+    exit(-1);
+  }
+
+  // Only the pages fully covered by the segment are mapped: the partial ones at both ends may
+  // be shared with another segment and are copied
+  unsigned int mapStart = (addr + GUEST_PAGE_SIZE - 1) & ~(GUEST_PAGE_SIZE - 1);
+  unsigned int mapEnd   = (addr + fileSize) & ~(GUEST_PAGE_SIZE - 1);
+  if ((fileOffset - addr) % GUEST_PAGE_SIZE != 0 || mapEnd <= mapStart)
+    mapStart = mapEnd = addr + fileSize;
+
+  if (mapEnd > mapStart &&
+      mmap(data + mapStart, mapEnd - mapStart, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fd,
+           fileOffset + (mapStart - addr)) == MAP_FAILED) {
+    fprintf(stderr, "Error: cannot map %s in the simulated memory\n", fileName);
+    exit(-1);
+  }
+  if (mapEnd > mapStart)
+    fileMappings.push_back(std::make_pair(mapStart / GUEST_PAGE_SIZE, mapEnd / GUEST_PAGE_SIZE));
+
+  const bool headRead = pread(fd, data + addr, mapStart - addr, fileOffset) == (ssize_t)(mapStart - addr);
+  const bool tailRead = pread(fd, data + mapEnd, addr + fileSize - mapEnd, fileOffset + (mapEnd - addr)) ==
+                        (ssize_t)(addr + fileSize - mapEnd);
+  close(fd);
+  if (!headRead || !tailRead) {
+    fprintf(stderr, "Error: cannot read segment at 0x%x from %s\n", addr, fileName);
+    exit(-1);
+  }
+
+  // The part of the segment not backed by the file (.bss)
+  memset(data + addr + fileSize, 0, memorySize - fileSize);
+}
+
+void GuestMemory::serialize(Checkpoint& cp)
+{
+  static const unsigned char zeroPage[GUEST_PAGE_SIZE] = {};
+  const unsigned int numberOfPages = size / GUEST_PAGE_SIZE;
+
+  if (!cp.isLoading()) {
+    // Pages which are not resident have never been written
+    std::vector<unsigned char> resident(numberOfPages);
+    if (mincore(data, size, resident.data()) != 0)
+      std::fill(resident.begin(), resident.end(), 1);
+    for (const auto& range : fileMappings)
+      std::fill(resident.begin() + range.first, resident.begin() + range.second, 1);
+
+    for (unsigned int onePage = 0; onePage < numberOfPages; onePage++) {
+      unsigned char* page = data + (size_t)onePage * GUEST_PAGE_SIZE;
+      if ((resident[onePage] & 1) && memcmp(page, zeroPage, GUEST_PAGE_SIZE) != 0) {
+        cp.transfer(onePage);
+        cp.transfer(page, GUEST_PAGE_SIZE);
+      }
+    }
+    unsigned int last = CHECKPOINT_LAST_PAGE;
+    cp.transfer(last);
+  } else {
+    // Pages missing from the checkpoint are zero: the whole memory is replaced by a fresh mapping
+    mapAnonymous(data, size);
+    fileMappings.clear();
+
+    unsigned int onePage;
+    for (cp.transfer(onePage); onePage != CHECKPOINT_LAST_PAGE; cp.transfer(onePage)) {
+      if (onePage >= numberOfPages) {
+        fprintf(stderr, "Error: checkpoint memory image is larger than the simulated memory\n");
+        exit(-1);
+      }
+      cp.transfer(data + (size_t)onePage * GUEST_PAGE_SIZE, GUEST_PAGE_SIZE);
+    }
+  }
+}
@@ -0,0 +1,530 @@
+/** Copyright 2021 INRIA, Université de Rennes 1 and ENS Rennes
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "decompressor.h"
+#include "iss.h"
+#include "riscvISA.h"
+
+// The engine works on native integers: the register file and the pc are copied in and out of the
+// core around the main loop, and memory is read as plain little-endian bytes.
+// Corner cases (JALR does not clear bit 0, HALF accesses ignore addr[0], unknown opcodes and
+// the system instructions other than ECALL and the CSR ones are dropped) follow what the pipeline does so that both
+// models agree.
+
+#define ISS_INVALID_PC 0x1 // never a valid pc as instructions are 4-byte aligned
+#define ISS_LOG_GRANULE 6
+#define ISS_GRANULES (1u << (32 - ISS_LOG_GRANULE))
+
+// With GCC and Clang, an instruction jumps straight to the code of the next one (labels as values) instead of going
+// back through the switch: the host predicts each of these indirect jumps on its own
+#if defined(__GNUC__)
+#define ISS_CASE(op)                                                                                                   \
+  case op:                                                                                                             \
+  op##_CODE:
+#define ISS_NEXT() goto* dispatch[(++d)->op]
+#else
+#define ISS_CASE(op) case op:
+#define ISS_NEXT() continue
+#endif
+
+// The tables are only touched once they hold a decoded instruction: calloc maps the rest of them to zero pages
+FunctionalCore::FunctionalCore() : generation(1), codeEnd(0), reservation(ISS_INVALID_PC)
+{
+  blocks       = (Block*)calloc(BLOCK_ENTRIES, sizeof(Block));
+  code         = (DecodedInstruction*)calloc(CODE_ENTRIES, sizeof(DecodedInstruction));
+  codeGranules = (unsigned int*)calloc(ISS_GRANULES, 4);
+  if (!blocks || !code || !codeGranules) {
+    fprintf(stderr, "Error: cannot allocate the decoded blocks of the ISS\n");
+    exit(-1);
+  }
+}
+
+FunctionalCore::~FunctionalCore()
+{
+  free(blocks);
+  free(code);
+  free(codeGranules);
+}
+
+// The blocks of the previous generations are left in place, the table only being cleared when the count wraps
+void FunctionalCore::flush()
+{
+  if (++generation == 0) {
+    memset(blocks, 0, BLOCK_ENTRIES * sizeof(Block));
+    generation = 1;
+  }
+  codeEnd = 0;
+  for (const unsigned int oneGranule : markedGranules)
+    codeGranules[oneGranule] = 0;
+  markedGranules.clear();
+}
+
+void FunctionalCore::decode(const unsigned int pc, unsigned int instruction, DecodedInstruction& d)
+{
+  d.size = 4;
+  if ((instruction & 0x3) != 0x3) {
+    d.size      = 2;
+    instruction = decompress(instruction & 0xffff).to_uint();
+  }
+
+  const unsigned int opCode = instruction & 0x7f;
+  const unsigned int funct3 = (instruction >> 12) & 0x7;
+  const unsigned int funct7 = instruction >> 25;
+
+  const int immI  = (int)instruction >> 20;
+  const int immS  = (((int)instruction >> 25) << 5) | ((instruction >> 7) & 0x1f);
+  const int immB  = (((int)instruction >> 31) << 12) | ((instruction << 4) & 0x800) | ((instruction >> 20) & 0x7e0) |
+                   ((instruction >> 7) & 0x1e);
+  const int immJ  = (((int)instruction >> 31) << 20) | (instruction & 0xff000) | ((instruction >> 9) & 0x800) |
+                   ((instruction >> 20) & 0x7fe);
+  const int immU  = instruction & 0xfffff000;
+
+  static const unsigned char branchOps[8] = {ISS_BEQ, ISS_BNE, ISS_NOP, ISS_NOP, ISS_BLT, ISS_BGE, ISS_BLTU, ISS_BGEU};
+  // LD with funct3 3, 6 and 7 behaves as a word access in the pipeline
+  static const unsigned char loadOps[8]  = {ISS_LB, ISS_LH, ISS_LW, ISS_LW, ISS_LBU, ISS_LHU, ISS_LW, ISS_LW};
+  static const unsigned char storeOps[8] = {ISS_SB, ISS_SH, ISS_SW, ISS_SW, ISS_SW, ISS_SW, ISS_SW, ISS_SW};
+  static const unsigned char opiOps[8]   = {ISS_ADDI, ISS_SLLI, ISS_SLTI, ISS_SLTIU, ISS_XORI, ISS_SRLI, ISS_ORI, ISS_ANDI};
+  static const unsigned char opOps[8]    = {ISS_ADD, ISS_SLL, ISS_SLT, ISS_SLTU, ISS_XOR, ISS_SRL, ISS_OR, ISS_AND};
+  static const unsigned char mulOps[8]   = {ISS_MUL, ISS_MULH, ISS_MULHSU, ISS_MULHU, ISS_DIV, ISS_DIVU, ISS_REM, ISS_REMU};
+
+  d.pc  = pc;
+  d.rd  = (instruction >> 7) & 0x1f;
+  d.rs1 = (instruction >> 15) & 0x1f;
+  d.rs2 = (instruction >> 20) & 0x1f;
+  d.imm = immI;
+  d.op  = ISS_NOP;
+
+  switch (opCode) {
+    case RISCV_LUI:
+      d.op  = ISS_LUI;
+      d.imm = immU;
+      break;
+    case RISCV_AUIPC:
+      d.op  = ISS_AUIPC;
+      d.imm = immU;
+      break;
+    case RISCV_JAL:
+      d.op  = ISS_JAL;
+      d.imm = immJ;
+      break;
+    case RISCV_JALR:
+      d.op = ISS_JALR;
+      break;
+    case RISCV_BR:
+      d.op  = branchOps[funct3];
+      d.imm = immB;
+      break;
+    case RISCV_LD:
+      d.op = loadOps[funct3];
+      break;
+    case RISCV_ST:
+      d.op  = storeOps[funct3];
+      d.imm = immS;
+      break;
+    case RISCV_OPI:
+      d.op = opiOps[funct3];
+      if (d.op == ISS_SRLI && (funct7 & 0x20))
+        d.op = ISS_SRAI;
+      if (d.op == ISS_SLLI) // shift amount held in the lower 5 bits
+        d.imm = immI & 0x1f;
+      break;
+    case RISCV_OP:
+      if (funct7 & 0x1) { // M Extension
+        d.op = mulOps[funct3];
+        break;
+      }
+      d.op = opOps[funct3];
+      if (d.op == ISS_ADD && (funct7 & 0x20))
+        d.op = ISS_SUB;
+      if (d.op == ISS_SRL && (funct7 & 0x20))
+        d.op = ISS_SRA;
+      break;
+    case RISCV_ATOMIC:
+      d.op  = ISS_ATOMIC;
+      d.imm = instruction >> 27;
+      break;
+    case RISCV_SYSTEM:
+      // Same test as the one made by the simulator on the extoMem pipeline register
+      d.op = (instruction >> 20) == 0 ? ISS_ECALL : funct3 != RISCV_SYSTEM_ENV ? ISS_CSR : ISS_SYSTEM;
+      d.imm = ((instruction >> 20) << 3) | funct3;
+      break;
+    default: // RISCV_MISC_MEM and unsupported opcodes are dropped
+      break;
+  }
+
+  // Writes to x0 go to a sink register that is never read
+  if (d.rd == 0)
+    d.rd = 32;
+}
+
+static inline unsigned int loadWord(const unsigned char* memory, const unsigned int addr)
+{
+  unsigned int value;
+  memcpy(&value, memory + (addr & ~3), 4);
+  return value;
+}
+
+// Instructions are only 2-byte aligned with the C extension
+static inline unsigned int loadInstruction(const unsigned char* memory, const unsigned int pc)
+{
+  unsigned int value;
+  memcpy(&value, memory + pc, 4);
+  return value;
+}
+
+// Each granule has one bit per halfword of the decoded instructions
+void FunctionalCore::markCode(const unsigned int start, const unsigned int end)
+{
+  for (unsigned int half = start; half != end; half += 2) {
+    unsigned int& granule = codeGranules[half >> ISS_LOG_GRANULE];
+    if (granule == 0)
+      markedGranules.push_back(half >> ISS_LOG_GRANULE);
+    granule |= 1u << ((half >> 1) & 31);
+  }
+}
+
+// Whether the halfwords written from addr (aligned on their size, 1 or 2 halfwords) hold a decoded instruction
+inline bool FunctionalCore::overlapsCode(const unsigned int addr, const unsigned int halfwords)
+{
+  return (codeGranules[addr >> ISS_LOG_GRANULE] >> ((addr >> 1) & 31)) & halfwords;
+}
+
+// The block runs up to its first control transfer or ECALL, or up to BLOCK_INSTRUCTIONS
+FunctionalCore::Block& FunctionalCore::decodeBlock(const unsigned char* memory, const unsigned int pc)
+{
+  if (codeEnd + BLOCK_INSTRUCTIONS + 1 > CODE_ENTRIES)
+    flush();
+
+  Block& block = blocks[(pc >> 1) & (BLOCK_ENTRIES - 1)];
+  block.pc         = pc;
+  block.generation = generation;
+  block.first      = codeEnd;
+  block.length     = 0;
+  unsigned int next = pc;
+  while (block.length < BLOCK_INSTRUCTIONS) {
+    DecodedInstruction& d = code[codeEnd++];
+    decode(next, loadInstruction(memory, next), d);
+    markCode(next, next + d.size);
+    block.length++;
+    next += d.size;
+    if ((d.op >= ISS_JAL && d.op <= ISS_BGEU) || d.op == ISS_ECALL)
+      break;
+  }
+
+  DecodedInstruction& end = code[codeEnd++];
+  end.pc                  = next;
+  end.op                  = ISS_END;
+  end.rd                  = 32;
+  end.rs1                 = 0;
+  end.rs2                 = 0;
+  end.size                = 0;
+  end.imm                 = 0;
+  return block;
+}
+
+static inline unsigned int loadHalf(const unsigned char* memory, const unsigned int addr)
+{
+  unsigned short value;
+  memcpy(&value, memory + (addr & ~1), 2);
+  return value;
+}
+
+bool FunctionalCore::run(struct Core& core, unsigned char* memory, unsigned long& instret,
+                         const unsigned long limit)
+{
+#if defined(__GNUC__)
+  // Code of each operation, in the order of IssOperation
+  static const void* const dispatch[] = {
+      &&ISS_NOP_CODE, &&ISS_LUI_CODE, &&ISS_AUIPC_CODE, &&ISS_JAL_CODE, &&ISS_JALR_CODE, &&ISS_BEQ_CODE,
+      &&ISS_BNE_CODE, &&ISS_BLT_CODE, &&ISS_BGE_CODE, &&ISS_BLTU_CODE, &&ISS_BGEU_CODE, &&ISS_LB_CODE, &&ISS_LH_CODE,
+      &&ISS_LW_CODE, &&ISS_LBU_CODE, &&ISS_LHU_CODE, &&ISS_SB_CODE, &&ISS_SH_CODE, &&ISS_SW_CODE, &&ISS_ADDI_CODE,
+      &&ISS_SLTI_CODE, &&ISS_SLTIU_CODE, &&ISS_XORI_CODE, &&ISS_ORI_CODE, &&ISS_ANDI_CODE, &&ISS_SLLI_CODE,
+      &&ISS_SRLI_CODE, &&ISS_SRAI_CODE, &&ISS_ADD_CODE, &&ISS_SUB_CODE, &&ISS_SLL_CODE, &&ISS_SLT_CODE,
+      &&ISS_SLTU_CODE, &&ISS_XOR_CODE, &&ISS_SRL_CODE, &&ISS_SRA_CODE, &&ISS_OR_CODE, &&ISS_AND_CODE, &&ISS_MUL_CODE,
+      &&ISS_MULH_CODE, &&ISS_MULHSU_CODE, &&ISS_MULHU_CODE, &&ISS_DIV_CODE, &&ISS_DIVU_CODE, &&ISS_REM_CODE,
+      &&ISS_REMU_CODE, &&ISS_ATOMIC_CODE, &&ISS_CSR_CODE, &&ISS_ECALL_CODE, &&ISS_SYSTEM_CODE, &&ISS_END_CODE};
+  static_assert(sizeof(dispatch) / sizeof(dispatch[0]) == ISS_END + 1, "one entry per operation");
+#endif
+
+  unsigned int reg[33]; // reg[32] is the sink for writes to x0
+  for (int i = 0; i < 32; i++)
+    reg[i] = core.regFile[i].to_int();
+  unsigned int pc = core.pc.to_uint();
+
+  bool isSyscall      = false;
+  unsigned long count = instret;
+  // The engine retires an instruction per cycle, the cycle count following instret from their values at the entry
+  const unsigned long cycleBase = core.cycle - instret;
+
+  while (count < limit) {
+    Block* block = &blocks[(pc >> 1) & (BLOCK_ENTRIES - 1)];
+    if (block->pc != pc || block->generation != generation)
+      block = &decodeBlock(memory, pc);
+
+    // The whole block is counted, the instructions it does not run being taken back when it is left early. Its
+    // last instructions before the limit run from a copy.
+    const DecodedInstruction* first = &code[block->first];
+    const unsigned long start       = count;
+    if (count + block->length > limit) {
+      const unsigned int length = limit - count;
+      memcpy(truncated, first, length * sizeof(DecodedInstruction));
+      truncated[length]    = first[block->length];
+      truncated[length].pc = first[length].pc;
+      first                = truncated;
+      count                = limit;
+    } else {
+      count += block->length;
+    }
+
+    // The instructions which go on with the next one of the block continue, the others set pc and break
+    for (const DecodedInstruction* d = first;; d++) {
+      unsigned int addr;
+      unsigned short half;
+
+      switch (d->op) {
+        ISS_CASE(ISS_NOP)
+        ISS_CASE(ISS_SYSTEM) // EBREAK, MRET and WFI are dropped
+        ISS_NEXT();
+        ISS_CASE(ISS_END)
+        pc = d->pc;
+        break;
+        ISS_CASE(ISS_LUI)
+        reg[d->rd] = d->imm;
+        ISS_NEXT();
+        ISS_CASE(ISS_AUIPC)
+        reg[d->rd] = d->pc + d->imm;
+        ISS_NEXT();
+        ISS_CASE(ISS_JAL)
+        reg[d->rd] = d->pc + d->size;
+        pc         = d->pc + d->imm;
+        break;
+        ISS_CASE(ISS_JALR)
+        addr       = reg[d->rs1] + d->imm;
+        reg[d->rd] = d->pc + d->size;
+        pc         = addr;
+        break;
+        ISS_CASE(ISS_BEQ)
+        pc = d->pc + (reg[d->rs1] == reg[d->rs2] ? d->imm : d->size);
+        break;
+        ISS_CASE(ISS_BNE)
+        pc = d->pc + (reg[d->rs1] != reg[d->rs2] ? d->imm : d->size);
+        break;
+        ISS_CASE(ISS_BLT)
+        pc = d->pc + ((int)reg[d->rs1] < (int)reg[d->rs2] ? d->imm : d->size);
+        break;
+        ISS_CASE(ISS_BGE)
+        pc = d->pc + ((int)reg[d->rs1] >= (int)reg[d->rs2] ? d->imm : d->size);
+        break;
+        ISS_CASE(ISS_BLTU)
+        pc = d->pc + (reg[d->rs1] < reg[d->rs2] ? d->imm : d->size);
+        break;
+        ISS_CASE(ISS_BGEU)
+        pc = d->pc + (reg[d->rs1] >= reg[d->rs2] ? d->imm : d->size);
+        break;
+        ISS_CASE(ISS_LB)
+        reg[d->rd] = (int)(signed char)memory[reg[d->rs1] + d->imm];
+        ISS_NEXT();
+        ISS_CASE(ISS_LH)
+        reg[d->rd] = (int)(short)loadHalf(memory, reg[d->rs1] + d->imm);
+        ISS_NEXT();
+        ISS_CASE(ISS_LW)
+        reg[d->rd] = loadWord(memory, reg[d->rs1] + d->imm);
+        ISS_NEXT();
+        ISS_CASE(ISS_LBU)
+        reg[d->rd] = memory[reg[d->rs1] + d->imm];
+        ISS_NEXT();
+        ISS_CASE(ISS_LHU)
+        reg[d->rd] = loadHalf(memory, reg[d->rs1] + d->imm);
+        ISS_NEXT();
+        // A store into decoded instructions leaves the block after it, and the blocks are decoded again
+        ISS_CASE(ISS_SB)
+        addr         = reg[d->rs1] + d->imm;
+        memory[addr] = reg[d->rs2];
+        if (!overlapsCode(addr & ~1, 1))
+          ISS_NEXT();
+        pc = d->pc + d->size;
+        goto codeWritten;
+        ISS_CASE(ISS_SH)
+        addr = (reg[d->rs1] + d->imm) & ~1;
+        half = reg[d->rs2];
+        memcpy(memory + addr, &half, 2);
+        if (!overlapsCode(addr, 1))
+          ISS_NEXT();
+        pc = d->pc + d->size;
+        goto codeWritten;
+        ISS_CASE(ISS_SW)
+        addr = (reg[d->rs1] + d->imm) & ~3;
+        memcpy(memory + addr, &reg[d->rs2], 4);
+        if (!overlapsCode(addr, 3))
+          ISS_NEXT();
+        pc = d->pc + d->size;
+        goto codeWritten;
+        ISS_CASE(ISS_ADDI)
+        reg[d->rd] = reg[d->rs1] + d->imm;
+        ISS_NEXT();
+        ISS_CASE(ISS_SLTI)
+        reg[d->rd] = (int)reg[d->rs1] < d->imm;
+        ISS_NEXT();
+        ISS_CASE(ISS_SLTIU)
+        reg[d->rd] = reg[d->rs1] < (unsigned int)d->imm;
+        ISS_NEXT();
+        ISS_CASE(ISS_XORI)
+        reg[d->rd] = reg[d->rs1] ^ d->imm;
+        ISS_NEXT();
+        ISS_CASE(ISS_ORI)
+        reg[d->rd] = reg[d->rs1] | d->imm;
+        ISS_NEXT();
+        ISS_CASE(ISS_ANDI)
+        reg[d->rd] = reg[d->rs1] & d->imm;
+        ISS_NEXT();
+        ISS_CASE(ISS_SLLI)
+        reg[d->rd] = reg[d->rs1] << d->imm;
+        ISS_NEXT();
+        ISS_CASE(ISS_SRLI)
+        reg[d->rd] = reg[d->rs1] >> d->rs2;
+        ISS_NEXT();
+        ISS_CASE(ISS_SRAI)
+        reg[d->rd] = (int)reg[d->rs1] >> d->rs2;
+        ISS_NEXT();
+        ISS_CASE(ISS_ADD)
+        reg[d->rd] = reg[d->rs1] + reg[d->rs2];
+        ISS_NEXT();
+        ISS_CASE(ISS_SUB)
+        reg[d->rd] = reg[d->rs1] - reg[d->rs2];
+        ISS_NEXT();
+        ISS_CASE(ISS_SLL)
+        reg[d->rd] = reg[d->rs1] << (reg[d->rs2] & 0x1f);
+        ISS_NEXT();
+        ISS_CASE(ISS_SLT)
+        reg[d->rd] = (int)reg[d->rs1] < (int)reg[d->rs2];
+        ISS_NEXT();
+        ISS_CASE(ISS_SLTU)
+        reg[d->rd] = reg[d->rs1] < reg[d->rs2];
+        ISS_NEXT();
+        ISS_CASE(ISS_XOR)
+        reg[d->rd] = reg[d->rs1] ^ reg[d->rs2];
+        ISS_NEXT();
+        ISS_CASE(ISS_SRL)
+        reg[d->rd] = reg[d->rs1] >> (reg[d->rs2] & 0x1f);
+        ISS_NEXT();
+        ISS_CASE(ISS_SRA)
+        reg[d->rd] = (int)reg[d->rs1] >> (reg[d->rs2] & 0x1f);
+        ISS_NEXT();
+        ISS_CASE(ISS_OR)
+        reg[d->rd] = reg[d->rs1] | reg[d->rs2];
+        ISS_NEXT();
+        ISS_CASE(ISS_AND)
+        reg[d->rd] = reg[d->rs1] & reg[d->rs2];
+        ISS_NEXT();
+        ISS_CASE(ISS_MUL)
+        reg[d->rd] = reg[d->rs1] * reg[d->rs2];
+        ISS_NEXT();
+        ISS_CASE(ISS_MULH)
+        reg[d->rd] = ((long long)(int)reg[d->rs1] * (long long)(int)reg[d->rs2]) >> 32;
+        ISS_NEXT();
+        ISS_CASE(ISS_MULHSU)
+        reg[d->rd] = ((long long)(int)reg[d->rs1] * (long long)reg[d->rs2]) >> 32;
+        ISS_NEXT();
+        ISS_CASE(ISS_MULHU)
+        reg[d->rd] = ((unsigned long long)reg[d->rs1] * reg[d->rs2]) >> 32;
+        ISS_NEXT();
+        // Division by zero and overflow give the results required by the ISA instead of trapping
+        ISS_CASE(ISS_DIV)
+        {
+          const unsigned int lhs = reg[d->rs1];
+          const unsigned int rhs = reg[d->rs2];
+          reg[d->rd] = rhs == 0 ? 0xffffffff : (lhs == 0x80000000 && rhs == 0xffffffff) ? lhs : (int)lhs / (int)rhs;
+          ISS_NEXT();
+        }
+        ISS_CASE(ISS_DIVU)
+        reg[d->rd] = reg[d->rs2] == 0 ? 0xffffffff : reg[d->rs1] / reg[d->rs2];
+        ISS_NEXT();
+        ISS_CASE(ISS_REM)
+        {
+          const unsigned int lhs = reg[d->rs1];
+          const unsigned int rhs = reg[d->rs2];
+          reg[d->rd] = rhs == 0 ? lhs : (lhs == 0x80000000 && rhs == 0xffffffff) ? 0 : (int)lhs % (int)rhs;
+          ISS_NEXT();
+        }
+        ISS_CASE(ISS_REMU)
+        reg[d->rd] = reg[d->rs2] == 0 ? reg[d->rs1] : reg[d->rs1] % reg[d->rs2];
+        ISS_NEXT();
+        // The engine is the only one accessing memory: SC succeeds when no other SC was made since the LR
+        ISS_CASE(ISS_ATOMIC)
+        {
+          addr                     = reg[d->rs1] & ~3;
+          const unsigned int value = loadWord(memory, addr);
+          if (d->imm == RISCV_ATOMIC_LR) {
+            reservation = addr;
+            reg[d->rd]  = value;
+            ISS_NEXT();
+          }
+          if (d->imm == RISCV_ATOMIC_SC) {
+            const bool success = reservation == addr;
+            reservation        = ISS_INVALID_PC;
+            reg[d->rd]         = !success;
+            if (!success)
+              ISS_NEXT();
+          } else {
+            reg[d->rd] = value;
+          }
+          const unsigned int stored = atomicValue(d->imm, value, reg[d->rs2]);
+          memcpy(memory + addr, &stored, 4);
+          if (!overlapsCode(addr, 3))
+            ISS_NEXT();
+          pc = d->pc + d->size;
+          goto codeWritten;
+        }
+        // The CSR file is the one of the core, whose counters are brought up to date first
+        ISS_CASE(ISS_CSR)
+        {
+          const unsigned int csr     = d->imm >> 3;
+          const unsigned int op      = d->imm & 3;
+          const unsigned int operand = (d->imm & 4) ? d->rs1 : reg[d->rs1];
+          core.instret               = start + (d - first);
+          core.cycle                 = cycleBase + core.instret;
+          const unsigned int value   = readCsr(core, csr, 0).to_uint();
+          if (op == RISCV_SYSTEM_CSRRW)
+            writeCsr(core, csr, operand, 0);
+          else if (d->rs1 != 0)
+            writeCsr(core, csr, op == RISCV_SYSTEM_CSRRS ? value | operand : value & ~operand, 0);
+          reg[d->rd] = value;
+          ISS_NEXT();
+        }
+        ISS_CASE(ISS_ECALL)
+        pc        = d->pc;
+        count     = start + (d - first);
+        isSyscall = true;
+        goto end;
+      }
+      break;
+
+    codeWritten:
+      count = start + (d - first) + 1;
+      flush();
+      break;
+    }
+  }
+
+end:
+  for (int i = 1; i < 32; i++)
+    core.regFile[i] = (int)reg[i];
+  core.pc    = pc;
+  core.cycle = cycleBase + count;
+  instret    = count;
+  return isSyscall;
+}
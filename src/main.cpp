@@ -20,6 +20,39 @@
 #include "CLI11.hpp"
 #include "basic_simulator.h"
 
+static prefetcherType parsePrefetcher(const std::string& name)
+{
+  if (name == "next-line")
+    return NEXT_LINE_PREFETCH;
+  if (name == "stride")
+    return STRIDE_PREFETCH;
+  if (name == "stream")
+    return STREAM_PREFETCH;
+  return NO_PREFETCH;
+}
+
+static mulDivUnitType parseMulDivUnit(const std::string& name)
+{
+  if (name == "pipelined")
+    return PIPELINED_UNIT;
+  if (name == "radix-2")
+    return RADIX2_UNIT;
+  if (name == "radix-4")
+    return RADIX4_UNIT;
+  return SINGLE_CYCLE_UNIT;
+}
+
+static branchPredictorType parsePredictor(const std::string& name)
+{
+  if (name == "gshare")
+    return GSHARE_PREDICTOR;
+  if (name == "perceptron")
+    return PERCEPTRON_PREDICTOR;
+  if (name == "tage")
+    return TAGE_PREDICTOR;
+  return BIMODAL_PREDICTOR;
+}
+
 int main(int argc, char** argv)
 {
   std::string binaryFile; // assign to default
@@ -30,6 +63,29 @@ int main(int argc, char** argv)
   std::vector<std::string> benchArgs, pargs;
   std::string breakpoint = "-1";
   std::string timeout = "-1";
+  std::string mode = "pipeline";
+  unsigned long fastForward = 0;
+  std::string simPointFile, bbvFile;
+  unsigned long intervalSize = 10000000, warmup = 100000;
+  bool warming = false;
+  bool regionOnly = false;
+  unsigned int maxClusters = 10, samplesPerCluster = 2;
+  std::string saveCheckpoint, loadCheckpoint;
+  long checkpointAt = -1;
+  unsigned int memorySize = GUEST_MEMORY_DEFAULT_SIZE >> 20;
+  bool mapElf = false;
+  CacheConfig cacheConfig   = {0, 10, 30, 100, NINE, 0, NO_PREFETCH, NO_PREFETCH, 0};
+  std::string inclusion     = "nine";
+  std::string l1iPrefetcher = "none", l1dPrefetcher = "none";
+  BranchPredictorConfig predictorConfig = {BIMODAL_PREDICTOR, 0, 0, 0, 0};
+  std::string predictor = "bimodal";
+  std::string branchStatsFile;
+  std::string cpiStatsFile;
+  unsigned long cpiInterval = 100000;
+  MulDivConfig mulDivConfig;
+  std::string multiplier = "pipelined", divider = "radix-4";
+  int cores = 1, threads = 1;
+  unsigned long quantum = 1000;
 
   CLI::App app{"Comet RISC-V Simulator"};
   app.add_option("-f,--file", binaryFile, "Specifies the RISC-V program binary file (elf)")->required();
@@ -43,18 +99,234 @@ int main(int argc, char** argv)
   app.add_option("-b,--break", breakpoint, "Provide a breakpoint at the cycle given (along with gdb : break basic_simulator.cpp:129)");
   app.add_option("-e,--end", timeout, "Add a timeout option to the execution (the simulator stops if this number of cycle is reached)");
 
+  app.add_set("-m,--mode", mode, {"pipeline", "iss", "dbt", "profile", "sampled"},
+              "Selects the execution engine: the cycle-accurate pipeline, the instruction-accurate ISS or the binary "
+              "translator, which runs the same model on host code (with iss and dbt, breakpoint and timeout are "
+              "counted in instructions). profile picks the simulation points of the program and sampled runs the "
+              "pipeline on them",
+              true);
+  app.add_option("--fast-forward", fastForward,
+                 "Runs this number of instructions with the binary translator before switching to the pipeline");
+  app.add_flag("--warm", warming,
+               "The binary translator warms the caches and the branch predictors while it fast-forwards (with "
+               "--fast-forward, --roi and -m sampled), so that the pipeline does not start cold");
+  app.add_flag("--roi", regionOnly,
+               "Only runs the region of interest of the program, between the SYS_roi_begin and SYS_roi_end "
+               "syscalls, with the pipeline, the rest of it being run by the binary translator");
+
+  app.add_option("--simpoints", simPointFile,
+                 "File of the simulation points, written with -m profile and read with -m sampled");
+  app.add_option("--bbv-file", bbvFile,
+                 "Writes the basic block vector of each interval to the given file (format of the SimPoint tool) with "
+                 "-m profile");
+  app.add_option("--interval", intervalSize, "Instructions of the intervals of the program with -m profile", true);
+  app.add_option("--max-clusters", maxClusters, "Largest number of clusters of intervals tried with -m profile",
+                 true);
+  app.add_option("--samples-per-cluster", samplesPerCluster,
+                 "Intervals simulated in each cluster, the first one being the closest to the centroid (at least 2 "
+                 "for error bounds)",
+                 true);
+  app.add_option("--warmup", warmup,
+                 "Instructions run through the pipeline before each sample with -m sampled, to warm it up", true);
+
+  app.add_option("--save-checkpoint", saveCheckpoint,
+                 "Saves the simulation state to the given file when the cycle (instruction with -m iss) given by "
+                 "--checkpoint-at is reached, then stops");
+  app.add_option("--checkpoint-at", checkpointAt,
+                 "Cycle (instruction with -m iss or dbt) at which the checkpoint is saved");
+  app.add_option("--load-checkpoint", loadCheckpoint,
+                 "Restores the simulation state from the given file before running (the program given with -f must "
+                 "be the one of the checkpoint)");
+
+  app.add_option("--memory-size", memorySize,
+                 "Size of the simulated memory in MiB, up to 4096 (pages are only allocated when the program "
+                 "touches them)",
+                 true);
+  app.add_flag("--map-elf", mapElf,
+               "Maps the loadable segments of the binary in the simulated memory instead of copying them");
+
+  app.add_option("--cache-levels", cacheConfig.levels,
+                 "Number of cache levels: 0 (none), 1 (split L1), 2 (and a unified L2) or 3 (and an L3), the geometry "
+                 "of the caches is set at build time (see cacheHierarchy.h)",
+                 true);
+  app.add_option("--l2-latency", cacheConfig.l2Latency, "Access latency of the L2 in cycles", true);
+  app.add_option("--l3-latency", cacheConfig.l3Latency, "Access latency of the L3 in cycles", true);
+  app.add_option("--memory-latency", cacheConfig.memoryLatency,
+                 "Access latency of the main memory in cycles (only used with caches)", true);
+  app.add_set("--inclusion", inclusion, {"nine", "inclusive", "exclusive"},
+              "Inclusion policy of the L2 and L3 with respect to the levels above (non-inclusive non-exclusive, "
+              "inclusive or exclusive)",
+              true);
+  app.add_option("--mshrs", cacheConfig.mshrs,
+                 "Number of MSHRs of the L1 data cache, which then serves hits while misses are outstanding (0 for a "
+                 "blocking cache, at most L1D_MSHRS set at build time)",
+                 true);
+  app.add_set("--l1i-prefetcher", l1iPrefetcher, {"none", "next-line", "stride", "stream"},
+              "Prefetcher of the L1 instruction cache (next-line, per-pc stride or stream buffer)", true);
+  app.add_set("--l1d-prefetcher", l1dPrefetcher, {"none", "next-line", "stride", "stream"},
+              "Prefetcher of the L1 data cache (next-line, per-pc stride or stream buffer)", true);
+  app.add_option("--write-buffer", cacheConfig.writeBuffer,
+                 "Lines of the write-back buffer of the L1 data cache, whose victims are then written back in the "
+                 "background (0 for none, at most WRITE_BUFFER_SIZE set at build time)",
+                 true);
+
+  app.add_set("--multiplier", multiplier, {"single-cycle", "pipelined", "radix-2", "radix-4"},
+              "Multiplier of the M extension (result in execute, in memory like a load, or iterative unit computing "
+              "1 or 2 bits per cycle)",
+              true);
+  app.add_set("--divider", divider, {"single-cycle", "pipelined", "radix-2", "radix-4"},
+              "Divider of the M extension (result in execute, in memory like a load, or iterative unit computing 1 "
+              "or 2 bits per cycle)",
+              true);
+
+  app.add_set("--branch-predictor", predictor, {"bimodal", "gshare", "perceptron", "tage"},
+              "Branch predictor of the pipeline (2-bit counters indexed by the pc, gshare, perceptron or TAGE)", true);
+  app.add_option("--bp-entries", predictorConfig.entries,
+                 "Entries of the branch predictor tables, a power of two (0 for the default of the predictor: 4 for "
+                 "bimodal, 64 for perceptron and 1024 otherwise)",
+                 true);
+  app.add_option("--bp-history", predictorConfig.history,
+                 "Bits of global history of the branch predictor, of the longest table for TAGE (0 for the default "
+                 "of the predictor: log2 of the entries for gshare, 16 for perceptron and 32 for TAGE)",
+                 true);
+  app.add_option("--btb-entries", predictorConfig.btbEntries,
+                 "Entries of the branch target buffer, which redirects fetch after the taken branches and jumps "
+                 "instead of decode (0 for none, a power of two up to BTB_ENTRIES set at build time)",
+                 true);
+  app.add_option("--ras-entries", predictorConfig.rasEntries,
+                 "Entries of the return address stack, which predicts the target of the function returns in decode "
+                 "(0 for none, up to RAS_ENTRIES set at build time)",
+                 true);
+  app.add_option("--cores", cores,
+                 "Number of cores, each one with its pipeline and private caches over the same memory. The program "
+                 "runs on the first one and starts the others with SYS_threadstart",
+                 true);
+  app.add_option("--threads", threads,
+                 "Host threads simulating the cores. With more than one, the order of the accesses of the cores to "
+                 "shared data within a quantum depends on the host scheduling, so results may change between runs",
+                 true);
+  app.add_option("--quantum", quantum,
+                 "Cycles the cores are simulated on their own between two synchronizations (1 interleaves them "
+                 "cycle by cycle)",
+                 true);
+
+  app.add_option("--branch-stats", branchStatsFile,
+                 "Writes the executions, taken and mispredicted counts of each conditional branch to the given file "
+                 "(CSV) at the end of the simulation");
+  app.add_option("--cpi-stats", cpiStatsFile,
+                 "Writes the CPI stack of the first core over each interval of --cpi-interval cycles to the given "
+                 "file (CSV)");
+  app.add_option("--cpi-interval", cpiInterval, "Cycles of the intervals written with --cpi-stats", true);
+
   CLI11_PARSE(app, argc, argv);
 
+  cacheConfig.inclusion     = (inclusion == "inclusive") ? INCLUSIVE : (inclusion == "exclusive") ? EXCLUSIVE : NINE;
+  cacheConfig.l1iPrefetcher = parsePrefetcher(l1iPrefetcher);
+  cacheConfig.l1dPrefetcher = parsePrefetcher(l1dPrefetcher);
+  predictorConfig.type      = parsePredictor(predictor);
+  mulDivConfig.multiplier   = parseMulDivUnit(multiplier);
+  mulDivConfig.divider      = parseMulDivUnit(divider);
+
+  if (memorySize == 0 || memorySize > (GUEST_MEMORY_MAX_SIZE >> 20)) {
+    fprintf(stderr, "Error: --memory-size must be between 1 and %zu MiB\n", GUEST_MEMORY_MAX_SIZE >> 20);
+    return -1;
+  }
+
+  if (fastForward > 0 && mode != "pipeline") {
+    fprintf(stderr, "Error: --fast-forward is only used with the pipeline\n");
+    return -1;
+  }
+
+  if (warming && fastForward == 0 && !regionOnly && mode != "sampled") {
+    fprintf(stderr, "Error: --warm is only used with --fast-forward, --roi and -m sampled\n");
+    return -1;
+  }
+
+  if (regionOnly && (mode != "pipeline" || fastForward > 0 || cores > 1 || !saveCheckpoint.empty())) {
+    fprintf(stderr, "Error: --roi is only used with the pipeline, on one core, without fast-forward nor checkpoint "
+                    "saving\n");
+    return -1;
+  }
+
+  if (cores < 1 || threads < 1 || quantum == 0) {
+    fprintf(stderr, "Error: --cores, --threads and --quantum must be at least 1\n");
+    return -1;
+  }
+  if (cores > 1 && (mode != "pipeline" || fastForward > 0 || !saveCheckpoint.empty() || !loadCheckpoint.empty() ||
+                    breakpoint != "-1")) {
+    fprintf(stderr, "Error: several cores are only simulated with the pipeline, without fast-forward, checkpoints "
+                    "nor breakpoint\n");
+    return -1;
+  }
+  // The levels below the L1 caches would be shared by the cores, which is not modelled
+  if (cores > 1 && cacheConfig.levels > 1) {
+    fprintf(stderr, "Error: several cores can only be simulated with L1 caches (--cache-levels 0 or 1)\n");
+    return -1;
+  }
+  // The bus snoops the lines of the L1 data caches, not the ones waiting in their MSHRs or write buffers
+  if (cores > 1 && (cacheConfig.mshrs > 0 || cacheConfig.writeBuffer > 0)) {
+    fprintf(stderr, "Error: several cores cannot be simulated with --mshrs nor --write-buffer\n");
+    return -1;
+  }
+
+  if ((mode == "profile" || mode == "sampled") != !simPointFile.empty()) {
+    fprintf(stderr, "Error: -m profile and -m sampled need --simpoints, which is only used with them\n");
+    return -1;
+  }
+  if (intervalSize == 0 || maxClusters == 0 || samplesPerCluster == 0) {
+    fprintf(stderr, "Error: --interval, --max-clusters and --samples-per-cluster cannot be 0\n");
+    return -1;
+  }
+
+  if (!cpiStatsFile.empty() && mode != "pipeline" && mode != "sampled") {
+    fprintf(stderr, "Error: --cpi-stats is only used with the pipeline\n");
+    return -1;
+  }
+  if (cpiInterval == 0) {
+    fprintf(stderr, "Error: --cpi-interval cannot be 0\n");
+    return -1;
+  }
+
+  if (saveCheckpoint.empty() != (checkpointAt < 0)) {
+    fprintf(stderr, "Error: --save-checkpoint and --checkpoint-at must be used together\n");
+    return -1;
+  }
+
   // add the binary file name at the start of argv[]
   benchArgs.push_back(binaryFile);
   for (auto a : pargs)
     benchArgs.push_back(a);
-  BasicSimulator sim(binaryFile, benchArgs, inputFile, outputFile, traceFile, signatureFile);
+  BasicSimulator sim(binaryFile, benchArgs, inputFile, outputFile, traceFile, signatureFile,
+                     (size_t)memorySize << 20, mapElf, cacheConfig, predictorConfig,
+                     mulDivConfig, cores);
 
   sim.breakpoint = std::stoi(breakpoint, NULL);
   sim.timeout = std::stoi(timeout, NULL);
+  sim.checkpointAt   = checkpointAt;
+  sim.checkpointFile = saveCheckpoint;
+  sim.branchStatsFile = branchStatsFile;
+  sim.warming         = warming;
+  sim.regionOnly      = regionOnly;
+
+  if (!loadCheckpoint.empty())
+    sim.loadCheckpoint(loadCheckpoint.c_str());
+  if (!cpiStatsFile.empty())
+    sim.openCpiStats(cpiStatsFile, cpiInterval);
 
-  sim.run();
+  if (mode == "profile") {
+    sim.profile(intervalSize, maxClusters, samplesPerCluster, simPointFile, bbvFile);
+  } else if (mode == "sampled") {
+    sim.runSampled(readSimPoints(simPointFile.c_str()), warmup);
+  } else if (mode != "pipeline") {
+    sim.translate = (mode == "dbt");
+    sim.runFunctional();
+  } else if (cores > 1) {
+    sim.runMultiCore(threads, quantum);
+  } else if (regionOnly) {
+    sim.runRegionOfInterest();
+  } else if (fastForward == 0 || sim.fastForward(fastForward)) {
+    sim.run();
+  }
 
   return 0;
 }
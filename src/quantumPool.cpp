@@ -0,0 +1,75 @@
+/** Copyright 2021 INRIA, Université de Rennes 1 and ENS Rennes
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include "quantumPool.h"
+
+QuantumPool::QuantumPool(const int threads) : generation(0), busy(0), stopping(false), task(NULL), count(0), next(0)
+{
+  // The calling thread is one of them
+  for (int oneThread = 1; oneThread < threads; oneThread++)
+    workers.push_back(std::thread(&QuantumPool::worker, this));
+}
+
+QuantumPool::~QuantumPool()
+{
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    stopping = true;
+  }
+  start.notify_all();
+  for (auto& oneWorker : workers)
+    oneWorker.join();
+}
+
+void QuantumPool::work()
+{
+  for (unsigned int oneTask = next++; oneTask < count; oneTask = next++)
+    (*task)(oneTask);
+}
+
+void QuantumPool::worker()
+{
+  unsigned long seen = 0;
+  while (true) {
+    {
+      std::unique_lock<std::mutex> guard(lock);
+      start.wait(guard, [this, seen] { return stopping || generation != seen; });
+      if (stopping)
+        return;
+      seen = generation;
+    }
+    work();
+    {
+      std::lock_guard<std::mutex> guard(lock);
+      if (--busy == 0)
+        done.notify_one();
+    }
+  }
+}
+
+void QuantumPool::run(const unsigned int taskCount, const std::function<void(unsigned int)>& quantumTask)
+{
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    task  = &quantumTask;
+    count = taskCount;
+    next  = 0;
+    busy  = workers.size();
+    generation++;
+  }
+  start.notify_all();
+  work();
+
+  std::unique_lock<std::mutex> guard(lock);
+  done.wait(guard, [this] { return busy == 0; });
+}
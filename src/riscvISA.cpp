@@ -25,7 +25,11 @@ const char* riscvNamesOPIW[8] = {"ADDWi", "SLLWi", "", "", "", "SRi", "", ""};
 const char* riscvNamesLD[8]   = {"LDB", "LDH", "LDW", "LDD", "LDBU", "LDHU", "LDWU"};
 const char* riscvNamesST[8]   = {"STB", "STH", "STW", "STD"};
 const char* riscvNamesBR[8]   = {"BEQ", "BNE", "", "", "BLT", "BGE", "BLTU", "BGEU"};
-const char* riscvNamesMUL[8]  = {"MPYLO", "MPYHI", "MPYHI", "MPYHI", "DIVHI", "DIVHI", "DIVLO", "DIVLO"};
+const char* riscvNamesMUL[8]  = {"MUL", "MULH", "MULHSU", "MULHU", "DIV", "DIVU", "REM", "REMU"};
+// Indexed by funct5
+const char* riscvNamesATOMIC[32] = {"AMOADD", "AMOSWAP", "LR", "SC", "AMOXOR",  "", "", "", "AMOOR",   "", "", "",
+                                    "AMOAND", "",        "",   "",   "AMOMIN",  "", "", "", "AMOMAX",  "", "", "",
+                                    "AMOMINU", "",       "",   "",   "AMOMAXU", "", "", ""};
 
 std::string printDecodedInstrRISCV(unsigned int oneInstruction)
 {
@@ -168,6 +172,10 @@ std::string printDecodedInstrRISCV(unsigned int oneInstruction)
         }
       }
       break;
+    case RISCV_ATOMIC:
+      stream << riscvNamesATOMIC[(oneInstruction >> 27) & 0x1f];
+      stream << " r" << (int)rd << " = (r" << (int)rs1 << "), r" << (int)rs2;
+      break;
     case RISCV_SYSTEM:
       stream << "SYSTEM";
       break;
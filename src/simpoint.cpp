@@ -0,0 +1,320 @@
+/** Copyright 2021 INRIA, Université de Rennes 1 and ENS Rennes
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <random>
+
+#include "simpoint.h"
+
+typedef std::vector<double> Point;
+
+static double distance2(const Point& a, const Point& b)
+{
+  double sum = 0;
+  for (int i = 0; i < SIMPOINT_DIMENSIONS; i++)
+    sum += (a[i] - b[i]) * (a[i] - b[i]);
+  return sum;
+}
+
+// Each basic block gets a random direction, drawn from its pc so that every run projects it the same way
+static std::vector<Point> project(const std::vector<BasicBlockVector>& intervals)
+{
+  std::map<unsigned int, Point> directions;
+  std::vector<Point> points;
+  for (const auto& oneInterval : intervals) {
+    unsigned long total = 0;
+    for (const auto& oneBlock : oneInterval)
+      total += oneBlock.second;
+
+    Point point(SIMPOINT_DIMENSIONS, 0);
+    for (const auto& oneBlock : oneInterval) {
+      Point& direction = directions[oneBlock.first];
+      if (direction.empty()) {
+        std::mt19937 random(oneBlock.first);
+        std::uniform_real_distribution<double> uniform(-1, 1);
+        for (int i = 0; i < SIMPOINT_DIMENSIONS; i++)
+          direction.push_back(uniform(random));
+      }
+      for (int i = 0; i < SIMPOINT_DIMENSIONS; i++)
+        point[i] += direction[i] * oneBlock.second / total;
+    }
+    points.push_back(point);
+  }
+  return points;
+}
+
+// Lloyd's algorithm from k random points, returns the sum of the squared distances to the centroids
+static double kmeans(const std::vector<Point>& points, const unsigned int k, std::mt19937& random,
+                     std::vector<unsigned int>& assignment, std::vector<Point>& centroids)
+{
+  std::vector<unsigned long> order(points.size());
+  for (unsigned long i = 0; i < points.size(); i++)
+    order[i] = i;
+  std::shuffle(order.begin(), order.end(), random);
+  centroids.clear();
+  for (unsigned int c = 0; c < k; c++)
+    centroids.push_back(points[order[c]]);
+
+  assignment.assign(points.size(), k);
+  double distortion = 0;
+  for (int iteration = 0; iteration < SIMPOINT_KMEANS_ITERATIONS; iteration++) {
+    bool changed = false;
+    distortion   = 0;
+    for (unsigned long i = 0; i < points.size(); i++) {
+      unsigned int nearest = 0;
+      double best          = DBL_MAX;
+      for (unsigned int c = 0; c < k; c++) {
+        const double d = distance2(points[i], centroids[c]);
+        if (d < best) {
+          best    = d;
+          nearest = c;
+        }
+      }
+      changed |= assignment[i] != nearest;
+      assignment[i] = nearest;
+      distortion += best;
+    }
+    if (!changed)
+      break;
+
+    std::vector<unsigned long> sizes(k, 0);
+    for (auto& oneCentroid : centroids)
+      oneCentroid.assign(SIMPOINT_DIMENSIONS, 0);
+    for (unsigned long i = 0; i < points.size(); i++) {
+      sizes[assignment[i]]++;
+      for (int d = 0; d < SIMPOINT_DIMENSIONS; d++)
+        centroids[assignment[i]][d] += points[i][d];
+    }
+    for (unsigned int c = 0; c < k; c++)
+      for (int d = 0; d < SIMPOINT_DIMENSIONS && sizes[c]; d++)
+        centroids[c][d] /= sizes[c];
+    // An empty cluster takes the point farthest from its centroid
+    for (unsigned int c = 0; c < k; c++) {
+      if (sizes[c])
+        continue;
+      unsigned long farthest = 0;
+      double worst           = -1;
+      for (unsigned long i = 0; i < points.size(); i++) {
+        const double d = distance2(points[i], centroids[assignment[i]]);
+        if (d > worst) {
+          worst    = d;
+          farthest = i;
+        }
+      }
+      centroids[c] = points[farthest];
+    }
+  }
+  return distortion;
+}
+
+// Bayesian information criterion of the clustering, the points of a cluster following a spherical Gaussian
+static double bic(const std::vector<unsigned int>& assignment, const unsigned int k, const double distortion)
+{
+  const double r = assignment.size();
+  const double m = SIMPOINT_DIMENSIONS;
+  std::vector<double> sizes(k, 0);
+  for (const unsigned int c : assignment)
+    sizes[c]++;
+
+  const double variance = std::max(distortion / (m * (r - k)), 1e-12);
+  double likelihood     = -r * m / 2 * std::log(2 * M_PI * variance) - m * (r - k) / 2;
+  for (const double oneSize : sizes)
+    if (oneSize > 0)
+      likelihood += oneSize * std::log(oneSize / r);
+  const double parameters = (k - 1) + k * m + 1;
+  return likelihood - parameters / 2 * std::log(r);
+}
+
+SimPointSet pickSimPoints(const std::vector<BasicBlockVector>& intervals, const unsigned long intervalSize,
+                          const unsigned int maxClusters, const unsigned int samplesPerCluster)
+{
+  SimPointSet set;
+  set.intervalSize = intervalSize;
+  set.clusters     = 0;
+  if (intervals.empty())
+    return set;
+
+  const std::vector<Point> points = project(intervals);
+  const unsigned long r           = points.size();
+
+  // Best clustering for each k, the BIC needs more points than clusters
+  std::vector<std::vector<unsigned int> > assignments;
+  std::vector<std::vector<Point> > centroids;
+  std::vector<double> scores;
+  std::mt19937 random(1);
+  for (unsigned int k = 1; k <= maxClusters && (k < r || k == 1); k++) {
+    std::vector<unsigned int> bestAssignment, assignment;
+    std::vector<Point> bestCentroids, oneCentroids;
+    double best = DBL_MAX;
+    for (int seed = 0; seed < SIMPOINT_KMEANS_SEEDS; seed++) {
+      const double distortion = kmeans(points, k, random, assignment, oneCentroids);
+      if (distortion < best) {
+        best           = distortion;
+        bestAssignment = assignment;
+        bestCentroids  = oneCentroids;
+      }
+    }
+    assignments.push_back(bestAssignment);
+    centroids.push_back(bestCentroids);
+    scores.push_back(r > 1 ? bic(bestAssignment, k, best) : 0);
+  }
+
+  const double low    = *std::min_element(scores.begin(), scores.end());
+  const double high   = *std::max_element(scores.begin(), scores.end());
+  unsigned int chosen = 0;
+  while (scores[chosen] < low + SIMPOINT_BIC_THRESHOLD * (high - low))
+    chosen++;
+  const std::vector<unsigned int>& assignment = assignments[chosen];
+  const std::vector<Point>& centroid          = centroids[chosen];
+
+  // Instructions of each cluster
+  std::vector<double> instructions(chosen + 1, 0);
+  double total = 0;
+  for (unsigned long i = 0; i < r; i++) {
+    unsigned long length = 0;
+    for (const auto& oneBlock : intervals[i])
+      length += oneBlock.second;
+    instructions[assignment[i]] += length;
+    total += length;
+  }
+
+  for (unsigned int c = 0; c <= chosen; c++) {
+    std::vector<unsigned long> members;
+    for (unsigned long i = 0; i < r; i++)
+      if (assignment[i] == c)
+        members.push_back(i);
+    if (members.empty())
+      continue;
+
+    // The closest member to the centroid first, then random ones
+    unsigned long closest = 0;
+    for (unsigned long m = 1; m < members.size(); m++)
+      if (distance2(points[members[m]], centroid[c]) < distance2(points[members[closest]], centroid[c]))
+        closest = m;
+    std::swap(members[0], members[closest]);
+    std::shuffle(members.begin() + 1, members.end(), random);
+
+    const unsigned long samples = std::min<unsigned long>(samplesPerCluster, members.size());
+    for (unsigned long s = 0; s < samples; s++)
+      set.points.push_back({members[s], set.clusters, members.size(), instructions[c] / total / samples});
+    set.clusters++;
+  }
+
+  std::sort(set.points.begin(), set.points.end(),
+            [](const SimPoint& a, const SimPoint& b) { return a.interval < b.interval; });
+  return set;
+}
+
+void estimateCPI(const SimPointSet& set, const std::vector<double>& cpi, double& estimate, double& error)
+{
+  std::vector<double> weight(set.clusters, 0), sum(set.clusters, 0), sumSquares(set.clusters, 0);
+  std::vector<unsigned long> samples(set.clusters, 0), size(set.clusters, 0);
+  for (unsigned long i = 0; i < set.points.size(); i++) {
+    const SimPoint& point = set.points[i];
+    weight[point.cluster] += point.weight;
+    sum[point.cluster] += cpi[i];
+    sumSquares[point.cluster] += cpi[i] * cpi[i];
+    samples[point.cluster]++;
+    size[point.cluster] = point.clusterIntervals;
+  }
+
+  // Stratified estimator, the finite population correction makes fully sampled clusters exact
+  estimate        = 0;
+  double variance = 0;
+  bool bounded    = true;
+  for (unsigned int c = 0; c < set.clusters; c++) {
+    if (samples[c] == 0)
+      continue;
+    const double n    = samples[c];
+    const double mean = sum[c] / n;
+    estimate += weight[c] * mean;
+    if (samples[c] == size[c])
+      continue;
+    if (samples[c] < 2) {
+      bounded = false;
+      continue;
+    }
+    const double sampleVariance = std::max(sumSquares[c] - n * mean * mean, 0.0) / (n - 1);
+    variance += weight[c] * weight[c] * sampleVariance / n * (1 - n / size[c]);
+  }
+  error = bounded ? 1.96 * std::sqrt(variance) : -1;
+}
+
+void writeBasicBlockVectors(const char* fileName, const std::vector<BasicBlockVector>& intervals)
+{
+  FILE* file = fopen(fileName, "w");
+  if (file == NULL) {
+    fprintf(stderr, "Error: cannot open %s\n", fileName);
+    exit(-1);
+  }
+  // Blocks are numbered from 1 in the order they are first executed
+  std::map<unsigned int, unsigned long> ids;
+  for (const auto& oneInterval : intervals) {
+    fprintf(file, "T");
+    for (const auto& oneBlock : oneInterval) {
+      auto id = ids.find(oneBlock.first);
+      if (id == ids.end())
+        id = ids.insert(std::make_pair(oneBlock.first, ids.size() + 1)).first;
+      fprintf(file, ":%lu:%lu ", id->second, oneBlock.second);
+    }
+    fprintf(file, "\n");
+  }
+  fclose(file);
+}
+
+void writeSimPoints(const char* fileName, const SimPointSet& set)
+{
+  FILE* file = fopen(fileName, "w");
+  if (file == NULL) {
+    fprintf(stderr, "Error: cannot open %s\n", fileName);
+    exit(-1);
+  }
+  fprintf(file, "# interval size and clusters, then interval, cluster, cluster size and weight of each sample\n");
+  fprintf(file, "%lu %u\n", set.intervalSize, set.clusters);
+  for (const auto& onePoint : set.points)
+    fprintf(file, "%lu %u %lu %.9f\n", onePoint.interval, onePoint.cluster, onePoint.clusterIntervals,
+            onePoint.weight);
+  fclose(file);
+}
+
+SimPointSet readSimPoints(const char* fileName)
+{
+  FILE* file = fopen(fileName, "r");
+  if (file == NULL) {
+    fprintf(stderr, "Error: cannot open %s\n", fileName);
+    exit(-1);
+  }
+  SimPointSet set;
+  // The first line is a comment
+  const bool valid = fscanf(file, "%*[^\n]\n") == 0 && fscanf(file, "%lu %u", &set.intervalSize, &set.clusters) == 2;
+  if (!valid || set.intervalSize == 0) {
+    fprintf(stderr, "Error: %s is not a simulation point file\n", fileName);
+    exit(-1);
+  }
+  SimPoint point;
+  while (fscanf(file, "%lu %u %lu %lf", &point.interval, &point.cluster, &point.clusterIntervals, &point.weight) ==
+         4) {
+    if (point.cluster >= set.clusters || (!set.points.empty() && point.interval <= set.points.back().interval)) {
+      fprintf(stderr, "Error: %s is not a simulation point file\n", fileName);
+      exit(-1);
+    }
+    set.points.push_back(point);
+  }
+  fclose(file);
+  return set;
+}
@@ -0,0 +1,101 @@
+# Checks that LR/SC and the AMOs are atomic across the cores: every core increments a word 1000 times with
+# LR.W/SC.W and another word of the same line with AMOADD.W, next to plain stores. Both counts, divided by the number
+# of cores, are printed in hexadecimal, one per line, and compared against expectedOutput. runTests.sh gives the
+# simulator the switches of the arguments file (4 cores interleaved cycle by cycle, with L1 caches), then the ones
+# it is given itself (on one core, with -m iss for example).
+
+  .text
+  .globl _start
+
+_start:
+  li a7, 0x4321          # SYS_nbcore
+  ecall
+  mv s1, a0
+  li s2, 1
+spawn:
+  bge s2, s1, started
+  la a0, worker
+  slli a1, s2, 12
+  li t0, 0x100000
+  add a1, a1, t0         # stack
+  mv a2, s2              # argument
+  li a7, 0x1234          # SYS_threadstart
+  ecall
+  addi s2, s2, 1
+  j spawn
+started:
+  call work
+  # waits for the other cores
+  la t0, counters
+  addi s2, s1, -1
+1:
+  lw t1, 8(t0)
+  bne t1, s2, 1b
+  lw a0, 0(t0)
+  divu a0, a0, s1
+  call puthex
+  la t0, counters
+  lw a0, 4(t0)
+  divu a0, a0, s1
+  call puthex
+  li a0, 0
+  li a7, 93
+  ecall
+
+worker:
+  call work
+  la t0, counters
+  addi t0, t0, 8
+  li t1, 1
+  amoadd.w zero, t1, (t0)
+  li a0, 0
+  li a7, 93
+  ecall
+
+work:
+  la t0, counters
+  addi t4, t0, 4
+  li t5, 1
+  li t6, 1000
+1:
+  lr.w t2, (t0)
+  addi t2, t2, 1
+  sc.w t3, t2, (t0)
+  bnez t3, 1b
+  amoadd.w zero, t5, (t4)
+  sw t6, 12(t0)
+  addi t6, t6, -1
+  bnez t6, 1b
+  ret
+
+# Writes a0 as 8 hexadecimal digits followed by a newline
+puthex:
+  addi sp, sp, -16
+  li t0, 28
+  mv t1, sp
+2:
+  srl t2, a0, t0
+  andi t2, t2, 15
+  addi t2, t2, 48
+  li t3, 58
+  blt t2, t3, 3f
+  addi t2, t2, 39
+3:
+  sb t2, 0(t1)
+  addi t1, t1, 1
+  addi t0, t0, -4
+  bgez t0, 2b
+  li t2, 10
+  sb t2, 0(t1)
+  li a0, 1
+  mv a1, sp
+  li a2, 9
+  li a7, 64
+  ecall
+  addi sp, sp, 16
+  ret
+
+  .data
+  .balign 16
+counters:
+  .word 0, 0, 0, 0
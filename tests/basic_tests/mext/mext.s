@@ -0,0 +1,79 @@
+# Checks the instructions of the M extension: every result is printed in
+# hexadecimal, one per line, and compared against expectedOutput.
+
+  .text
+  .globl _start
+
+  .macro rr op, a, b
+  li a0, \a
+  li a1, \b
+  \op a0, a0, a1
+  call puthex
+  .endm
+
+_start:
+  rr mul,    7,          -3
+  rr mul,    0x12345678, 0x9abcdef0
+  rr mulh,   -7,         3
+  rr mulh,   0x80000000, 0x80000000
+  rr mulhsu, -7,         3
+  rr mulhsu, -1,         -1
+  rr mulhu,  -7,         3
+  rr mulhu,  -1,         -1
+  rr div,    -7,         3
+  rr div,    7,          -3
+  rr div,    0x80000000, -1
+  rr div,    5,          0
+  rr divu,   -7,         3
+  rr divu,   5,          0
+  rr rem,    -7,         3
+  rr rem,    7,          -3
+  rr rem,    0x80000000, -1
+  rr rem,    5,          0
+  rr remu,   -7,         3
+  rr remu,   5,          0
+
+  # Back-to-back dependent operations
+  li s0, 1
+  li s1, 10
+1:
+  mul s0, s0, s1
+  divu s2, s0, s1
+  remu s3, s0, s1
+  add s0, s0, s2
+  add s0, s0, s3
+  addi s1, s1, -1
+  bnez s1, 1b
+  mv a0, s0
+  call puthex
+
+  li a0, 0
+  li a7, 93
+  ecall
+
+# Writes a0 as 8 hexadecimal digits followed by a newline
+puthex:
+  addi sp, sp, -16
+  li t0, 28
+  mv t1, sp
+2:
+  srl t2, a0, t0
+  andi t2, t2, 15
+  addi t2, t2, 48
+  li t3, 58
+  blt t2, t3, 3f
+  addi t2, t2, 39
+3:
+  sb t2, 0(t1)
+  addi t1, t1, 1
+  addi t0, t0, -4
+  bgez t0, 2b
+  li t2, 10
+  sb t2, 0(t1)
+  li a0, 1
+  mv a1, sp
+  li a2, 9
+  li a7, 64
+  ecall
+  addi sp, sp, 16
+  ret
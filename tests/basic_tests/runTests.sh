@@ -4,11 +4,13 @@ SUBFOLDERS=$(ls -d */)
 COMETSIM="../../../build/bin/comet.sim"
 TIMEOUT="30s"
 
-for TEST in $SUBFOLDERS
-do
-  echo "started test : " $TEST
-  cd $TEST
-  timeout $TIMEOUT $COMETSIM -f *.riscv* -o testOutput
+# Extra arguments are given to comet.sim (e.g. ./runTests.sh -m iss). The tests whose folder holds an arguments file
+# are run with the switches it contains, then once more with the extra arguments alone when there are some
+
+# Runs the test of the current folder with the given switches, exits when it fails
+runTest()
+{
+  timeout $TIMEOUT $COMETSIM -f *.riscv* -o testOutput "$@"
   STATUS=$?
   if [ $STATUS -ne 0 ]
   then
@@ -30,5 +32,21 @@ do
     exit 1
   fi
   rm testOutput
+}
+
+for TEST in $SUBFOLDERS
+do
+  echo "started test : " $TEST
+  cd $TEST
+  if [ -f arguments ]
+  then
+    runTest $(cat arguments)
+    if [ $# -ne 0 ]
+    then
+      runTest "$@"
+    fi
+  else
+    runTest "$@"
+  fi
   cd ..
 done